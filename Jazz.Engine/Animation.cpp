@@ -0,0 +1,843 @@
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <string.h>
+
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "Animation.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+// Rotation, translation and scale
+#define ANIMATION_CHANNELS 3
+
+// Minimum and step of translation and scale, each xyz
+#define ANIMATION_RANGE_COMPONENTS 12
+
+// The three smallest components of a unit quaternion lie within +-1 / sqrt(2)
+#define ANIMATION_ROTATION_LIMIT 0.70710678f
+
+// Characters per parallel batch
+#define ANIMATION_INSTANCE_BATCH 16
+
+namespace Jazz {
+
+	Pose::Pose() {
+		_jointCount = 0;
+		_stride = 0;
+	}
+
+	void Pose::Resize(U32 jointCount) {
+		_jointCount = jointCount;
+		_stride = (jointCount + ANIMATION_BATCH - 1) / ANIMATION_BATCH * ANIMATION_BATCH;
+		_data.resize((size_t)_stride * ANIMATION_COMPONENTS);
+	}
+
+	JointTransform Pose::Get(U32 joint) const {
+		F32 c[ANIMATION_COMPONENTS];
+		for (U32 component = 0; component < ANIMATION_COMPONENTS; ++component) {
+			c[component] = _data[component * _stride + joint];
+		}
+		return { { c[0], c[1], c[2], c[3] }, { c[4], c[5], c[6] }, { c[7], c[8], c[9] } };
+	}
+
+	void Pose::Set(U32 joint, const JointTransform& transform) {
+		const F32 c[ANIMATION_COMPONENTS] = {
+			transform.Rotation.X, transform.Rotation.Y, transform.Rotation.Z, transform.Rotation.W,
+			transform.Translation.X, transform.Translation.Y, transform.Translation.Z,
+			transform.Scale.X, transform.Scale.Y, transform.Scale.Z
+		};
+		for (U32 component = 0; component < ANIMATION_COMPONENTS; ++component) {
+			_data[component * _stride + joint] = c[component];
+		}
+	}
+
+	static F32 dot4(const Vec4& a, const Vec4& b) {
+		return a.X * b.X + a.Y * b.Y + a.Z * b.Z + a.W * b.W;
+	}
+
+	// Interpolates along the shorter arc and renormalizes, which is what every SIMD level does in lanes
+	static Vec4 nlerp(const Vec4& a, const Vec4& b, F32 alpha) {
+		F32 sign = dot4(a, b) < 0.0f ? -1.0f : 1.0f;
+		Vec4 q = {
+			a.X + (b.X * sign - a.X) * alpha,
+			a.Y + (b.Y * sign - a.Y) * alpha,
+			a.Z + (b.Z * sign - a.Z) * alpha,
+			a.W + (b.W * sign - a.W) * alpha
+		};
+		F32 inverseLength = 1.0f / sqrtf(dot4(q, q));
+		return { q.X * inverseLength, q.Y * inverseLength, q.Z * inverseLength, q.W * inverseLength };
+	}
+
+	// Smallest three: the largest component is dropped and rebuilt from the others, made positive since q and -q are
+	// the same rotation. The rest get 15 bits each, and the top bits of the first two say which one was dropped.
+	static void encodeRotation(const Vec4& rotation, U16* outValues) {
+		const F32 q[4] = { rotation.X, rotation.Y, rotation.Z, rotation.W };
+		U32 largest = 0;
+		for (U32 i = 1; i < 4; ++i) {
+			if (fabsf(q[i]) > fabsf(q[largest])) {
+				largest = i;
+			}
+		}
+
+		F32 scale = (q[largest] < 0.0f ? -1.0f : 1.0f) / sqrtf(dot4(rotation, rotation));
+		U32 value = 0;
+		for (U32 i = 0; i < 4; ++i) {
+			if (i != largest) {
+				F32 fraction = (q[i] * scale + ANIMATION_ROTATION_LIMIT) / (2.0f * ANIMATION_ROTATION_LIMIT);
+				outValues[value++] = (U16)fminf(fmaxf(fraction * 32767.0f + 0.5f, 0.0f), 32767.0f);
+			}
+		}
+		outValues[0] |= (U16)((largest & 1) << 15);
+		outValues[1] |= (U16)((largest >> 1) << 15);
+	}
+
+	static Vec4 decodeRotation(I32 raw0, I32 raw1, I32 raw2) {
+		const F32 step = 2.0f * ANIMATION_ROTATION_LIMIT / 32767.0f;
+		F32 a = (F32)(raw0 & 0x7fff) * step - ANIMATION_ROTATION_LIMIT;
+		F32 b = (F32)(raw1 & 0x7fff) * step - ANIMATION_ROTATION_LIMIT;
+		F32 c = (F32)(raw2 & 0x7fff) * step - ANIMATION_ROTATION_LIMIT;
+		F32 l = sqrtf(fmaxf(1.0f - a * a - b * b - c * c, 0.0f));
+		switch (((raw0 >> 15) & 1) | (((raw1 >> 15) & 1) << 1)) {
+		case 0:
+			return { l, a, b, c };
+		case 1:
+			return { a, l, b, c };
+		case 2:
+			return { a, b, l, c };
+		default:
+			return { a, b, c, l };
+		}
+	}
+
+	static Vec4 lerpValue(U32 channel, const Vec4& a, const Vec4& b, F32 alpha) {
+		if (channel == 0) {
+			return nlerp(a, b, alpha);
+		}
+		return { a.X + (b.X - a.X) * alpha, a.Y + (b.Y - a.Y) * alpha, a.Z + (b.Z - a.Z) * alpha, 0.0f };
+	}
+
+	// Angle between rotations, or the largest axis difference for translations and scales
+	static F32 valueError(U32 channel, const Vec4& value, const Vec4& source) {
+		if (channel == 0) {
+			// From the chord between the quaternions, acos is too coarse in float near identical rotations
+			F32 sign = dot4(value, source) < 0.0f ? -1.0f : 1.0f;
+			Vec4 chord = { value.X * sign - source.X, value.Y * sign - source.Y, value.Z * sign - source.Z, value.W * sign - source.W };
+			return 4.0f * asinf(fminf(0.5f * sqrtf(dot4(chord, chord)), 1.0f));
+		}
+		return fmaxf(fabsf(value.X - source.X), fmaxf(fabsf(value.Y - source.Y), fabsf(value.Z - source.Z)));
+	}
+
+	// Whether interpolating the decoded keys at start and end reproduces every frame in between
+	static bool segmentFits(U32 channel, const Vec4* source, const Vec4* decoded, U32 start, U32 end, F32 tolerance) {
+		for (U32 frame = start + 1; frame < end; ++frame) {
+			Vec4 value = lerpValue(channel, decoded[start], decoded[end], (F32)(frame - start) / (F32)(end - start));
+			if (valueError(channel, value, source[frame]) > tolerance) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	AnimationClip::AnimationClip() {
+		_jointCount = 0;
+		_stride = 0;
+		_frameCount = 0;
+		_frameRate = 0.0f;
+	}
+
+	const bool AnimationClip::Compress(const JointTransform* frames, U32 frameCount, U32 jointCount, F32 frameRate,
+		F32 rotationTolerance, F32 translationTolerance, F32 scaleTolerance) {
+		if (frameCount == 0 || frameCount > 65536 || jointCount == 0 || frameRate <= 0.0f) {
+			Logger::Error("Unable to compress an animation of %d frames and %d joints", frameCount, jointCount);
+			return false;
+		}
+
+		_jointCount = jointCount;
+		_stride = (jointCount + ANIMATION_BATCH - 1) / ANIMATION_BATCH * ANIMATION_BATCH;
+		_frameCount = frameCount;
+		_frameRate = frameRate;
+		_keys.clear();
+		_tracks.assign(ANIMATION_CHANNELS * jointCount, {});
+		_ranges.assign(ANIMATION_RANGE_COMPONENTS * _stride, 0.0f);
+
+		const F32 tolerances[ANIMATION_CHANNELS] = { rotationTolerance, translationTolerance, scaleTolerance };
+		std::vector<AnimationKey> quantized(frameCount);
+		std::vector<Vec4> source(frameCount);
+		std::vector<Vec4> decoded(frameCount);
+		for (U32 channel = 0; channel < ANIMATION_CHANNELS; ++channel) {
+			for (U32 joint = 0; joint < jointCount; ++joint) {
+				for (U32 frame = 0; frame < frameCount; ++frame) {
+					const JointTransform& transform = frames[frame * jointCount + joint];
+					const Vec3& value = channel == 1 ? transform.Translation : transform.Scale;
+					source[frame] = channel == 0 ? transform.Rotation : Vec4{ value.X, value.Y, value.Z, 0.0f };
+					quantized[frame].Frame = (U16)frame;
+				}
+
+				if (channel == 0) {
+					for (U32 frame = 0; frame < frameCount; ++frame) {
+						F32 inverseLength = 1.0f / sqrtf(dot4(source[frame], source[frame]));
+						source[frame] = { source[frame].X * inverseLength, source[frame].Y * inverseLength, source[frame].Z * inverseLength, source[frame].W * inverseLength };
+						encodeRotation(source[frame], quantized[frame].Values);
+						decoded[frame] = decodeRotation(quantized[frame].Values[0], quantized[frame].Values[1], quantized[frame].Values[2]);
+					}
+				} else {
+					// 16 bit fractions of the track's own range
+					F32* range = _ranges.data() + (channel - 1) * 6 * _stride + joint;
+					for (U32 axis = 0; axis < 3; ++axis) {
+						F32 minimum = (&source[0].X)[axis];
+						F32 maximum = minimum;
+						for (U32 frame = 1; frame < frameCount; ++frame) {
+							minimum = fminf(minimum, (&source[frame].X)[axis]);
+							maximum = fmaxf(maximum, (&source[frame].X)[axis]);
+						}
+						F32 step = (maximum - minimum) / 65535.0f;
+						range[axis * _stride] = minimum;
+						range[(3 + axis) * _stride] = step;
+
+						for (U32 frame = 0; frame < frameCount; ++frame) {
+							F32 fraction = step > 0.0f ? ((&source[frame].X)[axis] - minimum) / step : 0.0f;
+							U16 raw = (U16)fminf(fmaxf(fraction + 0.5f, 0.0f), 65535.0f);
+							quantized[frame].Values[axis] = raw;
+							(&decoded[frame].X)[axis] = minimum + (F32)raw * step;
+						}
+					}
+					for (U32 frame = 0; frame < frameCount; ++frame) {
+						decoded[frame].W = 0.0f;
+					}
+				}
+
+				// Constant tracks keep one key, the rest as few as linear interpolation allows
+				AnimationTrack& track = _tracks[channel * jointCount + joint];
+				track.FirstKey = (U32)_keys.size();
+				_keys.push_back(quantized[0]);
+
+				bool constant = true;
+				for (U32 frame = 1; frame < frameCount && constant; ++frame) {
+					constant = valueError(channel, decoded[0], source[frame]) <= tolerances[channel];
+				}
+				if (!constant) {
+					U32 start = 0;
+					while (start < frameCount - 1) {
+						U32 end = start + 1;
+						while (end + 1 < frameCount && segmentFits(channel, source.data(), decoded.data(), start, end + 1, tolerances[channel])) {
+							end++;
+						}
+						_keys.push_back(quantized[end]);
+						start = end;
+					}
+				}
+				track.KeyCount = (U32)_keys.size() - track.FirstKey;
+			}
+		}
+		return true;
+	}
+
+	size_t AnimationClip::GetSize() const {
+		return _keys.size() * sizeof(AnimationKey) + _tracks.size() * sizeof(AnimationTrack) + _ranges.size() * sizeof(F32);
+	}
+
+	// Raw keys of one batch of joints, gathered by the scalar track search so decoding and interpolation run in lanes
+	struct SampleBatch {
+		I32 Values[ANIMATION_CHANNELS][2][3][ANIMATION_BATCH];
+		F32 Alpha[ANIMATION_CHANNELS][ANIMATION_BATCH];
+	};
+
+	// The keys either side of frame and how far between them it lies. Tracks always start on the first frame and end
+	// on the last, and the search is branchless since its direction is a coin flip per track.
+	static void findKeys(const AnimationKey* keys, U32 keyCount, F32 frame, U32* outA, U32* outB, F32* outAlpha) {
+		if (keyCount == 1) {
+			*outA = 0;
+			*outB = 0;
+			*outAlpha = 0.0f;
+			return;
+		}
+
+		U32 frameIndex = (U32)frame;
+		U32 a = 0;
+		for (U32 count = keyCount - 1; count > 1; count -= count / 2) {
+			U32 middle = a + count / 2;
+			a = keys[middle].Frame <= frameIndex ? middle : a;
+		}
+
+		*outA = a;
+		*outB = a + 1;
+		*outAlpha = fminf((frame - (F32)keys[a].Frame) / (F32)(keys[a + 1].Frame - keys[a].Frame), 1.0f);
+	}
+
+	static void gatherBatch(const AnimationKey* keys, const AnimationTrack* tracks, U32 jointCount, U32 firstJoint, F32 frame, SampleBatch& batch) {
+		for (U32 lane = 0; lane < ANIMATION_BATCH; ++lane) {
+			// Padding lanes repeat the last joint
+			U32 joint = std::min(firstJoint + lane, jointCount - 1);
+			for (U32 channel = 0; channel < ANIMATION_CHANNELS; ++channel) {
+				const AnimationTrack& track = tracks[channel * jointCount + joint];
+				const AnimationKey* trackKeys = keys + track.FirstKey;
+				U32 a, b;
+				findKeys(trackKeys, track.KeyCount, frame, &a, &b, &batch.Alpha[channel][lane]);
+				for (U32 value = 0; value < 3; ++value) {
+					batch.Values[channel][0][value][lane] = trackKeys[a].Values[value];
+					batch.Values[channel][1][value][lane] = trackKeys[b].Values[value];
+				}
+			}
+		}
+	}
+
+	static void decodeScalar(const SampleBatch& batch, const F32* ranges, U32 stride, U32 firstJoint, Pose& pose) {
+		F32* out[ANIMATION_COMPONENTS];
+		for (U32 component = 0; component < ANIMATION_COMPONENTS; ++component) {
+			out[component] = pose.GetComponent(component) + firstJoint;
+		}
+
+		for (U32 lane = 0; lane < ANIMATION_BATCH; ++lane) {
+			const I32 (*rotation)[3][ANIMATION_BATCH] = batch.Values[0];
+			Vec4 a = decodeRotation(rotation[0][0][lane], rotation[0][1][lane], rotation[0][2][lane]);
+			Vec4 b = decodeRotation(rotation[1][0][lane], rotation[1][1][lane], rotation[1][2][lane]);
+			Vec4 q = nlerp(a, b, batch.Alpha[0][lane]);
+			out[0][lane] = q.X;
+			out[1][lane] = q.Y;
+			out[2][lane] = q.Z;
+			out[3][lane] = q.W;
+
+			for (U32 channel = 1; channel < ANIMATION_CHANNELS; ++channel) {
+				const F32* range = ranges + (channel - 1) * 6 * stride + firstJoint + lane;
+				for (U32 axis = 0; axis < 3; ++axis) {
+					F32 minimum = range[axis * stride];
+					F32 step = range[(3 + axis) * stride];
+					F32 valueA = minimum + (F32)batch.Values[channel][0][axis][lane] * step;
+					F32 valueB = minimum + (F32)batch.Values[channel][1][axis][lane] * step;
+					out[1 + channel * 3 + axis][lane] = valueA + (valueB - valueA) * batch.Alpha[channel][lane];
+				}
+			}
+		}
+	}
+
+#ifdef ARCH_X64
+	// SSE2 has no blendv
+	static __m128 selectSSE(__m128 a, __m128 b, __m128 mask) {
+		return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+	}
+
+	static void decodeRotationsSSE(const I32* raw0, const I32* raw1, const I32* raw2, __m128* outQ) {
+		const __m128 step = _mm_set1_ps(2.0f * ANIMATION_ROTATION_LIMIT / 32767.0f);
+		const __m128 limit = _mm_set1_ps(ANIMATION_ROTATION_LIMIT);
+		const __m128i mask = _mm_set1_epi32(0x7fff);
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i r0 = _mm_loadu_si128((const __m128i*)raw0);
+		__m128i r1 = _mm_loadu_si128((const __m128i*)raw1);
+		__m128i r2 = _mm_loadu_si128((const __m128i*)raw2);
+		__m128 a = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r0, mask)), step), limit);
+		__m128 b = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r1, mask)), step), limit);
+		__m128 c = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r2, mask)), step), limit);
+		__m128 remainder = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(a, a)), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+		__m128 l = _mm_sqrt_ps(_mm_max_ps(remainder, _mm_setzero_ps()));
+
+		__m128i largest = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r0, 15), one), _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(r1, 15), one), 1));
+		__m128 is0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_setzero_si128()));
+		__m128 is1 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, one));
+		__m128 is2 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(2)));
+		__m128 is3 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(3)));
+		outQ[0] = selectSSE(a, l, is0);
+		outQ[1] = selectSSE(selectSSE(b, a, is0), l, is1);
+		outQ[2] = selectSSE(selectSSE(c, b, _mm_or_ps(is0, is1)), l, is2);
+		outQ[3] = selectSSE(c, l, is3);
+	}
+
+	// Two halves of four lanes
+	static void decodeSSE(const SampleBatch& batch, const F32* ranges, U32 stride, U32 firstJoint, Pose& pose) {
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		for (U32 half = 0; half < ANIMATION_BATCH; half += 4) {
+			U32 joint = firstJoint + half;
+			__m128 a[4], b[4];
+			decodeRotationsSSE(batch.Values[0][0][0] + half, batch.Values[0][0][1] + half, batch.Values[0][0][2] + half, a);
+			decodeRotationsSSE(batch.Values[0][1][0] + half, batch.Values[0][1][1] + half, batch.Values[0][1][2] + half, b);
+
+			// Shorter arc, flipping b where the rotations point into opposite hemispheres
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3])));
+			__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), signMask);
+			__m128 alpha = _mm_loadu_ps(batch.Alpha[0] + half);
+			__m128 q[4];
+			for (U32 i = 0; i < 4; ++i) {
+				q[i] = _mm_add_ps(a[i], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(b[i], flip), a[i]), alpha));
+			}
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(q[0], q[0]), _mm_mul_ps(q[1], q[1])), _mm_add_ps(_mm_mul_ps(q[2], q[2]), _mm_mul_ps(q[3], q[3]))));
+			__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), length);
+			for (U32 i = 0; i < 4; ++i) {
+				_mm_storeu_ps(pose.GetComponent(i) + joint, _mm_mul_ps(q[i], inverseLength));
+			}
+
+			for (U32 channel = 1; channel < ANIMATION_CHANNELS; ++channel) {
+				const F32* range = ranges + (channel - 1) * 6 * stride + joint;
+				alpha = _mm_loadu_ps(batch.Alpha[channel] + half);
+				for (U32 axis = 0; axis < 3; ++axis) {
+					__m128 minimum = _mm_loadu_ps(range + axis * stride);
+					__m128 step = _mm_loadu_ps(range + (3 + axis) * stride);
+					__m128 valueA = _mm_add_ps(minimum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(batch.Values[channel][0][axis] + half))), step));
+					__m128 valueB = _mm_add_ps(minimum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(batch.Values[channel][1][axis] + half))), step));
+					_mm_storeu_ps(pose.GetComponent(1 + channel * 3 + axis) + joint, _mm_add_ps(valueA, _mm_mul_ps(_mm_sub_ps(valueB, valueA), alpha)));
+				}
+			}
+		}
+	}
+
+	TARGET_AVX2 static void decodeRotationsAVX2(const I32* raw0, const I32* raw1, const I32* raw2, __m256* outQ) {
+		const __m256 step = _mm256_set1_ps(2.0f * ANIMATION_ROTATION_LIMIT / 32767.0f);
+		const __m256 limit = _mm256_set1_ps(ANIMATION_ROTATION_LIMIT);
+		const __m256i mask = _mm256_set1_epi32(0x7fff);
+		const __m256i one = _mm256_set1_epi32(1);
+		__m256i r0 = _mm256_loadu_si256((const __m256i*)raw0);
+		__m256i r1 = _mm256_loadu_si256((const __m256i*)raw1);
+		__m256i r2 = _mm256_loadu_si256((const __m256i*)raw2);
+		__m256 a = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(r0, mask)), step), limit);
+		__m256 b = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(r1, mask)), step), limit);
+		__m256 c = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(r2, mask)), step), limit);
+		__m256 remainder = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(a, a)), _mm256_mul_ps(b, b)), _mm256_mul_ps(c, c));
+		__m256 l = _mm256_sqrt_ps(_mm256_max_ps(remainder, _mm256_setzero_ps()));
+
+		__m256i largest = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(r0, 15), one), _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(r1, 15), one), 1));
+		__m256 is0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_setzero_si256()));
+		__m256 is1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, one));
+		__m256 is2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(2)));
+		__m256 is3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(3)));
+		outQ[0] = _mm256_blendv_ps(a, l, is0);
+		outQ[1] = _mm256_blendv_ps(_mm256_blendv_ps(b, a, is0), l, is1);
+		outQ[2] = _mm256_blendv_ps(_mm256_blendv_ps(c, b, _mm256_or_ps(is0, is1)), l, is2);
+		outQ[3] = _mm256_blendv_ps(c, l, is3);
+	}
+
+	TARGET_AVX2 static void decodeAVX2(const SampleBatch& batch, const F32* ranges, U32 stride, U32 firstJoint, Pose& pose) {
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		__m256 a[4], b[4];
+		decodeRotationsAVX2(batch.Values[0][0][0], batch.Values[0][0][1], batch.Values[0][0][2], a);
+		decodeRotationsAVX2(batch.Values[0][1][0], batch.Values[0][1][1], batch.Values[0][1][2], b);
+
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])), _mm256_add_ps(_mm256_mul_ps(a[2], b[2]), _mm256_mul_ps(a[3], b[3])));
+		__m256 flip = _mm256_and_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_LT_OQ), signMask);
+		__m256 alpha = _mm256_loadu_ps(batch.Alpha[0]);
+		__m256 q[4];
+		for (U32 i = 0; i < 4; ++i) {
+			q[i] = _mm256_fmadd_ps(_mm256_sub_ps(_mm256_xor_ps(b[i], flip), a[i]), alpha, a[i]);
+		}
+		__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(q[0], q[0]), _mm256_mul_ps(q[1], q[1])), _mm256_add_ps(_mm256_mul_ps(q[2], q[2]), _mm256_mul_ps(q[3], q[3]))));
+		__m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), length);
+		for (U32 i = 0; i < 4; ++i) {
+			_mm256_storeu_ps(pose.GetComponent(i) + firstJoint, _mm256_mul_ps(q[i], inverseLength));
+		}
+
+		for (U32 channel = 1; channel < ANIMATION_CHANNELS; ++channel) {
+			const F32* range = ranges + (channel - 1) * 6 * stride + firstJoint;
+			alpha = _mm256_loadu_ps(batch.Alpha[channel]);
+			for (U32 axis = 0; axis < 3; ++axis) {
+				__m256 minimum = _mm256_loadu_ps(range + axis * stride);
+				__m256 step = _mm256_loadu_ps(range + (3 + axis) * stride);
+				__m256 valueA = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)batch.Values[channel][0][axis])), step, minimum);
+				__m256 valueB = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)batch.Values[channel][1][axis])), step, minimum);
+				_mm256_storeu_ps(pose.GetComponent(1 + channel * 3 + axis) + firstJoint, _mm256_fmadd_ps(_mm256_sub_ps(valueB, valueA), alpha, valueA));
+			}
+		}
+	}
+#endif
+
+	static void decodeBatch(const SampleBatch& batch, const F32* ranges, U32 stride, U32 firstJoint, Pose& pose, SimdLevel level) {
+#ifdef ARCH_X64
+		// AVX-512 would only split the batch in half
+		switch (level) {
+		case SimdLevel::AVX512:
+		case SimdLevel::AVX2:
+			decodeAVX2(batch, ranges, stride, firstJoint, pose);
+			return;
+		case SimdLevel::SSE:
+			decodeSSE(batch, ranges, stride, firstJoint, pose);
+			return;
+		default:
+			break;
+		}
+#endif
+		decodeScalar(batch, ranges, stride, firstJoint, pose);
+	}
+
+	void AnimationClip::Sample(F32 time, Pose& outPose, SimdLevel level) const {
+		outPose.Resize(_jointCount);
+		if (_jointCount == 0) {
+			return;
+		}
+
+		F32 frame = fminf(fmaxf(time * _frameRate, 0.0f), (F32)(_frameCount - 1));
+		SampleBatch batch;
+		for (U32 firstJoint = 0; firstJoint < _stride; firstJoint += ANIMATION_BATCH) {
+			gatherBatch(_keys.data(), _tracks.data(), _jointCount, firstJoint, frame, batch);
+			decodeBatch(batch, _ranges.data(), _stride, firstJoint, outPose, level);
+		}
+	}
+
+	static void blendScalar(const Pose* const* poses, const F32* weights, U32 poseCount, F32 weightScale, Pose& outPose) {
+		const Pose& reference = *poses[0];
+		for (U32 joint = 0; joint < outPose.GetStride(); ++joint) {
+			F32 sum[ANIMATION_COMPONENTS] = {};
+			for (U32 p = 0; p < poseCount; ++p) {
+				const Pose& pose = *poses[p];
+				F32 weight = weights[p] * weightScale;
+				F32 dot = 0.0f;
+				for (U32 c = 0; c < 4; ++c) {
+					dot += pose.GetComponent(c)[joint] * reference.GetComponent(c)[joint];
+				}
+
+				F32 rotationWeight = dot < 0.0f ? -weight : weight;
+				for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+					sum[c] += pose.GetComponent(c)[joint] * (c < 4 ? rotationWeight : weight);
+				}
+			}
+
+			F32 inverseLength = 1.0f / sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2] + sum[3] * sum[3]);
+			for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+				outPose.GetComponent(c)[joint] = c < 4 ? sum[c] * inverseLength : sum[c];
+			}
+		}
+	}
+
+#ifdef ARCH_X64
+	static void blendSSE(const Pose* const* poses, const F32* weights, U32 poseCount, F32 weightScale, Pose& outPose) {
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const Pose& reference = *poses[0];
+		for (U32 joint = 0; joint < outPose.GetStride(); joint += 4) {
+			__m128 sum[ANIMATION_COMPONENTS];
+			for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+				sum[c] = _mm_setzero_ps();
+			}
+
+			for (U32 p = 0; p < poseCount; ++p) {
+				const Pose& pose = *poses[p];
+				__m128 weight = _mm_set1_ps(weights[p] * weightScale);
+				__m128 value[ANIMATION_COMPONENTS];
+				__m128 dot = _mm_setzero_ps();
+				for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+					value[c] = _mm_loadu_ps(pose.GetComponent(c) + joint);
+				}
+				for (U32 c = 0; c < 4; ++c) {
+					dot = _mm_add_ps(dot, _mm_mul_ps(value[c], _mm_loadu_ps(reference.GetComponent(c) + joint)));
+				}
+
+				__m128 rotationWeight = _mm_xor_ps(weight, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), signMask));
+				for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+					sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(value[c], c < 4 ? rotationWeight : weight));
+				}
+			}
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sum[0], sum[0]), _mm_mul_ps(sum[1], sum[1])), _mm_add_ps(_mm_mul_ps(sum[2], sum[2]), _mm_mul_ps(sum[3], sum[3]))));
+			__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), length);
+			for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+				_mm_storeu_ps(outPose.GetComponent(c) + joint, c < 4 ? _mm_mul_ps(sum[c], inverseLength) : sum[c]);
+			}
+		}
+	}
+
+	TARGET_AVX2 static void blendAVX2(const Pose* const* poses, const F32* weights, U32 poseCount, F32 weightScale, Pose& outPose) {
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		const Pose& reference = *poses[0];
+		for (U32 joint = 0; joint < outPose.GetStride(); joint += 8) {
+			__m256 sum[ANIMATION_COMPONENTS];
+			for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+				sum[c] = _mm256_setzero_ps();
+			}
+
+			for (U32 p = 0; p < poseCount; ++p) {
+				const Pose& pose = *poses[p];
+				__m256 weight = _mm256_set1_ps(weights[p] * weightScale);
+				__m256 value[ANIMATION_COMPONENTS];
+				__m256 dot = _mm256_setzero_ps();
+				for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+					value[c] = _mm256_loadu_ps(pose.GetComponent(c) + joint);
+				}
+				for (U32 c = 0; c < 4; ++c) {
+					dot = _mm256_fmadd_ps(value[c], _mm256_loadu_ps(reference.GetComponent(c) + joint), dot);
+				}
+
+				__m256 rotationWeight = _mm256_xor_ps(weight, _mm256_and_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_LT_OQ), signMask));
+				for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+					sum[c] = _mm256_fmadd_ps(value[c], c < 4 ? rotationWeight : weight, sum[c]);
+				}
+			}
+
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sum[0], sum[0]), _mm256_mul_ps(sum[1], sum[1])), _mm256_add_ps(_mm256_mul_ps(sum[2], sum[2]), _mm256_mul_ps(sum[3], sum[3]))));
+			__m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), length);
+			for (U32 c = 0; c < ANIMATION_COMPONENTS; ++c) {
+				_mm256_storeu_ps(outPose.GetComponent(c) + joint, c < 4 ? _mm256_mul_ps(sum[c], inverseLength) : sum[c]);
+			}
+		}
+	}
+#endif
+
+	void Animation::Blend(const Pose* const* poses, const F32* weights, U32 poseCount, Pose& outPose, SimdLevel level) {
+		if (poseCount == 0) {
+			return;
+		}
+
+		F32 totalWeight = 0.0f;
+		for (U32 p = 0; p < poseCount; ++p) {
+			totalWeight += weights[p];
+		}
+
+		// With no weight at all the first pose wins
+		static const F32 fullWeight = 1.0f;
+		if (totalWeight <= 0.0f) {
+			weights = &fullWeight;
+			poseCount = 1;
+			totalWeight = 1.0f;
+		}
+
+		outPose.Resize(poses[0]->GetJointCount());
+		F32 weightScale = 1.0f / totalWeight;
+#ifdef ARCH_X64
+		switch (level) {
+		case SimdLevel::AVX512:
+		case SimdLevel::AVX2:
+			blendAVX2(poses, weights, poseCount, weightScale, outPose);
+			return;
+		case SimdLevel::SSE:
+			blendSSE(poses, weights, poseCount, weightScale, outPose);
+			return;
+		default:
+			break;
+		}
+#endif
+		blendScalar(poses, weights, poseCount, weightScale, outPose);
+	}
+
+	static Mat4 toMatrix(const Pose& pose, U32 joint) {
+		JointTransform transform = pose.Get(joint);
+		F32 x = transform.Rotation.X;
+		F32 y = transform.Rotation.Y;
+		F32 z = transform.Rotation.Z;
+		F32 w = transform.Rotation.W;
+
+		Mat4 m;
+		m.M[0] = (1.0f - 2.0f * (y * y + z * z)) * transform.Scale.X;
+		m.M[1] = 2.0f * (x * y + w * z) * transform.Scale.X;
+		m.M[2] = 2.0f * (x * z - w * y) * transform.Scale.X;
+		m.M[3] = 0.0f;
+		m.M[4] = 2.0f * (x * y - w * z) * transform.Scale.Y;
+		m.M[5] = (1.0f - 2.0f * (x * x + z * z)) * transform.Scale.Y;
+		m.M[6] = 2.0f * (y * z + w * x) * transform.Scale.Y;
+		m.M[7] = 0.0f;
+		m.M[8] = 2.0f * (x * z + w * y) * transform.Scale.Z;
+		m.M[9] = 2.0f * (y * z - w * x) * transform.Scale.Z;
+		m.M[10] = (1.0f - 2.0f * (x * x + y * y)) * transform.Scale.Z;
+		m.M[11] = 0.0f;
+		m.M[12] = transform.Translation.X;
+		m.M[13] = transform.Translation.Y;
+		m.M[14] = transform.Translation.Z;
+		m.M[15] = 1.0f;
+		return m;
+	}
+
+	// Both matrices are affine, so the bottom row is always 0 0 0 1
+	static void multiplyAffine(const Mat4& a, const Mat4& b, Mat4& out) {
+		for (U32 column = 0; column < 4; ++column) {
+			for (U32 row = 0; row < 3; ++row) {
+				out.M[column * 4 + row] = a.M[row] * b.M[column * 4] + a.M[4 + row] * b.M[column * 4 + 1] + a.M[8 + row] * b.M[column * 4 + 2];
+			}
+			out.M[column * 4 + 3] = b.M[column * 4 + 3];
+		}
+		out.M[12] += a.M[12];
+		out.M[13] += a.M[13];
+		out.M[14] += a.M[14];
+	}
+
+	void Animation::ComputeJointMatrices(const Skeleton& skeleton, const Pose& pose, Mat4* outModelMatrices, Mat4* outJointMatrices) {
+		for (U32 joint = 0; joint < (U32)skeleton.Parents.size(); ++joint) {
+			U32 parent = skeleton.Parents[joint];
+			if (parent == U32_MAX) {
+				outModelMatrices[joint] = toMatrix(pose, joint);
+			} else {
+				multiplyAffine(outModelMatrices[parent], toMatrix(pose, joint), outModelMatrices[joint]);
+			}
+			multiplyAffine(outModelMatrices[joint], skeleton.InverseBindMatrices[joint], outJointMatrices[joint]);
+		}
+	}
+
+	// Per thread, so characters evaluate without allocating once the poses have grown
+	struct EvaluationScratch {
+		Pose Layers[ANIMATION_MAX_LAYERS];
+		Pose Blended;
+		std::vector<Mat4> ModelMatrices;
+	};
+
+	static void evaluateInstance(const AnimationInstance& instance, EvaluationScratch& scratch, SimdLevel level) {
+		U32 layerCount = std::min(instance.LayerCount, (U32)ANIMATION_MAX_LAYERS);
+		if (layerCount == 0) {
+			return;
+		}
+
+		const Pose* poses[ANIMATION_MAX_LAYERS];
+		F32 weights[ANIMATION_MAX_LAYERS];
+		for (U32 l = 0; l < layerCount; ++l) {
+			const AnimationLayer& layer = instance.Layers[l];
+			layer.Clip->Sample(layer.Time, scratch.Layers[l], level);
+			poses[l] = &scratch.Layers[l];
+			weights[l] = layer.Weight;
+		}
+
+		const Pose* pose = poses[0];
+		if (layerCount > 1) {
+			Animation::Blend(poses, weights, layerCount, scratch.Blended, level);
+			pose = &scratch.Blended;
+		}
+
+		scratch.ModelMatrices.resize(instance.Rig->Parents.size());
+		Animation::ComputeJointMatrices(*instance.Rig, *pose, scratch.ModelMatrices.data(), instance.OutJointMatrices);
+	}
+
+	void Animation::Evaluate(const AnimationInstance* instances, U32 instanceCount, SimdLevel level, bool parallel) {
+		std::vector<EvaluationScratch> scratch(JobSystem::GetThreadCount());
+		auto evaluateBatch = [&](U32 start, U32 end) {
+			EvaluationScratch& threadScratch = scratch[JobSystem::GetThreadIndex()];
+			for (U32 i = start; i < end; ++i) {
+				evaluateInstance(instances[i], threadScratch, level);
+			}
+		};
+
+		if (!parallel || instanceCount <= ANIMATION_INSTANCE_BATCH) {
+			evaluateBatch(0, instanceCount);
+		} else {
+			JobSystem::ParallelFor(instanceCount, ANIMATION_INSTANCE_BATCH, evaluateBatch);
+		}
+	}
+
+	static Vec4 axisAngle(const Vec3& axis, F32 angle) {
+		Vec3 unit = TMath::Normalize(axis);
+		F32 s = sinf(angle * 0.5f);
+		return { unit.X * s, unit.Y * s, unit.Z * s, cosf(angle * 0.5f) };
+	}
+
+	// Every joint swings around its own axis, some are held still and the root walks
+	static void generateClip(std::mt19937& random, U32 frameCount, U32 jointCount, F32 frameRate, std::vector<JointTransform>& outFrames) {
+		std::uniform_real_distribution<F32> unit(-1.0f, 1.0f);
+		std::vector<Vec3> axes(jointCount);
+		std::vector<F32> amplitudes(jointCount);
+		std::vector<F32> phases(jointCount);
+		for (U32 joint = 0; joint < jointCount; ++joint) {
+			axes[joint] = { unit(random), unit(random), unit(random) + 2.0f };
+			amplitudes[joint] = joint % 5 == 4 ? 0.0f : 0.8f * fabsf(unit(random));
+			phases[joint] = 3.14159f * unit(random);
+		}
+
+		outFrames.resize(frameCount * jointCount);
+		for (U32 frame = 0; frame < frameCount; ++frame) {
+			F32 cycle = 6.28318f * (F32)frame / (F32)(frameCount - 1);
+			for (U32 joint = 0; joint < jointCount; ++joint) {
+				JointTransform& transform = outFrames[frame * jointCount + joint];
+				transform.Rotation = axisAngle(axes[joint], amplitudes[joint] * sinf(cycle + phases[joint]));
+				transform.Translation = joint == 0 ? Vec3{ (F32)frame / frameRate, 0.05f * sinf(2.0f * cycle), 0.0f } : Vec3{ 0.0f, 0.1f, 0.0f };
+				transform.Scale = { 1.0f, 1.0f, 1.0f };
+			}
+		}
+	}
+
+	const bool Animation::RunBenchmark() {
+		const U32 jointCount = 64;
+		const U32 frameCount = 90;
+		const F32 frameRate = 30.0f;
+		const U32 clipCount = 8;
+		const U32 characterCount = 4096;
+		const U32 iterations = 10;
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+		SimdLevel supportedLevel = Simd::GetSupportedLevel();
+
+		Logger::Log("Animation benchmark, %s supported, %d threads", Simd::GetLevelName(supportedLevel), JobSystem::GetThreadCount());
+
+		std::mt19937 random(1234);
+		Skeleton skeleton;
+		Pose bindPose;
+		bindPose.Resize(jointCount);
+		for (U32 joint = 0; joint < jointCount; ++joint) {
+			skeleton.Parents.push_back(joint == 0 ? U32_MAX : (joint - 1) / 2);
+			bindPose.Set(joint, { { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, joint == 0 ? 0.0f : 0.1f, 0.0f }, { 1.0f, 1.0f, 1.0f } });
+		}
+		std::vector<Mat4> bindModel(jointCount);
+		std::vector<Mat4> unused(jointCount);
+		skeleton.InverseBindMatrices.assign(jointCount, TMath::Identity());
+		ComputeJointMatrices(skeleton, bindPose, bindModel.data(), unused.data());
+		for (U32 joint = 0; joint < jointCount; ++joint) {
+			skeleton.InverseBindMatrices[joint] = TMath::Translation({ -bindModel[joint].M[12], -bindModel[joint].M[13], -bindModel[joint].M[14] });
+		}
+
+		// Compression, with the error measured on every source frame
+		std::vector<AnimationClip> clips(clipCount);
+		size_t rawSize = 0;
+		size_t compressedSize = 0;
+		U32 keyCount = 0;
+		F32 rotationError = 0.0f;
+		F32 translationError = 0.0f;
+		Pose sampled;
+		std::vector<JointTransform> frames;
+		for (AnimationClip& clip : clips) {
+			generateClip(random, frameCount, jointCount, frameRate, frames);
+			clip.Compress(frames.data(), frameCount, jointCount, frameRate);
+			rawSize += frames.size() * sizeof(JointTransform);
+			compressedSize += clip.GetSize();
+			keyCount += clip.GetKeyCount();
+
+			for (U32 frame = 0; frame < frameCount; ++frame) {
+				clip.Sample((F32)frame / frameRate, sampled, SimdLevel::Scalar);
+				for (U32 joint = 0; joint < jointCount; ++joint) {
+					const JointTransform& source = frames[frame * jointCount + joint];
+					JointTransform transform = sampled.Get(joint);
+					rotationError = fmaxf(rotationError, valueError(0, transform.Rotation, source.Rotation));
+					Vec4 translation = { transform.Translation.X, transform.Translation.Y, transform.Translation.Z, 0.0f };
+					Vec4 sourceTranslation = { source.Translation.X, source.Translation.Y, source.Translation.Z, 0.0f };
+					translationError = fmaxf(translationError, valueError(1, translation, sourceTranslation));
+				}
+			}
+		}
+		Logger::Log("%d clips of %d frames, %d joints: %zu bytes raw, %zu compressed (%.1fx), %.1f keys per track",
+			clipCount, frameCount, jointCount, rawSize, compressedSize, (F64)rawSize / (F64)compressedSize,
+			(F64)keyCount / (F64)(clipCount * jointCount * ANIMATION_CHANNELS));
+		Logger::Log("Max error %g radians, %g units", rotationError, translationError);
+
+		// Two layer characters at scattered times
+		std::uniform_int_distribution<U32> pickClip(0, clipCount - 1);
+		std::uniform_real_distribution<F32> pickTime(0.0f, clips[0].GetDuration());
+		std::vector<AnimationLayer> layers(characterCount * 2);
+		std::vector<AnimationInstance> instances(characterCount);
+		std::vector<Mat4> jointMatrices(characterCount * jointCount);
+		for (U32 i = 0; i < characterCount; ++i) {
+			layers[i * 2] = { &clips[pickClip(random)], pickTime(random), 0.7f };
+			layers[i * 2 + 1] = { &clips[pickClip(random)], pickTime(random), 0.3f };
+			instances[i] = { &skeleton, &layers[i * 2], 2, &jointMatrices[i * jointCount] };
+		}
+		Logger::Log("%d characters, 2 layers each", characterCount);
+
+		bool passed = true;
+		std::vector<Mat4> baseline;
+		F64 baselineTime = 0.0;
+		for (SimdLevel level : levels) {
+			if (level > supportedLevel) {
+				break;
+			}
+
+			for (U32 parallel = 0; parallel < 2; ++parallel) {
+				F64 time = Benchmark::Time(iterations, [&](U32) { Evaluate(instances.data(), characterCount, level, parallel != 0); });
+				baselineTime = baselineTime > 0.0 ? baselineTime : time;
+				if (baseline.empty()) {
+					baseline = jointMatrices;
+				}
+
+				F32 difference = 0.0f;
+				for (size_t m = 0; m < jointMatrices.size(); ++m) {
+					for (U32 e = 0; e < 16; ++e) {
+						difference = fmaxf(difference, fabsf(jointMatrices[m].M[e] - baseline[m].M[e]));
+					}
+				}
+
+				char name[64];
+				snprintf(name, sizeof(name), "%s%s", Simd::GetLevelName(level), parallel ? " parallel" : "");
+				Logger::Log("  %-24s %9.3f ms %7.2fx, max difference %g", name, time, baselineTime / time, difference);
+				passed &= Benchmark::Check(difference <= 1e-4f, "%s joint matrices differ from scalar ones by %g", name, difference);
+			}
+		}
+		return passed;
+	}
+}
\ No newline at end of file
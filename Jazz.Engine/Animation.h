@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+
+#include "Defines.h"
+#include "TMath.h"
+#include "Simd.h"
+
+// Rotation xyzw, translation xyz and scale xyz of every joint in a pose
+#define ANIMATION_COMPONENTS 10
+
+// Joints sampled and blended together. Poses are padded to a multiple of it so every SIMD level runs whole batches.
+#define ANIMATION_BATCH 8
+
+// Layers a single character can blend in Evaluate
+#define ANIMATION_MAX_LAYERS 8
+
+namespace Jazz {
+
+	struct JointTransform {
+		Vec4 Rotation; // Unit quaternion
+		Vec3 Translation;
+		Vec3 Scale;
+	};
+
+	// Joints are listed parents first, so model space matrices can be built in a single pass
+	struct Skeleton {
+		std::vector<U32> Parents; // U32_MAX for a root
+		std::vector<Mat4> InverseBindMatrices;
+	};
+
+	// Local joint transforms as structure of arrays, component c of joint j at GetComponent(c)[j]
+	class Pose {
+	public:
+		Pose();
+
+		void Resize(U32 jointCount);
+
+		JointTransform Get(U32 joint) const;
+		void Set(U32 joint, const JointTransform& transform);
+
+		U32 GetJointCount() const { return _jointCount; }
+		U32 GetStride() const { return _stride; }
+		F32* GetComponent(U32 component) { return _data.data() + component * _stride; }
+		const F32* GetComponent(U32 component) const { return _data.data() + component * _stride; }
+	private:
+		std::vector<F32> _data;
+		U32 _jointCount;
+		U32 _stride;
+	};
+
+	// A quantized key of one track: a smallest-three quaternion, or a position or scale as 16 bit fractions of the
+	// track's range
+	struct AnimationKey {
+		U16 Frame;
+		U16 Values[3];
+	};
+
+	struct AnimationTrack {
+		U32 FirstKey;
+		U32 KeyCount;
+	};
+
+	// Keyframe animation of every joint of a skeleton, compressed at import time. Each rotation, translation and scale
+	// track keeps only the keys linear interpolation cannot reconstruct within tolerance, at 8 bytes a key.
+	class AnimationClip {
+	public:
+		AnimationClip();
+
+		// frames holds frameCount poses of jointCount transforms each, sampled at frameRate. Tolerances are in radians
+		// for rotations and in model units for translations and scales.
+		const bool Compress(const JointTransform* frames, U32 frameCount, U32 jointCount, F32 frameRate,
+			F32 rotationTolerance = 0.0005f, F32 translationTolerance = 0.0001f, F32 scaleTolerance = 0.0001f);
+
+		// Time is clamped to the clip, looping is up to the caller. outPose is resized to the clip's joint count.
+		void Sample(F32 time, Pose& outPose, SimdLevel level = Simd::GetSupportedLevel()) const;
+
+		U32 GetJointCount() const { return _jointCount; }
+		U32 GetKeyCount() const { return (U32)_keys.size(); }
+		F32 GetDuration() const { return _frameCount > 1 ? (F32)(_frameCount - 1) / _frameRate : 0.0f; }
+
+		// Bytes of keys, tracks and ranges
+		size_t GetSize() const;
+	private:
+		std::vector<AnimationKey> _keys;
+		std::vector<AnimationTrack> _tracks; // Rotation, translation then scale track of every joint
+		std::vector<F32> _ranges; // Translation minimum and step, then scale minimum and step, each xyz and padded per joint
+		U32 _jointCount;
+		U32 _stride;
+		U32 _frameCount;
+		F32 _frameRate;
+	};
+
+	struct AnimationLayer {
+		const AnimationClip* Clip;
+		F32 Time;
+		F32 Weight;
+	};
+
+	// One animated character. Its joint matrices are ready for VulkanRenderer::setInstanceJoints.
+	struct AnimationInstance {
+		const Skeleton* Rig;
+		const AnimationLayer* Layers;
+		U32 LayerCount;
+		Mat4* OutJointMatrices;
+	};
+
+	class Animation {
+	public:
+		// Weighted blend of poses with matching joint counts. Weights are normalized, rotations follow the first pose's
+		// hemisphere and are renormalized.
+		static void Blend(const Pose* const* poses, const F32* weights, U32 poseCount, Pose& outPose, SimdLevel level = Simd::GetSupportedLevel());
+
+		// Model space matrices, and those times the inverse bind matrices for skinning
+		static void ComputeJointMatrices(const Skeleton& skeleton, const Pose& pose, Mat4* outModelMatrices, Mat4* outJointMatrices);
+
+		// Samples, blends and poses every instance, spread across the job system by character
+		static void Evaluate(const AnimationInstance* instances, U32 instanceCount, SimdLevel level = Simd::GetSupportedLevel(), bool parallel = true);
+
+		// Compression ratio and error of generated clips, then thousands of two layer characters evaluated for every
+		// supported SIMD level, single threaded and parallel. Fails when a level disagrees with scalar evaluation.
+		static const bool RunBenchmark();
+	};
+}
\ No newline at end of file
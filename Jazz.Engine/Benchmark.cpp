@@ -0,0 +1,20 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "Logger.h"
+#include "Benchmark.h"
+
+namespace Jazz {
+
+	const bool Benchmark::Check(const bool condition, const char* message, ...) {
+		if (!condition) {
+			char buffer[256];
+			va_list args;
+			va_start(args, message);
+			vsnprintf(buffer, sizeof(buffer), message, args);
+			va_end(args);
+			Logger::Error("Benchmark check failed: %s", buffer);
+		}
+		return condition;
+	}
+}
\ No newline at end of file
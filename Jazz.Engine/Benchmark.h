@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+#include "Types.h"
+
+namespace Jazz {
+
+	// Shared by the RunBenchmark() functions of the engine modules. Each returns false once one of its checks failed, so
+	// the --benchmark-* command lines double as regression tests.
+	class Benchmark {
+	public:
+		// Average milliseconds per call of function(iteration)
+		template<typename Function>
+		static F64 Time(U32 iterations, Function function) {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (U32 i = 0; i < iterations; ++i) {
+				function(i);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			return std::chrono::duration<F64, std::milli>(end - start).count() / iterations;
+		}
+
+		// Same, with setup(iteration) run before each call and left out of the measured time
+		template<typename Setup, typename Function>
+		static F64 Time(U32 iterations, Setup setup, Function function) {
+			F64 total = 0.0;
+			for (U32 i = 0; i < iterations; ++i) {
+				setup(i);
+				auto start = std::chrono::high_resolution_clock::now();
+				function(i);
+				auto end = std::chrono::high_resolution_clock::now();
+				total += std::chrono::duration<F64, std::milli>(end - start).count();
+			}
+			return total / iterations;
+		}
+
+		// Logs the failure when condition is false, and returns it
+		static const bool Check(const bool condition, const char* message, ...);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include <random>
+#include <string.h>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "Culling.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+// Objects per parallel batch, a multiple of every SIMD width
+#define CULLING_BATCH_SIZE 16384
+
+namespace Jazz {
+
+	BoundingSphereSoA::BoundingSphereSoA() {
+		_count = 0;
+	}
+
+	U32 BoundingSphereSoA::Add(const Vec3& center, const F32 radius) {
+		_centerX.push_back(center.X);
+		_centerY.push_back(center.Y);
+		_centerZ.push_back(center.Z);
+		_radius.push_back(radius);
+		return _count++;
+	}
+
+	void BoundingSphereSoA::Set(const U32 index, const Vec3& center, const F32 radius) {
+		_centerX[index] = center.X;
+		_centerY[index] = center.Y;
+		_centerZ[index] = center.Z;
+		_radius[index] = radius;
+	}
+
+	void BoundingSphereSoA::Clear() {
+		_centerX.clear();
+		_centerY.clear();
+		_centerZ.clear();
+		_radius.clear();
+		_count = 0;
+	}
+
+	static FORCEINLINE U32 countTrailingZeros(U32 value) {
+#if _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return (U32)index;
+#else
+		return (U32)__builtin_ctz(value);
+#endif
+	}
+
+	// Appends start + bit for every set bit in mask
+	static FORCEINLINE U32 writeVisible(U32 mask, U32 start, U32* out) {
+		U32 count = 0;
+		while (mask) {
+			out[count++] = start + countTrailingZeros(mask);
+			mask &= mask - 1;
+		}
+		return count;
+	}
+
+	static U32 cullScalar(const Frustum& frustum, const BoundingSphereSoA& bounds, U32 start, U32 end, U32* out) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+
+		U32 count = 0;
+		for (U32 i = start; i < end; ++i) {
+			bool visible = true;
+			for (U32 p = 0; p < 6; ++p) {
+				const Vec4& plane = frustum.Planes[p];
+				visible &= plane.X * x[i] + plane.Y * y[i] + plane.Z * z[i] + plane.W >= -r[i];
+			}
+			if (visible) {
+				out[count++] = i;
+			}
+		}
+		return count;
+	}
+
+#ifdef ARCH_X64
+	// The SIMD paths multiply and add separately, in the order of the scalar expression above, so every level finds exactly
+	// the same visible set. A fused multiply-add would round differently for spheres touching a plane.
+	static U32 cullSSE(const Frustum& frustum, const BoundingSphereSoA& bounds, U32 start, U32 end, U32* out) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (U32 p = 0; p < 6; ++p) {
+			planeX[p] = _mm_set1_ps(frustum.Planes[p].X);
+			planeY[p] = _mm_set1_ps(frustum.Planes[p].Y);
+			planeZ[p] = _mm_set1_ps(frustum.Planes[p].Z);
+			planeW[p] = _mm_set1_ps(frustum.Planes[p].W);
+		}
+
+		U32 count = 0;
+		U32 i = start;
+		for (; i + 4 <= end; i += 4) {
+			__m128 cx = _mm_loadu_ps(x + i);
+			__m128 cy = _mm_loadu_ps(y + i);
+			__m128 cz = _mm_loadu_ps(z + i);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (U32 p = 0; p < 6; ++p) {
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_mul_ps(planeZ[p], cz)), planeW[p]);
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+			}
+
+			count += writeVisible((U32)_mm_movemask_ps(visible), i, out + count);
+		}
+
+		return count + cullScalar(frustum, bounds, i, end, out + count);
+	}
+
+	TARGET_AVX2 static U32 cullAVX2(const Frustum& frustum, const BoundingSphereSoA& bounds, U32 start, U32 end, U32* out) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (U32 p = 0; p < 6; ++p) {
+			planeX[p] = _mm256_set1_ps(frustum.Planes[p].X);
+			planeY[p] = _mm256_set1_ps(frustum.Planes[p].Y);
+			planeZ[p] = _mm256_set1_ps(frustum.Planes[p].Z);
+			planeW[p] = _mm256_set1_ps(frustum.Planes[p].W);
+		}
+
+		U32 count = 0;
+		U32 i = start;
+		for (; i + 8 <= end; i += 8) {
+			__m256 cx = _mm256_loadu_ps(x + i);
+			__m256 cy = _mm256_loadu_ps(y + i);
+			__m256 cz = _mm256_loadu_ps(z + i);
+			__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r + i));
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (U32 p = 0; p < 6; ++p) {
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)), _mm256_mul_ps(planeZ[p], cz)), planeW[p]);
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+			}
+
+			count += writeVisible((U32)_mm256_movemask_ps(visible), i, out + count);
+		}
+
+		return count + cullScalar(frustum, bounds, i, end, out + count);
+	}
+
+	TARGET_AVX512 static U32 cullAVX512(const Frustum& frustum, const BoundingSphereSoA& bounds, U32 start, U32 end, U32* out) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+
+		__m512 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (U32 p = 0; p < 6; ++p) {
+			planeX[p] = _mm512_set1_ps(frustum.Planes[p].X);
+			planeY[p] = _mm512_set1_ps(frustum.Planes[p].Y);
+			planeZ[p] = _mm512_set1_ps(frustum.Planes[p].Z);
+			planeW[p] = _mm512_set1_ps(frustum.Planes[p].W);
+		}
+
+		U32 count = 0;
+		U32 i = start;
+		for (; i + 16 <= end; i += 16) {
+			__m512 cx = _mm512_loadu_ps(x + i);
+			__m512 cy = _mm512_loadu_ps(y + i);
+			__m512 cz = _mm512_loadu_ps(z + i);
+			__m512 negativeRadius = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(r + i));
+
+			__mmask16 visible = 0xffff;
+			for (U32 p = 0; p < 6; ++p) {
+				__m512 distance = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(planeX[p], cx), _mm512_mul_ps(planeY[p], cy)), _mm512_mul_ps(planeZ[p], cz)), planeW[p]);
+				visible = _mm512_mask_cmp_ps_mask(visible, distance, negativeRadius, _CMP_GE_OQ);
+			}
+
+			count += writeVisible((U32)visible, i, out + count);
+		}
+
+		return count + cullScalar(frustum, bounds, i, end, out + count);
+	}
+#endif
+
+	static U32 cullRange(const Frustum& frustum, const BoundingSphereSoA& bounds, U32 start, U32 end, U32* out, SimdLevel level) {
+#ifdef ARCH_X64
+		switch (level) {
+		case SimdLevel::AVX512:
+			return cullAVX512(frustum, bounds, start, end, out);
+		case SimdLevel::AVX2:
+			return cullAVX2(frustum, bounds, start, end, out);
+		case SimdLevel::SSE:
+			return cullSSE(frustum, bounds, start, end, out);
+		default:
+			break;
+		}
+#endif
+		return cullScalar(frustum, bounds, start, end, out);
+	}
+
+	U32 Culling::CullSpheres(const Frustum& frustum, const BoundingSphereSoA& bounds, U32* outVisible, SimdLevel level, bool parallel) {
+		U32 count = bounds.GetCount();
+		if (!parallel || count <= CULLING_BATCH_SIZE) {
+			return cullRange(frustum, bounds, 0, count, outVisible, level);
+		}
+
+		// Each batch compacts into the front of its own slice of the output, the slices are then joined up
+		U32 batchCount = (count + CULLING_BATCH_SIZE - 1) / CULLING_BATCH_SIZE;
+		std::vector<U32> batchVisibleCounts(batchCount);
+		JobSystem::ParallelFor(count, CULLING_BATCH_SIZE, [&](U32 start, U32 end) {
+			batchVisibleCounts[start / CULLING_BATCH_SIZE] = cullRange(frustum, bounds, start, end, outVisible + start, level);
+		});
+
+		U32 visibleCount = batchVisibleCounts[0];
+		for (U32 batch = 1; batch < batchCount; ++batch) {
+			memmove(outVisible + visibleCount, outVisible + batch * CULLING_BATCH_SIZE, sizeof(U32) * batchVisibleCounts[batch]);
+			visibleCount += batchVisibleCounts[batch];
+		}
+		return visibleCount;
+	}
+
+	// Benchmark baseline: the straightforward layout and loop, one object at a time
+	struct SphereAoS {
+		Vec3 Center;
+		F32 Radius;
+	};
+
+	static U32 cullScalarAoS(const Frustum& frustum, const std::vector<SphereAoS>& spheres, U32* out) {
+		U32 count = 0;
+		for (U32 i = 0; i < (U32)spheres.size(); ++i) {
+			const SphereAoS& sphere = spheres[i];
+			bool visible = true;
+			for (U32 p = 0; p < 6 && visible; ++p) {
+				const Vec4& plane = frustum.Planes[p];
+				visible = plane.X * sphere.Center.X + plane.Y * sphere.Center.Y + plane.Z * sphere.Center.Z + plane.W >= -sphere.Radius;
+			}
+			if (visible) {
+				out[count++] = i;
+			}
+		}
+		return count;
+	}
+
+	const bool Culling::RunBenchmark() {
+		const U32 objectCounts[] = { 10000, 100000, 1000000 };
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2, SimdLevel::AVX512 };
+		SimdLevel supportedLevel = Simd::GetSupportedLevel();
+
+		Mat4 view = TMath::LookAt({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f });
+		Mat4 projection = TMath::Perspective(1.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+		Frustum frustum = TMath::ExtractFrustum(TMath::Multiply(projection, view));
+
+		Logger::Log("Frustum culling benchmark, %s supported, %d threads", Simd::GetLevelName(supportedLevel), JobSystem::GetThreadCount());
+		bool passed = true;
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<F32> position(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<F32> radius(0.5f, 5.0f);
+
+		for (U32 objectCount : objectCounts) {
+			std::vector<SphereAoS> spheres(objectCount);
+			BoundingSphereSoA bounds;
+			for (U32 i = 0; i < objectCount; ++i) {
+				spheres[i].Center = { position(random), position(random), position(random) };
+				spheres[i].Radius = radius(random);
+				bounds.Add(spheres[i].Center, spheres[i].Radius);
+			}
+
+			std::vector<U32> baseline(objectCount);
+			std::vector<U32> visible(objectCount);
+			U32 iterations = objectCount >= 1000000 ? 20 : 200;
+
+			U32 baselineVisible = 0;
+			F64 baselineTime = Benchmark::Time(iterations, [&](U32) { baselineVisible = cullScalarAoS(frustum, spheres, baseline.data()); });
+			Logger::Log("%d objects, %d visible", objectCount, baselineVisible);
+			Logger::Log("  %-24s %9.3f ms", "Scalar AoS (baseline)", baselineTime);
+
+			for (SimdLevel level : levels) {
+				if (level > supportedLevel) {
+					break;
+				}
+
+				for (U32 parallel = 0; parallel < 2; ++parallel) {
+					U32 visibleCount = 0;
+					F64 time = Benchmark::Time(iterations, [&](U32) { visibleCount = CullSpheres(frustum, bounds, visible.data(), level, parallel != 0); });
+
+					char name[64];
+					snprintf(name, sizeof(name), "%s SoA%s", Simd::GetLevelName(level), parallel ? " parallel" : "");
+					Logger::Log("  %-24s %9.3f ms %7.2fx", name, time, baselineTime / time);
+					// Every level rounds the same way, so it must find exactly the baseline's objects
+					bool same = visibleCount == baselineVisible && memcmp(visible.data(), baseline.data(), sizeof(U32) * visibleCount) == 0;
+					passed &= Benchmark::Check(same, "%s found %d visible, the baseline %d or other objects", name, visibleCount, baselineVisible);
+				}
+			}
+		}
+		return passed;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "TMath.h"
+#include "Simd.h"
+
+namespace Jazz {
+
+	// Bounding spheres stored as structure of arrays so each SIMD load fetches one component of 4, 8 or 16 objects
+	class BoundingSphereSoA {
+	public:
+		BoundingSphereSoA();
+
+		U32 Add(const Vec3& center, const F32 radius);
+		void Set(const U32 index, const Vec3& center, const F32 radius);
+		void Clear();
+
+		U32 GetCount() const { return _count; }
+		const F32* GetCenterX() const { return _centerX.data(); }
+		const F32* GetCenterY() const { return _centerY.data(); }
+		const F32* GetCenterZ() const { return _centerZ.data(); }
+		const F32* GetRadius() const { return _radius.data(); }
+	private:
+		std::vector<F32> _centerX;
+		std::vector<F32> _centerY;
+		std::vector<F32> _centerZ;
+		std::vector<F32> _radius;
+		U32 _count;
+	};
+
+	class Culling {
+	public:
+		// Writes the indices of the spheres touching the frustum to outVisible in ascending order and returns
+		// how many there are. outVisible must have room for bounds.GetCount() entries.
+		static U32 CullSpheres(const Frustum& frustum, const BoundingSphereSoA& bounds, U32* outVisible,
+			SimdLevel level = Simd::GetSupportedLevel(), bool parallel = true);
+
+		// Compares every supported SIMD level, single threaded and parallel, against a scalar array-of-structs
+		// baseline at 10k, 100k and 1M objects. Fails when any of them finds a different visible count.
+		static const bool RunBenchmark();
+	};
+}
\ No newline at end of file
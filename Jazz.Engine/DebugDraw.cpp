@@ -0,0 +1,171 @@
+#include "DebugDraw.h"
+
+#ifdef JAZZ_DEBUG_DRAW
+
+#include <atomic>
+#include <string.h>
+#include <math.h>
+
+#define DEBUG_DRAW_HALF (DEBUG_DRAW_MAX_VERTICES / 2)
+#define DEBUG_DRAW_CIRCLE_SEGMENTS 32
+
+namespace Jazz {
+
+	static DebugVertex* _vertices = nullptr;
+	static std::atomic<U32> _counts[2];
+	static std::atomic<bool> _enabled(true);
+
+	// Claims count vertices in one half, nullptr when they no longer fit. A reservation straddling the end of the half
+	// zeroes what it got: zero vertices are degenerate, transparent lines.
+	static DebugVertex* reserve(U32 count, bool depthTested) {
+		if (!_enabled.load(std::memory_order_relaxed) || _vertices == nullptr) {
+			return nullptr;
+		}
+
+		const U32 half = depthTested ? 0 : 1;
+		const U32 first = _counts[half].fetch_add(count, std::memory_order_relaxed);
+		DebugVertex* base = _vertices + half * DEBUG_DRAW_HALF;
+		if (first >= DEBUG_DRAW_HALF) {
+			return nullptr;
+		}
+		if (first + count > DEBUG_DRAW_HALF) {
+			memset(base + first, 0, (DEBUG_DRAW_HALF - first) * sizeof(DebugVertex));
+			return nullptr;
+		}
+		return base + first;
+	}
+
+	static void writeLine(DebugVertex* out, const Vec3& from, const Vec3& to, U32 color) {
+		out[0] = { from, color };
+		out[1] = { to, color };
+	}
+
+	// Twelve edges of a box given its corners, bit 0 of the index picks max X, bit 1 max Y and bit 2 max Z
+	static void writeBox(const Vec3* corners, U32 color, bool depthTested) {
+		DebugVertex* out = reserve(24, depthTested);
+		if (out == nullptr) {
+			return;
+		}
+
+		for (U32 i = 0; i < 8; ++i) {
+			for (U32 axis = 1; axis < 8; axis <<= 1) {
+				if ((i & axis) == 0) {
+					writeLine(out, corners[i], corners[i | axis], color);
+					out += 2;
+				}
+			}
+		}
+	}
+
+	// The point all three planes pass through
+	static Vec3 intersectPlanes(const Vec4& a, const Vec4& b, const Vec4& c) {
+		const Vec3 na = { a.X, a.Y, a.Z };
+		const Vec3 nb = { b.X, b.Y, b.Z };
+		const Vec3 nc = { c.X, c.Y, c.Z };
+		const Vec3 bc = TMath::Cross(nb, nc);
+		const Vec3 ca = TMath::Cross(nc, na);
+		const Vec3 ab = TMath::Cross(na, nb);
+		const F32 denominator = TMath::Dot(na, bc);
+		Vec3 sum = TMath::Add(TMath::Add(TMath::Scale(bc, a.W), TMath::Scale(ca, b.W)), TMath::Scale(ab, c.W));
+		return TMath::Scale(sum, -1.0f / denominator);
+	}
+
+	void DebugDraw::SetEnabled(bool enabled) {
+		_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	void DebugDraw::DrawLine(const Vec3& from, const Vec3& to, U32 color, bool depthTested) {
+		DebugVertex* out = reserve(2, depthTested);
+		if (out != nullptr) {
+			writeLine(out, from, to, color);
+		}
+	}
+
+	void DebugDraw::DrawBox(const Vec3& min, const Vec3& max, U32 color, bool depthTested) {
+		Vec3 corners[8];
+		for (U32 i = 0; i < 8; ++i) {
+			corners[i] = { (i & 1) ? max.X : min.X, (i & 2) ? max.Y : min.Y, (i & 4) ? max.Z : min.Z };
+		}
+		writeBox(corners, color, depthTested);
+	}
+
+	void DebugDraw::DrawBox(const Mat4& transform, const Vec3& halfExtents, U32 color, bool depthTested) {
+		Vec3 corners[8];
+		for (U32 i = 0; i < 8; ++i) {
+			const Vec3 local = { (i & 1) ? halfExtents.X : -halfExtents.X, (i & 2) ? halfExtents.Y : -halfExtents.Y, (i & 4) ? halfExtents.Z : -halfExtents.Z };
+			corners[i] = TMath::TransformPoint(transform, local);
+		}
+		writeBox(corners, color, depthTested);
+	}
+
+	void DebugDraw::DrawSphere(const Vec3& center, F32 radius, U32 color, bool depthTested) {
+		DebugVertex* out = reserve(3 * DEBUG_DRAW_CIRCLE_SEGMENTS * 2, depthTested);
+		if (out == nullptr) {
+			return;
+		}
+
+		// Unit circle once, then swizzled into the XY, YZ and ZX planes
+		F32 cosines[DEBUG_DRAW_CIRCLE_SEGMENTS + 1];
+		F32 sines[DEBUG_DRAW_CIRCLE_SEGMENTS + 1];
+		for (U32 i = 0; i <= DEBUG_DRAW_CIRCLE_SEGMENTS; ++i) {
+			const F32 angle = 6.28318531f * (F32)(i % DEBUG_DRAW_CIRCLE_SEGMENTS) / DEBUG_DRAW_CIRCLE_SEGMENTS;
+			cosines[i] = cosf(angle) * radius;
+			sines[i] = sinf(angle) * radius;
+		}
+
+		for (U32 plane = 0; plane < 3; ++plane) {
+			for (U32 i = 0; i < DEBUG_DRAW_CIRCLE_SEGMENTS; ++i) {
+				Vec3 from;
+				Vec3 to;
+				if (plane == 0) {
+					from = { cosines[i], sines[i], 0.0f };
+					to = { cosines[i + 1], sines[i + 1], 0.0f };
+				} else if (plane == 1) {
+					from = { 0.0f, cosines[i], sines[i] };
+					to = { 0.0f, cosines[i + 1], sines[i + 1] };
+				} else {
+					from = { sines[i], 0.0f, cosines[i] };
+					to = { sines[i + 1], 0.0f, cosines[i + 1] };
+				}
+				writeLine(out, TMath::Add(center, from), TMath::Add(center, to), color);
+				out += 2;
+			}
+		}
+	}
+
+	void DebugDraw::DrawFrustum(const Frustum& frustum, U32 color, bool depthTested) {
+		// Planes are left, right, bottom, top, near, far, corners follow the box bit layout
+		Vec3 corners[8];
+		for (U32 i = 0; i < 8; ++i) {
+			corners[i] = intersectPlanes(frustum.Planes[(i & 1) ? 1 : 0], frustum.Planes[(i & 2) ? 3 : 2], frustum.Planes[(i & 4) ? 5 : 4]);
+		}
+		writeBox(corners, color, depthTested);
+	}
+
+	void DebugDraw::DrawAxes(const Mat4& transform, F32 size, bool depthTested) {
+		DebugVertex* out = reserve(6, depthTested);
+		if (out == nullptr) {
+			return;
+		}
+
+		const Vec3 origin = TMath::TransformPoint(transform, { 0.0f, 0.0f, 0.0f });
+		writeLine(out, origin, TMath::TransformPoint(transform, { size, 0.0f, 0.0f }), 0xff0000ff);
+		writeLine(out + 2, origin, TMath::TransformPoint(transform, { 0.0f, size, 0.0f }), 0xff00ff00);
+		writeLine(out + 4, origin, TMath::TransformPoint(transform, { 0.0f, 0.0f, size }), 0xffff0000);
+	}
+
+	void DebugDraw::BeginFrame(DebugVertex* vertices) {
+		_vertices = vertices;
+		_counts[0].store(0, std::memory_order_relaxed);
+		_counts[1].store(0, std::memory_order_relaxed);
+	}
+
+	void DebugDraw::EndFrame(U32* outDepthTestedCount, U32* outOverlayCount) {
+		const U32 depthTested = _counts[0].exchange(DEBUG_DRAW_HALF, std::memory_order_relaxed);
+		const U32 overlay = _counts[1].exchange(DEBUG_DRAW_HALF, std::memory_order_relaxed);
+		*outDepthTestedCount = depthTested < DEBUG_DRAW_HALF ? depthTested : DEBUG_DRAW_HALF;
+		*outOverlayCount = overlay < DEBUG_DRAW_HALF ? overlay : DEBUG_DRAW_HALF;
+	}
+}
+
+#endif
\ No newline at end of file
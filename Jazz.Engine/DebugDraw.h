@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Types.h"
+#include "TMath.h"
+
+// Debug drawing is compiled into debug builds only, define JAZZ_DEBUG_DRAW to keep it in others. Compiled out, every
+// call below is an empty inline function.
+#if defined(_DEBUG) && !defined(JAZZ_DEBUG_DRAW)
+#define JAZZ_DEBUG_DRAW
+#endif
+
+#ifdef JAZZ_DEBUG_DRAW
+#define DEBUG_DRAW_STUB ;
+#else
+#define DEBUG_DRAW_STUB {}
+#endif
+
+// Line vertices of one frame, the first half of the ring is depth tested and the second half drawn on top
+#define DEBUG_DRAW_MAX_VERTICES (1 << 18)
+
+namespace Jazz {
+
+	struct DebugVertex {
+		Vec3 Position; // World space
+		U32 Color; // RGBA8 with R in the lowest byte
+	};
+
+	// Immediate mode world space lines for the current frame. Safe to call from any thread: each shape reserves its
+	// vertices with one atomic add and writes them straight into the frame's upload ring. Calls must not overlap
+	// VulkanRenderer::drawFrame(), which hands the lines of the frame to the GPU. Shapes that no longer fit are dropped.
+	class DebugDraw {
+	public:
+		static void SetEnabled(bool enabled) DEBUG_DRAW_STUB
+
+		static void DrawLine(const Vec3& from, const Vec3& to, U32 color, bool depthTested = true) DEBUG_DRAW_STUB
+		static void DrawBox(const Vec3& min, const Vec3& max, U32 color, bool depthTested = true) DEBUG_DRAW_STUB
+
+		// The box from -halfExtents to halfExtents, transformed
+		static void DrawBox(const Mat4& transform, const Vec3& halfExtents, U32 color, bool depthTested = true) DEBUG_DRAW_STUB
+
+		// A circle around each axis
+		static void DrawSphere(const Vec3& center, F32 radius, U32 color, bool depthTested = true) DEBUG_DRAW_STUB
+
+		// The edges between the corners where the planes meet, the far plane must be finite
+		static void DrawFrustum(const Frustum& frustum, U32 color, bool depthTested = true) DEBUG_DRAW_STUB
+
+		// The transform's X, Y and Z axes in red, green and blue
+		static void DrawAxes(const Mat4& transform, F32 size, bool depthTested = false) DEBUG_DRAW_STUB
+
+#ifdef JAZZ_DEBUG_DRAW
+		// Renderer side. Vertices are written from here on into a buffer of DEBUG_DRAW_MAX_VERTICES no frame in flight reads.
+		static void BeginFrame(DebugVertex* vertices);
+
+		// Vertex counts of the two halves since BeginFrame(), further lines are dropped until the next BeginFrame()
+		static void EndFrame(U32* outDepthTestedCount, U32* outOverlayCount);
+#endif
+	};
+}
\ No newline at end of file
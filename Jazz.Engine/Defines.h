@@ -28,11 +28,28 @@
 #else
 #define JAZZ_API __declspec(dllimport)
 #endif // PLATFORM_WINDOWS
-#elif PLATFORM_LINUX || PLATFORM_MAC
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
 #define FORCEINLINE inline
 // TODO: Define JAZZ_API for these platforms
 #endif
 
+// Lets a single function use a wider instruction set than the rest of the build.
+// Callers must check Simd::GetSupportedLevel() before calling into them.
+// Separate multiply and add intrinsics are not fused, so they round like the scalar code, as they do with MSVC.
+#if _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1"), optimize("fp-contract=off")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma,f16c"), optimize("fp-contract=off")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512dq"), optimize("fp-contract=off")))
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define ARCH_X64
+#endif
+
 // Assertions
 #define ASSERTIONS_ENABLED
 #ifdef ASSERTIONS_ENABLED
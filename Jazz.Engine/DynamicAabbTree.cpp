@@ -0,0 +1,638 @@
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+#include "Logger.h"
+#include "Benchmark.h"
+#include "DynamicAabbTree.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+namespace Jazz {
+
+	static Aabb combine(const Aabb& a, const Aabb& b) {
+		return {
+			{ fminf(a.Min.X, b.Min.X), fminf(a.Min.Y, b.Min.Y), fminf(a.Min.Z, b.Min.Z) },
+			{ fmaxf(a.Max.X, b.Max.X), fmaxf(a.Max.Y, b.Max.Y), fmaxf(a.Max.Z, b.Max.Z) }
+		};
+	}
+
+	static F32 surfaceArea(const Aabb& box) {
+		F32 x = box.Max.X - box.Min.X;
+		F32 y = box.Max.Y - box.Min.Y;
+		F32 z = box.Max.Z - box.Min.Z;
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	static bool contains(const Aabb& outer, const Aabb& inner) {
+		return outer.Min.X <= inner.Min.X && outer.Min.Y <= inner.Min.Y && outer.Min.Z <= inner.Min.Z &&
+			outer.Max.X >= inner.Max.X && outer.Max.Y >= inner.Max.Y && outer.Max.Z >= inner.Max.Z;
+	}
+
+	static Aabb fatten(const Aabb& box, const Vec3& displacement) {
+		Vec3 margin = TMath::Scale(TMath::Subtract(box.Max, box.Min), AABB_TREE_FAT_MARGIN);
+		Aabb fat = { TMath::Subtract(box.Min, margin), TMath::Add(box.Max, margin) };
+
+		// Twice the expected move, so the next one or two frames stay inside
+		fat.Min.X += fminf(2.0f * displacement.X, 0.0f);
+		fat.Min.Y += fminf(2.0f * displacement.Y, 0.0f);
+		fat.Min.Z += fminf(2.0f * displacement.Z, 0.0f);
+		fat.Max.X += fmaxf(2.0f * displacement.X, 0.0f);
+		fat.Max.Y += fmaxf(2.0f * displacement.Y, 0.0f);
+		fat.Max.Z += fmaxf(2.0f * displacement.Z, 0.0f);
+		return fat;
+	}
+
+	DynamicAabbTree::DynamicAabbTree() {
+		_root = U32_MAX;
+		_freeList = U32_MAX;
+		_proxyCount = 0;
+	}
+
+	U32 DynamicAabbTree::CreateProxy(const Aabb& box, U32 userData) {
+		U32 proxy = allocateNode();
+		AabbTreeNode& node = _nodes[proxy];
+		node.Box = fatten(box, { 0.0f, 0.0f, 0.0f });
+		node.UserData = userData;
+		node.Height = 0;
+		insertLeaf(proxy);
+		_proxyCount++;
+		return proxy;
+	}
+
+	void DynamicAabbTree::DestroyProxy(U32 proxy) {
+		removeLeaf(proxy);
+		freeNode(proxy);
+		_proxyCount--;
+	}
+
+	const bool DynamicAabbTree::MoveProxy(U32 proxy, const Aabb& box, const Vec3& displacement) {
+		if (contains(_nodes[proxy].Box, box)) {
+			return false;
+		}
+
+		removeLeaf(proxy);
+		_nodes[proxy].Box = fatten(box, displacement);
+		insertLeaf(proxy);
+		return true;
+	}
+
+	U32 DynamicAabbTree::allocateNode() {
+		U32 node;
+		if (_freeList != U32_MAX) {
+			node = _freeList;
+			_freeList = _nodes[node].Parent;
+		} else {
+			node = (U32)_nodes.size();
+			_nodes.push_back({});
+		}
+
+		AabbTreeNode& treeNode = _nodes[node];
+		treeNode.Parent = U32_MAX;
+		treeNode.Children[0] = U32_MAX;
+		treeNode.Children[1] = U32_MAX;
+		treeNode.Height = 0;
+		treeNode.UserData = U32_MAX;
+		return node;
+	}
+
+	void DynamicAabbTree::freeNode(U32 node) {
+		_nodes[node].Parent = _freeList;
+		_nodes[node].Height = U32_MAX;
+		_freeList = node;
+	}
+
+	void DynamicAabbTree::insertLeaf(U32 leaf) {
+		if (_root == U32_MAX) {
+			_root = leaf;
+			_nodes[leaf].Parent = U32_MAX;
+			return;
+		}
+
+		// Walk down while pushing the leaf into a child is cheaper than making it a sibling here. Every node above the
+		// new one grows to cover the leaf, which is the inherited cost.
+		Aabb leafBox = _nodes[leaf].Box;
+		U32 index = _root;
+		while (_nodes[index].Children[0] != U32_MAX) {
+			const AabbTreeNode& node = _nodes[index];
+			F32 area = surfaceArea(node.Box);
+			F32 combinedArea = surfaceArea(combine(node.Box, leafBox));
+			F32 cost = 2.0f * combinedArea;
+			F32 inheritanceCost = 2.0f * (combinedArea - area);
+
+			F32 childCosts[2];
+			for (U32 c = 0; c < 2; ++c) {
+				const AabbTreeNode& child = _nodes[node.Children[c]];
+				F32 childArea = surfaceArea(combine(leafBox, child.Box));
+				childCosts[c] = (child.Children[0] == U32_MAX ? childArea : childArea - surfaceArea(child.Box)) + inheritanceCost;
+			}
+
+			if (cost < childCosts[0] && cost < childCosts[1]) {
+				break;
+			}
+			index = childCosts[0] < childCosts[1] ? node.Children[0] : node.Children[1];
+		}
+
+		U32 sibling = index;
+		U32 oldParent = _nodes[sibling].Parent;
+		U32 newParent = allocateNode();
+		AabbTreeNode& parentNode = _nodes[newParent];
+		parentNode.Parent = oldParent;
+		parentNode.Box = combine(leafBox, _nodes[sibling].Box);
+		parentNode.Height = _nodes[sibling].Height + 1;
+		parentNode.Children[0] = sibling;
+		parentNode.Children[1] = leaf;
+		_nodes[sibling].Parent = newParent;
+		_nodes[leaf].Parent = newParent;
+
+		if (oldParent != U32_MAX) {
+			U32* children = _nodes[oldParent].Children;
+			children[children[0] == sibling ? 0 : 1] = newParent;
+		} else {
+			_root = newParent;
+		}
+
+		// Refit and rebalance on the way back up
+		for (index = _nodes[leaf].Parent; index != U32_MAX; index = _nodes[index].Parent) {
+			index = balance(index);
+			AabbTreeNode& node = _nodes[index];
+			const AabbTreeNode& child0 = _nodes[node.Children[0]];
+			const AabbTreeNode& child1 = _nodes[node.Children[1]];
+			node.Height = 1 + std::max(child0.Height, child1.Height);
+			node.Box = combine(child0.Box, child1.Box);
+		}
+	}
+
+	void DynamicAabbTree::removeLeaf(U32 leaf) {
+		if (leaf == _root) {
+			_root = U32_MAX;
+			return;
+		}
+
+		// The sibling takes the parent's place
+		U32 parent = _nodes[leaf].Parent;
+		U32 grandParent = _nodes[parent].Parent;
+		U32 sibling = _nodes[parent].Children[0] == leaf ? _nodes[parent].Children[1] : _nodes[parent].Children[0];
+		freeNode(parent);
+
+		if (grandParent == U32_MAX) {
+			_root = sibling;
+			_nodes[sibling].Parent = U32_MAX;
+			return;
+		}
+
+		U32* children = _nodes[grandParent].Children;
+		children[children[0] == parent ? 0 : 1] = sibling;
+		_nodes[sibling].Parent = grandParent;
+
+		for (U32 index = grandParent; index != U32_MAX; index = _nodes[index].Parent) {
+			index = balance(index);
+			AabbTreeNode& node = _nodes[index];
+			const AabbTreeNode& child0 = _nodes[node.Children[0]];
+			const AabbTreeNode& child1 = _nodes[node.Children[1]];
+			node.Height = 1 + std::max(child0.Height, child1.Height);
+			node.Box = combine(child0.Box, child1.Box);
+		}
+	}
+
+	// Rotates the taller child up when the heights of a's children differ by more than one. Returns the subtree's new root.
+	U32 DynamicAabbTree::balance(U32 a) {
+		AabbTreeNode& nodeA = _nodes[a];
+		if (nodeA.Children[0] == U32_MAX || nodeA.Height < 2) {
+			return a;
+		}
+
+		U32 b = nodeA.Children[0];
+		U32 c = nodeA.Children[1];
+		I32 difference = (I32)_nodes[c].Height - (I32)_nodes[b].Height;
+		if (difference >= -1 && difference <= 1) {
+			return a;
+		}
+
+		// up is the taller child, stay the shorter one. up's taller child stays with it, the other moves to a.
+		U32 up = difference > 1 ? c : b;
+		U32 stay = difference > 1 ? b : c;
+		U32 upSide = difference > 1 ? 1 : 0;
+		AabbTreeNode& nodeUp = _nodes[up];
+		U32 f = nodeUp.Children[0];
+		U32 g = nodeUp.Children[1];
+
+		nodeUp.Children[0] = a;
+		nodeUp.Parent = nodeA.Parent;
+		nodeA.Parent = up;
+		if (nodeUp.Parent != U32_MAX) {
+			U32* children = _nodes[nodeUp.Parent].Children;
+			children[children[0] == a ? 0 : 1] = up;
+		} else {
+			_root = up;
+		}
+
+		U32 keep = _nodes[f].Height > _nodes[g].Height ? f : g;
+		U32 give = keep == f ? g : f;
+		nodeUp.Children[1] = keep;
+		nodeA.Children[upSide] = give;
+		_nodes[give].Parent = a;
+
+		nodeA.Box = combine(_nodes[stay].Box, _nodes[give].Box);
+		nodeA.Height = 1 + std::max(_nodes[stay].Height, _nodes[give].Height);
+		nodeUp.Box = combine(nodeA.Box, _nodes[keep].Box);
+		nodeUp.Height = 1 + std::max(nodeA.Height, _nodes[keep].Height);
+		return up;
+	}
+
+	// The six planes as structure of arrays in two SSE registers each, padded with planes nothing is ever outside of
+	struct FrustumPlanesSoA {
+		F32 X[8];
+		F32 Y[8];
+		F32 Z[8];
+		F32 W[8];
+	};
+
+	enum class FrustumOverlap {
+		Outside,
+		Intersecting,
+		Inside
+	};
+
+	static FrustumPlanesSoA transposePlanes(const Frustum& frustum) {
+		FrustumPlanesSoA planes = {};
+		for (U32 p = 0; p < 8; ++p) {
+			planes.W[p] = 1e30f;
+		}
+		for (U32 p = 0; p < 6; ++p) {
+			planes.X[p] = frustum.Planes[p].X;
+			planes.Y[p] = frustum.Planes[p].Y;
+			planes.Z[p] = frustum.Planes[p].Z;
+			planes.W[p] = frustum.Planes[p].W;
+		}
+		return planes;
+	}
+
+	// Center distance against the box's projected radius for every plane at once
+	static FrustumOverlap testFrustum(const FrustumPlanesSoA& planes, const Aabb& box) {
+		F32 cx = (box.Min.X + box.Max.X) * 0.5f;
+		F32 cy = (box.Min.Y + box.Max.Y) * 0.5f;
+		F32 cz = (box.Min.Z + box.Max.Z) * 0.5f;
+		F32 ex = (box.Max.X - box.Min.X) * 0.5f;
+		F32 ey = (box.Max.Y - box.Min.Y) * 0.5f;
+		F32 ez = (box.Max.Z - box.Min.Z) * 0.5f;
+
+#ifdef ARCH_X64
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 centerX = _mm_set1_ps(cx), centerY = _mm_set1_ps(cy), centerZ = _mm_set1_ps(cz);
+		__m128 extentX = _mm_set1_ps(ex), extentY = _mm_set1_ps(ey), extentZ = _mm_set1_ps(ez);
+		__m128 outside = _mm_setzero_ps();
+		__m128 intersecting = _mm_setzero_ps();
+		for (U32 p = 0; p < 8; p += 4) {
+			__m128 x = _mm_loadu_ps(planes.X + p);
+			__m128 y = _mm_loadu_ps(planes.Y + p);
+			__m128 z = _mm_loadu_ps(planes.Z + p);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, centerX), _mm_mul_ps(y, centerY)), _mm_add_ps(_mm_mul_ps(z, centerZ), _mm_loadu_ps(planes.W + p)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, x), extentX), _mm_mul_ps(_mm_andnot_ps(signMask, y), extentY)),
+				_mm_mul_ps(_mm_andnot_ps(signMask, z), extentZ));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+		}
+		if (_mm_movemask_ps(outside)) {
+			return FrustumOverlap::Outside;
+		}
+		return _mm_movemask_ps(intersecting) ? FrustumOverlap::Intersecting : FrustumOverlap::Inside;
+#else
+		bool intersecting = false;
+		for (U32 p = 0; p < 6; ++p) {
+			F32 distance = planes.X[p] * cx + planes.Y[p] * cy + planes.Z[p] * cz + planes.W[p];
+			F32 radius = fabsf(planes.X[p]) * ex + fabsf(planes.Y[p]) * ey + fabsf(planes.Z[p]) * ez;
+			if (distance + radius < 0.0f) {
+				return FrustumOverlap::Outside;
+			}
+			intersecting |= distance - radius < 0.0f;
+		}
+		return intersecting ? FrustumOverlap::Intersecting : FrustumOverlap::Inside;
+#endif
+	}
+
+	struct RaySetup {
+		F32 Origin[3];
+		F32 InverseDirection[3];
+	};
+
+	static RaySetup setupRay(const Vec3& origin, const Vec3& direction) {
+		// Axis parallel rays get a huge but finite inverse so the slabs never produce 0 * inf
+		RaySetup ray;
+		const F32 d[3] = { direction.X, direction.Y, direction.Z };
+		ray.Origin[0] = origin.X;
+		ray.Origin[1] = origin.Y;
+		ray.Origin[2] = origin.Z;
+		for (U32 axis = 0; axis < 3; ++axis) {
+			ray.InverseDirection[axis] = 1.0f / (fabsf(d[axis]) > 1e-30f ? d[axis] : copysignf(1e-30f, d[axis]));
+		}
+		return ray;
+	}
+
+	// Slab test, returns the entry distance or a negative value for a miss within maxDistance
+	static F32 intersectRay(const RaySetup& ray, const Aabb& box, F32 maxDistance) {
+#ifdef ARCH_X64
+		// The last lane repeats Z so it never decides anything
+		__m128 origin = _mm_setr_ps(ray.Origin[0], ray.Origin[1], ray.Origin[2], ray.Origin[2]);
+		__m128 inverse = _mm_setr_ps(ray.InverseDirection[0], ray.InverseDirection[1], ray.InverseDirection[2], ray.InverseDirection[2]);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.Min.X, box.Min.Y, box.Min.Z, box.Min.Z), origin), inverse);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.Max.X, box.Max.Y, box.Max.Z, box.Max.Z), origin), inverse);
+		__m128 nearT = _mm_min_ps(t1, t2);
+		__m128 farT = _mm_max_ps(t1, t2);
+		nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(2, 3, 0, 1)));
+		nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(1, 0, 3, 2)));
+		farT = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(2, 3, 0, 1)));
+		farT = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(1, 0, 3, 2)));
+		F32 entry = _mm_cvtss_f32(nearT);
+		F32 exit = _mm_cvtss_f32(farT);
+#else
+		const F32 boxMin[3] = { box.Min.X, box.Min.Y, box.Min.Z };
+		const F32 boxMax[3] = { box.Max.X, box.Max.Y, box.Max.Z };
+		F32 entry = -INFINITY;
+		F32 exit = INFINITY;
+		for (U32 axis = 0; axis < 3; ++axis) {
+			F32 t1 = (boxMin[axis] - ray.Origin[axis]) * ray.InverseDirection[axis];
+			F32 t2 = (boxMax[axis] - ray.Origin[axis]) * ray.InverseDirection[axis];
+			entry = fmaxf(entry, fminf(t1, t2));
+			exit = fminf(exit, fmaxf(t1, t2));
+		}
+#endif
+		entry = fmaxf(entry, 0.0f);
+		return entry <= exit && entry <= maxDistance ? entry : -1.0f;
+	}
+
+	static F32 pointDistanceSquared(const Vec3& point, const Aabb& box) {
+#ifdef ARCH_X64
+		__m128 p = _mm_setr_ps(point.X, point.Y, point.Z, point.Z);
+		__m128 below = _mm_sub_ps(_mm_setr_ps(box.Min.X, box.Min.Y, box.Min.Z, box.Min.Z), p);
+		__m128 above = _mm_sub_ps(p, _mm_setr_ps(box.Max.X, box.Max.Y, box.Max.Z, box.Max.Z));
+		__m128 d = _mm_max_ps(_mm_max_ps(below, above), _mm_setzero_ps());
+		d = _mm_mul_ps(d, d);
+		F32 lanes[4];
+		_mm_storeu_ps(lanes, d);
+		return lanes[0] + lanes[1] + lanes[2];
+#else
+		F32 dx = fmaxf(fmaxf(box.Min.X - point.X, point.X - box.Max.X), 0.0f);
+		F32 dy = fmaxf(fmaxf(box.Min.Y - point.Y, point.Y - box.Max.Y), 0.0f);
+		F32 dz = fmaxf(fmaxf(box.Min.Z - point.Z, point.Z - box.Max.Z), 0.0f);
+		return dx * dx + dy * dy + dz * dz;
+#endif
+	}
+
+	U32 DynamicAabbTree::QueryFrustum(const Frustum& frustum, U32* outUserData) const {
+		if (_root == U32_MAX) {
+			return 0;
+		}
+
+		// The top bit marks subtrees already known to be inside
+		const U32 insideBit = 0x80000000u;
+		FrustumPlanesSoA planes = transposePlanes(frustum);
+		std::vector<U32>& stack = _stack;
+		stack.clear();
+		stack.push_back(_root);
+
+		U32 count = 0;
+		while (!stack.empty()) {
+			U32 entry = stack.back();
+			stack.pop_back();
+			const AabbTreeNode& node = _nodes[entry & ~insideBit];
+
+			bool inside = (entry & insideBit) != 0;
+			if (!inside) {
+				FrustumOverlap overlap = testFrustum(planes, node.Box);
+				if (overlap == FrustumOverlap::Outside) {
+					continue;
+				}
+				inside = overlap == FrustumOverlap::Inside;
+			}
+
+			if (node.Children[0] == U32_MAX) {
+				outUserData[count++] = node.UserData;
+			} else {
+				stack.push_back(node.Children[0] | (inside ? insideBit : 0));
+				stack.push_back(node.Children[1] | (inside ? insideBit : 0));
+			}
+		}
+		return count;
+	}
+
+	U32 DynamicAabbTree::RayCast(const Vec3& origin, const Vec3& direction, F32 maxDistance, F32* outDistance,
+		const std::function<F32(U32 userData)>& hit) const {
+		U32 result = U32_MAX;
+		if (_root == U32_MAX) {
+			return result;
+		}
+
+		RaySetup ray = setupRay(origin, direction);
+		F32 closest = maxDistance;
+		std::vector<U32>& stack = _stack;
+		stack.clear();
+		if (intersectRay(ray, _nodes[_root].Box, closest) >= 0.0f) {
+			stack.push_back(_root);
+		}
+
+		while (!stack.empty()) {
+			const AabbTreeNode& node = _nodes[stack.back()];
+			stack.pop_back();
+
+			if (node.Children[0] == U32_MAX) {
+				F32 distance = hit ? hit(node.UserData) : intersectRay(ray, node.Box, closest);
+				if (distance >= 0.0f && distance <= closest) {
+					closest = distance;
+					result = node.UserData;
+				}
+				continue;
+			}
+
+			// Nearer child on top of the stack, so later hits get clipped by it
+			F32 distance0 = intersectRay(ray, _nodes[node.Children[0]].Box, closest);
+			F32 distance1 = intersectRay(ray, _nodes[node.Children[1]].Box, closest);
+			bool firstNearer = distance0 >= 0.0f && (distance1 < 0.0f || distance0 <= distance1);
+			U32 nearChild = firstNearer ? node.Children[0] : node.Children[1];
+			U32 farChild = firstNearer ? node.Children[1] : node.Children[0];
+			F32 nearDistance = firstNearer ? distance0 : distance1;
+			F32 farDistance = firstNearer ? distance1 : distance0;
+			if (farDistance >= 0.0f) {
+				stack.push_back(farChild);
+			}
+			if (nearDistance >= 0.0f) {
+				stack.push_back(nearChild);
+			}
+		}
+
+		if (outDistance && result != U32_MAX) {
+			*outDistance = closest;
+		}
+		return result;
+	}
+
+	U32 DynamicAabbTree::QueryNearest(const Vec3& point, F32 maxDistance, F32* outDistance, const std::function<F32(U32 userData)>& distance) const {
+		U32 result = U32_MAX;
+		if (_root == U32_MAX) {
+			return result;
+		}
+
+		// Best first, closest boxes come off the heap first and the search ends at the first box beyond the best hit
+		typedef std::pair<F32, U32> Candidate;
+		std::vector<Candidate>& heap = _heap;
+		heap.clear();
+		F32 closestSquared = maxDistance * maxDistance;
+		heap.push_back({ pointDistanceSquared(point, _nodes[_root].Box), _root });
+
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+			Candidate candidate = heap.back();
+			heap.pop_back();
+			if (candidate.first > closestSquared) {
+				break;
+			}
+
+			const AabbTreeNode& node = _nodes[candidate.second];
+			if (node.Children[0] == U32_MAX) {
+				F32 leafDistance = distance ? distance(node.UserData) : sqrtf(candidate.first);
+				if (leafDistance * leafDistance <= closestSquared) {
+					closestSquared = leafDistance * leafDistance;
+					result = node.UserData;
+				}
+				continue;
+			}
+
+			for (U32 c = 0; c < 2; ++c) {
+				F32 childDistance = pointDistanceSquared(point, _nodes[node.Children[c]].Box);
+				if (childDistance <= closestSquared) {
+					heap.push_back({ childDistance, node.Children[c] });
+					std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+				}
+			}
+		}
+
+		if (outDistance && result != U32_MAX) {
+			*outDistance = sqrtf(closestSquared);
+		}
+		return result;
+	}
+
+	const bool DynamicAabbTree::RunBenchmark() {
+		const U32 boxCounts[] = { 10000, 100000, 1000000 };
+		const U32 queryCount = 200;
+
+		// A camera seeing a tenth of the world, where the output is linear in the box count anyway, and one seeing
+		// a ten thousandth of it like a shadow cascade, where the tree should pull away from the scan as boxes are added
+		Mat4 view = TMath::LookAt({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f });
+		const U32 frustumCount = 2;
+		const char* frustumNames[frustumCount] = { "Frustum, far 1000", "Frustum, far 100" };
+		const F32 frustumFars[frustumCount] = { 1000.0f, 100.0f };
+
+		Logger::Log("Dynamic AABB tree benchmark, tree against linear scans");
+		bool passed = true;
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<F32> position(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<F32> size(0.5f, 5.0f);
+		std::uniform_real_distribution<F32> direction(-1.0f, 1.0f);
+		std::uniform_real_distribution<F32> step(-0.5f, 0.5f);
+
+		for (U32 boxCount : boxCounts) {
+			std::vector<Aabb> boxes(boxCount);
+			std::vector<U32> proxies(boxCount);
+			DynamicAabbTree tree;
+			F64 buildTime = Benchmark::Time(1, [&](U32) {
+				for (U32 i = 0; i < boxCount; ++i) {
+					Vec3 center = { position(random), position(random), position(random) };
+					F32 halfSize = size(random);
+					boxes[i] = { TMath::Subtract(center, { halfSize, halfSize, halfSize }), TMath::Add(center, { halfSize, halfSize, halfSize }) };
+					proxies[i] = tree.CreateProxy(boxes[i], i);
+				}
+			});
+			Logger::Log("%d boxes, built in %.3f ms, height %d", boxCount, buildTime, tree.GetHeight());
+
+			std::vector<U32> visible(boxCount);
+			F64 treeTime = 0.0;
+			F64 linearTime = 0.0;
+			for (U32 f = 0; f < frustumCount; ++f) {
+				Frustum frustum = TMath::ExtractFrustum(TMath::Multiply(TMath::Perspective(1.0f, 16.0f / 9.0f, 0.1f, frustumFars[f]), view));
+				FrustumPlanesSoA planes = transposePlanes(frustum);
+				U32 treeVisible = 0;
+				U32 linearVisible = 0;
+				treeTime = Benchmark::Time(20, [&](U32) { treeVisible = tree.QueryFrustum(frustum, visible.data()); });
+				linearTime = Benchmark::Time(20, [&](U32) {
+					linearVisible = 0;
+					for (U32 i = 0; i < boxCount; ++i) {
+						linearVisible += testFrustum(planes, boxes[i]) != FrustumOverlap::Outside ? 1 : 0;
+					}
+				});
+				Logger::Log("  %-24s %9.3f ms %9.3f ms %7.2fx, %d visible (%d with fattened boxes)", frustumNames[f], linearTime, treeTime,
+					linearTime / treeTime, linearVisible, treeVisible);
+
+				// Fattened boxes can only add to what the exact boxes touch
+				passed &= Benchmark::Check(treeVisible >= linearVisible, "%s found %d boxes in the tree, %d in the scan", frustumNames[f],
+					treeVisible, linearVisible);
+			}
+
+			// Exact refinement against the real boxes, so both sides must agree
+			std::vector<Vec3> origins(queryCount);
+			std::vector<Vec3> directions(queryCount);
+			for (U32 i = 0; i < queryCount; ++i) {
+				origins[i] = { position(random), position(random), position(random) };
+				directions[i] = TMath::Normalize({ direction(random), direction(random), direction(random) });
+			}
+
+			U32 mismatches = 0;
+			std::vector<U32> treeHits(queryCount);
+			treeTime = Benchmark::Time(queryCount, [&](U32 q) {
+				RaySetup ray = setupRay(origins[q], directions[q]);
+				treeHits[q] = tree.RayCast(origins[q], directions[q], 2000.0f, nullptr, [&](U32 box) { return intersectRay(ray, boxes[box], 2000.0f); });
+			});
+			linearTime = Benchmark::Time(queryCount, [&](U32 q) {
+				RaySetup ray = setupRay(origins[q], directions[q]);
+				U32 closestBox = U32_MAX;
+				F32 closest = 2000.0f;
+				for (U32 i = 0; i < boxCount; ++i) {
+					F32 distance = intersectRay(ray, boxes[i], closest);
+					if (distance >= 0.0f && distance <= closest) {
+						closest = distance;
+						closestBox = i;
+					}
+				}
+				mismatches += closestBox != treeHits[q] ? 1 : 0;
+			});
+			Logger::Log("  %-24s %9.3f ms %9.3f ms %7.2fx", "Ray cast", linearTime, treeTime, linearTime / treeTime);
+			passed &= Benchmark::Check(mismatches == 0, "%d of %d ray casts hit another box than the scan", mismatches, queryCount);
+
+			mismatches = 0;
+			treeTime = Benchmark::Time(queryCount, [&](U32 q) {
+				treeHits[q] = tree.QueryNearest(origins[q], 1e30f, nullptr, [&](U32 box) { return sqrtf(pointDistanceSquared(origins[q], boxes[box])); });
+			});
+			linearTime = Benchmark::Time(queryCount, [&](U32 q) {
+				U32 closestBox = U32_MAX;
+				F32 closest = 1e30f;
+				for (U32 i = 0; i < boxCount; ++i) {
+					F32 distance = pointDistanceSquared(origins[q], boxes[i]);
+					if (distance < closest) {
+						closest = distance;
+						closestBox = i;
+					}
+				}
+				mismatches += closestBox != treeHits[q] ? 1 : 0;
+			});
+			Logger::Log("  %-24s %9.3f ms %9.3f ms %7.2fx", "Nearest", linearTime, treeTime, linearTime / treeTime);
+			passed &= Benchmark::Check(mismatches == 0, "%d of %d nearest queries found another box than the scan", mismatches, queryCount);
+
+			// One percent of the boxes drift a little each frame
+			U32 moveCount = boxCount / 100;
+			U32 reinserted = 0;
+			treeTime = Benchmark::Time(10, [&](U32) {
+				for (U32 i = 0; i < moveCount; ++i) {
+					U32 box = (i * 7919) % boxCount;
+					Vec3 displacement = { step(random), step(random), step(random) };
+					boxes[box] = { TMath::Add(boxes[box].Min, displacement), TMath::Add(boxes[box].Max, displacement) };
+					reinserted += tree.MoveProxy(proxies[box], boxes[box], displacement) ? 1 : 0;
+				}
+			});
+			Logger::Log("  %-24s %9.3f ms for %d moves, %d%% reinserted", "Move", treeTime, moveCount, reinserted * 10 / (moveCount > 0 ? moveCount : 1));
+		}
+		return passed;
+	}
+}
\ No newline at end of file
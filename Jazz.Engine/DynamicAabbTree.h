@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "Defines.h"
+#include "TMath.h"
+
+// Leaves are enlarged by this share of their size so small movements don't touch the tree
+#define AABB_TREE_FAT_MARGIN 0.1f
+
+namespace Jazz {
+
+	struct Aabb {
+		Vec3 Min;
+		Vec3 Max;
+	};
+
+	struct AabbTreeNode {
+		Aabb Box; // Fattened for leaves
+		U32 Parent; // Next free node while unused
+		U32 Children[2]; // U32_MAX for leaves
+		U32 Height; // 0 for leaves, U32_MAX while unused
+		U32 UserData;
+	};
+
+	// Bounding volume hierarchy over moving boxes (Box2D's dynamic tree in 3D). Leaves are inserted next to the sibling
+	// that grows the total surface area least and AVL style rotations keep the tree balanced, so a move is a removal and
+	// reinsertion in logarithmic time, and only for objects that left their fattened box. Node tests use SSE.
+	// Queries share one traversal stack kept by the tree, so a tree must not be queried from several threads at once.
+	class DynamicAabbTree {
+	public:
+		DynamicAabbTree();
+
+		// Returns the proxy, a stable node index
+		U32 CreateProxy(const Aabb& box, U32 userData);
+		void DestroyProxy(U32 proxy);
+
+		// displacement predicts the next move and stretches the fattened box along it. Returns true if the tree changed.
+		const bool MoveProxy(U32 proxy, const Aabb& box, const Vec3& displacement = { 0.0f, 0.0f, 0.0f });
+
+		U32 GetUserData(U32 proxy) const { return _nodes[proxy].UserData; }
+		const Aabb& GetFatBox(U32 proxy) const { return _nodes[proxy].Box; }
+		U32 GetProxyCount() const { return _proxyCount; }
+		U32 GetHeight() const { return _root == U32_MAX ? 0 : _nodes[_root].Height; }
+
+		// Writes the user data of every proxy whose fattened box touches the frustum, outUserData needs room for
+		// GetProxyCount() entries. Subtrees entirely inside are taken without further tests. Returns the count.
+		U32 QueryFrustum(const Frustum& frustum, U32* outUserData) const;
+
+		// Nearest proxy along the ray within maxDistance, or U32_MAX. hit refines a candidate to the distance of the
+		// actual object, negative for a miss; without it the fattened box is the object.
+		U32 RayCast(const Vec3& origin, const Vec3& direction, F32 maxDistance, F32* outDistance = nullptr,
+			const std::function<F32(U32 userData)>& hit = nullptr) const;
+
+		// Nearest proxy to point within maxDistance, or U32_MAX. distance refines a candidate like hit does for rays
+		// and must never be less than the distance to its box.
+		U32 QueryNearest(const Vec3& point, F32 maxDistance, F32* outDistance = nullptr,
+			const std::function<F32(U32 userData)>& distance = nullptr) const;
+
+		// Frustum, ray and nearest queries plus scattered moves against linear scans at 10k, 100k and 1M boxes. Fails
+		// when a query disagrees with its scan.
+		static const bool RunBenchmark();
+	private:
+		U32 allocateNode();
+		void freeNode(U32 node);
+		void insertLeaf(U32 leaf);
+		void removeLeaf(U32 leaf);
+		U32 balance(U32 node);
+	private:
+		std::vector<AabbTreeNode> _nodes;
+		U32 _root;
+		U32 _freeList;
+		U32 _proxyCount;
+
+		// Traversal state reused by the queries so they don't allocate
+		mutable std::vector<U32> _stack;
+		mutable std::vector<std::pair<F32, U32>> _heap;
+	};
+}
\ No newline at end of file
@@ -2,18 +2,27 @@
 #include "Platform.h"
 #include "VulkanRenderer.h"
 #include "Logger.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+#include "EntityWorld.h"
 
 namespace Jazz {
 
 	Engine::Engine(const char* applicationName) {
 		Jazz::Logger::Log("Initializing Jazz Engine: %d", 4);
+		JobSystem::Initialize();
 		_platform = new Platform(this, applicationName);
 		_renderer = new VulkanRenderer(_platform);
+		_transforms = new TransformHierarchy();
+		_world = new EntityWorld();
 	}
 
 	Engine::~Engine() {
+		delete _world;
+		delete _transforms;
 		delete _renderer;
 		delete _platform;
+		JobSystem::Shutdown();
 	}
 
 	void Engine::Run() {
@@ -21,6 +30,9 @@ namespace Jazz {
 	}
 
 	void Engine::OnLoop(const F32 deltaTime) {
+		_world->RunSystems(deltaTime);
+		_transforms->Update();
+		_renderer->updateParticles(deltaTime);
 		_renderer->drawFrame();
 	}
 
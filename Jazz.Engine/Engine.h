@@ -6,6 +6,8 @@ namespace Jazz {
 	
 	class Platform;
 	class VulkanRenderer;
+	class TransformHierarchy;
+	class EntityWorld;
 
 	class Engine {
 	public:
@@ -17,8 +19,13 @@ namespace Jazz {
 		void OnLoop(const F32 deltaTime);
 
 		void DeviceWaitIdle();
+
+		TransformHierarchy* GetTransforms() { return _transforms; }
+		EntityWorld* GetWorld() { return _world; }
 	private:
 		Platform* _platform;
 		VulkanRenderer* _renderer;
+		TransformHierarchy* _transforms;
+		EntityWorld* _world;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string.h>
+
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "EntityWorld.h"
+
+// Chunks per parallel batch
+#define ECS_CHUNKS_PER_BATCH 4
+
+namespace Jazz {
+
+	static FORCEINLINE U32 lowestComponent(ComponentMask mask) {
+#if _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return (U32)index;
+#else
+		return (U32)__builtin_ctzll(mask);
+#endif
+	}
+
+	static U32 alignOffset(U32 offset, U32 alignment) {
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	EntityWorld::EntityWorld() {
+		_entityCount = 0;
+	}
+
+	EntityWorld::~EntityWorld() {
+		for (EcsArchetype& archetype : _archetypes) {
+			for (EcsChunk& chunk : archetype.Chunks) {
+				delete[] chunk.Allocation;
+			}
+		}
+	}
+
+	U32 EntityWorld::RegisterComponent(const char* name, U32 size, U32 alignment) {
+		if (_components.size() >= ECS_MAX_COMPONENTS) {
+			Logger::Error("Unable to register component %s, at most %d components are supported", name, ECS_MAX_COMPONENTS);
+			return U32_MAX;
+		}
+
+		if (alignment > ECS_CHUNK_ALIGNMENT) {
+			Logger::Error("Unable to register component %s, its alignment of %d is above %d", name, alignment, ECS_CHUNK_ALIGNMENT);
+			return U32_MAX;
+		}
+
+		_components.push_back({ name, size, alignment });
+		return (U32)_components.size() - 1;
+	}
+
+	Entity EntityWorld::CreateEntity(ComponentMask components) {
+		U32 archetypeIndex = getArchetype(components);
+		if (archetypeIndex == U32_MAX) {
+			return { U32_MAX, 0 };
+		}
+
+		U32 index;
+		if (!_freeEntities.empty()) {
+			index = _freeEntities.back();
+			_freeEntities.pop_back();
+		} else {
+			index = (U32)_entities.size();
+			_entities.push_back({ 0, U32_MAX, 0, 0 });
+		}
+
+		allocateRow(archetypeIndex, index);
+		_entityCount++;
+		return { index, _entities[index].Generation };
+	}
+
+	void EntityWorld::DestroyEntity(Entity entity) {
+		if (!IsAlive(entity)) {
+			return;
+		}
+
+		EntityRecord& record = _entities[entity.Index];
+		freeRow(record.Archetype, record.Chunk, record.Row);
+		record.Archetype = U32_MAX;
+		record.Generation++;
+		_freeEntities.push_back(entity.Index);
+		_entityCount--;
+	}
+
+	const bool EntityWorld::IsAlive(Entity entity) const {
+		return entity.Index < _entities.size() && _entities[entity.Index].Generation == entity.Generation && _entities[entity.Index].Archetype != U32_MAX;
+	}
+
+	void EntityWorld::AddComponent(Entity entity, U32 component) {
+		if (IsAlive(entity)) {
+			moveEntity(entity, _archetypes[_entities[entity.Index].Archetype].Mask | ((ComponentMask)1 << component));
+		}
+	}
+
+	void EntityWorld::RemoveComponent(Entity entity, U32 component) {
+		if (IsAlive(entity)) {
+			moveEntity(entity, _archetypes[_entities[entity.Index].Archetype].Mask & ~((ComponentMask)1 << component));
+		}
+	}
+
+	void* EntityWorld::GetComponent(Entity entity, U32 component) {
+		if (!IsAlive(entity)) {
+			return nullptr;
+		}
+
+		const EntityRecord& record = _entities[entity.Index];
+		const EcsArchetype& archetype = _archetypes[record.Archetype];
+		if (!(archetype.Mask & ((ComponentMask)1 << component))) {
+			return nullptr;
+		}
+		return archetype.Chunks[record.Chunk].Data + archetype.Offsets[component] + (size_t)record.Row * _components[component].Size;
+	}
+
+	U32 EntityWorld::CreateQuery(ComponentMask required, ComponentMask excluded) {
+		_queries.push_back({ required, excluded, {}, 0 });
+		return (U32)_queries.size() - 1;
+	}
+
+	void EntityWorld::ForEachChunk(U32 query, const std::function<void(const EcsChunkView& chunk)>& function, bool parallel) {
+		EcsQuery& cachedQuery = _queries[query];
+		updateQuery(cachedQuery);
+
+		_chunkViews.clear();
+		for (U32 archetypeIndex : cachedQuery.Archetypes) {
+			const EcsArchetype& archetype = _archetypes[archetypeIndex];
+			for (const EcsChunk& chunk : archetype.Chunks) {
+				_chunkViews.push_back({ &archetype, chunk.Data, chunk.Count });
+			}
+		}
+
+		U32 chunkCount = (U32)_chunkViews.size();
+		if (!parallel || chunkCount <= ECS_CHUNKS_PER_BATCH) {
+			for (const EcsChunkView& chunk : _chunkViews) {
+				function(chunk);
+			}
+			return;
+		}
+
+		JobSystem::ParallelFor(chunkCount, ECS_CHUNKS_PER_BATCH, [&](U32 start, U32 end) {
+			for (U32 i = start; i < end; ++i) {
+				function(_chunkViews[i]);
+			}
+		});
+	}
+
+	U32 EntityWorld::AddSystem(const char* name, U32 query, const std::function<void(const EcsChunkView& chunk, F32 deltaTime)>& update) {
+		_systems.push_back({ name, query, update });
+		return (U32)_systems.size() - 1;
+	}
+
+	void EntityWorld::RunSystems(F32 deltaTime) {
+		for (const EcsSystem& system : _systems) {
+			ForEachChunk(system.Query, [&](const EcsChunkView& chunk) { system.Update(chunk, deltaTime); });
+		}
+	}
+
+	U32 EntityWorld::getArchetype(ComponentMask mask) {
+		auto found = _archetypeLookup.find(mask);
+		if (found != _archetypeLookup.end()) {
+			return found->second;
+		}
+
+		// Entity handles plus one of each component per row, with room to align every array
+		U32 rowSize = sizeof(Entity);
+		U32 arrayCount = 1;
+		for (ComponentMask bits = mask; bits; bits &= bits - 1) {
+			U32 component = lowestComponent(bits);
+			if (component >= _components.size()) {
+				Logger::Error("Unable to create an archetype with unregistered component %d", component);
+				return U32_MAX;
+			}
+			rowSize += _components[component].Size;
+			arrayCount++;
+		}
+
+		U32 capacity = (ECS_CHUNK_SIZE - arrayCount * ECS_CHUNK_ALIGNMENT) / rowSize;
+		if (capacity == 0) {
+			Logger::Error("Unable to create an archetype, %d bytes of components don't fit a chunk", rowSize);
+			return U32_MAX;
+		}
+
+		EcsArchetype archetype = {};
+		archetype.Mask = mask;
+		archetype.Capacity = capacity;
+		U32 offset = capacity * sizeof(Entity);
+		for (ComponentMask bits = mask; bits; bits &= bits - 1) {
+			U32 component = lowestComponent(bits);
+			offset = alignOffset(offset, ECS_CHUNK_ALIGNMENT);
+			archetype.Offsets[component] = offset;
+			offset += capacity * _components[component].Size;
+		}
+
+		_archetypes.push_back(std::move(archetype));
+		U32 archetypeIndex = (U32)_archetypes.size() - 1;
+		_archetypeLookup[mask] = archetypeIndex;
+		return archetypeIndex;
+	}
+
+	void EntityWorld::allocateRow(U32 archetypeIndex, U32 entityIndex) {
+		EcsArchetype& archetype = _archetypes[archetypeIndex];
+		if (archetype.Chunks.empty() || archetype.Chunks.back().Count == archetype.Capacity) {
+			EcsChunk chunk = {};
+			chunk.Allocation = new U8[ECS_CHUNK_SIZE + ECS_CHUNK_ALIGNMENT];
+			chunk.Data = (U8*)(((size_t)chunk.Allocation + ECS_CHUNK_ALIGNMENT - 1) & ~(size_t)(ECS_CHUNK_ALIGNMENT - 1));
+			archetype.Chunks.push_back(chunk);
+		}
+
+		EcsChunk& chunk = archetype.Chunks.back();
+		U32 row = chunk.Count++;
+		EntityRecord& record = _entities[entityIndex];
+		((Entity*)chunk.Data)[row] = { entityIndex, record.Generation };
+		for (ComponentMask bits = archetype.Mask; bits; bits &= bits - 1) {
+			U32 component = lowestComponent(bits);
+			U32 size = _components[component].Size;
+			memset(chunk.Data + archetype.Offsets[component] + (size_t)row * size, 0, size);
+		}
+
+		record.Archetype = archetypeIndex;
+		record.Chunk = (U32)archetype.Chunks.size() - 1;
+		record.Row = row;
+	}
+
+	void EntityWorld::freeRow(U32 archetypeIndex, U32 chunkIndex, U32 row) {
+		// The archetype's last entity fills the hole, so every chunk but the last stays full
+		EcsArchetype& archetype = _archetypes[archetypeIndex];
+		EcsChunk& chunk = archetype.Chunks[chunkIndex];
+		EcsChunk& lastChunk = archetype.Chunks.back();
+		U32 lastRow = lastChunk.Count - 1;
+
+		if (&chunk != &lastChunk || row != lastRow) {
+			Entity moved = ((Entity*)lastChunk.Data)[lastRow];
+			((Entity*)chunk.Data)[row] = moved;
+			for (ComponentMask bits = archetype.Mask; bits; bits &= bits - 1) {
+				U32 component = lowestComponent(bits);
+				U32 size = _components[component].Size;
+				U32 offset = archetype.Offsets[component];
+				memcpy(chunk.Data + offset + (size_t)row * size, lastChunk.Data + offset + (size_t)lastRow * size, size);
+			}
+			_entities[moved.Index].Chunk = chunkIndex;
+			_entities[moved.Index].Row = row;
+		}
+
+		lastChunk.Count--;
+		if (lastChunk.Count == 0) {
+			delete[] lastChunk.Allocation;
+			archetype.Chunks.pop_back();
+		}
+	}
+
+	void EntityWorld::moveEntity(Entity entity, ComponentMask mask) {
+		// May add an archetype, so no references into the archetypes until it returns
+		U32 targetIndex = getArchetype(mask);
+		if (targetIndex == U32_MAX) {
+			return;
+		}
+
+		EntityRecord source = _entities[entity.Index];
+		if (source.Archetype == targetIndex) {
+			return;
+		}
+
+		allocateRow(targetIndex, entity.Index);
+		const EntityRecord& target = _entities[entity.Index];
+		const EcsArchetype& sourceArchetype = _archetypes[source.Archetype];
+		const EcsArchetype& targetArchetype = _archetypes[targetIndex];
+		const U8* sourceData = sourceArchetype.Chunks[source.Chunk].Data;
+		U8* targetData = targetArchetype.Chunks[target.Chunk].Data;
+		for (ComponentMask bits = sourceArchetype.Mask & mask; bits; bits &= bits - 1) {
+			U32 component = lowestComponent(bits);
+			U32 size = _components[component].Size;
+			memcpy(targetData + targetArchetype.Offsets[component] + (size_t)target.Row * size,
+				sourceData + sourceArchetype.Offsets[component] + (size_t)source.Row * size, size);
+		}
+
+		freeRow(source.Archetype, source.Chunk, source.Row);
+	}
+
+	void EntityWorld::updateQuery(EcsQuery& query) {
+		for (U32 i = query.CheckedArchetypeCount; i < _archetypes.size(); ++i) {
+			ComponentMask mask = _archetypes[i].Mask;
+			if ((mask & query.Required) == query.Required && !(mask & query.Excluded)) {
+				query.Archetypes.push_back(i);
+			}
+		}
+		query.CheckedArchetypeCount = (U32)_archetypes.size();
+	}
+
+	struct BenchmarkVector {
+		F32 X;
+		F32 Y;
+		F32 Z;
+	};
+
+	// What an object typically carries besides what the system touches
+	struct BenchmarkPayload {
+		F32 Data[24];
+	};
+
+	struct BenchmarkObject {
+		BenchmarkVector Position;
+		BenchmarkVector Velocity;
+		BenchmarkPayload Payload;
+	};
+
+	const bool EntityWorld::RunBenchmark() {
+		const U32 entityCount = 1000000;
+		const U32 iterations = 20;
+		const F32 deltaTime = 1.0f / 60.0f;
+
+		Logger::Log("Entity world benchmark, %d threads", JobSystem::GetThreadCount());
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<F32> value(-10.0f, 10.0f);
+
+		// One allocation per object, visited in an order unrelated to where they ended up on the heap
+		std::vector<std::unique_ptr<BenchmarkObject>> objects(entityCount);
+		EntityWorld world;
+		U32 position = world.RegisterComponent<BenchmarkVector>("Position");
+		U32 velocity = world.RegisterComponent<BenchmarkVector>("Velocity");
+		U32 payload = world.RegisterComponent<BenchmarkPayload>("Payload");
+		ComponentMask mask = ((ComponentMask)1 << position) | ((ComponentMask)1 << velocity) | ((ComponentMask)1 << payload);
+		for (U32 i = 0; i < entityCount; ++i) {
+			BenchmarkVector p = { value(random), value(random), value(random) };
+			BenchmarkVector v = { value(random), value(random), value(random) };
+			objects[i].reset(new BenchmarkObject());
+			objects[i]->Position = p;
+			objects[i]->Velocity = v;
+
+			Entity entity = world.CreateEntity(mask);
+			*world.GetComponent<BenchmarkVector>(entity, position) = p;
+			*world.GetComponent<BenchmarkVector>(entity, velocity) = v;
+		}
+		std::shuffle(objects.begin(), objects.end(), random);
+
+		const EcsArchetype& archetype = world._archetypes[world._entities[0].Archetype];
+		Logger::Log("%d entities, %d per chunk, %d chunks", entityCount, archetype.Capacity, (U32)archetype.Chunks.size());
+
+		F64 baselineTime = Benchmark::Time(iterations, [&](U32) {
+			for (const std::unique_ptr<BenchmarkObject>& object : objects) {
+				object->Position.X += object->Velocity.X * deltaTime;
+				object->Position.Y += object->Velocity.Y * deltaTime;
+				object->Position.Z += object->Velocity.Z * deltaTime;
+			}
+		});
+		Logger::Log("  %-24s %9.3f ms", "Objects (baseline)", baselineTime);
+
+		U32 query = world.CreateQuery(((ComponentMask)1 << position) | ((ComponentMask)1 << velocity));
+		auto integrate = [&](const EcsChunkView& chunk) {
+			BenchmarkVector* positions = chunk.Get<BenchmarkVector>(position);
+			const BenchmarkVector* velocities = chunk.Get<BenchmarkVector>(velocity);
+			for (U32 i = 0; i < chunk.Count; ++i) {
+				positions[i].X += velocities[i].X * deltaTime;
+				positions[i].Y += velocities[i].Y * deltaTime;
+				positions[i].Z += velocities[i].Z * deltaTime;
+			}
+		};
+
+		bool passed = true;
+		for (U32 parallel = 0; parallel < 2; ++parallel) {
+			F64 time = Benchmark::Time(iterations, [&](U32) { world.ForEachChunk(query, integrate, parallel != 0); });
+			Logger::Log("  %-24s %9.3f ms %7.2fx", parallel ? "Chunks parallel" : "Chunks", time, baselineTime / time);
+
+			// Every entity visited exactly once per pass
+			std::atomic<U32> visited(0);
+			world.ForEachChunk(query, [&](const EcsChunkView& chunk) { visited += chunk.Count; }, parallel != 0);
+			passed &= Benchmark::Check(visited == entityCount, "%s visited %d of %d entities", parallel ? "Parallel chunks" : "Chunks",
+				(U32)visited, entityCount);
+		}
+		return passed;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "Defines.h"
+
+// Every archetype stores its entities in blocks of this size
+#define ECS_CHUNK_SIZE 16384
+
+// Component arrays inside a chunk start on their own cache line
+#define ECS_CHUNK_ALIGNMENT 64
+
+// Component ids index a 64 bit mask
+#define ECS_MAX_COMPONENTS 64
+
+namespace Jazz {
+
+	typedef U64 ComponentMask;
+
+	struct Entity {
+		U32 Index;
+		U32 Generation; // Bumped every time the index is reused, so stale handles are detected
+	};
+
+	// A fixed size block holding up to the archetype's capacity entities: their handles, then one tightly packed array
+	// per component
+	struct EcsChunk {
+		U8* Data;
+		U8* Allocation;
+		U32 Count;
+	};
+
+	// All entities with exactly the same set of components
+	struct EcsArchetype {
+		ComponentMask Mask;
+		U32 Capacity; // Entities per chunk
+		U32 Offsets[ECS_MAX_COMPONENTS]; // Byte offset of each component's array within a chunk
+		std::vector<EcsChunk> Chunks;
+	};
+
+	// What a system sees of one chunk
+	struct EcsChunkView {
+		const EcsArchetype* Archetype;
+		U8* Data;
+		U32 Count;
+
+		const Entity* GetEntities() const { return (const Entity*)Data; }
+
+		// Only valid for components the query requires
+		template<typename T>
+		T* Get(U32 component) const { return (T*)(Data + Archetype->Offsets[component]); }
+	};
+
+	// The archetypes matching a query are cached and only newly created archetypes are tested when it runs again
+	struct EcsQuery {
+		ComponentMask Required;
+		ComponentMask Excluded;
+		std::vector<U32> Archetypes;
+		U32 CheckedArchetypeCount;
+	};
+
+	struct EcsSystem {
+		const char* Name;
+		U32 Query;
+		std::function<void(const EcsChunkView& chunk, F32 deltaTime)> Update;
+	};
+
+	// Archetype based entity component system. Systems visit their matching chunks in parallel and walk each component
+	// array linearly. Entities must not be created, destroyed or change components while a query or system runs.
+	class EntityWorld {
+	public:
+		EntityWorld();
+		~EntityWorld();
+
+		// Returns the component id, or U32_MAX once ECS_MAX_COMPONENTS are registered
+		U32 RegisterComponent(const char* name, U32 size, U32 alignment);
+
+		template<typename T>
+		U32 RegisterComponent(const char* name) { return RegisterComponent(name, sizeof(T), alignof(T)); }
+
+		// Components start zeroed
+		Entity CreateEntity(ComponentMask components);
+		void DestroyEntity(Entity entity);
+		const bool IsAlive(Entity entity) const;
+
+		// Both move the entity to the archetype with the new set of components
+		void AddComponent(Entity entity, U32 component);
+		void RemoveComponent(Entity entity, U32 component);
+
+		// Null when the entity doesn't have the component. Only valid until the next structural change.
+		void* GetComponent(Entity entity, U32 component);
+
+		template<typename T>
+		T* GetComponent(Entity entity, U32 component) { return (T*)GetComponent(entity, component); }
+
+		U32 GetEntityCount() const { return _entityCount; }
+
+		U32 CreateQuery(ComponentMask required, ComponentMask excluded = 0);
+
+		// Calls function for every chunk matching the query, spread across the job system when parallel
+		void ForEachChunk(U32 query, const std::function<void(const EcsChunkView& chunk)>& function, bool parallel = true);
+
+		// Systems run in the order they were added
+		U32 AddSystem(const char* name, U32 query, const std::function<void(const EcsChunkView& chunk, F32 deltaTime)>& update);
+		void RunSystems(F32 deltaTime);
+
+		// Integrating a million positions through a system against the same objects allocated one by one. Fails when
+		// a chunk pass doesn't visit every entity exactly once.
+		static const bool RunBenchmark();
+	private:
+		struct EntityRecord {
+			U32 Generation;
+			U32 Archetype;
+			U32 Chunk;
+			U32 Row;
+		};
+
+		struct ComponentInfo {
+			const char* Name;
+			U32 Size;
+			U32 Alignment;
+		};
+
+		U32 getArchetype(ComponentMask mask);
+		void allocateRow(U32 archetypeIndex, U32 entityIndex);
+		void freeRow(U32 archetypeIndex, U32 chunkIndex, U32 row);
+		void moveEntity(Entity entity, ComponentMask mask);
+		void updateQuery(EcsQuery& query);
+	private:
+		std::vector<ComponentInfo> _components;
+		std::vector<EcsArchetype> _archetypes;
+		std::unordered_map<ComponentMask, U32> _archetypeLookup;
+		std::vector<EntityRecord> _entities;
+		std::vector<U32> _freeEntities;
+		std::vector<EcsQuery> _queries;
+		std::vector<EcsSystem> _systems;
+		std::vector<EcsChunkView> _chunkViews;
+		U32 _entityCount;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+#include "JobSystem.h"
+
+namespace Jazz {
+
+	struct ParallelForBatches {
+		const std::function<void(U32 start, U32 end)>* Function;
+		U32 Count;
+		U32 BatchSize;
+		U32 BatchCount;
+		std::atomic<U32> NextBatch;
+		std::atomic<U32> CompletedBatches;
+		std::atomic<U32> ActiveWorkers; // Workers still holding a pointer to this entry
+	};
+
+	static std::vector<std::thread> workers;
+	static std::deque<ParallelForBatches*> queue;
+	static std::mutex queueMutex;
+	static std::condition_variable queueCondition;
+	static bool running = false;
+	static thread_local U32 threadIndex = 0;
+
+	// Claims batches until none are left
+	static void runBatches(ParallelForBatches* batches) {
+		while (true) {
+			U32 batch = batches->NextBatch.fetch_add(1);
+			if (batch >= batches->BatchCount) {
+				return;
+			}
+
+			U32 start = batch * batches->BatchSize;
+			U32 end = start + batches->BatchSize < batches->Count ? start + batches->BatchSize : batches->Count;
+			(*batches->Function)(start, end);
+			batches->CompletedBatches.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	static void workerLoop(U32 index) {
+		threadIndex = index;
+
+		while (true) {
+			ParallelForBatches* batches = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [] { return !running || !queue.empty(); });
+				if (!running) {
+					return;
+				}
+
+				// Leave the entry queued until all its batches are claimed so other workers can join in
+				batches = queue.front();
+				if (batches->NextBatch.load() >= batches->BatchCount) {
+					queue.pop_front();
+					continue;
+				}
+				batches->ActiveWorkers.fetch_add(1);
+			}
+
+			runBatches(batches);
+			batches->ActiveWorkers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void JobSystem::Initialize(U32 workerCount) {
+		if (workerCount == 0) {
+			U32 hardwareThreads = std::thread::hardware_concurrency();
+			workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+		}
+
+		running = true;
+		for (U32 i = 0; i < workerCount; ++i) {
+			workers.emplace_back(workerLoop, i + 1);
+		}
+
+		Logger::Trace("Job system started with %d worker threads", workerCount);
+	}
+
+	void JobSystem::Shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			running = false;
+		}
+		queueCondition.notify_all();
+
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	U32 JobSystem::GetThreadCount() {
+		return (U32)workers.size() + 1;
+	}
+
+	U32 JobSystem::GetThreadIndex() {
+		return threadIndex;
+	}
+
+	void JobSystem::ParallelFor(U32 count, U32 batchSize, const std::function<void(U32 start, U32 end)>& function) {
+		if (count == 0) {
+			return;
+		}
+
+		batchSize = batchSize > 0 ? batchSize : 1;
+		U32 batchCount = (count + batchSize - 1) / batchSize;
+
+		// Not worth waking anyone for a single batch
+		if (batchCount == 1 || workers.empty()) {
+			for (U32 start = 0; start < count; start += batchSize) {
+				function(start, start + batchSize < count ? start + batchSize : count);
+			}
+			return;
+		}
+
+		ParallelForBatches batches;
+		batches.Function = &function;
+		batches.Count = count;
+		batches.BatchSize = batchSize;
+		batches.BatchCount = batchCount;
+		batches.NextBatch = 0;
+		batches.CompletedBatches = 0;
+		batches.ActiveWorkers = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queue.push_back(&batches);
+		}
+		queueCondition.notify_all();
+
+		runBatches(&batches);
+
+		// Every batch is claimed, unlink the entry so no other worker can pick it up
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			for (auto it = queue.begin(); it != queue.end(); ++it) {
+				if (*it == &batches) {
+					queue.erase(it);
+					break;
+				}
+			}
+		}
+
+		// Wait for in-flight batches, and for workers to let go of the entry before it goes out of scope
+		while (batches.CompletedBatches.load(std::memory_order_acquire) < batchCount || batches.ActiveWorkers.load(std::memory_order_acquire) > 0) {
+			std::this_thread::yield();
+		}
+	}
+}
\ No newline at end of file
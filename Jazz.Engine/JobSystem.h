@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+
+#include "Types.h"
+
+namespace Jazz {
+
+	// Fixed pool of worker threads. The calling thread always takes part in the work it submits,
+	// so ParallelFor can be nested and everything still runs inline when there are no workers.
+	class JobSystem {
+	public:
+		// workerCount of 0 uses one worker per hardware thread, minus the calling thread
+		static void Initialize(U32 workerCount = 0);
+		static void Shutdown();
+
+		// Number of threads that can run jobs, including the calling thread
+		static U32 GetThreadCount();
+
+		// 0 on the thread that called Initialize, 1..N on workers
+		static U32 GetThreadIndex();
+
+		// Calls function(start, end) over [0, count) in batches of at most batchSize and returns once every batch is done
+		static void ParallelFor(U32 count, U32 batchSize, const std::function<void(U32 start, U32 end)>& function);
+	};
+}
\ No newline at end of file
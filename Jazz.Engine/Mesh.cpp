@@ -0,0 +1,219 @@
+#include <fstream>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "Logger.h"
+#include "Mesh.h"
+#include "VertexCompression.h"
+
+namespace Jazz {
+
+	static U64 alignBlob(U64 offset) {
+		return (offset + JAZZ_MESH_BLOB_ALIGNMENT - 1) & ~((U64)JAZZ_MESH_BLOB_ALIGNMENT - 1);
+	}
+
+	// Written so a huge offset or size can't wrap around past the end of the file
+	static bool isBlobInFile(U64 offset, U64 size, U64 fileSize) {
+		return offset >= sizeof(MeshFileHeader) && offset <= fileSize && size <= fileSize - offset;
+	}
+
+	MeshFile::MeshFile() {
+		_file = {};
+		_header = nullptr;
+	}
+
+	MeshFile::~MeshFile() {
+		Close();
+	}
+
+	const bool MeshFile::Open(const char* path) {
+		Close();
+
+		if (!Platform::MapFile(path, &_file)) {
+			Logger::Error("Unable to map mesh file: %s", path);
+			return false;
+		}
+
+		// Validate everything needed to index the blobs safely, the vertex and index values are trusted as-is
+		const MeshFileHeader* header = (const MeshFileHeader*)_file.Data;
+		if (_file.Size < sizeof(MeshFileHeader) || header->Magic != JAZZ_MESH_MAGIC) {
+			Logger::Error("Not a Jazz mesh file: %s", path);
+			Close();
+			return false;
+		}
+
+		if (header->Version != JAZZ_MESH_VERSION) {
+			Logger::Error("Mesh file %s has version %d, expected %d", path, header->Version, JAZZ_MESH_VERSION);
+			Close();
+			return false;
+		}
+
+		U32 vertexStride = (header->Flags & JAZZ_MESH_FLAG_COMPRESSED_VERTICES) ? sizeof(CompressedVertex) : sizeof(MeshVertex);
+		if (header->VertexStride != vertexStride) {
+			Logger::Error("Mesh file %s has an unsupported vertex stride of %d", path, header->VertexStride);
+			Close();
+			return false;
+		}
+
+		if (header->VertexDataSize != (U64)header->VertexCount * header->VertexStride || header->IndexDataSize != (U64)header->IndexCount * sizeof(U32)) {
+			Logger::Error("Mesh file %s has blob sizes that don't match its counts", path);
+			Close();
+			return false;
+		}
+
+		if (!isBlobInFile(header->VertexDataOffset, header->VertexDataSize, _file.Size) || !isBlobInFile(header->IndexDataOffset, header->IndexDataSize, _file.Size)) {
+			Logger::Error("Mesh file is truncated: %s", path);
+			Close();
+			return false;
+		}
+
+		// Loading copies from the vertex blob through the end of the index blob in one go
+		if (header->IndexDataOffset < header->VertexDataOffset + header->VertexDataSize) {
+			Logger::Error("Mesh file %s has its index blob before the end of its vertex blob", path);
+			Close();
+			return false;
+		}
+
+		if (header->LodCount == 0 || header->LodCount > JAZZ_MESH_MAX_LODS) {
+			Logger::Error("Mesh file %s has %d LODs, expected 1 to %d", path, header->LodCount, JAZZ_MESH_MAX_LODS);
+			Close();
+			return false;
+		}
+
+		for (U32 i = 0; i < header->LodCount; ++i) {
+			const MeshLod& lod = header->Lods[i];
+			if (lod.FirstIndex > header->IndexCount || lod.IndexCount > header->IndexCount - lod.FirstIndex) {
+				Logger::Error("Mesh file %s has LOD %d outside of its indices", path, i);
+				Close();
+				return false;
+			}
+		}
+
+		if ((header->Flags & JAZZ_MESH_FLAG_SKINNED) && (header->SkinDataSize != (U64)header->VertexCount * sizeof(SkinWeights) ||
+			!isBlobInFile(header->SkinDataOffset, header->SkinDataSize, _file.Size) || header->JointCount == 0 || header->JointCount > JAZZ_MESH_MAX_JOINTS)) {
+			Logger::Error("Mesh file %s has invalid skin data", path);
+			Close();
+			return false;
+		}
+
+		_header = header;
+		return true;
+	}
+
+	void MeshFile::Close() {
+		Platform::UnmapFile(&_file);
+		_header = nullptr;
+	}
+
+	void MeshFile::ReadVertices(MeshVertex* outVertices) const {
+		if (HasCompressedVertices()) {
+			VertexCompression::Decode((const CompressedVertex*)GetVertexData(), _header->VertexCount, _header->Bounds, outVertices);
+		} else {
+			memcpy(outVertices, GetVertexData(), sizeof(MeshVertex) * _header->VertexCount);
+		}
+	}
+
+	const bool MeshFile::Write(const char* path, const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, const MeshLod* lods, U32 lodCount,
+		const bool compressVertices, const SkinWeights* skinWeights, U32 jointCount) {
+		if (lodCount > JAZZ_MESH_MAX_LODS) {
+			Logger::Error("Mesh has %d LODs, at most %d are supported", lodCount, JAZZ_MESH_MAX_LODS);
+			return false;
+		}
+
+		if (skinWeights && (jointCount == 0 || jointCount > JAZZ_MESH_MAX_JOINTS)) {
+			Logger::Error("Mesh has %d joints, at most %d are supported", jointCount, JAZZ_MESH_MAX_JOINTS);
+			return false;
+		}
+
+		MeshFileHeader header = {};
+		header.Magic = JAZZ_MESH_MAGIC;
+		header.Version = JAZZ_MESH_VERSION;
+		header.Flags = compressVertices ? JAZZ_MESH_FLAG_COMPRESSED_VERTICES : 0;
+		header.VertexStride = compressVertices ? sizeof(CompressedVertex) : sizeof(MeshVertex);
+		header.VertexCount = vertexCount;
+		header.IndexCount = indexCount;
+		header.VertexDataOffset = alignBlob(sizeof(MeshFileHeader));
+		header.VertexDataSize = (U64)vertexCount * header.VertexStride;
+		header.IndexDataOffset = alignBlob(header.VertexDataOffset + header.VertexDataSize);
+		header.IndexDataSize = (U64)indexCount * sizeof(U32);
+		header.Bounds = ComputeBounds(vertices, vertexCount);
+		if (skinWeights) {
+			header.Flags |= JAZZ_MESH_FLAG_SKINNED;
+			header.JointCount = jointCount;
+			header.SkinDataOffset = alignBlob(header.IndexDataOffset + header.IndexDataSize);
+			header.SkinDataSize = (U64)vertexCount * sizeof(SkinWeights);
+		}
+
+		if (lodCount == 0) {
+			header.LodCount = 1;
+			header.Lods[0].FirstIndex = 0;
+			header.Lods[0].IndexCount = indexCount;
+		} else {
+			header.LodCount = lodCount;
+			memcpy(header.Lods, lods, sizeof(MeshLod) * lodCount);
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			Logger::Error("Unable to open mesh file for writing: %s", path);
+			return false;
+		}
+
+		const char padding[JAZZ_MESH_BLOB_ALIGNMENT] = {};
+		file.write((const char*)&header, sizeof(MeshFileHeader));
+		file.write(padding, header.VertexDataOffset - sizeof(MeshFileHeader));
+		if (compressVertices) {
+			std::vector<CompressedVertex> compressed(vertexCount);
+			VertexCompression::Encode(vertices, vertexCount, header.Bounds, compressed.data());
+			file.write((const char*)compressed.data(), header.VertexDataSize);
+		} else {
+			file.write((const char*)vertices, header.VertexDataSize);
+		}
+		file.write(padding, header.IndexDataOffset - (header.VertexDataOffset + header.VertexDataSize));
+		file.write((const char*)indices, header.IndexDataSize);
+		if (skinWeights) {
+			file.write(padding, header.SkinDataOffset - (header.IndexDataOffset + header.IndexDataSize));
+			file.write((const char*)skinWeights, header.SkinDataSize);
+		}
+		file.close();
+
+		return true;
+	}
+
+	MeshBounds MeshFile::ComputeBounds(const MeshVertex* vertices, U32 vertexCount) {
+		MeshBounds bounds = {};
+		if (vertexCount == 0) {
+			return bounds;
+		}
+
+		for (U32 axis = 0; axis < 3; ++axis) {
+			bounds.Min[axis] = vertices[0].Position[axis];
+			bounds.Max[axis] = vertices[0].Position[axis];
+		}
+
+		for (U32 i = 1; i < vertexCount; ++i) {
+			for (U32 axis = 0; axis < 3; ++axis) {
+				F32 value = vertices[i].Position[axis];
+				bounds.Min[axis] = value < bounds.Min[axis] ? value : bounds.Min[axis];
+				bounds.Max[axis] = value > bounds.Max[axis] ? value : bounds.Max[axis];
+			}
+		}
+
+		// Sphere around the box center, tightened to the farthest actual vertex
+		F32 radiusSquared = 0.0f;
+		for (U32 axis = 0; axis < 3; ++axis) {
+			bounds.Center[axis] = (bounds.Min[axis] + bounds.Max[axis]) * 0.5f;
+		}
+		for (U32 i = 0; i < vertexCount; ++i) {
+			F32 dx = vertices[i].Position[0] - bounds.Center[0];
+			F32 dy = vertices[i].Position[1] - bounds.Center[1];
+			F32 dz = vertices[i].Position[2] - bounds.Center[2];
+			F32 distanceSquared = dx * dx + dy * dy + dz * dz;
+			radiusSquared = distanceSquared > radiusSquared ? distanceSquared : radiusSquared;
+		}
+		bounds.Radius = sqrtf(radiusSquared);
+
+		return bounds;
+	}
+}
\ No newline at end of file
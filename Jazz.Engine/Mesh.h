@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Types.h"
+#include "Platform.h"
+
+// Jazz binary mesh (.jmesh). The file is laid out exactly as the GPU wants it: a fixed size header
+// followed by aligned vertex and index blobs. Loading is a mmap plus a copy into GPU memory, no parsing.
+#define JAZZ_MESH_MAGIC 0x48534d4a // "JMSH"
+#define JAZZ_MESH_VERSION 1
+#define JAZZ_MESH_BLOB_ALIGNMENT 256
+#define JAZZ_MESH_MAX_LODS 8
+#define JAZZ_MESH_MAX_JOINTS 256 // Joint indices are bytes
+
+// Header flags
+#define JAZZ_MESH_FLAG_COMPRESSED_VERTICES 0x1 // The vertex blob holds CompressedVertex
+#define JAZZ_MESH_FLAG_SKINNED 0x2 // A SkinWeights blob follows the index blob
+
+namespace Jazz {
+
+	struct MeshVertex {
+		F32 Position[3];
+		F32 Normal[3];
+		F32 UV[2];
+	};
+
+	// 16 bytes: position as 16 bit fractions of the mesh bounds, octahedral encoded normal, half float UV
+	struct CompressedVertex {
+		U16 Position[3];
+		U16 Padding;
+		I16 Normal[2];
+		U16 UV[2];
+	};
+
+	// Up to four joints per vertex, weights are 8 bit fractions adding up to 255
+	struct SkinWeights {
+		U8 Joints[4];
+		U8 Weights[4];
+	};
+
+	struct MeshBounds {
+		F32 Center[3];
+		F32 Radius;
+		F32 Min[3];
+		F32 Max[3];
+	};
+
+	struct MeshLod {
+		U32 FirstIndex;
+		U32 IndexCount;
+		F32 Error; // Object space error introduced by simplification
+		U32 Reserved;
+	};
+
+	struct MeshFileHeader {
+		U32 Magic;
+		U32 Version;
+		U32 Flags;
+		U32 VertexStride;
+		U32 VertexCount;
+		U32 IndexCount;
+		U32 LodCount;
+		U32 JointCount; // Skinned meshes only
+		U64 VertexDataOffset;
+		U64 VertexDataSize;
+		U64 IndexDataOffset;
+		U64 IndexDataSize;
+		MeshBounds Bounds;
+		U32 Reserved1[2];
+		MeshLod Lods[JAZZ_MESH_MAX_LODS];
+		U64 SkinDataOffset;
+		U64 SkinDataSize;
+		U8 Reserved2[256];
+	};
+
+	static_assert(sizeof(MeshVertex) == 32, "MeshVertex must stay tightly packed");
+	static_assert(sizeof(CompressedVertex) == 16, "CompressedVertex must match the vertex input layout");
+	static_assert(sizeof(SkinWeights) == 8, "SkinWeights must match the skinning shader");
+	static_assert(sizeof(MeshFileHeader) == 512, "MeshFileHeader must stay a fixed size");
+
+	class MeshFile {
+	public:
+		MeshFile();
+		~MeshFile();
+
+		const bool Open(const char* path);
+		void Close();
+
+		const MeshFileHeader* GetHeader() const { return _header; }
+		const void* GetVertexData() const { return (const U8*)_file.Data + _header->VertexDataOffset; }
+		const void* GetIndexData() const { return (const U8*)_file.Data + _header->IndexDataOffset; }
+		const bool HasCompressedVertices() const { return (_header->Flags & JAZZ_MESH_FLAG_COMPRESSED_VERTICES) != 0; }
+		const bool IsSkinned() const { return (_header->Flags & JAZZ_MESH_FLAG_SKINNED) != 0; }
+
+		// One per vertex, or nullptr for meshes that are not skinned
+		const SkinWeights* GetSkinWeights() const { return IsSkinned() ? (const SkinWeights*)((const U8*)_file.Data + _header->SkinDataOffset) : nullptr; }
+
+		// Full precision copy of the vertices whichever way they are stored, outVertices needs room for all of them
+		void ReadVertices(MeshVertex* outVertices) const;
+
+		// Writes a mesh in the layout Open() expects. When no LODs are given the whole index buffer is LOD 0. Skinned
+		// meshes pass one SkinWeights per vertex and their joint count.
+		static const bool Write(const char* path, const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, const MeshLod* lods = nullptr, U32 lodCount = 0,
+			const bool compressVertices = false, const SkinWeights* skinWeights = nullptr, U32 jointCount = 0);
+
+		static MeshBounds ComputeBounds(const MeshVertex* vertices, U32 vertexCount);
+	private:
+		MappedFile _file;
+		const MeshFileHeader* _header;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "TMath.h"
+#include "MeshOptimizer.h"
+
+namespace Jazz {
+
+	// FIFO cache emulated with a timestamp per vertex: a vertex is cached while fewer than cacheSize misses happened since
+	// it was loaded. Moving the clock cacheSize + 1 ahead empties it.
+	struct VertexCache {
+		std::vector<U32> Timestamps;
+		U32 Time;
+		U32 Size;
+
+		VertexCache(U32 vertexCount, U32 cacheSize) : Timestamps(vertexCount, 0), Time(cacheSize + 1), Size(cacheSize) {}
+
+		bool IsCached(U32 vertex) const {
+			return Time - Timestamps[vertex] <= Size;
+		}
+
+		// Returns 1 on a miss
+		U32 Access(U32 vertex) {
+			if (IsCached(vertex)) {
+				return 0;
+			}
+			Timestamps[vertex] = Time++;
+			return 1;
+		}
+
+		void Clear() {
+			Time += Size + 1;
+		}
+	};
+
+	// Next vertex to fan around once the last one's candidates are exhausted: the most recent vertex still referenced by
+	// unemitted triangles, or failing that the first such vertex in index order
+	static U32 skipDeadEnd(std::vector<U32>& deadEnds, const std::vector<U32>& liveTriangles, U32& cursor) {
+		while (!deadEnds.empty()) {
+			U32 vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0) {
+				return vertex;
+			}
+		}
+
+		while (cursor < liveTriangles.size()) {
+			if (liveTriangles[cursor] > 0) {
+				return cursor;
+			}
+			cursor++;
+		}
+		return U32_MAX;
+	}
+
+	void MeshOptimizer::OptimizeVertexCache(const U32* indices, U32 indexCount, U32 vertexCount, U32* outIndices) {
+		U32 triangleCount = indexCount / 3;
+
+		// Triangles around each vertex
+		std::vector<U32> liveTriangles(vertexCount, 0);
+		for (U32 i = 0; i < triangleCount * 3; ++i) {
+			liveTriangles[indices[i]]++;
+		}
+
+		std::vector<U32> adjacencyOffsets(vertexCount + 1, 0);
+		for (U32 v = 0; v < vertexCount; ++v) {
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+		}
+
+		std::vector<U32> adjacency(triangleCount * 3);
+		std::vector<U32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (U32 i = 0; i < triangleCount * 3; ++i) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		VertexCache cache(vertexCount, MESH_OPTIMIZER_CACHE_SIZE);
+		std::vector<U8> emitted(triangleCount, 0);
+		std::vector<U32> deadEnds;
+		std::vector<U32> candidates;
+		deadEnds.reserve(triangleCount * 3);
+		candidates.reserve(64);
+
+		U32 outCount = 0;
+		U32 cursor = 0;
+		U32 fanVertex = skipDeadEnd(deadEnds, liveTriangles, cursor);
+		while (fanVertex != U32_MAX) {
+			candidates.clear();
+			for (U32 k = adjacencyOffsets[fanVertex]; k < adjacencyOffsets[fanVertex + 1]; ++k) {
+				U32 triangle = adjacency[k];
+				if (emitted[triangle]) {
+					continue;
+				}
+
+				for (U32 corner = 0; corner < 3; ++corner) {
+					U32 vertex = indices[triangle * 3 + corner];
+					outIndices[outCount++] = vertex;
+					deadEnds.push_back(vertex);
+					candidates.push_back(vertex);
+					liveTriangles[vertex]--;
+					cache.Access(vertex);
+				}
+				emitted[triangle] = 1;
+			}
+
+			// Prefer the oldest candidate that stays cached while its remaining triangles are fanned, anything still live
+			// over nothing
+			U32 next = U32_MAX;
+			I32 bestPriority = -1;
+			for (U32 vertex : candidates) {
+				if (liveTriangles[vertex] == 0) {
+					continue;
+				}
+
+				I32 priority = 0;
+				U32 age = cache.Time - cache.Timestamps[vertex];
+				if (age + 2 * liveTriangles[vertex] <= MESH_OPTIMIZER_CACHE_SIZE) {
+					priority = (I32)age;
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = vertex;
+				}
+			}
+
+			fanVertex = next != U32_MAX ? next : skipDeadEnd(deadEnds, liveTriangles, cursor);
+		}
+	}
+
+	void MeshOptimizer::OptimizeOverdraw(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32* outIndices,
+		F32 threshold) {
+		U32 triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// Hard boundaries where the cache starts over anyway, a triangle missing on all three vertices
+		VertexCache cache(vertexCount, MESH_OPTIMIZER_CACHE_SIZE);
+		std::vector<U32> hardClusters;
+		for (U32 t = 0; t < triangleCount; ++t) {
+			U32 misses = cache.Access(indices[t * 3 + 0]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+			if (t == 0 || misses == 3) {
+				hardClusters.push_back(t);
+			}
+		}
+		hardClusters.push_back(triangleCount);
+
+		// Soft boundaries wherever a cluster so far is nearly as cache friendly as the hard cluster it came from
+		std::vector<U32> clusters;
+		for (size_t c = 0; c + 1 < hardClusters.size(); ++c) {
+			U32 start = hardClusters[c];
+			U32 end = hardClusters[c + 1];
+
+			cache.Clear();
+			U32 clusterMisses = 0;
+			for (U32 i = start * 3; i < end * 3; ++i) {
+				clusterMisses += cache.Access(indices[i]);
+			}
+			F32 acmrLimit = (F32)clusterMisses / (F32)(end - start) * threshold;
+
+			cache.Clear();
+			clusters.push_back(start);
+			U32 runMisses = 0;
+			U32 runTriangles = 0;
+			for (U32 t = start; t < end; ++t) {
+				runMisses += cache.Access(indices[t * 3 + 0]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+				runTriangles++;
+				if (t + 1 < end && (F32)runMisses <= acmrLimit * (F32)runTriangles) {
+					clusters.push_back(t + 1);
+					cache.Clear();
+					runMisses = 0;
+					runTriangles = 0;
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+		U32 clusterCount = (U32)clusters.size() - 1;
+
+		// Area weighted centroid and normal of each cluster and of the whole mesh
+		std::vector<Vec3> clusterCentroids(clusterCount);
+		std::vector<Vec3> clusterNormals(clusterCount);
+		Vec3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+		F32 meshArea = 0.0f;
+		for (U32 c = 0; c < clusterCount; ++c) {
+			Vec3 centroid = { 0.0f, 0.0f, 0.0f };
+			Vec3 normal = { 0.0f, 0.0f, 0.0f };
+			F32 area = 0.0f;
+			for (U32 t = clusters[c]; t < clusters[c + 1]; ++t) {
+				const F32* a = vertices[indices[t * 3 + 0]].Position;
+				const F32* b = vertices[indices[t * 3 + 1]].Position;
+				const F32* p = vertices[indices[t * 3 + 2]].Position;
+				Vec3 cross = TMath::Cross({ b[0] - a[0], b[1] - a[1], b[2] - a[2] }, { p[0] - a[0], p[1] - a[1], p[2] - a[2] });
+				F32 triangleArea = TMath::Length(cross);
+				centroid.X += (a[0] + b[0] + p[0]) * triangleArea;
+				centroid.Y += (a[1] + b[1] + p[1]) * triangleArea;
+				centroid.Z += (a[2] + b[2] + p[2]) * triangleArea;
+				normal = TMath::Add(normal, cross);
+				area += triangleArea;
+			}
+
+			meshCentroid = TMath::Add(meshCentroid, centroid);
+			meshArea += area;
+			F32 inverseArea = area > 0.0f ? 1.0f / (3.0f * area) : 0.0f;
+			clusterCentroids[c] = { centroid.X * inverseArea, centroid.Y * inverseArea, centroid.Z * inverseArea };
+			F32 normalLength = TMath::Length(normal);
+			clusterNormals[c] = normalLength > 0.0f ? TMath::Scale(normal, 1.0f / normalLength) : normal;
+		}
+		F32 inverseMeshArea = meshArea > 0.0f ? 1.0f / (3.0f * meshArea) : 0.0f;
+		meshCentroid = TMath::Scale(meshCentroid, inverseMeshArea);
+
+		// Clusters facing away from the center sit on the outside of the mesh
+		std::vector<F32> sortKeys(clusterCount);
+		std::vector<U32> order(clusterCount);
+		for (U32 c = 0; c < clusterCount; ++c) {
+			sortKeys[c] = TMath::Dot(TMath::Subtract(clusterCentroids[c], meshCentroid), clusterNormals[c]);
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](U32 a, U32 b) { return sortKeys[a] > sortKeys[b]; });
+
+		U32 outCount = 0;
+		for (U32 c : order) {
+			U32 count = (clusters[c + 1] - clusters[c]) * 3;
+			memcpy(outIndices + outCount, indices + clusters[c] * 3, sizeof(U32) * count);
+			outCount += count;
+		}
+	}
+
+	U32 MeshOptimizer::OptimizeVertexFetch(const MeshVertex* vertices, U32 vertexCount, U32* indices, U32 indexCount, MeshVertex* outVertices) {
+		std::vector<U32> remap(vertexCount, U32_MAX);
+		U32 outCount = 0;
+		for (U32 i = 0; i < indexCount; ++i) {
+			U32& index = indices[i];
+			if (remap[index] == U32_MAX) {
+				remap[index] = outCount;
+				outVertices[outCount++] = vertices[index];
+			}
+			index = remap[index];
+		}
+		return outCount;
+	}
+
+	VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const U32* indices, U32 indexCount, U32 vertexCount, U32 cacheSize) {
+		VertexCache cache(vertexCount, cacheSize);
+		std::vector<U8> referenced(vertexCount, 0);
+		U32 misses = 0;
+		U32 uniqueVertices = 0;
+		for (U32 i = 0; i < indexCount; ++i) {
+			misses += cache.Access(indices[i]);
+			uniqueVertices += referenced[indices[i]] ? 0 : 1;
+			referenced[indices[i]] = 1;
+		}
+
+		VertexCacheStats stats = {};
+		stats.Acmr = indexCount >= 3 ? (F32)misses / (F32)(indexCount / 3) : 0.0f;
+		stats.Atvr = uniqueVertices > 0 ? (F32)misses / (F32)uniqueVertices : 0.0f;
+		return stats;
+	}
+
+	const bool MeshOptimizer::OptimizeMeshFile(const char* inputPath, const char* outputPath) {
+		MeshFile meshFile;
+		if (!meshFile.Open(inputPath)) {
+			return false;
+		}
+
+		// The output may be the input, which is still mapped
+		const MeshFileHeader* header = meshFile.GetHeader();
+		U32 vertexCount = header->VertexCount;
+		std::vector<MeshVertex> vertices(vertexCount);
+		meshFile.ReadVertices(vertices.data());
+		const U32* sourceIndices = (const U32*)meshFile.GetIndexData();
+		std::vector<U32> indices(sourceIndices, sourceIndices + header->IndexCount);
+		MeshLod lods[JAZZ_MESH_MAX_LODS];
+		U32 lodCount = header->LodCount;
+		memcpy(lods, header->Lods, sizeof(lods));
+		bool compressVertices = meshFile.HasCompressedVertices();
+		std::vector<SkinWeights> skinWeights;
+		if (meshFile.IsSkinned()) {
+			skinWeights.assign(meshFile.GetSkinWeights(), meshFile.GetSkinWeights() + vertexCount);
+		}
+		U32 jointCount = header->JointCount;
+		meshFile.Close();
+
+		// LODs share the vertices but are drawn on their own, so each is ordered separately
+		std::vector<U32> cacheOrder;
+		for (U32 lod = 0; lod < lodCount; ++lod) {
+			U32* lodIndices = indices.data() + lods[lod].FirstIndex;
+			U32 indexCount = lods[lod].IndexCount;
+			VertexCacheStats before = AnalyzeVertexCache(lodIndices, indexCount, vertexCount);
+
+			cacheOrder.resize(indexCount);
+			OptimizeVertexCache(lodIndices, indexCount, vertexCount, cacheOrder.data());
+			OptimizeOverdraw(vertices.data(), vertexCount, cacheOrder.data(), indexCount, lodIndices);
+
+			VertexCacheStats after = AnalyzeVertexCache(lodIndices, indexCount, vertexCount);
+			Logger::Log("LOD %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", lod, before.Acmr, after.Acmr, before.Atvr, after.Atvr);
+		}
+
+		std::vector<MeshVertex> fetchOrder(vertexCount);
+		std::vector<U32> sourceOrder = skinWeights.empty() ? std::vector<U32>() : indices;
+		U32 usedVertexCount = OptimizeVertexFetch(vertices.data(), vertexCount, indices.data(), (U32)indices.size(), fetchOrder.data());
+		if (usedVertexCount < vertexCount) {
+			Logger::Log("Dropped %d unreferenced vertices", vertexCount - usedVertexCount);
+		}
+
+		// Skin weights follow their vertices to the new order
+		std::vector<SkinWeights> skinFetchOrder(skinWeights.empty() ? 0 : usedVertexCount);
+		for (U32 i = 0; i < (U32)sourceOrder.size(); ++i) {
+			skinFetchOrder[indices[i]] = skinWeights[sourceOrder[i]];
+		}
+
+		return MeshFile::Write(outputPath, fetchOrder.data(), usedVertexCount, indices.data(), (U32)indices.size(), lods, lodCount, compressVertices,
+			skinFetchOrder.empty() ? nullptr : skinFetchOrder.data(), jointCount);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Types.h"
+#include "Mesh.h"
+
+// Entries in the simulated post-transform cache, a FIFO of this size is a fair stand-in for current hardware
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+// How much worse than its source cluster's ACMR a split off overdraw cluster may be
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+namespace Jazz {
+
+	struct VertexCacheStats {
+		F32 Acmr; // Cache misses per triangle, 0.5 at best for a regular grid and 3 at worst
+		F32 Atvr; // Cache misses per referenced vertex, 1 means every vertex is transformed exactly once
+	};
+
+	// Offline reordering of mesh data for the GPU. Every pass keeps the triangles themselves intact, only their order
+	// and the order of the vertices change.
+	class MeshOptimizer {
+	public:
+		// Tipsify (Sander, Nehab and Barczak): fans around the most recently used vertex that will still be cached once
+		// its remaining triangles are emitted. outIndices needs room for indexCount entries and must not alias indices.
+		static void OptimizeVertexCache(const U32* indices, U32 indexCount, U32 vertexCount, U32* outIndices);
+
+		// Splits cache optimized triangles into clusters wherever the cache starts over, or costs at most threshold times
+		// the surrounding ACMR, then draws the clusters facing out of the mesh first so they occlude the rest.
+		// outIndices needs room for indexCount entries and must not alias indices.
+		static void OptimizeOverdraw(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32* outIndices,
+			F32 threshold = MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+
+		// Reorders vertices by first use and rewrites indices in place to match, dropping unreferenced vertices.
+		// outVertices needs room for vertexCount entries. Returns the new vertex count.
+		static U32 OptimizeVertexFetch(const MeshVertex* vertices, U32 vertexCount, U32* indices, U32 indexCount, MeshVertex* outVertices);
+
+		static VertexCacheStats AnalyzeVertexCache(const U32* indices, U32 indexCount, U32 vertexCount, U32 cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+
+		// Rewrites a mesh file with every LOD optimized for the vertex cache then overdraw, and its vertices for fetch
+		// locality. Logs ACMR and ATVR before and after for each LOD.
+		static const bool OptimizeMeshFile(const char* inputPath, const char* outputPath);
+	};
+}
\ No newline at end of file
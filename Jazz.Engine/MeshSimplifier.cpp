@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Logger.h"
+#include "TMath.h"
+#include "MeshSimplifier.h"
+
+// Border planes are weighted far above surface planes so open edges keep their outline
+#define SIMPLIFIER_BORDER_WEIGHT 10.0
+
+// Collapses may turn a triangle by at most about 75 degrees, so flips can't creep in over several passes either
+#define SIMPLIFIER_MIN_NORMAL_DOT 0.25f
+
+// A level must drop at least this share of the previous level's triangles to be kept
+#define SIMPLIFIER_MIN_REDUCTION 0.2f
+
+namespace Jazz {
+
+	// Sum of squared distances to a set of weighted planes, as the symmetric matrix terms of the quadric
+	struct Quadric {
+		F64 A00, A01, A02, A11, A12, A22;
+		F64 B0, B1, B2;
+		F64 C;
+		F64 Weight;
+	};
+
+	struct Collapse {
+		U32 From; // Positions
+		U32 To;
+		F64 Cost;
+	};
+
+	static void addPlane(Quadric& q, F64 a, F64 b, F64 c, F64 d, F64 weight) {
+		q.A00 += weight * a * a;
+		q.A01 += weight * a * b;
+		q.A02 += weight * a * c;
+		q.A11 += weight * b * b;
+		q.A12 += weight * b * c;
+		q.A22 += weight * c * c;
+		q.B0 += weight * a * d;
+		q.B1 += weight * b * d;
+		q.B2 += weight * c * d;
+		q.C += weight * d * d;
+		q.Weight += weight;
+	}
+
+	static void addQuadric(Quadric& q, const Quadric& other) {
+		q.A00 += other.A00;
+		q.A01 += other.A01;
+		q.A02 += other.A02;
+		q.A11 += other.A11;
+		q.A12 += other.A12;
+		q.A22 += other.A22;
+		q.B0 += other.B0;
+		q.B1 += other.B1;
+		q.B2 += other.B2;
+		q.C += other.C;
+		q.Weight += other.Weight;
+	}
+
+	// Weighted mean squared distance of a point to the planes
+	static F64 evaluate(const Quadric& q, const F32* p) {
+		F64 x = p[0], y = p[1], z = p[2];
+		F64 value = q.A00 * x * x + q.A11 * y * y + q.A22 * z * z + 2.0 * (q.A01 * x * y + q.A02 * x * z + q.A12 * y * z) +
+			2.0 * (q.B0 * x + q.B1 * y + q.B2 * z) + q.C;
+		return value > 0.0 && q.Weight > 0.0 ? value / q.Weight : 0.0;
+	}
+
+	static Vec3 triangleNormal(const F32* a, const F32* b, const F32* c) {
+		Vec3 ab = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		Vec3 ac = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		return TMath::Cross(ab, ac);
+	}
+
+	static U64 edgeKey(U32 a, U32 b) {
+		return ((U64)a << 32) | b;
+	}
+
+	U32 MeshSimplifier::Simplify(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32 targetIndexCount,
+		F32 maxError, U32* outIndices, F32* outError) {
+		*outError = 0.0f;
+		memcpy(outIndices, indices, sizeof(U32) * indexCount);
+		if (indexCount <= targetIndexCount) {
+			return indexCount;
+		}
+
+		// Collapses work on positions, vertices that only differ in normal or UV are welded
+		struct PositionHash {
+			size_t operator()(const Vec3& p) const {
+				U32 bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+			}
+		};
+		struct PositionEqual {
+			bool operator()(const Vec3& a, const Vec3& b) const { return a.X == b.X && a.Y == b.Y && a.Z == b.Z; }
+		};
+
+		std::unordered_map<Vec3, U32, PositionHash, PositionEqual> positionLookup;
+		std::vector<U32> vertexPositions(vertexCount);
+		std::vector<U32> positionVertices; // One vertex per position
+		std::vector<U32> positionVertexCounts;
+		for (U32 i = 0; i < vertexCount; ++i) {
+			const F32* p = vertices[i].Position;
+			auto inserted = positionLookup.emplace(Vec3{ p[0], p[1], p[2] }, (U32)positionVertices.size());
+			if (inserted.second) {
+				positionVertices.push_back(i);
+				positionVertexCounts.push_back(0);
+			}
+			vertexPositions[i] = inserted.first->second;
+			positionVertexCounts[inserted.first->second]++;
+		}
+
+		U32 positionCount = (U32)positionVertices.size();
+		auto position = [&](U32 p) { return vertices[positionVertices[p]].Position; };
+
+		// Every surface plane goes to its three corners, weighted by triangle area
+		std::vector<Quadric> quadrics(positionCount, Quadric{});
+		std::unordered_set<U64> edges;
+		for (U32 i = 0; i < indexCount; i += 3) {
+			U32 p[3] = { vertexPositions[indices[i]], vertexPositions[indices[i + 1]], vertexPositions[indices[i + 2]] };
+			Vec3 normal = triangleNormal(position(p[0]), position(p[1]), position(p[2]));
+			F32 length = TMath::Length(normal);
+			if (length > 0.0f) {
+				normal = TMath::Scale(normal, 1.0f / length);
+				F64 d = -(normal.X * position(p[0])[0] + normal.Y * position(p[0])[1] + normal.Z * position(p[0])[2]);
+				for (U32 corner = 0; corner < 3; ++corner) {
+					addPlane(quadrics[p[corner]], normal.X, normal.Y, normal.Z, d, length * 0.5f);
+				}
+			}
+			for (U32 corner = 0; corner < 3; ++corner) {
+				edges.insert(edgeKey(p[corner], p[(corner + 1) % 3]));
+			}
+		}
+
+		// Seam positions are locked, border positions get planes standing on their border edges
+		std::vector<U8> locked(positionCount, 0);
+		std::vector<U8> border(positionCount, 0);
+		for (U32 p = 0; p < positionCount; ++p) {
+			locked[p] = positionVertexCounts[p] > 1 ? 1 : 0;
+		}
+		for (U32 i = 0; i < indexCount; i += 3) {
+			U32 p[3] = { vertexPositions[indices[i]], vertexPositions[indices[i + 1]], vertexPositions[indices[i + 2]] };
+			Vec3 normal = TMath::Normalize(triangleNormal(position(p[0]), position(p[1]), position(p[2])));
+			for (U32 corner = 0; corner < 3; ++corner) {
+				U32 a = p[corner];
+				U32 b = p[(corner + 1) % 3];
+				if (edges.count(edgeKey(b, a))) {
+					continue;
+				}
+
+				border[a] = 1;
+				border[b] = 1;
+				Vec3 edge = { position(b)[0] - position(a)[0], position(b)[1] - position(a)[1], position(b)[2] - position(a)[2] };
+				Vec3 planeNormal = TMath::Normalize(TMath::Cross(edge, normal));
+				F64 d = -(planeNormal.X * position(a)[0] + planeNormal.Y * position(a)[1] + planeNormal.Z * position(a)[2]);
+				F64 weight = TMath::Dot(edge, edge) * SIMPLIFIER_BORDER_WEIGHT;
+				addPlane(quadrics[a], planeNormal.X, planeNormal.Y, planeNormal.Z, d, weight);
+				addPlane(quadrics[b], planeNormal.X, planeNormal.Y, planeNormal.Z, d, weight);
+			}
+		}
+
+		U32 count = indexCount;
+		F64 maxCost = (F64)maxError * maxError;
+		F64 appliedCost = 0.0;
+		std::vector<U32> triangleOffsets(positionCount + 1);
+		std::vector<U32> triangleLists;
+		std::vector<Collapse> collapses;
+		std::vector<U8> touched(positionCount);
+		std::vector<U32> collapseVertices(positionCount);
+
+		// Each pass collapses a set of edges far enough apart to not affect each other, cheapest first
+		while (count > targetIndexCount) {
+			std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+			for (U32 i = 0; i < count; ++i) {
+				triangleOffsets[vertexPositions[outIndices[i]] + 1]++;
+			}
+			for (U32 p = 0; p < positionCount; ++p) {
+				triangleOffsets[p + 1] += triangleOffsets[p];
+			}
+			triangleLists.resize(count);
+			std::vector<U32> cursors(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (U32 i = 0; i < count; ++i) {
+				triangleLists[cursors[vertexPositions[outIndices[i]]]++] = i / 3;
+			}
+
+			edges.clear();
+			for (U32 i = 0; i < count; i += 3) {
+				for (U32 corner = 0; corner < 3; ++corner) {
+					edges.insert(edgeKey(vertexPositions[outIndices[i + corner]], vertexPositions[outIndices[i + (corner + 1) % 3]]));
+				}
+			}
+
+			collapses.clear();
+			for (U32 i = 0; i < count; i += 3) {
+				for (U32 corner = 0; corner < 3; ++corner) {
+					U32 ends[2] = { vertexPositions[outIndices[i + corner]], vertexPositions[outIndices[i + (corner + 1) % 3]] };
+					bool borderEdge = !edges.count(edgeKey(ends[1], ends[0]));
+					for (U32 direction = 0; direction < 2; ++direction) {
+						U32 from = ends[direction];
+						U32 to = ends[1 - direction];
+						if (locked[from] || (border[from] && !borderEdge)) {
+							continue;
+						}
+
+						Quadric combined = quadrics[from];
+						addQuadric(combined, quadrics[to]);
+						collapses.push_back({ from, to, evaluate(combined, position(to)) });
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+
+			std::fill(touched.begin(), touched.end(), 0);
+			U32 remaining = count;
+			U32 applied = 0;
+			for (const Collapse& collapse : collapses) {
+				if (remaining <= targetIndexCount || collapse.Cost > maxCost) {
+					break;
+				}
+				if (touched[collapse.From] || touched[collapse.To]) {
+					continue;
+				}
+
+				// Reject collapses that flip a triangle, and find which vertex of the target the triangles continue with
+				bool flips = false;
+				U32 removed = 0;
+				U32 targetVertex = positionVertices[collapse.To];
+				for (U32 t = triangleOffsets[collapse.From]; t < triangleOffsets[collapse.From + 1] && !flips; ++t) {
+					const U32* triangle = &outIndices[triangleLists[t] * 3];
+					U32 p[3] = { vertexPositions[triangle[0]], vertexPositions[triangle[1]], vertexPositions[triangle[2]] };
+					if (p[0] == collapse.To || p[1] == collapse.To || p[2] == collapse.To) {
+						targetVertex = triangle[p[0] == collapse.To ? 0 : (p[1] == collapse.To ? 1 : 2)];
+						removed++;
+						continue;
+					}
+
+					const F32* before[3] = { position(p[0]), position(p[1]), position(p[2]) };
+					const F32* after[3] = { before[0], before[1], before[2] };
+					for (U32 corner = 0; corner < 3; ++corner) {
+						after[corner] = p[corner] == collapse.From ? position(collapse.To) : before[corner];
+					}
+					Vec3 normalBefore = triangleNormal(before[0], before[1], before[2]);
+					Vec3 normalAfter = triangleNormal(after[0], after[1], after[2]);
+					flips = TMath::Dot(normalBefore, normalAfter) <= SIMPLIFIER_MIN_NORMAL_DOT * TMath::Length(normalBefore) * TMath::Length(normalAfter);
+				}
+				if (flips) {
+					continue;
+				}
+
+				// Everything around the collapse changes, so nothing else around it moves this pass
+				for (U32 t = triangleOffsets[collapse.From]; t < triangleOffsets[collapse.From + 1]; ++t) {
+					const U32* triangle = &outIndices[triangleLists[t] * 3];
+					for (U32 corner = 0; corner < 3; ++corner) {
+						touched[vertexPositions[triangle[corner]]] = 1;
+					}
+				}
+				touched[collapse.To] = 1;
+
+				collapseVertices[collapse.From] = targetVertex;
+				touched[collapse.From] = 2;
+				addQuadric(quadrics[collapse.To], quadrics[collapse.From]);
+				appliedCost = std::max(appliedCost, collapse.Cost);
+				remaining -= removed * 3;
+				applied++;
+			}
+
+			if (applied == 0) {
+				break;
+			}
+
+			// Move the collapsed vertices and drop the triangles that degenerated
+			U32 kept = 0;
+			for (U32 i = 0; i < count; i += 3) {
+				U32 triangle[3];
+				for (U32 corner = 0; corner < 3; ++corner) {
+					U32 vertex = outIndices[i + corner];
+					U32 p = vertexPositions[vertex];
+					triangle[corner] = touched[p] == 2 ? collapseVertices[p] : vertex;
+				}
+
+				U32 p0 = vertexPositions[triangle[0]];
+				U32 p1 = vertexPositions[triangle[1]];
+				U32 p2 = vertexPositions[triangle[2]];
+				if (p0 == p1 || p1 == p2 || p0 == p2) {
+					continue;
+				}
+				outIndices[kept++] = triangle[0];
+				outIndices[kept++] = triangle[1];
+				outIndices[kept++] = triangle[2];
+			}
+			count = kept;
+		}
+
+		*outError = (F32)sqrt(appliedCost);
+		return count;
+	}
+
+	U32 MeshSimplifier::GenerateLods(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount,
+		std::vector<U32>& outIndices, MeshLod* outLods, U32 maxLodCount) {
+		outIndices.assign(indices, indices + indexCount);
+		outLods[0] = { 0, indexCount, 0.0f, 0 };
+
+		// Every level simplifies the source rather than the level before, so its error is measured against the source
+		std::vector<U32> lodIndices(indexCount);
+		U32 lodCount = 1;
+		U32 previousCount = indexCount;
+		F32 previousError = 0.0f;
+		while (lodCount < maxLodCount) {
+			U32 target = (previousCount / 6) * 3;
+			F32 error = 0.0f;
+			U32 count = Simplify(vertices, vertexCount, indices, indexCount, target, 1e30f, lodIndices.data(), &error);
+			if (count == 0 || (F32)count > (F32)previousCount * (1.0f - SIMPLIFIER_MIN_REDUCTION)) {
+				break;
+			}
+
+			// Errors only grow with the level so selection can stop at the first level that is too coarse
+			previousError = std::max(previousError, error);
+			outLods[lodCount] = { (U32)outIndices.size(), count, previousError, 0 };
+			outIndices.insert(outIndices.end(), lodIndices.begin(), lodIndices.begin() + count);
+			previousCount = count;
+			lodCount++;
+		}
+		return lodCount;
+	}
+
+	const bool MeshSimplifier::BuildLodFile(const char* inputPath, const char* outputPath) {
+		MeshFile meshFile;
+		if (!meshFile.Open(inputPath)) {
+			return false;
+		}
+
+		// Simplification works on the decoded vertices, the output keeps the input's vertex format
+		const MeshFileHeader* header = meshFile.GetHeader();
+		std::vector<MeshVertex> vertices(header->VertexCount);
+		meshFile.ReadVertices(vertices.data());
+		bool compressVertices = meshFile.HasCompressedVertices();
+
+		const U32* indices = (const U32*)meshFile.GetIndexData() + header->Lods[0].FirstIndex;
+		std::vector<U32> lodIndices;
+		MeshLod lods[JAZZ_MESH_MAX_LODS];
+		U32 lodCount = GenerateLods(vertices.data(), header->VertexCount, indices, header->Lods[0].IndexCount, lodIndices, lods);
+
+		for (U32 lod = 0; lod < lodCount; ++lod) {
+			Logger::Log("LOD %d: %d triangles, error %f", lod, lods[lod].IndexCount / 3, lods[lod].Error);
+		}
+
+		// The output may be the input, which is still mapped. Vertices keep their place, so do their skin weights.
+		std::vector<SkinWeights> skinWeights;
+		if (meshFile.IsSkinned()) {
+			skinWeights.assign(meshFile.GetSkinWeights(), meshFile.GetSkinWeights() + header->VertexCount);
+		}
+		U32 jointCount = header->JointCount;
+		meshFile.Close();
+		return MeshFile::Write(outputPath, vertices.data(), (U32)vertices.size(), lodIndices.data(), (U32)lodIndices.size(), lods, lodCount, compressVertices,
+			skinWeights.empty() ? nullptr : skinWeights.data(), jointCount);
+	}
+}
\ No newline at end of file
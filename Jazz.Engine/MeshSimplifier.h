@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+#include "Mesh.h"
+
+namespace Jazz {
+
+	// Quadric error edge collapse (Garland and Heckbert). Vertices only ever collapse onto other vertices, so every
+	// level keeps indexing the original vertex buffer and a mesh file can store its LODs as extra index ranges.
+	class MeshSimplifier {
+	public:
+		// Collapses the cheapest edges until at most targetIndexCount indices remain or the next collapse would move the
+		// surface by more than maxError. Attribute seams are kept, open borders only collapse along themselves. outIndices
+		// needs room for indexCount entries, outError receives the largest object space error introduced. Returns the new
+		// index count.
+		static U32 Simplify(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32 targetIndexCount,
+			F32 maxError, U32* outIndices, F32* outError);
+
+		// LOD 0 is the source, every further level aims for half the triangles of the one before and stops once that
+		// no longer pays off. outIndices receives every level back to back. Returns the LOD count.
+		static U32 GenerateLods(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount,
+			std::vector<U32>& outIndices, MeshLod* outLods, U32 maxLodCount = JAZZ_MESH_MAX_LODS);
+
+		// Rewrites a mesh file with a generated LOD chain, built from its first LOD
+		static const bool BuildLodFile(const char* inputPath, const char* outputPath);
+	};
+}
\ No newline at end of file
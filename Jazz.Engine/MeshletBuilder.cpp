@@ -0,0 +1,165 @@
+#include <math.h>
+
+#include "Defines.h"
+#include "TMath.h"
+#include "MeshletBuilder.h"
+
+// Normal cones wider than about 84 degrees from the axis cull too rarely to be worth testing
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+namespace Jazz {
+
+	static Vec3 vertexPosition(const MeshVertex* vertices, U32 index) {
+		return { vertices[index].Position[0], vertices[index].Position[1], vertices[index].Position[2] };
+	}
+
+	static void computeBounds(const MeshVertex* vertices, const U32* indices, U32 indexCount, Meshlet& meshlet) {
+		Vec3 first = vertexPosition(vertices, indices[0]);
+		Vec3 min = first;
+		Vec3 max = first;
+		for (U32 i = 1; i < indexCount; ++i) {
+			Vec3 p = vertexPosition(vertices, indices[i]);
+			min = { p.X < min.X ? p.X : min.X, p.Y < min.Y ? p.Y : min.Y, p.Z < min.Z ? p.Z : min.Z };
+			max = { p.X > max.X ? p.X : max.X, p.Y > max.Y ? p.Y : max.Y, p.Z > max.Z ? p.Z : max.Z };
+		}
+
+		Vec3 center = TMath::Scale(TMath::Add(min, max), 0.5f);
+		F32 radiusSquared = 0.0f;
+		for (U32 i = 0; i < indexCount; ++i) {
+			Vec3 offset = TMath::Subtract(vertexPosition(vertices, indices[i]), center);
+			F32 distanceSquared = TMath::Dot(offset, offset);
+			radiusSquared = distanceSquared > radiusSquared ? distanceSquared : radiusSquared;
+		}
+
+		meshlet.Center[0] = center.X;
+		meshlet.Center[1] = center.Y;
+		meshlet.Center[2] = center.Z;
+		meshlet.Radius = sqrtf(radiusSquared);
+
+		// Cone around the average face normal, faces wind counter clockwise
+		Vec3 normals[MESHLET_MAX_TRIANGLES];
+		U32 normalCount = 0;
+		Vec3 sum = { 0.0f, 0.0f, 0.0f };
+		for (U32 i = 0; i < indexCount; i += 3) {
+			Vec3 p0 = vertexPosition(vertices, indices[i + 0]);
+			Vec3 p1 = vertexPosition(vertices, indices[i + 1]);
+			Vec3 p2 = vertexPosition(vertices, indices[i + 2]);
+			Vec3 normal = TMath::Cross(TMath::Subtract(p1, p0), TMath::Subtract(p2, p0));
+			F32 length = TMath::Length(normal);
+			if (length > 0.0f) {
+				normals[normalCount] = TMath::Scale(normal, 1.0f / length);
+				sum = TMath::Add(sum, normals[normalCount]);
+				normalCount++;
+			}
+		}
+
+		Vec3 axis = TMath::Normalize(sum);
+		F32 minDot = normalCount > 0 && TMath::Length(sum) > 0.0f ? 1.0f : -1.0f;
+		for (U32 i = 0; i < normalCount; ++i) {
+			F32 d = TMath::Dot(axis, normals[i]);
+			minDot = d < minDot ? d : minDot;
+		}
+
+		meshlet.ConeAxis[0] = axis.X;
+		meshlet.ConeAxis[1] = axis.Y;
+		meshlet.ConeAxis[2] = axis.Z;
+		meshlet.ConeCutoff = minDot > MESHLET_MIN_CONE_DOT ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+	}
+
+	U32 MeshletBuilder::Build(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32* outIndices,
+		std::vector<Meshlet>& outMeshlets) {
+		outMeshlets.clear();
+		U32 triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return 0;
+		}
+
+		// Triangles around each vertex
+		std::vector<U32> adjacencyOffsets(vertexCount + 1, 0);
+		for (U32 i = 0; i < triangleCount * 3; ++i) {
+			adjacencyOffsets[indices[i] + 1]++;
+		}
+		for (U32 v = 0; v < vertexCount; ++v) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		std::vector<U32> adjacency(triangleCount * 3);
+		std::vector<U32> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (U32 i = 0; i < triangleCount * 3; ++i) {
+			adjacency[adjacencyFill[indices[i]]++] = i / 3;
+		}
+
+		std::vector<U8> emitted(triangleCount, 0);
+		std::vector<U32> vertexMeshlets(vertexCount, U32_MAX); // Last meshlet each vertex was added to
+		std::vector<U32> candidates;
+		U32 seed = 0;
+		U32 outIndexCount = 0;
+
+		while (true) {
+			while (seed < triangleCount && emitted[seed]) {
+				++seed;
+			}
+			if (seed == triangleCount) {
+				break;
+			}
+
+			U32 meshletIndex = (U32)outMeshlets.size();
+			Meshlet meshlet = {};
+			meshlet.FirstIndex = outIndexCount;
+			candidates.clear();
+			candidates.push_back(seed);
+
+			while (meshlet.IndexCount < MESHLET_MAX_TRIANGLES * 3) {
+
+				// Neighbour adding the fewest new vertices, dropping the ones another pick already took
+				U32 best = U32_MAX;
+				U32 bestNewVertices = 4;
+				U32 kept = 0;
+				for (U32 i = 0; i < (U32)candidates.size(); ++i) {
+					U32 triangle = candidates[i];
+					if (emitted[triangle]) {
+						continue;
+					}
+					candidates[kept++] = triangle;
+
+					U32 newVertices = 0;
+					for (U32 corner = 0; corner < 3; ++corner) {
+						newVertices += vertexMeshlets[indices[triangle * 3 + corner]] != meshletIndex ? 1 : 0;
+					}
+					if (newVertices < bestNewVertices) {
+						best = triangle;
+						bestNewVertices = newVertices;
+					}
+				}
+				candidates.resize(kept);
+
+				// Nothing connected is left, the next seed starts a new meshlet rather than a far away patch
+				if (best == U32_MAX || meshlet.VertexCount + bestNewVertices > MESHLET_MAX_VERTICES) {
+					break;
+				}
+
+				emitted[best] = 1;
+				for (U32 corner = 0; corner < 3; ++corner) {
+					U32 vertex = indices[best * 3 + corner];
+					outIndices[outIndexCount++] = vertex;
+					if (vertexMeshlets[vertex] == meshletIndex) {
+						continue;
+					}
+
+					vertexMeshlets[vertex] = meshletIndex;
+					meshlet.VertexCount++;
+					for (U32 i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; ++i) {
+						if (!emitted[adjacency[i]]) {
+							candidates.push_back(adjacency[i]);
+						}
+					}
+				}
+				meshlet.IndexCount += 3;
+			}
+
+			computeBounds(vertices, outIndices + meshlet.FirstIndex, meshlet.IndexCount, meshlet);
+			outMeshlets.push_back(meshlet);
+		}
+
+		return (U32)outMeshlets.size();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+#include "Mesh.h"
+
+// Meshlet size limits, small enough for a workgroup to own one and matching what mesh shading hardware prefers
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+namespace Jazz {
+
+	// A small connected patch of a mesh with bounds to cull it on its own. It faces entirely away from a camera when
+	// dot(Center - camera, ConeAxis) >= ConeCutoff * |Center - camera| + Radius.
+	struct Meshlet {
+		U32 FirstIndex; // Into the reordered index buffer
+		U32 IndexCount;
+		U32 VertexCount; // Distinct vertices
+		F32 Center[3];
+		F32 Radius;
+		F32 ConeAxis[3];
+		F32 ConeCutoff; // Sine of the normal cone's half angle, 1 when the normals spread too far to ever cull
+	};
+
+	class MeshletBuilder {
+	public:
+		// Grows each meshlet from the first unassigned triangle, always adding the neighbouring triangle that brings in the
+		// fewest new vertices. outIndices needs room for indexCount entries and receives the triangles reordered so each
+		// meshlet is a contiguous range. Returns the meshlet count.
+		static U32 Build(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount, U32* outIndices,
+			std::vector<Meshlet>& outMeshlets);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,737 @@
+#include <algorithm>
+#include <random>
+#include <string.h>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "OcclusionBuffer.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+// Stand-in for the missing edge of a triangle side, far outside any buffer
+#define OCCLUSION_EDGE_FAR 1e30f
+
+// Occluder triangles per parallel setup batch
+#define OCCLUSION_SETUP_BATCH_SIZE 256
+
+// Spheres per parallel test batch
+#define OCCLUSION_TEST_BATCH_SIZE 1024
+
+namespace Jazz {
+
+	OcclusionBuffer::OcclusionBuffer(U32 width, U32 height) {
+		_tilesX = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+		_tilesY = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+		_width = _tilesX * OCCLUSION_TILE_WIDTH;
+		_height = _tilesY * OCCLUSION_TILE_HEIGHT;
+		_tiles.resize(_tilesX * _tilesY);
+
+		_view = TMath::Identity();
+		_projection = TMath::Identity();
+		_viewProjection = TMath::Identity();
+		_occluderTriangleCount = 0;
+		_stats = {};
+	}
+
+	void OcclusionBuffer::Begin(const Mat4& view, const Mat4& projection) {
+		_view = view;
+		_projection = projection;
+		_viewProjection = TMath::Multiply(projection, view);
+
+		for (OcclusionTile& tile : _tiles) {
+			memset(tile.Mask, 0, sizeof(tile.Mask));
+			tile.ZMax0 = 1.0f;
+			tile.ZMax1 = 0.0f;
+		}
+
+		_occluders.clear();
+		_occluderTriangleCount = 0;
+		_stats = {};
+	}
+
+	void OcclusionBuffer::AddOccluder(const F32* positions, const U32* indices, U32 indexCount, const Mat4& transform) {
+		Occluder occluder;
+		occluder.Positions = positions;
+		occluder.Indices = indices;
+		occluder.TriangleCount = indexCount / 3;
+		occluder.FirstTriangle = _occluderTriangleCount;
+		occluder.Transform = TMath::Multiply(_viewProjection, transform);
+		_occluders.push_back(occluder);
+		_occluderTriangleCount += occluder.TriangleCount;
+	}
+
+	static FORCEINLINE Vec4 transformClip(const Mat4& m, const F32* p) {
+		return {
+			m.M[0] * p[0] + m.M[4] * p[1] + m.M[8] * p[2] + m.M[12],
+			m.M[1] * p[0] + m.M[5] * p[1] + m.M[9] * p[2] + m.M[13],
+			m.M[2] * p[0] + m.M[6] * p[1] + m.M[10] * p[2] + m.M[14],
+			m.M[3] * p[0] + m.M[7] * p[1] + m.M[11] * p[2] + m.M[15]
+		};
+	}
+
+	// Bits first to last of a 32 pixel row, either end may be outside the row
+	static FORCEINLINE U32 rowMask(I32 first, I32 last) {
+		I32 begin = first < 0 ? 0 : first;
+		I32 end = last + 1 > 32 ? 32 : last + 1;
+		if (end <= begin) {
+			return 0;
+		}
+		U32 endMask = end == 32 ? 0xffffffffu : (1u << end) - 1;
+		return endMask & ~((1u << begin) - 1);
+	}
+
+	static void setupTriangle(const Vec4* clip, F32 width, F32 height, OcclusionTriangle* out) {
+		out->MinY = 1.0f;
+		out->MaxY = 0.0f;
+
+		F32 x[3], y[3], z[3];
+		for (U32 i = 0; i < 3; ++i) {
+			F32 invW = 1.0f / clip[i].W;
+			x[i] = (clip[i].X * invW * 0.5f + 0.5f) * width;
+			y[i] = (clip[i].Y * invW * 0.5f + 0.5f) * height;
+			z[i] = clip[i].Z * invW;
+		}
+
+		// Front faces wind clockwise in Y down screen space. Slivers are dropped too, losing an occluder
+		// triangle only ever makes the buffer more conservative.
+		F32 area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (!(area < -1e-3f)) {
+			return;
+		}
+
+		F32 minX = std::min(x[0], std::min(x[1], x[2]));
+		F32 maxX = std::max(x[0], std::max(x[1], x[2]));
+		F32 minY = std::min(y[0], std::min(y[1], y[2]));
+		F32 maxY = std::max(y[0], std::max(y[1], y[2]));
+		if (maxX < 0.0f || minX >= width || maxY < 0.0f || minY >= height) {
+			return;
+		}
+
+		// Edge i runs from vertex i to the next, the inside is a * x + b * y + c >= 0. Horizontal edges
+		// are covered by the triangle's Y range.
+		for (U32 i = 0; i < 3; ++i) {
+			U32 j = (i + 1) % 3;
+			F32 a = y[j] - y[i];
+			F32 b = x[i] - x[j];
+			F32 c = -a * x[i] - b * y[i];
+
+			out->LeftSlope[i] = 0.0f;
+			out->LeftOffset[i] = -OCCLUSION_EDGE_FAR;
+			out->RightSlope[i] = 0.0f;
+			out->RightOffset[i] = OCCLUSION_EDGE_FAR;
+			if (a > 0.0f) {
+				out->LeftSlope[i] = -b / a;
+				out->LeftOffset[i] = -c / a;
+			} else if (a < 0.0f) {
+				out->RightSlope[i] = -b / a;
+				out->RightOffset[i] = -c / a;
+			}
+		}
+
+		out->DepthDx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+		out->DepthDy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+		out->DepthOrigin = z[0] - out->DepthDx * x[0] - out->DepthDy * y[0];
+		out->MaxDepth = std::max(z[0], std::max(z[1], z[2]));
+
+		out->MinX = minX;
+		out->MaxX = maxX;
+		out->MinY = minY;
+		out->MaxY = maxY;
+	}
+
+	void OcclusionBuffer::setupTriangles(U32 start, U32 end) {
+		U32 occluderIndex = 0;
+		while (start >= _occluders[occluderIndex].FirstTriangle + _occluders[occluderIndex].TriangleCount) {
+			++occluderIndex;
+		}
+
+		for (U32 triangle = start; triangle < end; ++triangle) {
+			while (triangle >= _occluders[occluderIndex].FirstTriangle + _occluders[occluderIndex].TriangleCount) {
+				++occluderIndex;
+			}
+			const Occluder& occluder = _occluders[occluderIndex];
+			const U32* indices = occluder.Indices + (triangle - occluder.FirstTriangle) * 3;
+
+			Vec4 vertices[3];
+			for (U32 i = 0; i < 3; ++i) {
+				vertices[i] = transformClip(occluder.Transform, occluder.Positions + indices[i] * 3);
+			}
+
+			// Clip against the near plane (z >= 0), which leaves a polygon of up to four vertices
+			Vec4 polygon[4];
+			U32 polygonCount = 0;
+			for (U32 i = 0; i < 3; ++i) {
+				const Vec4& a = vertices[i];
+				const Vec4& b = vertices[(i + 1) % 3];
+				if (a.Z >= 0.0f) {
+					polygon[polygonCount++] = a;
+				}
+				if ((a.Z >= 0.0f) != (b.Z >= 0.0f)) {
+					F32 t = a.Z / (a.Z - b.Z);
+					polygon[polygonCount++] = { a.X + (b.X - a.X) * t, a.Y + (b.Y - a.Y) * t, 0.0f, a.W + (b.W - a.W) * t };
+				}
+			}
+
+			OcclusionTriangle* out = &_triangles[triangle * 2];
+			out[0].MinY = 1.0f;
+			out[0].MaxY = 0.0f;
+			out[1].MinY = 1.0f;
+			out[1].MaxY = 0.0f;
+			if (polygonCount >= 3) {
+				setupTriangle(polygon, (F32)_width, (F32)_height, &out[0]);
+			}
+			if (polygonCount == 4) {
+				Vec4 second[3] = { polygon[0], polygon[2], polygon[3] };
+				setupTriangle(second, (F32)_width, (F32)_height, &out[1]);
+			}
+		}
+	}
+
+	// Merges a triangle's coverage of a tile into the working layer, see OcclusionTile
+	static FORCEINLINE void updateTile(OcclusionTile& tile, const U32* mask, F32 depth) {
+		bool workingEmpty = true;
+		bool full = true;
+		for (U32 row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+			workingEmpty &= tile.Mask[row] == 0;
+		}
+
+		// Restart the working layer when merging would push it back further than the triangle is from the reference layer
+		if (!workingEmpty && depth - tile.ZMax1 > tile.ZMax0 - depth) {
+			memset(tile.Mask, 0, sizeof(tile.Mask));
+			workingEmpty = true;
+		}
+
+		tile.ZMax1 = workingEmpty ? depth : std::max(tile.ZMax1, depth);
+		for (U32 row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+			tile.Mask[row] |= mask[row];
+			full &= tile.Mask[row] == 0xffffffffu;
+		}
+
+		if (full) {
+			tile.ZMax0 = tile.ZMax1;
+			tile.ZMax1 = 0.0f;
+			memset(tile.Mask, 0, sizeof(tile.Mask));
+		}
+	}
+
+	// Farthest depth of the triangle inside a tile: its plane at the farthest tile corner, capped by its farthest vertex
+	static FORCEINLINE F32 tileDepth(const OcclusionTriangle& triangle, F32 tileX, F32 tileY) {
+		F32 x = triangle.DepthDx > 0.0f ? tileX + OCCLUSION_TILE_WIDTH : tileX;
+		F32 y = triangle.DepthDy > 0.0f ? tileY + OCCLUSION_TILE_HEIGHT : tileY;
+		return std::min(triangle.DepthOrigin + triangle.DepthDx * x + triangle.DepthDy * y, triangle.MaxDepth);
+	}
+
+	static void rasterizeScalar(const OcclusionTriangle& triangle, OcclusionTile* tiles, U32 tileRow, U32 tileBegin, U32 tileEnd) {
+		F32 rowY = (F32)(tileRow * OCCLUSION_TILE_HEIGHT);
+
+		// Span of pixel centers covered on each row
+		I32 first[OCCLUSION_TILE_HEIGHT];
+		I32 last[OCCLUSION_TILE_HEIGHT];
+		for (U32 row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+			F32 y = rowY + row + 0.5f;
+			F32 left = -OCCLUSION_EDGE_FAR;
+			F32 right = OCCLUSION_EDGE_FAR;
+			for (U32 i = 0; i < 3; ++i) {
+				left = std::max(left, y * triangle.LeftSlope[i] + triangle.LeftOffset[i]);
+				right = std::min(right, y * triangle.RightSlope[i] + triangle.RightOffset[i]);
+			}
+			left = std::min(std::max(ceilf(left - 0.5f), -64.0f), 1e8f);
+			right = std::min(std::max(floorf(right - 0.5f), -64.0f), 1e8f);
+
+			bool inside = y >= triangle.MinY && y <= triangle.MaxY;
+			first[row] = inside ? (I32)left : 0;
+			last[row] = inside ? (I32)right : -1;
+		}
+
+		for (U32 tileX = tileBegin; tileX <= tileEnd; ++tileX) {
+			I32 x = (I32)(tileX * OCCLUSION_TILE_WIDTH);
+			U32 mask[OCCLUSION_TILE_HEIGHT];
+			U32 any = 0;
+			for (U32 row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+				mask[row] = rowMask(first[row] - x, last[row] - x);
+				any |= mask[row];
+			}
+			if (!any) {
+				continue;
+			}
+
+			OcclusionTile& tile = tiles[tileX];
+			F32 depth = tileDepth(triangle, (F32)x, rowY);
+			if (depth < tile.ZMax0) {
+				updateTile(tile, mask, depth);
+			}
+		}
+	}
+
+#ifdef ARCH_X64
+	// One AVX2 register holds a whole tile, one 32 bit row per lane
+	TARGET_AVX2 static void rasterizeAVX2(const OcclusionTriangle& triangle, OcclusionTile* tiles, U32 tileRow, U32 tileBegin, U32 tileEnd) {
+		F32 rowY = (F32)(tileRow * OCCLUSION_TILE_HEIGHT);
+		__m256 y = _mm256_add_ps(_mm256_set1_ps(rowY + 0.5f), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+
+		__m256 left = _mm256_fmadd_ps(y, _mm256_set1_ps(triangle.LeftSlope[0]), _mm256_set1_ps(triangle.LeftOffset[0]));
+		__m256 right = _mm256_fmadd_ps(y, _mm256_set1_ps(triangle.RightSlope[0]), _mm256_set1_ps(triangle.RightOffset[0]));
+		for (U32 i = 1; i < 3; ++i) {
+			left = _mm256_max_ps(left, _mm256_fmadd_ps(y, _mm256_set1_ps(triangle.LeftSlope[i]), _mm256_set1_ps(triangle.LeftOffset[i])));
+			right = _mm256_min_ps(right, _mm256_fmadd_ps(y, _mm256_set1_ps(triangle.RightSlope[i]), _mm256_set1_ps(triangle.RightOffset[i])));
+		}
+
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 lowest = _mm256_set1_ps(-64.0f);
+		__m256 highest = _mm256_set1_ps(1e8f);
+		left = _mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(_mm256_sub_ps(left, half)), lowest), highest);
+		right = _mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(_mm256_sub_ps(right, half)), lowest), highest);
+
+		// Rows outside the triangle get an empty span
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(y, _mm256_set1_ps(triangle.MinY), _CMP_GE_OQ), _mm256_cmp_ps(y, _mm256_set1_ps(triangle.MaxY), _CMP_LE_OQ));
+		__m256i first = _mm256_castps_si256(_mm256_and_ps(inside, _mm256_castsi256_ps(_mm256_cvtps_epi32(left))));
+		__m256i end = _mm256_castps_si256(_mm256_and_ps(inside, _mm256_castsi256_ps(_mm256_add_epi32(_mm256_cvtps_epi32(right), _mm256_set1_epi32(1)))));
+
+		__m256i zero = _mm256_setzero_si256();
+		__m256i thirtyTwo = _mm256_set1_epi32(32);
+		__m256i ones = _mm256_set1_epi32(-1);
+
+		for (U32 tileX = tileBegin; tileX <= tileEnd; ++tileX) {
+			__m256i x = _mm256_set1_epi32((I32)(tileX * OCCLUSION_TILE_WIDTH));
+
+			// Variable shifts of 32 or more give 0, which takes care of spans that end before or start after the tile
+			__m256i begin = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(first, x), zero), thirtyTwo);
+			__m256i stop = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(end, x), zero), thirtyTwo);
+			__m256i mask = _mm256_and_si256(_mm256_sllv_epi32(ones, begin), _mm256_srlv_epi32(ones, _mm256_sub_epi32(thirtyTwo, stop)));
+			if (_mm256_testz_si256(mask, mask)) {
+				continue;
+			}
+
+			OcclusionTile& tile = tiles[tileX];
+			F32 depth = tileDepth(triangle, (F32)(tileX * OCCLUSION_TILE_WIDTH), rowY);
+			if (depth >= tile.ZMax0) {
+				continue;
+			}
+
+			__m256i working = _mm256_loadu_si256((const __m256i*)tile.Mask);
+			bool workingEmpty = _mm256_testz_si256(working, working) != 0;
+			if (!workingEmpty && depth - tile.ZMax1 > tile.ZMax0 - depth) {
+				working = zero;
+				workingEmpty = true;
+			}
+
+			tile.ZMax1 = workingEmpty ? depth : std::max(tile.ZMax1, depth);
+			working = _mm256_or_si256(working, mask);
+
+			if (_mm256_testc_si256(working, ones)) {
+				tile.ZMax0 = tile.ZMax1;
+				tile.ZMax1 = 0.0f;
+				working = zero;
+			}
+			_mm256_storeu_si256((__m256i*)tile.Mask, working);
+		}
+	}
+#endif
+
+	void OcclusionBuffer::rasterizeTileRow(U32 tileRow, SimdLevel level) {
+		OcclusionTile* tiles = &_tiles[tileRow * _tilesX];
+		F32 top = (F32)(tileRow * OCCLUSION_TILE_HEIGHT) + 0.5f;
+		F32 bottom = top + OCCLUSION_TILE_HEIGHT - 1;
+
+		// Occluders are submitted in order, so tiles see their triangles in the same order on every level
+		for (const OcclusionTriangle& triangle : _triangles) {
+			if (triangle.MaxY < top || triangle.MinY > bottom) {
+				continue;
+			}
+
+			I32 begin = (I32)triangle.MinX / OCCLUSION_TILE_WIDTH;
+			I32 end = (I32)triangle.MaxX / OCCLUSION_TILE_WIDTH;
+			U32 tileBegin = begin < 0 ? 0 : (U32)begin;
+			U32 tileEnd = end >= (I32)_tilesX ? _tilesX - 1 : (U32)end;
+
+#ifdef ARCH_X64
+			if (level >= SimdLevel::AVX2) {
+				rasterizeAVX2(triangle, tiles, tileRow, tileBegin, tileEnd);
+				continue;
+			}
+#endif
+			rasterizeScalar(triangle, tiles, tileRow, tileBegin, tileEnd);
+		}
+	}
+
+	void OcclusionBuffer::Rasterize(SimdLevel level, bool parallel) {
+		_stats.OccluderCount = (U32)_occluders.size();
+		_triangles.resize(_occluderTriangleCount * 2);
+		if (_occluderTriangleCount == 0) {
+			return;
+		}
+
+		if (parallel) {
+			JobSystem::ParallelFor(_occluderTriangleCount, OCCLUSION_SETUP_BATCH_SIZE, [&](U32 start, U32 end) {
+				setupTriangles(start, end);
+			});
+		} else {
+			setupTriangles(0, _occluderTriangleCount);
+		}
+
+		_stats.TriangleCount = 0;
+		for (const OcclusionTriangle& triangle : _triangles) {
+			_stats.TriangleCount += triangle.MinY <= triangle.MaxY ? 1 : 0;
+		}
+
+		// Every tile row is owned by one job, so tiles are written without synchronization
+		if (parallel) {
+			JobSystem::ParallelFor(_tilesY, 1, [&](U32 start, U32 end) {
+				for (U32 tileRow = start; tileRow < end; ++tileRow) {
+					rasterizeTileRow(tileRow, level);
+				}
+			});
+		} else {
+			for (U32 tileRow = 0; tileRow < _tilesY; ++tileRow) {
+				rasterizeTileRow(tileRow, level);
+			}
+		}
+	}
+
+	const bool OcclusionBuffer::IsSphereVisible(const Vec3& center, F32 radius) const {
+		Vec3 c = TMath::TransformPoint(_view, center);
+		c.Z = -c.Z;
+
+		// Spheres reaching the near plane can't be projected
+		F32 zNear = _projection.M[14] / _projection.M[10];
+		if (c.Z < radius + zNear) {
+			return true;
+		}
+
+		// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+		F32 p00 = _projection.M[0];
+		F32 p11 = -_projection.M[5];
+		F32 r2 = radius * radius;
+
+		F32 lengthX = sqrtf(c.X * c.X + c.Z * c.Z - r2);
+		F32 minX = (lengthX * -c.X - radius * -c.Z) / (radius * -c.X + lengthX * -c.Z);
+		F32 maxX = (lengthX * -c.X + radius * -c.Z) / (-radius * -c.X + lengthX * -c.Z);
+		F32 lengthY = sqrtf(c.Y * c.Y + c.Z * c.Z - r2);
+		F32 minY = (lengthY * -c.Y - radius * -c.Z) / (radius * -c.Y + lengthY * -c.Z);
+		F32 maxY = (lengthY * -c.Y + radius * -c.Z) / (-radius * -c.Y + lengthY * -c.Z);
+
+		// Clip space to pixels, Y points down
+		I32 x0 = (I32)floorf((minX * p00 * 0.5f + 0.5f) * _width);
+		I32 x1 = (I32)ceilf((maxX * p00 * 0.5f + 0.5f) * _width);
+		I32 y0 = (I32)floorf((-maxY * p11 * 0.5f + 0.5f) * _height);
+		I32 y1 = (I32)ceilf((-minY * p11 * 0.5f + 0.5f) * _height);
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, (I32)_width);
+		y1 = std::min(y1, (I32)_height);
+		if (x0 >= x1 || y0 >= y1) {
+			return true;
+		}
+
+		// Depth of the point of the sphere closest to the camera
+		F32 depth = _projection.M[14] / (c.Z - radius) - _projection.M[10];
+		return isRectVisible(x0, y0, x1, y1, depth);
+	}
+
+	const bool OcclusionBuffer::isRectVisible(I32 x0, I32 y0, I32 x1, I32 y1, F32 depth) const {
+		for (I32 tileY = y0 / OCCLUSION_TILE_HEIGHT; tileY <= (y1 - 1) / OCCLUSION_TILE_HEIGHT; ++tileY) {
+			for (I32 tileX = x0 / OCCLUSION_TILE_WIDTH; tileX <= (x1 - 1) / OCCLUSION_TILE_WIDTH; ++tileX) {
+				const OcclusionTile& tile = _tiles[tileY * _tilesX + tileX];
+				if (depth > tile.ZMax0) {
+					continue;
+				}
+				if (depth <= tile.ZMax1) {
+					return true;
+				}
+
+				// Hidden only if the working layer covers every pixel of the sphere's rectangle in this tile
+				I32 tileLeft = tileX * OCCLUSION_TILE_WIDTH;
+				I32 tileTop = tileY * OCCLUSION_TILE_HEIGHT;
+				U32 columns = rowMask(x0 - tileLeft, x1 - 1 - tileLeft);
+				I32 rowEnd = std::min(y1 - tileTop, OCCLUSION_TILE_HEIGHT);
+				for (I32 row = std::max(y0 - tileTop, 0); row < rowEnd; ++row) {
+					if ((columns & ~tile.Mask[row]) != 0) {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+#ifdef ARCH_X64
+	// Pixel rectangles and nearest depths of up to 8 spheres, lane by lane
+	struct SphereRects {
+		I32 X0[8], Y0[8], X1[8], Y1[8];
+		F32 Depth[8];
+	};
+
+	// IsSphereVisible() for 4 spheres up to the tile test. Multiplies and adds are kept apart and in the same order, so
+	// every lane rounds exactly like the scalar code. Returns the lanes that still need their tiles tested, the others
+	// are visible.
+	TARGET_SSE41 static U32 projectSpheresSSE(const Mat4& view, const Mat4& projection, U32 width, U32 height, const BoundingSphereSoA& bounds,
+		const U32* indices, SphereRects* out) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+		__m128 sx = _mm_setr_ps(x[indices[0]], x[indices[1]], x[indices[2]], x[indices[3]]);
+		__m128 sy = _mm_setr_ps(y[indices[0]], y[indices[1]], y[indices[2]], y[indices[3]]);
+		__m128 sz = _mm_setr_ps(z[indices[0]], z[indices[1]], z[indices[2]], z[indices[3]]);
+		__m128 radius = _mm_setr_ps(r[indices[0]], r[indices[1]], r[indices[2]], r[indices[3]]);
+
+		__m128 center[3];
+		for (U32 i = 0; i < 3; ++i) {
+			center[i] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(view.M[i]), sx), _mm_mul_ps(_mm_set1_ps(view.M[i + 4]), sy)),
+				_mm_mul_ps(_mm_set1_ps(view.M[i + 8]), sz)), _mm_set1_ps(view.M[i + 12]));
+		}
+		__m128 zero = _mm_setzero_ps();
+		__m128 negativeX = _mm_sub_ps(zero, center[0]);
+		__m128 negativeY = _mm_sub_ps(zero, center[1]);
+		__m128 cz = _mm_sub_ps(zero, center[2]);
+		__m128 negativeZ = _mm_sub_ps(zero, cz);
+		__m128 negativeRadius = _mm_sub_ps(zero, radius);
+
+		__m128 projectable = _mm_cmpge_ps(cz, _mm_add_ps(radius, _mm_set1_ps(projection.M[14] / projection.M[10])));
+		if (_mm_movemask_ps(projectable) == 0) {
+			return 0;
+		}
+
+		__m128 r2 = _mm_mul_ps(radius, radius);
+		__m128 zz = _mm_mul_ps(cz, cz);
+		__m128 lengthX = _mm_sqrt_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(negativeX, negativeX), zz), r2));
+		__m128 lengthY = _mm_sqrt_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(negativeY, negativeY), zz), r2));
+		__m128 minX = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(lengthX, negativeX), _mm_mul_ps(radius, negativeZ)),
+			_mm_add_ps(_mm_mul_ps(radius, negativeX), _mm_mul_ps(lengthX, negativeZ)));
+		__m128 maxX = _mm_div_ps(_mm_add_ps(_mm_mul_ps(lengthX, negativeX), _mm_mul_ps(radius, negativeZ)),
+			_mm_add_ps(_mm_mul_ps(negativeRadius, negativeX), _mm_mul_ps(lengthX, negativeZ)));
+		__m128 minY = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(lengthY, negativeY), _mm_mul_ps(radius, negativeZ)),
+			_mm_add_ps(_mm_mul_ps(radius, negativeY), _mm_mul_ps(lengthY, negativeZ)));
+		__m128 maxY = _mm_div_ps(_mm_add_ps(_mm_mul_ps(lengthY, negativeY), _mm_mul_ps(radius, negativeZ)),
+			_mm_add_ps(_mm_mul_ps(negativeRadius, negativeY), _mm_mul_ps(lengthY, negativeZ)));
+
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 p00 = _mm_set1_ps(projection.M[0]);
+		__m128 p11 = _mm_set1_ps(-projection.M[5]);
+		__m128 screenWidth = _mm_set1_ps((F32)width);
+		__m128 screenHeight = _mm_set1_ps((F32)height);
+		__m128i x0 = _mm_cvttps_epi32(_mm_floor_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(minX, p00), half), half), screenWidth)));
+		__m128i x1 = _mm_cvttps_epi32(_mm_ceil_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(maxX, p00), half), half), screenWidth)));
+		__m128i y0 = _mm_cvttps_epi32(_mm_floor_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(zero, maxY), p11), half), half), screenHeight)));
+		__m128i y1 = _mm_cvttps_epi32(_mm_ceil_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(zero, minY), p11), half), half), screenHeight)));
+		x0 = _mm_max_epi32(x0, _mm_setzero_si128());
+		y0 = _mm_max_epi32(y0, _mm_setzero_si128());
+		x1 = _mm_min_epi32(x1, _mm_set1_epi32((I32)width));
+		y1 = _mm_min_epi32(y1, _mm_set1_epi32((I32)height));
+		__m128i covers = _mm_and_si128(_mm_cmplt_epi32(x0, x1), _mm_cmplt_epi32(y0, y1));
+
+		_mm_storeu_si128((__m128i*)out->X0, x0);
+		_mm_storeu_si128((__m128i*)out->Y0, y0);
+		_mm_storeu_si128((__m128i*)out->X1, x1);
+		_mm_storeu_si128((__m128i*)out->Y1, y1);
+		_mm_storeu_ps(out->Depth, _mm_sub_ps(_mm_div_ps(_mm_set1_ps(projection.M[14]), _mm_sub_ps(cz, radius)), _mm_set1_ps(projection.M[10])));
+		return (U32)_mm_movemask_ps(_mm_and_ps(projectable, _mm_castsi128_ps(covers)));
+	}
+
+	// Same for 8 spheres, gathered through the index list
+	TARGET_AVX2 static U32 projectSpheresAVX2(const Mat4& view, const Mat4& projection, U32 width, U32 height, const BoundingSphereSoA& bounds,
+		const U32* indices, SphereRects* out) {
+		__m256i index = _mm256_loadu_si256((const __m256i*)indices);
+		__m256 sx = _mm256_i32gather_ps(bounds.GetCenterX(), index, 4);
+		__m256 sy = _mm256_i32gather_ps(bounds.GetCenterY(), index, 4);
+		__m256 sz = _mm256_i32gather_ps(bounds.GetCenterZ(), index, 4);
+		__m256 radius = _mm256_i32gather_ps(bounds.GetRadius(), index, 4);
+
+		__m256 center[3];
+		for (U32 i = 0; i < 3; ++i) {
+			center[i] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(view.M[i]), sx), _mm256_mul_ps(_mm256_set1_ps(view.M[i + 4]), sy)),
+				_mm256_mul_ps(_mm256_set1_ps(view.M[i + 8]), sz)), _mm256_set1_ps(view.M[i + 12]));
+		}
+		__m256 zero = _mm256_setzero_ps();
+		__m256 negativeX = _mm256_sub_ps(zero, center[0]);
+		__m256 negativeY = _mm256_sub_ps(zero, center[1]);
+		__m256 cz = _mm256_sub_ps(zero, center[2]);
+		__m256 negativeZ = _mm256_sub_ps(zero, cz);
+		__m256 negativeRadius = _mm256_sub_ps(zero, radius);
+
+		__m256 projectable = _mm256_cmp_ps(cz, _mm256_add_ps(radius, _mm256_set1_ps(projection.M[14] / projection.M[10])), _CMP_GE_OQ);
+		if (_mm256_movemask_ps(projectable) == 0) {
+			return 0;
+		}
+
+		__m256 r2 = _mm256_mul_ps(radius, radius);
+		__m256 zz = _mm256_mul_ps(cz, cz);
+		__m256 lengthX = _mm256_sqrt_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(negativeX, negativeX), zz), r2));
+		__m256 lengthY = _mm256_sqrt_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(negativeY, negativeY), zz), r2));
+		__m256 minX = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(lengthX, negativeX), _mm256_mul_ps(radius, negativeZ)),
+			_mm256_add_ps(_mm256_mul_ps(radius, negativeX), _mm256_mul_ps(lengthX, negativeZ)));
+		__m256 maxX = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(lengthX, negativeX), _mm256_mul_ps(radius, negativeZ)),
+			_mm256_add_ps(_mm256_mul_ps(negativeRadius, negativeX), _mm256_mul_ps(lengthX, negativeZ)));
+		__m256 minY = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(lengthY, negativeY), _mm256_mul_ps(radius, negativeZ)),
+			_mm256_add_ps(_mm256_mul_ps(radius, negativeY), _mm256_mul_ps(lengthY, negativeZ)));
+		__m256 maxY = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(lengthY, negativeY), _mm256_mul_ps(radius, negativeZ)),
+			_mm256_add_ps(_mm256_mul_ps(negativeRadius, negativeY), _mm256_mul_ps(lengthY, negativeZ)));
+
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 p00 = _mm256_set1_ps(projection.M[0]);
+		__m256 p11 = _mm256_set1_ps(-projection.M[5]);
+		__m256 screenWidth = _mm256_set1_ps((F32)width);
+		__m256 screenHeight = _mm256_set1_ps((F32)height);
+		__m256i x0 = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(minX, p00), half), half), screenWidth)));
+		__m256i x1 = _mm256_cvttps_epi32(_mm256_ceil_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(maxX, p00), half), half), screenWidth)));
+		__m256i y0 = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(zero, maxY), p11), half), half), screenHeight)));
+		__m256i y1 = _mm256_cvttps_epi32(_mm256_ceil_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(zero, minY), p11), half), half), screenHeight)));
+		x0 = _mm256_max_epi32(x0, _mm256_setzero_si256());
+		y0 = _mm256_max_epi32(y0, _mm256_setzero_si256());
+		x1 = _mm256_min_epi32(x1, _mm256_set1_epi32((I32)width));
+		y1 = _mm256_min_epi32(y1, _mm256_set1_epi32((I32)height));
+		__m256i covers = _mm256_and_si256(_mm256_cmpgt_epi32(x1, x0), _mm256_cmpgt_epi32(y1, y0));
+
+		_mm256_storeu_si256((__m256i*)out->X0, x0);
+		_mm256_storeu_si256((__m256i*)out->Y0, y0);
+		_mm256_storeu_si256((__m256i*)out->X1, x1);
+		_mm256_storeu_si256((__m256i*)out->Y1, y1);
+		_mm256_storeu_ps(out->Depth, _mm256_sub_ps(_mm256_div_ps(_mm256_set1_ps(projection.M[14]), _mm256_sub_ps(cz, radius)), _mm256_set1_ps(projection.M[10])));
+		return (U32)_mm256_movemask_ps(_mm256_and_ps(projectable, _mm256_castsi256_ps(covers)));
+	}
+#endif
+
+	U32 OcclusionBuffer::CullSpheres(const BoundingSphereSoA& bounds, U32* indices, U32 count, SimdLevel level, bool parallel) {
+		const F32* x = bounds.GetCenterX();
+		const F32* y = bounds.GetCenterY();
+		const F32* z = bounds.GetCenterZ();
+		const F32* r = bounds.GetRadius();
+
+		_sphereVisible.resize(count);
+		auto test = [&](U32 start, U32 end) {
+			U32 i = start;
+#ifdef ARCH_X64
+			if (level >= SimdLevel::SSE) {
+				U32 width = level >= SimdLevel::AVX2 ? 8 : 4;
+				SphereRects rects;
+				for (; i + width <= end; i += width) {
+					U32 tested = width == 8 ? projectSpheresAVX2(_view, _projection, _width, _height, bounds, indices + i, &rects)
+						: projectSpheresSSE(_view, _projection, _width, _height, bounds, indices + i, &rects);
+					for (U32 lane = 0; lane < width; ++lane) {
+						bool visible = (tested & (1u << lane)) == 0 || isRectVisible(rects.X0[lane], rects.Y0[lane], rects.X1[lane], rects.Y1[lane], rects.Depth[lane]);
+						_sphereVisible[i + lane] = visible ? 1 : 0;
+					}
+				}
+			}
+#endif
+			for (; i < end; ++i) {
+				U32 index = indices[i];
+				_sphereVisible[i] = IsSphereVisible({ x[index], y[index], z[index] }, r[index]) ? 1 : 0;
+			}
+		};
+
+		if (parallel) {
+			JobSystem::ParallelFor(count, OCCLUSION_TEST_BATCH_SIZE, test);
+		} else {
+			test(0, count);
+		}
+
+		U32 visibleCount = 0;
+		for (U32 i = 0; i < count; ++i) {
+			indices[visibleCount] = indices[i];
+			visibleCount += _sphereVisible[i];
+		}
+
+		_stats.TestedCount += count;
+		_stats.OccludedCount += count - visibleCount;
+		return visibleCount;
+	}
+
+	const bool OcclusionBuffer::RunBenchmark() {
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+		SimdLevel supportedLevel = Simd::GetSupportedLevel();
+
+		// Unit cube, counter clockwise seen from outside
+		const F32 cubePositions[] = {
+			-1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, 1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,
+			-1.0f, -1.0f, 1.0f,  1.0f, -1.0f, 1.0f,  1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f
+		};
+		const U32 cubeIndices[] = {
+			4, 5, 6, 4, 6, 7,  1, 0, 3, 1, 3, 2,  5, 1, 2, 5, 2, 6,
+			0, 4, 7, 0, 7, 3,  7, 6, 2, 7, 2, 3,  0, 1, 5, 0, 5, 4
+		};
+
+		// A street level view down a grid of buildings, with small objects scattered between and behind them
+		Mat4 view = TMath::LookAt({ 0.0f, 2.0f, 0.0f }, { 0.0f, 2.0f, -1.0f }, { 0.0f, 1.0f, 0.0f });
+		Mat4 projection = TMath::Perspective(1.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+		std::vector<Mat4> buildings;
+		for (I32 row = 0; row < 16; ++row) {
+			for (I32 column = -8; column < 8; ++column) {
+				Mat4 transform = TMath::Identity();
+				transform.M[0] = 8.0f;
+				transform.M[5] = 15.0f;
+				transform.M[10] = 8.0f;
+				transform.M[12] = column * 24.0f + 12.0f;
+				transform.M[13] = 15.0f;
+				transform.M[14] = -20.0f - row * 24.0f;
+				buildings.push_back(transform);
+			}
+		}
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<F32> positionX(-200.0f, 200.0f);
+		std::uniform_real_distribution<F32> positionY(0.0f, 10.0f);
+		std::uniform_real_distribution<F32> positionZ(-400.0f, -5.0f);
+		std::uniform_real_distribution<F32> radius(0.5f, 2.0f);
+
+		const U32 objectCount = 100000;
+		BoundingSphereSoA bounds;
+		for (U32 i = 0; i < objectCount; ++i) {
+			bounds.Add({ positionX(random), positionY(random), positionZ(random) }, radius(random));
+		}
+
+		Frustum frustum = TMath::ExtractFrustum(TMath::Multiply(projection, view));
+		std::vector<U32> frustumVisible(objectCount);
+		U32 frustumVisibleCount = Culling::CullSpheres(frustum, bounds, frustumVisible.data());
+		std::vector<U32> visible(objectCount);
+
+		OcclusionBuffer buffer;
+		Logger::Log("Software occlusion benchmark, %dx%d buffer, %s supported, %d threads", buffer.GetWidth(), buffer.GetHeight(),
+			Simd::GetLevelName(supportedLevel), JobSystem::GetThreadCount());
+		Logger::Log("%d occluders, %d objects, %d in the frustum", (U32)buildings.size(), objectCount, frustumVisibleCount);
+
+		auto rasterize = [&](SimdLevel level, bool parallel) {
+			buffer.Begin(view, projection);
+			for (const Mat4& transform : buildings) {
+				buffer.AddOccluder(cubePositions, cubeIndices, 36, transform);
+			}
+			buffer.Rasterize(level, parallel);
+		};
+
+		// Every configuration must hide exactly the same objects as the first, scalar single threaded one
+		bool passed = true;
+		U32 baselineVisibleCount = U32_MAX;
+		std::vector<U32> baselineVisible;
+		for (SimdLevel level : levels) {
+			if (level > supportedLevel) {
+				break;
+			}
+
+			for (U32 parallel = 0; parallel < 2; ++parallel) {
+				F64 rasterizeTime = Benchmark::Time(200, [&](U32) { rasterize(level, parallel != 0); });
+
+				U32 visibleCount = 0;
+				F64 testTime = Benchmark::Time(20, [&](U32) { memcpy(visible.data(), frustumVisible.data(), sizeof(U32) * frustumVisibleCount); },
+					[&](U32) { visibleCount = buffer.CullSpheres(bounds, visible.data(), frustumVisibleCount, level, parallel != 0); });
+				if (baselineVisibleCount == U32_MAX) {
+					baselineVisibleCount = visibleCount;
+					baselineVisible.assign(visible.begin(), visible.begin() + visibleCount);
+				}
+
+				char name[64];
+				snprintf(name, sizeof(name), "%s%s", Simd::GetLevelName(level), parallel ? " parallel" : "");
+				Logger::Log("  %-20s rasterize %7.3f ms (%d triangles), test %7.3f ms, %d of %d occluded", name, rasterizeTime,
+					buffer.GetStats().TriangleCount, testTime, frustumVisibleCount - visibleCount, frustumVisibleCount);
+				bool same = visibleCount == baselineVisibleCount && memcmp(visible.data(), baselineVisible.data(), sizeof(U32) * visibleCount) == 0;
+				passed &= Benchmark::Check(same, "%s left %d of %d visible, scalar %d or other objects", name, visibleCount,
+					frustumVisibleCount, baselineVisibleCount);
+			}
+		}
+		return passed;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+
+#include "TMath.h"
+#include "Simd.h"
+#include "Culling.h"
+
+// Tiles are 32x8 pixels: one bit per pixel in eight 32 bit rows, the eight rows fill one AVX2 register
+#define OCCLUSION_TILE_WIDTH 32
+#define OCCLUSION_TILE_HEIGHT 8
+
+namespace Jazz {
+
+	// Masked occlusion tile. Every pixel is at most ZMax0 deep, and the pixels in Mask are at most ZMax1 deep.
+	// Occluders are merged into the Mask/ZMax1 layer, once it covers the whole tile it becomes the new ZMax0.
+	struct OcclusionTile {
+		U32 Mask[OCCLUSION_TILE_HEIGHT];
+		F32 ZMax0;
+		F32 ZMax1;
+	};
+
+	// Screen space triangle ready for rasterization. Left and right edges are x = y * slope + offset,
+	// edges that don't bound that side are pushed out of the way so rows can take a plain max and min.
+	struct OcclusionTriangle {
+		F32 LeftSlope[3];
+		F32 LeftOffset[3];
+		F32 RightSlope[3];
+		F32 RightOffset[3];
+		F32 MinX, MaxX, MinY, MaxY; // MinY > MaxY when the triangle was culled
+		F32 DepthOrigin, DepthDx, DepthDy; // Depth plane, depth = origin + dx * x + dy * y
+		F32 MaxDepth;
+	};
+
+	struct OcclusionStats {
+		U32 OccluderCount;
+		U32 TriangleCount; // Triangles left after clipping and backface culling
+		U32 TestedCount;
+		U32 OccludedCount;
+	};
+
+	// Low resolution software depth buffer for culling on the CPU. A frame is Begin(), AddOccluder() for a
+	// small set of large objects close to the camera, Rasterize() on the job system, then any number of
+	// visibility tests. Depth is stored conservatively, objects are only rejected when they are fully hidden.
+	class OcclusionBuffer {
+	public:
+		// The size is rounded up to whole tiles
+		OcclusionBuffer(U32 width = 320, U32 height = 192);
+
+		U32 GetWidth() const { return _width; }
+		U32 GetHeight() const { return _height; }
+
+		// Clears the buffer and drops the occluders of the previous frame
+		void Begin(const Mat4& view, const Mat4& projection);
+
+		// positions are xyz triples. The arrays are only read by Rasterize() and must stay alive until then.
+		void AddOccluder(const F32* positions, const U32* indices, U32 indexCount, const Mat4& transform);
+
+		void Rasterize(SimdLevel level = Simd::GetSupportedLevel(), bool parallel = true);
+
+		const bool IsSphereVisible(const Vec3& center, F32 radius) const;
+
+		// Keeps the entries of indices whose sphere is visible, in order, and returns how many are left. SSE and AVX2
+		// project 4 or 8 spheres at a time, the tiles under each projected rectangle are then tested one sphere at a time.
+		U32 CullSpheres(const BoundingSphereSoA& bounds, U32* indices, U32 count, SimdLevel level = Simd::GetSupportedLevel(),
+			bool parallel = true);
+
+		const OcclusionStats& GetStats() const { return _stats; }
+
+		// Rasterization and object test throughput of every supported SIMD level on a synthetic city block scene. Fails when
+		// any of them hides different objects than scalar code does.
+		static const bool RunBenchmark();
+	private:
+		void setupTriangles(U32 start, U32 end);
+		void rasterizeTileRow(U32 tileRow, SimdLevel level);
+		const bool isRectVisible(I32 x0, I32 y0, I32 x1, I32 y1, F32 depth) const;
+	private:
+		struct Occluder {
+			const F32* Positions;
+			const U32* Indices;
+			U32 TriangleCount;
+			U32 FirstTriangle; // Running total over the occluders added before this one
+			Mat4 Transform;
+		};
+
+		U32 _width;
+		U32 _height;
+		U32 _tilesX;
+		U32 _tilesY;
+		std::vector<OcclusionTile> _tiles;
+
+		Mat4 _view;
+		Mat4 _projection;
+		Mat4 _viewProjection;
+
+		std::vector<Occluder> _occluders;
+		U32 _occluderTriangleCount;
+
+		// Two slots per occluder triangle, near plane clipping can split a triangle in two
+		std::vector<OcclusionTriangle> _triangles;
+		std::vector<U8> _sphereVisible;
+
+		OcclusionStats _stats;
+	};
+}
\ No newline at end of file
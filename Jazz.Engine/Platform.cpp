@@ -1,3 +1,16 @@
+#include "Defines.h"
+
+#ifdef PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
@@ -45,14 +58,101 @@ namespace Jazz {
 	}
 
 	const bool Platform::StartGameLoop() {
+		F64 previousTime = glfwGetTime();
 		while (!glfwWindowShouldClose(_window)) {
 			glfwPollEvents();
 
-			_engine->OnLoop(0);
+			// Long stalls such as window drags or breakpoints advance the simulation by a tenth of a second at most
+			F64 time = glfwGetTime();
+			F32 deltaTime = (F32)(time - previousTime);
+			previousTime = time;
+			_engine->OnLoop(deltaTime < 0.1f ? deltaTime : 0.1f);
 		}
 
 		_engine->DeviceWaitIdle();
 
 		return true;
 	}
+
+	const bool Platform::MapFile(const char* path, MappedFile* outFile) {
+		*outFile = {};
+
+#ifdef PLATFORM_WINDOWS
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			Logger::Error("Unable to open file for mapping: %s", path);
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			Logger::Error("Unable to map empty or unreadable file: %s", path);
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			Logger::Error("Unable to create file mapping: %s", path);
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			Logger::Error("Unable to map file: %s", path);
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		outFile->Data = data;
+		outFile->Size = (U64)size.QuadPart;
+		outFile->FileHandle = file;
+		outFile->MappingHandle = mapping;
+#else
+		I32 file = open(path, O_RDONLY);
+		if (file < 0) {
+			Logger::Error("Unable to open file for mapping: %s", path);
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0) {
+			Logger::Error("Unable to map empty or unreadable file: %s", path);
+			close(file);
+			return false;
+		}
+
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED) {
+			Logger::Error("Unable to map file: %s", path);
+			return false;
+		}
+
+		// The whole file is about to be streamed into GPU memory front to back
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+		madvise(data, (size_t)info.st_size, MADV_WILLNEED);
+
+		outFile->Data = data;
+		outFile->Size = (U64)info.st_size;
+#endif
+		return true;
+	}
+
+	void Platform::UnmapFile(MappedFile* file) {
+		if (!file->Data) {
+			return;
+		}
+
+#ifdef PLATFORM_WINDOWS
+		UnmapViewOfFile(file->Data);
+		CloseHandle((HANDLE)file->MappingHandle);
+		CloseHandle((HANDLE)file->FileHandle);
+#else
+		munmap((void*)file->Data, (size_t)file->Size);
+#endif
+		*file = {};
+	}
 }
\ No newline at end of file
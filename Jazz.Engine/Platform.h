@@ -9,6 +9,14 @@ namespace Jazz {
 
 	class Engine;
 
+	// A read-only view of a file mapped into the address space.
+	struct MappedFile {
+		const void* Data;
+		U64 Size;
+		void* FileHandle;
+		void* MappingHandle;
+	};
+
 	class Platform {
 	public:
 		Platform(Engine* engine, const char* applicationName);
@@ -24,6 +32,9 @@ namespace Jazz {
 
 		const bool StartGameLoop();
 
+		static const bool MapFile(const char* path, MappedFile* outFile);
+		static void UnmapFile(MappedFile* file);
+
 	private:
 		Engine* _engine;
 		GLFWwindow* _window;
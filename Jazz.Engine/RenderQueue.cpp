@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <random>
+#include <string.h>
+
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+
+// Queues smaller than this sort on the calling thread, the job overhead outweighs the work
+#define RENDER_QUEUE_PARALLEL_THRESHOLD 16384
+
+#define RENDER_QUEUE_RADIX_BUCKETS 256
+
+namespace Jazz {
+
+	U64 RenderQueue::MakeKey(U32 pass, U32 pipeline, F32 depth) {
+		depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+		U64 quantizedDepth = (U64)((F64)depth * (F64)(((U64)1 << RENDER_QUEUE_DEPTH_BITS) - 1));
+
+		U64 key = pass & ((1u << RENDER_QUEUE_PASS_BITS) - 1);
+		key = (key << RENDER_QUEUE_PIPELINE_BITS) | (pipeline & ((1u << RENDER_QUEUE_PIPELINE_BITS) - 1));
+		key = (key << RENDER_QUEUE_DEPTH_BITS) | quantizedDepth;
+		return key;
+	}
+
+	void RenderQueue::Clear() {
+		_keys.clear();
+		_payloads.clear();
+	}
+
+	void RenderQueue::Push(U64 key, U32 payload) {
+		_keys.push_back(key);
+		_payloads.push_back(payload);
+	}
+
+	void RenderQueue::Sort(bool parallel) {
+		U32 count = (U32)_keys.size();
+		if (count < 2) {
+			return;
+		}
+
+		// Each chunk is histogrammed and scattered by one job, chunks keep their order within a bucket so the sort stays stable
+		U32 chunkCount = parallel && count >= RENDER_QUEUE_PARALLEL_THRESHOLD ? JobSystem::GetThreadCount() : 1;
+		U32 chunkSize = (count + chunkCount - 1) / chunkCount;
+		_histograms.resize(chunkCount * RENDER_QUEUE_RADIX_BUCKETS);
+		_scratchKeys.resize(count);
+		_scratchPayloads.resize(count);
+
+		// Bits that differ between any two keys, digits without any are already sorted
+		U64 differing = 0;
+		for (U32 i = 1; i < count; ++i) {
+			differing |= _keys[i] ^ _keys[0];
+		}
+
+		for (U32 shift = 0; shift < 64; shift += 8) {
+			if (((differing >> shift) & 0xff) == 0) {
+				continue;
+			}
+
+			const U64* sourceKeys = _keys.data();
+			const U32* sourcePayloads = _payloads.data();
+			U64* destinationKeys = _scratchKeys.data();
+			U32* destinationPayloads = _scratchPayloads.data();
+			U32* histograms = _histograms.data();
+
+			auto countChunks = [&](U32 start, U32 end) {
+				for (U32 chunk = start; chunk < end; ++chunk) {
+					U32* histogram = histograms + chunk * RENDER_QUEUE_RADIX_BUCKETS;
+					memset(histogram, 0, sizeof(U32) * RENDER_QUEUE_RADIX_BUCKETS);
+					U32 last = std::min(count, (chunk + 1) * chunkSize);
+					for (U32 i = chunk * chunkSize; i < last; ++i) {
+						histogram[(sourceKeys[i] >> shift) & 0xff]++;
+					}
+				}
+			};
+
+			auto scatterChunks = [&](U32 start, U32 end) {
+				for (U32 chunk = start; chunk < end; ++chunk) {
+					U32* offsets = histograms + chunk * RENDER_QUEUE_RADIX_BUCKETS;
+					U32 last = std::min(count, (chunk + 1) * chunkSize);
+					for (U32 i = chunk * chunkSize; i < last; ++i) {
+						U32 destination = offsets[(sourceKeys[i] >> shift) & 0xff]++;
+						destinationKeys[destination] = sourceKeys[i];
+						destinationPayloads[destination] = sourcePayloads[i];
+					}
+				}
+			};
+
+			if (chunkCount > 1) {
+				JobSystem::ParallelFor(chunkCount, 1, countChunks);
+			} else {
+				countChunks(0, 1);
+			}
+
+			// Turn the counts into write offsets, bucket by bucket and chunk by chunk within a bucket
+			U32 offset = 0;
+			for (U32 bucket = 0; bucket < RENDER_QUEUE_RADIX_BUCKETS; ++bucket) {
+				for (U32 chunk = 0; chunk < chunkCount; ++chunk) {
+					U32& entry = histograms[chunk * RENDER_QUEUE_RADIX_BUCKETS + bucket];
+					U32 bucketCount = entry;
+					entry = offset;
+					offset += bucketCount;
+				}
+			}
+
+			if (chunkCount > 1) {
+				JobSystem::ParallelFor(chunkCount, 1, scatterChunks);
+			} else {
+				scatterChunks(0, 1);
+			}
+
+			_keys.swap(_scratchKeys);
+			_payloads.swap(_scratchPayloads);
+		}
+	}
+
+	const bool RenderQueue::RunBenchmark() {
+		const U32 drawCounts[] = { 1000, 100000, 1000000 };
+
+		Logger::Log("Render queue sort benchmark, %d threads", JobSystem::GetThreadCount());
+		bool passed = true;
+
+		std::mt19937 random(1234);
+		std::uniform_int_distribution<U32> pass(0, 1);
+		std::uniform_int_distribution<U32> pipeline(0, 7);
+		std::uniform_real_distribution<F32> depth(0.0f, 1.0f);
+
+		for (U32 drawCount : drawCounts) {
+			std::vector<U64> keys(drawCount);
+			for (U32 i = 0; i < drawCount; ++i) {
+				keys[i] = MakeKey(pass(random), pipeline(random), depth(random));
+			}
+
+			U32 iterations = drawCount >= 1000000 ? 10 : 100;
+			std::vector<std::pair<U64, U32>> pairs(drawCount);
+
+			// Only the sorts are timed, refilling the inputs is not
+			F64 baselineTime = Benchmark::Time(iterations, [&](U32) {
+				for (U32 i = 0; i < drawCount; ++i) {
+					pairs[i] = { keys[i], i };
+				}
+			}, [&](U32) {
+				std::stable_sort(pairs.begin(), pairs.end(), [](const std::pair<U64, U32>& a, const std::pair<U64, U32>& b) { return a.first < b.first; });
+			});
+			Logger::Log("%d draws", drawCount);
+			Logger::Log("  %-24s %9.3f ms", "std::stable_sort", baselineTime);
+
+			RenderQueue queue;
+			for (U32 parallel = 0; parallel < 2; ++parallel) {
+				F64 time = Benchmark::Time(iterations, [&](U32) {
+					queue.Clear();
+					for (U32 i = 0; i < drawCount; ++i) {
+						queue.Push(keys[i], i);
+					}
+				}, [&](U32) { queue.Sort(parallel != 0); });
+
+				bool matches = true;
+				for (U32 i = 0; i < drawCount; ++i) {
+					matches &= queue.GetKeys()[i] == pairs[i].first && queue.GetPayloads()[i] == pairs[i].second;
+				}
+
+				Logger::Log("  %-24s %9.3f ms %7.2fx", parallel ? "Radix parallel" : "Radix", time, baselineTime / time);
+				passed &= Benchmark::Check(matches, "%s order of %d draws differs from std::stable_sort", parallel ? "Parallel radix" : "Radix", drawCount);
+			}
+		}
+		return passed;
+	}
+}
\ No newline at end of file
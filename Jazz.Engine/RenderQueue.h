@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+
+// Sort key layout, most significant first: pass, pipeline, depth. Only state a draw actually binds belongs in the key,
+// the top bits stay clear and the radix sort skips them.
+#define RENDER_QUEUE_PASS_BITS 4
+#define RENDER_QUEUE_PIPELINE_BITS 8
+#define RENDER_QUEUE_DEPTH_BITS 32
+
+namespace Jazz {
+
+	// Draws as 64 bit sort keys plus a payload, typically the index of whatever describes the draw. Sorting
+	// groups draws by pass, then pipeline, and orders each group front to back.
+	class RenderQueue {
+	public:
+		// Depth is 0 at the near plane and 1 at the far plane, the other fields are truncated to their bit counts
+		static U64 MakeKey(U32 pass, U32 pipeline, F32 depth);
+
+		static U32 GetKeyPass(U64 key) { return (U32)(key >> (RENDER_QUEUE_PIPELINE_BITS + RENDER_QUEUE_DEPTH_BITS)) & ((1u << RENDER_QUEUE_PASS_BITS) - 1); }
+		static U32 GetKeyPipeline(U64 key) { return (U32)(key >> RENDER_QUEUE_DEPTH_BITS) & ((1u << RENDER_QUEUE_PIPELINE_BITS) - 1); }
+
+		void Clear();
+		void Push(U64 key, U32 payload);
+
+		// Stable LSD radix sort on the keys, 8 bits per pass. Passes over bytes every key shares are skipped,
+		// large queues split each pass across the job system.
+		void Sort(bool parallel = true);
+
+		U32 GetCount() const { return (U32)_keys.size(); }
+		const U64* GetKeys() const { return _keys.data(); }
+		const U32* GetPayloads() const { return _payloads.data(); }
+
+		// Compares the radix sort, single threaded and parallel, against std::stable_sort at 1k, 100k and 1M draws.
+		// Fails when the orders differ.
+		static const bool RunBenchmark();
+	private:
+		std::vector<U64> _keys;
+		std::vector<U32> _payloads;
+		std::vector<U64> _scratchKeys;
+		std::vector<U32> _scratchPayloads;
+		std::vector<U32> _histograms; // 256 buckets per chunk
+	};
+}
\ No newline at end of file
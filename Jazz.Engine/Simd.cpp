@@ -0,0 +1,89 @@
+#include "Simd.h"
+
+#ifdef ARCH_X64
+#if _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#endif
+
+namespace Jazz {
+
+#ifdef ARCH_X64
+	static void cpuid(I32 info[4], I32 leaf, I32 subleaf) {
+#if _MSC_VER
+		__cpuidex(info, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	static U64 readXcr0() {
+#if _MSC_VER
+		return _xgetbv(0);
+#else
+		U32 eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((U64)edx << 32) | eax;
+#endif
+	}
+
+	static SimdLevel detectLevel() {
+		I32 info[4];
+		cpuid(info, 0, 0);
+		I32 maxLeaf = info[0];
+
+		cpuid(info, 1, 0);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool f16c = (info[2] & (1 << 29)) != 0;
+		if (!sse41) {
+			return SimdLevel::Scalar;
+		}
+
+		// The OS has to save the wide registers on context switches
+		U64 xcr0 = osxsave ? readXcr0() : 0;
+		bool osYmm = (xcr0 & 0x6) == 0x6;
+		bool osZmm = (xcr0 & 0xe6) == 0xe6;
+		if (!avx || !osYmm || maxLeaf < 7) {
+			return SimdLevel::SSE;
+		}
+
+		cpuid(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		bool avx512f = (info[1] & (1 << 16)) != 0;
+		bool avx512dq = (info[1] & (1 << 17)) != 0;
+		if (!avx2 || !fma || !f16c) {
+			return SimdLevel::SSE;
+		}
+
+		return (avx512f && avx512dq && osZmm) ? SimdLevel::AVX512 : SimdLevel::AVX2;
+	}
+#endif
+
+	SimdLevel Simd::GetSupportedLevel() {
+#ifdef ARCH_X64
+		static SimdLevel level = detectLevel();
+		return level;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	const char* Simd::GetLevelName(SimdLevel level) {
+		switch (level) {
+		case SimdLevel::SSE:
+			return "SSE4.1";
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::AVX512:
+			return "AVX-512";
+		default:
+			return "Scalar";
+		}
+	}
+}
\ No newline at end of file
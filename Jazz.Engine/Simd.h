@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Defines.h"
+#include "Types.h"
+
+namespace Jazz {
+
+	enum class SimdLevel {
+		Scalar,
+		SSE,	// SSE4.1, 4 lanes
+		AVX2,	// 8 lanes
+		AVX512	// 16 lanes
+	};
+
+	class Simd {
+	public:
+		// Highest level supported by both the CPU and the OS, detected once
+		static SimdLevel GetSupportedLevel();
+
+		static const char* GetLevelName(SimdLevel level);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+#include "RenderQueue.h"
+
+// Layers draw in ascending order, each may be depth sorted on its own
+#define SPRITE_MAX_LAYERS 256
+
+namespace Jazz {
+
+	struct Sprite {
+		F32 X; // Center in pixels from the top left corner
+		F32 Y;
+		F32 Width;
+		F32 Height;
+		F32 Rotation; // Radians, clockwise on screen
+		F32 UV[4]; // Top left u, v then bottom right u, v
+		U32 Color; // RGBA8 with R in the lowest byte, multiplies the texture
+		U32 Texture; // Bindless texture index, texture 0 is white
+		U32 Layer;
+		F32 Depth; // Only orders sprites of depth sorted layers, which draw far to near
+	};
+
+	// Per instance input of the sprite pipeline, the vertex shader builds the corners
+	struct SpriteInstance {
+		F32 X;
+		F32 Y;
+		F32 Width;
+		F32 Height;
+		F32 Rotation;
+		U16 UV[4]; // Unorm
+		U32 Color;
+		U32 Texture;
+	};
+
+	// Collects a frame's sprites and writes them out as instances sorted by layer, then depth in depth sorted layers,
+	// then texture. Textures are indexed per instance, so the result is a single instanced draw of a four vertex strip.
+	class SpriteBatcher {
+	public:
+		SpriteBatcher();
+
+		void Clear();
+		void Draw(const Sprite& sprite);
+
+		// For callers that build instances themselves, such as text
+		void DrawInstance(const SpriteInstance& instance, U32 layer, F32 depth = 0.0f);
+
+		// Sprites of a layer that isn't depth sorted keep their submission order per texture, but not across textures
+		void SetLayerDepthSorted(U32 layer, bool sorted);
+
+		U32 GetCount() const { return (U32)_instances.size(); }
+
+		// Sorts and writes the instances, as many as fit in maxInstances. outInstances may be write combined memory, it is
+		// only ever written in order. Returns the instance count.
+		U32 Build(SpriteInstance* outInstances, U32 maxInstances);
+
+		// Build time at 10k, 50k and 200k sprites across 64 textures and 8 layers. Fails when a sprite is dropped.
+		static const bool RunBenchmark();
+	private:
+		std::vector<SpriteInstance> _instances;
+		RenderQueue _queue;
+		U64 _depthSortedLayers[SPRITE_MAX_LAYERS / 64];
+		U64 _lastKey;
+		bool _inOrder; // Every key so far was at least the one before
+	};
+}
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <set>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "StaticBatcher.h"
+
+namespace Jazz {
+
+	StaticBatcher::StaticBatcher(F32 chunkSize) {
+		_chunkSize = chunkSize;
+	}
+
+	U32 StaticBatcher::AddMesh(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount) {
+		SourceMesh mesh;
+		mesh.Vertices.assign(vertices, vertices + vertexCount);
+		mesh.Indices.assign(indices, indices + indexCount);
+
+		MeshBounds bounds = MeshFile::ComputeBounds(vertices, vertexCount);
+		mesh.Center = { bounds.Center[0], bounds.Center[1], bounds.Center[2] };
+		_meshes.push_back(std::move(mesh));
+		return (U32)_meshes.size() - 1;
+	}
+
+	U32 StaticBatcher::AddMeshFile(const char* path) {
+		MeshFile meshFile;
+		if (!meshFile.Open(path)) {
+			return U32_MAX;
+		}
+
+		const MeshFileHeader* header = meshFile.GetHeader();
+		if (header->VertexCount == 0 || header->LodCount == 0) {
+			Logger::Error("Mesh %s is empty", path);
+			return U32_MAX;
+		}
+
+		std::vector<MeshVertex> vertices(header->VertexCount);
+		meshFile.ReadVertices(vertices.data());
+		const U32* indices = (const U32*)meshFile.GetIndexData() + header->Lods[0].FirstIndex;
+		return AddMesh(vertices.data(), header->VertexCount, indices, header->Lods[0].IndexCount);
+	}
+
+	void StaticBatcher::AddInstance(U32 meshIndex, const Mat4& transform, U32 materialIndex) {
+		_instances.push_back({ meshIndex, materialIndex, transform });
+	}
+
+	void StaticBatcher::Build(std::vector<StaticBatch>& outBatches) const {
+		outBatches.clear();
+
+		// Cell of each instance's bounds center, then instances sorted by material and cell
+		U32 instanceCount = (U32)_instances.size();
+		std::vector<I32> cells(instanceCount * 3);
+		for (U32 i = 0; i < instanceCount; ++i) {
+			const Instance& instance = _instances[i];
+			Vec3 center = TMath::TransformPoint(instance.Transform, _meshes[instance.MeshIndex].Center);
+			cells[i * 3 + 0] = (I32)floorf(center.X / _chunkSize);
+			cells[i * 3 + 1] = (I32)floorf(center.Y / _chunkSize);
+			cells[i * 3 + 2] = (I32)floorf(center.Z / _chunkSize);
+		}
+
+		std::vector<U32> order(instanceCount);
+		for (U32 i = 0; i < instanceCount; ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](U32 a, U32 b) {
+			if (_instances[a].MaterialIndex != _instances[b].MaterialIndex) {
+				return _instances[a].MaterialIndex < _instances[b].MaterialIndex;
+			}
+			for (U32 axis = 0; axis < 3; ++axis) {
+				if (cells[a * 3 + axis] != cells[b * 3 + axis]) {
+					return cells[a * 3 + axis] < cells[b * 3 + axis];
+				}
+			}
+			return a < b;
+		});
+
+		StaticBatch* batch = nullptr;
+		for (U32 i : order) {
+			const Instance& instance = _instances[i];
+			const SourceMesh& mesh = _meshes[instance.MeshIndex];
+			const I32* cell = &cells[i * 3];
+
+			bool sameKey = batch && batch->MaterialIndex == instance.MaterialIndex &&
+				batch->Cell[0] == cell[0] && batch->Cell[1] == cell[1] && batch->Cell[2] == cell[2];
+			if (!sameKey || (batch->InstanceCount > 0 && batch->Vertices.size() + mesh.Vertices.size() > STATIC_BATCH_MAX_VERTICES)) {
+				outBatches.push_back({});
+				batch = &outBatches.back();
+				batch->MaterialIndex = instance.MaterialIndex;
+				memcpy(batch->Cell, cell, sizeof(batch->Cell));
+				batch->InstanceCount = 0;
+			}
+
+			// Normals go through the cofactor matrix, the inverse transpose scaled by the determinant, which keeps them
+			// perpendicular under non-uniform scale. Mirroring transforms flip the winding back.
+			const F32* m = instance.Transform.M;
+			Vec3 column0 = { m[0], m[1], m[2] };
+			Vec3 column1 = { m[4], m[5], m[6] };
+			Vec3 column2 = { m[8], m[9], m[10] };
+			Vec3 cofactor0 = TMath::Cross(column1, column2);
+			Vec3 cofactor1 = TMath::Cross(column2, column0);
+			Vec3 cofactor2 = TMath::Cross(column0, column1);
+			bool mirrored = TMath::Dot(column0, cofactor0) < 0.0f;
+
+			U32 firstVertex = (U32)batch->Vertices.size();
+			for (const MeshVertex& source : mesh.Vertices) {
+				MeshVertex vertex = source;
+				Vec3 position = TMath::TransformPoint(instance.Transform, { source.Position[0], source.Position[1], source.Position[2] });
+				Vec3 normal = TMath::Add(TMath::Add(TMath::Scale(cofactor0, source.Normal[0]), TMath::Scale(cofactor1, source.Normal[1])),
+					TMath::Scale(cofactor2, source.Normal[2]));
+				normal = TMath::Normalize(mirrored ? TMath::Scale(normal, -1.0f) : normal);
+				vertex.Position[0] = position.X;
+				vertex.Position[1] = position.Y;
+				vertex.Position[2] = position.Z;
+				vertex.Normal[0] = normal.X;
+				vertex.Normal[1] = normal.Y;
+				vertex.Normal[2] = normal.Z;
+				batch->Vertices.push_back(vertex);
+			}
+
+			for (U32 t = 0; t + 2 < (U32)mesh.Indices.size(); t += 3) {
+				batch->Indices.push_back(firstVertex + mesh.Indices[t]);
+				batch->Indices.push_back(firstVertex + mesh.Indices[t + (mirrored ? 2 : 1)]);
+				batch->Indices.push_back(firstVertex + mesh.Indices[t + (mirrored ? 1 : 2)]);
+			}
+			batch->InstanceCount++;
+		}
+	}
+
+	const bool StaticBatcher::BuildSceneFiles(const char* listPath, const char* outputPrefix, F32 chunkSize) {
+		std::ifstream list(listPath);
+		if (!list.is_open()) {
+			Logger::Error("Unable to open static scene list %s", listPath);
+			return false;
+		}
+
+		StaticBatcher batcher(chunkSize);
+		std::unordered_map<std::string, U32> meshIndices;
+		std::set<std::pair<U32, U32>> instancedBatches;
+		std::string line;
+		U32 lineNumber = 0;
+		while (std::getline(list, line)) {
+			lineNumber++;
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			std::istringstream fields(line);
+			std::string meshPath;
+			U32 materialIndex;
+			Mat4 transform;
+			fields >> meshPath >> materialIndex;
+			for (U32 i = 0; i < 16; ++i) {
+				fields >> transform.M[i];
+			}
+			if (fields.fail()) {
+				Logger::Error("%s:%d: expected a mesh path, a material index and 16 transform values", listPath, lineNumber);
+				return false;
+			}
+
+			auto mesh = meshIndices.find(meshPath);
+			if (mesh == meshIndices.end()) {
+				U32 meshIndex = batcher.AddMeshFile(meshPath.c_str());
+				if (meshIndex == U32_MAX) {
+					return false;
+				}
+				mesh = meshIndices.emplace(meshPath, meshIndex).first;
+			}
+			batcher.AddInstance(mesh->second, transform, materialIndex);
+			instancedBatches.insert({ mesh->second, materialIndex });
+		}
+
+		std::vector<StaticBatch> batches;
+		batcher.Build(batches);
+
+		std::string manifestPath = std::string(outputPrefix) + ".jbatch";
+		std::ofstream manifest(manifestPath, std::ios::trunc);
+		if (!manifest.is_open()) {
+			Logger::Error("Unable to write %s", manifestPath.c_str());
+			return false;
+		}
+
+		for (U32 i = 0; i < (U32)batches.size(); ++i) {
+			const StaticBatch& batch = batches[i];
+			std::string meshPath = std::string(outputPrefix) + "." + std::to_string(i) + ".jmesh";
+			if (!MeshFile::Write(meshPath.c_str(), batch.Vertices.data(), (U32)batch.Vertices.size(), batch.Indices.data(), (U32)batch.Indices.size(),
+				nullptr, 0, true)) {
+				return false;
+			}
+			manifest << meshPath << " " << batch.MaterialIndex << "\n";
+		}
+
+		Logger::Log("Merged %d static instances of %d meshes into %d batches, draws drop from %d per object or %d instanced to %d",
+			(U32)batcher._instances.size(), (U32)batcher._meshes.size(), (U32)batches.size(), (U32)batcher._instances.size(),
+			(U32)instancedBatches.size(), (U32)batches.size());
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+#include "TMath.h"
+#include "Mesh.h"
+
+// Edge of the grid cells static geometry is merged within, in world units. Culling works on whole cells.
+#define STATIC_BATCH_CHUNK_SIZE 64.0f
+
+// A cell whose merged geometry grows past this starts another batch
+#define STATIC_BATCH_MAX_VERTICES (1 << 18)
+
+namespace Jazz {
+
+	// World space geometry of every static instance sharing a material within one grid cell
+	struct StaticBatch {
+		U32 MaterialIndex;
+		I32 Cell[3];
+		U32 InstanceCount;
+		std::vector<MeshVertex> Vertices;
+		std::vector<U32> Indices;
+	};
+
+	// Import time merging of static geometry. Instances are transformed into world space and grouped by material and
+	// the grid cell holding their bounds center, so a scene of many small meshes becomes a few large ones drawn with
+	// one draw and one set of binds each, while cells far from the camera still get culled.
+	class StaticBatcher {
+	public:
+		StaticBatcher(F32 chunkSize = STATIC_BATCH_CHUNK_SIZE);
+
+		// Copies the geometry. Returns the source mesh index.
+		U32 AddMesh(const MeshVertex* vertices, U32 vertexCount, const U32* indices, U32 indexCount);
+
+		// The first LOD of a mesh file. Returns the source mesh index, or U32_MAX if the file could not be read.
+		U32 AddMeshFile(const char* path);
+
+		void AddInstance(U32 meshIndex, const Mat4& transform, U32 materialIndex);
+
+		// Batches come out sorted by material, then cell
+		void Build(std::vector<StaticBatch>& outBatches) const;
+
+		// Reads a scene list, one static instance per line: mesh file, material index and the 16 column major
+		// transform values. Writes every batch to outputPrefix.N.jmesh and lists them with their materials in
+		// outputPrefix.jbatch, which VulkanRenderer::loadStaticBatches() reads.
+		static const bool BuildSceneFiles(const char* listPath, const char* outputPrefix, F32 chunkSize = STATIC_BATCH_CHUNK_SIZE);
+	private:
+		struct SourceMesh {
+			std::vector<MeshVertex> Vertices;
+			std::vector<U32> Indices;
+			Vec3 Center;
+		};
+
+		struct Instance {
+			U32 MeshIndex;
+			U32 MaterialIndex;
+			Mat4 Transform;
+		};
+
+		F32 _chunkSize;
+		std::vector<SourceMesh> _meshes;
+		std::vector<Instance> _instances;
+	};
+}
\ No newline at end of file
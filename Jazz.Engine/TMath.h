@@ -1,21 +1,177 @@
 #pragma once
 
+#include <math.h>
+
 #include "Types.h"
 
 namespace Jazz {
-	
+
+	struct Vec3 {
+		F32 X;
+		F32 Y;
+		F32 Z;
+	};
+
+	struct Vec4 {
+		F32 X;
+		F32 Y;
+		F32 Z;
+		F32 W;
+	};
+
+	// Column major to match GLSL, element (row, column) lives at M[column * 4 + row]
+	struct Mat4 {
+		F32 M[16];
+	};
+
+	// Planes are (normal, distance) with normals pointing into the frustum: left, right, bottom, top, near, far
+	struct Frustum {
+		Vec4 Planes[6];
+	};
+
 	class TMath {
 	public:
-		static U32 ClampU32(const U32 value, const U32 min, const U32 max);
-	};
+		static U32 ClampU32(const U32 value, const U32 min, const U32 max) {
+			if (value < min) {
+				return min;
+			}
+			if (value > max) {
+				return max;
+			}
+			return value;
+		}
+
+		static Vec3 Add(const Vec3& a, const Vec3& b) { return { a.X + b.X, a.Y + b.Y, a.Z + b.Z }; }
+		static Vec3 Subtract(const Vec3& a, const Vec3& b) { return { a.X - b.X, a.Y - b.Y, a.Z - b.Z }; }
+		static Vec3 Scale(const Vec3& v, const F32 s) { return { v.X * s, v.Y * s, v.Z * s }; }
+		static F32 Dot(const Vec3& a, const Vec3& b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+		static F32 Length(const Vec3& v) { return sqrtf(Dot(v, v)); }
+
+		static Vec3 Cross(const Vec3& a, const Vec3& b) {
+			return { a.Y * b.Z - a.Z * b.Y, a.Z * b.X - a.X * b.Z, a.X * b.Y - a.Y * b.X };
+		}
+
+		static Vec3 Normalize(const Vec3& v) {
+			F32 length = Length(v);
+			return length > 0.0f ? Scale(v, 1.0f / length) : v;
+		}
+
+		static Mat4 Identity() {
+			Mat4 result = {};
+			result.M[0] = 1.0f;
+			result.M[5] = 1.0f;
+			result.M[10] = 1.0f;
+			result.M[15] = 1.0f;
+			return result;
+		}
+
+		static Mat4 Multiply(const Mat4& a, const Mat4& b) {
+			Mat4 result;
+			for (U32 column = 0; column < 4; ++column) {
+				for (U32 row = 0; row < 4; ++row) {
+					result.M[column * 4 + row] =
+						a.M[0 * 4 + row] * b.M[column * 4 + 0] +
+						a.M[1 * 4 + row] * b.M[column * 4 + 1] +
+						a.M[2 * 4 + row] * b.M[column * 4 + 2] +
+						a.M[3 * 4 + row] * b.M[column * 4 + 3];
+				}
+			}
+			return result;
+		}
+
+		static Mat4 Translation(const Vec3& t) {
+			Mat4 result = Identity();
+			result.M[12] = t.X;
+			result.M[13] = t.Y;
+			result.M[14] = t.Z;
+			return result;
+		}
+
+		static Vec3 TransformPoint(const Mat4& m, const Vec3& p) {
+			return {
+				m.M[0] * p.X + m.M[4] * p.Y + m.M[8] * p.Z + m.M[12],
+				m.M[1] * p.X + m.M[5] * p.Y + m.M[9] * p.Z + m.M[13],
+				m.M[2] * p.X + m.M[6] * p.Y + m.M[10] * p.Z + m.M[14]
+			};
+		}
+
+		// Right handed, Vulkan clip space: Y points down and depth goes from 0 to 1
+		static Mat4 Perspective(const F32 fovY, const F32 aspect, const F32 nearPlane, const F32 farPlane) {
+			F32 f = 1.0f / tanf(fovY * 0.5f);
+			Mat4 result = {};
+			result.M[0] = f / aspect;
+			result.M[5] = -f;
+			result.M[10] = farPlane / (nearPlane - farPlane);
+			result.M[11] = -1.0f;
+			result.M[14] = (nearPlane * farPlane) / (nearPlane - farPlane);
+			return result;
+		}
 
-	U32 TMath::ClampU32(const U32 value, const U32 min, const U32 max) {
-		if (value < min) {
-			return min;
+		// Flips Y and maps depth to 0..1 like Perspective
+		static Mat4 Orthographic(const F32 left, const F32 right, const F32 bottom, const F32 top, const F32 nearPlane, const F32 farPlane) {
+			Mat4 result = {};
+			result.M[0] = 2.0f / (right - left);
+			result.M[5] = -2.0f / (top - bottom);
+			result.M[10] = 1.0f / (nearPlane - farPlane);
+			result.M[12] = -(right + left) / (right - left);
+			result.M[13] = (top + bottom) / (top - bottom);
+			result.M[14] = nearPlane / (nearPlane - farPlane);
+			result.M[15] = 1.0f;
+			return result;
 		}
-		if (value > max) {
-			return max;
+
+		// Gribb/Hartmann plane extraction for a 0..1 depth range
+		static Frustum ExtractFrustum(const Mat4& viewProjection) {
+			const F32* m = viewProjection.M;
+			Vec4 rows[4];
+			for (U32 row = 0; row < 4; ++row) {
+				rows[row] = { m[row], m[4 + row], m[8 + row], m[12 + row] };
+			}
+
+			Frustum frustum;
+			frustum.Planes[0] = { rows[3].X + rows[0].X, rows[3].Y + rows[0].Y, rows[3].Z + rows[0].Z, rows[3].W + rows[0].W };
+			frustum.Planes[1] = { rows[3].X - rows[0].X, rows[3].Y - rows[0].Y, rows[3].Z - rows[0].Z, rows[3].W - rows[0].W };
+			frustum.Planes[2] = { rows[3].X + rows[1].X, rows[3].Y + rows[1].Y, rows[3].Z + rows[1].Z, rows[3].W + rows[1].W };
+			frustum.Planes[3] = { rows[3].X - rows[1].X, rows[3].Y - rows[1].Y, rows[3].Z - rows[1].Z, rows[3].W - rows[1].W };
+			frustum.Planes[4] = rows[2];
+			frustum.Planes[5] = { rows[3].X - rows[2].X, rows[3].Y - rows[2].Y, rows[3].Z - rows[2].Z, rows[3].W - rows[2].W };
+
+			for (U32 i = 0; i < 6; ++i) {
+				Vec4& plane = frustum.Planes[i];
+				F32 length = sqrtf(plane.X * plane.X + plane.Y * plane.Y + plane.Z * plane.Z);
+				plane = { plane.X / length, plane.Y / length, plane.Z / length, plane.W / length };
+			}
+			return frustum;
+		}
+
+		// Largest axis scale of an affine transform, used to scale bounding sphere radii
+		static F32 MaxScale(const Mat4& m) {
+			F32 x = m.M[0] * m.M[0] + m.M[1] * m.M[1] + m.M[2] * m.M[2];
+			F32 y = m.M[4] * m.M[4] + m.M[5] * m.M[5] + m.M[6] * m.M[6];
+			F32 z = m.M[8] * m.M[8] + m.M[9] * m.M[9] + m.M[10] * m.M[10];
+			F32 largest = x > y ? x : y;
+			return sqrtf(largest > z ? largest : z);
 		}
-		return value;
-	}
+
+		static Mat4 LookAt(const Vec3& eye, const Vec3& target, const Vec3& up) {
+			Vec3 f = Normalize(Subtract(target, eye));
+			Vec3 s = Normalize(Cross(f, up));
+			Vec3 u = Cross(s, f);
+
+			Mat4 result = Identity();
+			result.M[0] = s.X;
+			result.M[4] = s.Y;
+			result.M[8] = s.Z;
+			result.M[1] = u.X;
+			result.M[5] = u.Y;
+			result.M[9] = u.Z;
+			result.M[2] = -f.X;
+			result.M[6] = -f.Y;
+			result.M[10] = -f.Z;
+			result.M[12] = -Dot(s, eye);
+			result.M[13] = -Dot(u, eye);
+			result.M[14] = Dot(f, eye);
+			return result;
+		}
+	};
 }
\ No newline at end of file
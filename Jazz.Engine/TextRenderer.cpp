@@ -0,0 +1,499 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "Benchmark.h"
+#include "TextRenderer.h"
+
+// Built-in font: 5x8 cells, rows 0-6 above the baseline and row 7 for descenders, leftmost pixel in bit 4. A line is
+// 10 font units high with the baseline 8 units down.
+#define BUILTIN_FONT_FIRST 32
+#define BUILTIN_FONT_COUNT 95
+#define BUILTIN_FONT_LINE_UNITS 10.0f
+#define BUILTIN_FONT_SUBSAMPLES 4
+
+// Share of the line height from its top down to the baseline
+#define TEXT_BASELINE 0.8f
+
+namespace Jazz {
+
+	static const U8 builtinFont[BUILTIN_FONT_COUNT][8] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00 }, // !
+		{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+		{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a, 0x00 }, // #
+		{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04, 0x00 }, // $
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00 }, // %
+		{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d, 0x00 }, // &
+		{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00 }, // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00 }, // )
+		{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00, 0x00 }, // *
+		{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00, 0x00 }, // +
+		{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08, 0x00 }, // ,
+		{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x00 }, // -
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00 }, // .
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00 }, // /
+		{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e, 0x00 }, // 0
+		{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00 }, // 1
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f, 0x00 }, // 2
+		{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e, 0x00 }, // 3
+		{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02, 0x00 }, // 4
+		{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e, 0x00 }, // 5
+		{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e, 0x00 }, // 6
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00 }, // 7
+		{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e, 0x00 }, // 8
+		{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c, 0x00 }, // 9
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00, 0x00 }, // :
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08, 0x00 }, // ;
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00 }, // <
+		{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // =
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00 }, // >
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00 }, // ?
+		{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e, 0x00 }, // @
+		{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x00 }, // A
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e, 0x00 }, // B
+		{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e, 0x00 }, // C
+		{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c, 0x00 }, // D
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f, 0x00 }, // E
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10, 0x00 }, // F
+		{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f, 0x00 }, // G
+		{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x00 }, // H
+		{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00 }, // I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c, 0x00 }, // J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00 }, // K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f, 0x00 }, // L
+		{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00 }, // M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00 }, // N
+		{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00 }, // O
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10, 0x00 }, // P
+		{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d, 0x00 }, // Q
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11, 0x00 }, // R
+		{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e, 0x00 }, // S
+		{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00 }, // U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00 }, // V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a, 0x00 }, // W
+		{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11, 0x00 }, // X
+		{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04, 0x00 }, // Y
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f, 0x00 }, // Z
+		{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e, 0x00 }, // [
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00 }, // backslash
+		{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e, 0x00 }, // ]
+		{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ^
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x00 }, // _
+		{ 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+		{ 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f, 0x00 }, // a
+		{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e, 0x00 }, // b
+		{ 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e, 0x00 }, // c
+		{ 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f, 0x00 }, // d
+		{ 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00 }, // e
+		{ 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08, 0x00 }, // f
+		{ 0x00, 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e }, // g
+		{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // h
+		{ 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e, 0x00 }, // i
+		{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x02, 0x12, 0x0c }, // j
+		{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00 }, // k
+		{ 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00 }, // l
+		{ 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11, 0x00 }, // m
+		{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // n
+		{ 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e, 0x00 }, // o
+		{ 0x00, 0x00, 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10 }, // p
+		{ 0x00, 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x01 }, // q
+		{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00 }, // r
+		{ 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e, 0x00 }, // s
+		{ 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06, 0x00 }, // t
+		{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d, 0x00 }, // u
+		{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00 }, // v
+		{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a, 0x00 }, // w
+		{ 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x00 }, // x
+		{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x0e }, // y
+		{ 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f, 0x00 }, // z
+		{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00 }, // {
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // |
+		{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00 }, // }
+		{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00 }, // ~
+	};
+
+	TextRenderer::TextRenderer() {
+		_rasterizer = RasterizeBuiltinGlyph;
+		_atlasTexture = 0;
+		_frame = 0;
+		_asciiGlyphs.assign((TEXT_MAX_PIXEL_SIZE + 1) * 128, U32_MAX);
+
+		_atlas.assign(TEXT_ATLAS_SIZE * TEXT_ATLAS_SIZE, 0);
+		_cellGlyphs.assign(TEXT_ATLAS_CELL_COUNT, U32_MAX);
+		_cellPrevious.resize(TEXT_ATLAS_CELL_COUNT);
+		_cellNext.resize(TEXT_ATLAS_CELL_COUNT);
+		for (U32 cell = 0; cell < TEXT_ATLAS_CELL_COUNT; ++cell) {
+			_cellPrevious[cell] = cell > 0 ? cell - 1 : U32_MAX;
+			_cellNext[cell] = cell + 1 < TEXT_ATLAS_CELL_COUNT ? cell + 1 : U32_MAX;
+		}
+		_mostRecentCell = 0;
+		_leastRecentCell = TEXT_ATLAS_CELL_COUNT - 1;
+		_dirtyFirstRow = TEXT_ATLAS_SIZE;
+		_dirtyEndRow = 0;
+
+		_frameStats = {};
+		_stats = {};
+	}
+
+	void TextRenderer::SetRasterizer(const std::function<const bool(U32 codepoint, U32 pixelSize, GlyphBitmap* outGlyph)>& rasterizer) {
+		_rasterizer = rasterizer;
+	}
+
+	const bool TextRenderer::RasterizeBuiltinGlyph(U32 codepoint, U32 pixelSize, GlyphBitmap* outGlyph) {
+		if (codepoint < BUILTIN_FONT_FIRST || codepoint >= BUILTIN_FONT_FIRST + BUILTIN_FONT_COUNT) {
+			codepoint = '?';
+		}
+		const U8* rows = builtinFont[codepoint - BUILTIN_FONT_FIRST];
+
+		// Scaled by whole pixels to stay sharp, only sizes below a line of 10 pixels get box filtered coverage
+		F32 unit = (F32)pixelSize / BUILTIN_FONT_LINE_UNITS;
+		unit = unit >= 1.0f ? floorf(unit) : unit;
+		outGlyph->Width = (U32)ceilf(5.0f * unit);
+		outGlyph->Height = (U32)ceilf(8.0f * unit);
+		outGlyph->OffsetX = 0;
+		outGlyph->OffsetY = -(I32)floorf(7.0f * unit + 0.5f);
+		outGlyph->Advance = 6.0f * unit;
+		if (outGlyph->Width >= TEXT_ATLAS_CELL || outGlyph->Height >= TEXT_ATLAS_CELL) {
+			return false;
+		}
+
+		const F32 step = 1.0f / (BUILTIN_FONT_SUBSAMPLES * unit);
+		const U32 sampleCount = BUILTIN_FONT_SUBSAMPLES * BUILTIN_FONT_SUBSAMPLES;
+		U8* coverage = outGlyph->Coverage;
+		for (U32 y = 0; y < outGlyph->Height; ++y) {
+			for (U32 x = 0; x < outGlyph->Width; ++x) {
+				U32 covered = 0;
+				for (U32 sy = 0; sy < BUILTIN_FONT_SUBSAMPLES; ++sy) {
+					U32 row = (U32)(((F32)(y * BUILTIN_FONT_SUBSAMPLES + sy) + 0.5f) * step);
+					if (row >= 8) {
+						continue;
+					}
+					for (U32 sx = 0; sx < BUILTIN_FONT_SUBSAMPLES; ++sx) {
+						U32 column = (U32)(((F32)(x * BUILTIN_FONT_SUBSAMPLES + sx) + 0.5f) * step);
+						covered += column < 5 ? (rows[row] >> (4 - column)) & 1 : 0;
+					}
+				}
+				*coverage++ = (U8)((covered * 255 + sampleCount / 2) / sampleCount);
+			}
+		}
+
+		// Blank glyphs need no atlas cell
+		bool blank = true;
+		for (U32 row = 0; row < 8; ++row) {
+			blank &= rows[row] == 0;
+		}
+		if (blank) {
+			outGlyph->Width = 0;
+			outGlyph->Height = 0;
+		}
+		return true;
+	}
+
+	// Invalid sequences decode as U+FFFD
+	static U32 decodeUtf8(const char** text) {
+		const U8* bytes = (const U8*)*text;
+		U32 length = bytes[0] < 0x80 ? 1 : (bytes[0] >> 5) == 0x6 ? 2 : (bytes[0] >> 4) == 0xE ? 3 : (bytes[0] >> 3) == 0x1E ? 4 : 0;
+		if (length == 0) {
+			*text += 1;
+			return 0xFFFD;
+		}
+
+		static const U8 leadMasks[5] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+		U32 codepoint = bytes[0] & leadMasks[length];
+		for (U32 i = 1; i < length; ++i) {
+			if ((bytes[i] & 0xC0) != 0x80) {
+				*text += i;
+				return 0xFFFD;
+			}
+			codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+		}
+		*text += length;
+		return codepoint;
+	}
+
+	U32 TextRenderer::findGlyph(U32 codepoint, U32 pixelSize) {
+		U32* ascii = codepoint < 128 ? &_asciiGlyphs[pixelSize * 128 + codepoint] : nullptr;
+		if (ascii && *ascii != U32_MAX) {
+			return *ascii;
+		}
+		U64 key = ((U64)codepoint << 32) | pixelSize;
+		if (!ascii) {
+			auto found = _glyphLookup.find(key);
+			if (found != _glyphLookup.end()) {
+				return found->second;
+			}
+		}
+
+		// Metrics are kept for good, the coverage only while the glyph has an atlas cell
+		Glyph glyph = {};
+		glyph.Codepoint = codepoint;
+		glyph.PixelSize = pixelSize;
+		glyph.Cell = U32_MAX;
+		glyph.LastFrame = U32_MAX;
+		if (_rasterizer(codepoint, pixelSize, &_scratchGlyph)) {
+			glyph.OffsetX = _scratchGlyph.OffsetX;
+			glyph.OffsetY = _scratchGlyph.OffsetY;
+			glyph.Width = _scratchGlyph.Width;
+			glyph.Height = _scratchGlyph.Height;
+			glyph.Advance = _scratchGlyph.Advance;
+		}
+
+		U32 glyphIndex = (U32)_glyphs.size();
+		_glyphs.push_back(glyph);
+		if (ascii) {
+			*ascii = glyphIndex;
+		} else {
+			_glyphLookup[key] = glyphIndex;
+		}
+		return glyphIndex;
+	}
+
+	void TextRenderer::touchCell(U32 cell) {
+		if (cell == _mostRecentCell) {
+			return;
+		}
+
+		U32 previous = _cellPrevious[cell];
+		U32 next = _cellNext[cell];
+		_cellNext[previous] = next;
+		if (next != U32_MAX) {
+			_cellPrevious[next] = previous;
+		} else {
+			_leastRecentCell = previous;
+		}
+
+		_cellPrevious[cell] = U32_MAX;
+		_cellNext[cell] = _mostRecentCell;
+		_cellPrevious[_mostRecentCell] = cell;
+		_mostRecentCell = cell;
+	}
+
+	// Gives the glyph a cell if it has none and marks it drawn this frame. Cells drawn this frame all sit at the front of
+	// the list, so once the least recent one was drawn too the atlas is full until the next frame.
+	const bool TextRenderer::makeResident(U32 glyphIndex) {
+		Glyph& glyph = _glyphs[glyphIndex];
+		if (glyph.Cell == U32_MAX) {
+			U32 cell = _leastRecentCell;
+			U32 evicted = _cellGlyphs[cell];
+			if (evicted != U32_MAX) {
+				if (_glyphs[evicted].LastFrame == _frame) {
+					return false;
+				}
+				_glyphs[evicted].Cell = U32_MAX;
+				_frameStats.GlyphsEvicted++;
+			}
+
+			if (!_rasterizer(glyph.Codepoint, glyph.PixelSize, &_scratchGlyph)) {
+				return false;
+			}
+
+			// The whole cell is rewritten so nothing of the evicted glyph is left around the new one
+			U32 cellX = (cell % TEXT_ATLAS_CELLS_PER_ROW) * TEXT_ATLAS_CELL;
+			U32 cellY = (cell / TEXT_ATLAS_CELLS_PER_ROW) * TEXT_ATLAS_CELL;
+			for (U32 y = 0; y < TEXT_ATLAS_CELL; ++y) {
+				U8* row = &_atlas[(cellY + y) * TEXT_ATLAS_SIZE + cellX];
+				memset(row, 0, TEXT_ATLAS_CELL);
+				if (y < glyph.Height) {
+					memcpy(row, &_scratchGlyph.Coverage[y * glyph.Width], glyph.Width);
+				}
+			}
+			_dirtyFirstRow = cellY < _dirtyFirstRow ? cellY : _dirtyFirstRow;
+			_dirtyEndRow = cellY + TEXT_ATLAS_CELL > _dirtyEndRow ? cellY + TEXT_ATLAS_CELL : _dirtyEndRow;
+
+			_cellGlyphs[cell] = glyphIndex;
+			glyph.Cell = cell;
+			_frameStats.GlyphsRasterized++;
+		}
+
+		touchCell(glyph.Cell);
+		glyph.LastFrame = _frame;
+		return true;
+	}
+
+	void TextRenderer::buildLayout(Layout& layout) {
+		layout.Glyphs.clear();
+		layout.Glyphs.reserve(layout.Text.size());
+
+		F32 penX = 0.0f;
+		F32 lineTop = 0.0f;
+		F32 baseline = floorf((F32)layout.PixelSize * TEXT_BASELINE + 0.5f);
+		F32 width = 0.0f;
+		const char* text = layout.Text.c_str();
+		const U32* asciiGlyphs = &_asciiGlyphs[layout.PixelSize * 128];
+		while (*text) {
+			U32 codepoint = (U8)*text < 0x80 ? (U32)*text++ : decodeUtf8(&text);
+			if (codepoint == '\n') {
+				width = penX > width ? penX : width;
+				penX = 0.0f;
+				lineTop += (F32)layout.PixelSize;
+				continue;
+			}
+
+			// Glyphs start on whole pixels so the atlas texels map one to one onto the screen
+			U32 glyphIndex = codepoint < 128 && asciiGlyphs[codepoint] != U32_MAX ? asciiGlyphs[codepoint] : findGlyph(codepoint, layout.PixelSize);
+			const Glyph& glyph = _glyphs[glyphIndex];
+			if (glyph.Width > 0) {
+				LayoutGlyph layoutGlyph;
+				layoutGlyph.Glyph = glyphIndex;
+				layoutGlyph.CenterX = floorf(penX + 0.5f) + (F32)glyph.OffsetX + (F32)glyph.Width * 0.5f;
+				layoutGlyph.CenterY = lineTop + baseline + (F32)glyph.OffsetY + (F32)glyph.Height * 0.5f;
+				layout.Glyphs.push_back(layoutGlyph);
+			}
+			penX += glyph.Advance;
+		}
+		layout.Width = penX > width ? penX : width;
+	}
+
+	F32 TextRenderer::Draw(SpriteBatcher& sprites, const char* text, F32 x, F32 y, U32 pixelSize, U32 color, U32 layer) {
+		pixelSize = pixelSize < 1 ? 1 : (pixelSize > TEXT_MAX_PIXEL_SIZE ? TEXT_MAX_PIXEL_SIZE : pixelSize);
+
+		// FNV-1a over the text and size finds the cached layout, which is only trusted once the text compares equal
+		U64 hash = 14695981039346656037ull;
+		U32 length = 0;
+		for (const char* c = text; *c; ++c, ++length) {
+			hash = (hash ^ (U8)*c) * 1099511628211ull;
+		}
+		hash = (hash ^ pixelSize) * 1099511628211ull;
+
+		U32 layoutIndex;
+		auto found = _layoutLookup.find(hash);
+		if (found != _layoutLookup.end() && _layouts[found->second].PixelSize == pixelSize && _layouts[found->second].Text.compare(0, std::string::npos, text, length) == 0) {
+			layoutIndex = found->second;
+			_frameStats.LayoutHits++;
+		} else {
+			// A colliding text takes over the slot, it gets laid out again should it come back
+			if (found != _layoutLookup.end()) {
+				layoutIndex = found->second;
+			} else if (!_freeLayouts.empty()) {
+				layoutIndex = _freeLayouts.back();
+				_freeLayouts.pop_back();
+				_layoutLookup[hash] = layoutIndex;
+			} else {
+				layoutIndex = (U32)_layouts.size();
+				_layouts.emplace_back();
+				_layoutLookup[hash] = layoutIndex;
+			}
+
+			Layout& layout = _layouts[layoutIndex];
+			layout.Text.assign(text, length);
+			layout.PixelSize = pixelSize;
+			layout.Hash = hash;
+			buildLayout(layout);
+			_frameStats.LayoutMisses++;
+		}
+
+		Layout& layout = _layouts[layoutIndex];
+		layout.LastFrame = _frame;
+
+		SpriteInstance instance;
+		instance.Rotation = 0.0f;
+		instance.Color = color;
+		instance.Texture = _atlasTexture;
+		F32 originX = floorf(x + 0.5f);
+		F32 originY = floorf(y + 0.5f);
+		for (const LayoutGlyph& layoutGlyph : layout.Glyphs) {
+			const Glyph& glyph = _glyphs[layoutGlyph.Glyph];
+			if (glyph.LastFrame != _frame && !makeResident(layoutGlyph.Glyph)) {
+				_frameStats.GlyphsDropped++;
+				continue;
+			}
+
+			U32 cellX = (glyph.Cell % TEXT_ATLAS_CELLS_PER_ROW) * TEXT_ATLAS_CELL;
+			U32 cellY = (glyph.Cell / TEXT_ATLAS_CELLS_PER_ROW) * TEXT_ATLAS_CELL;
+			instance.X = originX + layoutGlyph.CenterX;
+			instance.Y = originY + layoutGlyph.CenterY;
+			instance.Width = (F32)glyph.Width;
+			instance.Height = (F32)glyph.Height;
+			instance.UV[0] = (U16)(cellX * 65535u / TEXT_ATLAS_SIZE);
+			instance.UV[1] = (U16)(cellY * 65535u / TEXT_ATLAS_SIZE);
+			instance.UV[2] = (U16)((cellX + glyph.Width) * 65535u / TEXT_ATLAS_SIZE);
+			instance.UV[3] = (U16)((cellY + glyph.Height) * 65535u / TEXT_ATLAS_SIZE);
+			sprites.DrawInstance(instance, layer);
+			_frameStats.GlyphsDrawn++;
+		}
+		return layout.Width;
+	}
+
+	void TextRenderer::EndFrame() {
+		for (U32 i = 0; i < (U32)_layouts.size(); ++i) {
+			Layout& layout = _layouts[i];
+			if (layout.LastFrame == U32_MAX || _frame - layout.LastFrame < TEXT_LAYOUT_MAX_AGE) {
+				continue;
+			}
+
+			// A colliding text may have taken the slot over without changing its hash
+			auto found = _layoutLookup.find(layout.Hash);
+			if (found != _layoutLookup.end() && found->second == i) {
+				_layoutLookup.erase(found);
+			}
+			layout.Text.clear();
+			layout.Glyphs.clear();
+			layout.LastFrame = U32_MAX;
+			_freeLayouts.push_back(i);
+		}
+
+		_stats = _frameStats;
+		_frameStats = {};
+		++_frame;
+	}
+
+	const bool TextRenderer::TakeDirtyRows(U32* outFirstRow, U32* outRowCount) {
+		if (_dirtyFirstRow >= _dirtyEndRow) {
+			return false;
+		}
+		*outFirstRow = _dirtyFirstRow;
+		*outRowCount = _dirtyEndRow - _dirtyFirstRow;
+		_dirtyFirstRow = TEXT_ATLAS_SIZE;
+		_dirtyEndRow = 0;
+		return true;
+	}
+
+	const bool TextRenderer::RunBenchmark() {
+		const U32 stringCount = 2000;
+		const U32 iterations = 20;
+		Logger::Log("Text benchmark, %d strings", stringCount);
+		bool passed = true;
+
+		SpriteBatcher sprites;
+		TextRenderer text;
+		std::vector<SpriteInstance> instances(stringCount * 64);
+
+		// Every frame gets its own set of strings for the changing case, formatting is not what is measured
+		std::vector<std::string> strings((iterations + 1) * stringCount);
+		char buffer[64];
+		for (U32 frame = 0; frame <= iterations; ++frame) {
+			for (U32 i = 0; i < stringCount; ++i) {
+				snprintf(buffer, sizeof(buffer), "Entity %4d: %8.3f %8.3f", i, (F32)(frame * 31 + i) * 0.173f, (F32)(frame * 17 + i) * 1.37f);
+				strings[frame * stringCount + i] = buffer;
+			}
+		}
+
+		U32 glyphCount = 0;
+		auto timeFrames = [&](bool changing) {
+			return Benchmark::Time(iterations, [&](U32 iteration) {
+				const std::string* frameStrings = &strings[(changing ? iteration + 1 : 0) * stringCount];
+				sprites.Clear();
+				for (U32 i = 0; i < stringCount; ++i) {
+					text.Draw(sprites, frameStrings[i].c_str(), (F32)(i % 8) * 240.0f, (F32)(i / 8) * 16.0f, 14, 0xFFFFFFFF);
+				}
+				glyphCount = sprites.Build(instances.data(), (U32)instances.size());
+				text.EndFrame();
+			});
+		};
+
+		// The first frame lays out and rasterizes everything
+		timeFrames(false);
+		F64 staticTime = timeFrames(false);
+		Logger::Log("  %-24s %9.3f ms, %d glyphs, %d layouts rebuilt", "unchanged strings", staticTime, glyphCount, text.GetStats().LayoutMisses);
+		passed &= Benchmark::Check(text.GetStats().LayoutMisses == 0, "%d unchanged strings were laid out again", text.GetStats().LayoutMisses);
+		F64 changingTime = timeFrames(true);
+		Logger::Log("  %-24s %9.3f ms, %d glyphs, %d layouts rebuilt", "every string changed", changingTime, glyphCount, text.GetStats().LayoutMisses);
+		passed &= Benchmark::Check(text.GetStats().LayoutMisses == stringCount, "%d of %d changed strings were laid out", text.GetStats().LayoutMisses, stringCount);
+		return passed;
+	}
+}
\ No newline at end of file
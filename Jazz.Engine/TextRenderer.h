@@ -0,0 +1,139 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "SpriteBatcher.h"
+
+// Single channel glyph atlas, a grid of equally sized cells so any evicted glyph's cell fits any new one
+#define TEXT_ATLAS_SIZE 1024
+#define TEXT_ATLAS_CELL 32
+#define TEXT_ATLAS_CELLS_PER_ROW (TEXT_ATLAS_SIZE / TEXT_ATLAS_CELL)
+#define TEXT_ATLAS_CELL_COUNT (TEXT_ATLAS_CELLS_PER_ROW * TEXT_ATLAS_CELLS_PER_ROW)
+
+// Line height in pixels, larger text is drawn at this size
+#define TEXT_MAX_PIXEL_SIZE 32
+
+// Frames a cached layout survives without being drawn. Strings that change every frame never come back, so keeping
+// their layouts around longer only grows the cache.
+#define TEXT_LAYOUT_MAX_AGE 8
+
+namespace Jazz {
+
+	// A rasterized glyph. Leaves a pixel of every cell free so linear filtering never reaches into the neighbours.
+	struct GlyphBitmap {
+		U32 Width; // At most TEXT_ATLAS_CELL - 1
+		U32 Height;
+		I32 OffsetX; // Top left corner from the pen position on the baseline
+		I32 OffsetY;
+		F32 Advance;
+		U8 Coverage[TEXT_ATLAS_CELL * TEXT_ATLAS_CELL]; // Rows of Width
+	};
+
+	// Counts of the last finished frame
+	struct TextStats {
+		U32 LayoutHits;
+		U32 LayoutMisses;
+		U32 GlyphsDrawn;
+		U32 GlyphsRasterized;
+		U32 GlyphsEvicted;
+		U32 GlyphsDropped; // Every atlas cell already held a glyph drawn this frame
+	};
+
+	// Lays text out into glyph sprites sampling one atlas texture, so all text goes out with the sprites in their single
+	// draw. Layouts are cached per string and size, glyphs are rasterized into the atlas on first use and evicted least
+	// recently used first.
+	class TextRenderer {
+	public:
+		TextRenderer();
+
+		void SetAtlasTexture(U32 texture) { _atlasTexture = texture; }
+
+		// Replaces the built-in font, e.g. with a TrueType rasterizer. Returns false for glyphs it cannot provide.
+		void SetRasterizer(const std::function<const bool(U32 codepoint, U32 pixelSize, GlyphBitmap* outGlyph)>& rasterizer);
+
+		// UTF-8 text with its first line's top left corner at (x, y) in pixels, lines pixelSize apart. Color is RGBA8 with
+		// R in the lowest byte. Returns the width of the widest line.
+		F32 Draw(SpriteBatcher& sprites, const char* text, F32 x, F32 y, U32 pixelSize, U32 color, U32 layer = SPRITE_MAX_LAYERS - 1);
+
+		// Call once the frame's sprites have been built, drops layouts that went unused for TEXT_LAYOUT_MAX_AGE frames
+		void EndFrame();
+
+		// TEXT_ATLAS_SIZE squared coverage values, rows tightly packed
+		const U8* GetAtlasPixels() const { return _atlas.data(); }
+
+		// Atlas rows written since the last call. Returns false if there are none.
+		const bool TakeDirtyRows(U32* outFirstRow, U32* outRowCount);
+
+		const TextStats& GetStats() const { return _stats; }
+
+		// 5x7 pixel font covering printable ASCII, other codepoints come out as '?'
+		static const bool RasterizeBuiltinGlyph(U32 codepoint, U32 pixelSize, GlyphBitmap* outGlyph);
+
+		// Frame cost of 2000 strings that stay the same and of 2000 strings that all change every frame. Fails when the
+		// layout cache misses on an unchanged string or hits on a changed one.
+		static const bool RunBenchmark();
+	private:
+		struct Glyph {
+			U32 Codepoint;
+			U32 PixelSize;
+			U32 Cell; // U32_MAX while not in the atlas
+			U32 LastFrame;
+			I32 OffsetX;
+			I32 OffsetY;
+			U32 Width;
+			U32 Height;
+			F32 Advance;
+		};
+
+		// A visible glyph's sprite relative to the text origin
+		struct LayoutGlyph {
+			U32 Glyph;
+			F32 CenterX;
+			F32 CenterY;
+		};
+
+		struct Layout {
+			std::string Text;
+			U32 PixelSize;
+			U64 Hash;
+			U32 LastFrame;
+			F32 Width;
+			std::vector<LayoutGlyph> Glyphs;
+		};
+
+		U32 findGlyph(U32 codepoint, U32 pixelSize);
+		const bool makeResident(U32 glyphIndex);
+		void buildLayout(Layout& layout);
+		void touchCell(U32 cell);
+	private:
+		std::function<const bool(U32 codepoint, U32 pixelSize, GlyphBitmap* outGlyph)> _rasterizer;
+		U32 _atlasTexture;
+		U32 _frame;
+
+		std::vector<Glyph> _glyphs;
+		std::unordered_map<U64, U32> _glyphLookup; // Codepoint in the high half, pixel size in the low half
+		std::vector<U32> _asciiGlyphs; // 128 per pixel size, skips the lookup for ASCII
+
+		// Atlas cells in a doubly linked list from most to least recently drawn
+		std::vector<U8> _atlas;
+		std::vector<U32> _cellGlyphs;
+		std::vector<U32> _cellPrevious;
+		std::vector<U32> _cellNext;
+		U32 _mostRecentCell;
+		U32 _leastRecentCell;
+		U32 _dirtyFirstRow;
+		U32 _dirtyEndRow;
+		GlyphBitmap _scratchGlyph;
+
+		std::vector<Layout> _layouts;
+		std::vector<U32> _freeLayouts;
+		std::unordered_map<U64, U32> _layoutLookup; // By hash of the text and pixel size
+
+		TextStats _frameStats;
+		TextStats _stats;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+// Nodes per parallel batch, a multiple of every SIMD width
+#define TRANSFORM_BATCH_SIZE 4096
+
+// Scattered nodes miss the cache on every one of their arrays, so once 1 / TRANSFORM_DENSE_DIVISOR of a level changed
+// it is cheaper to compute all of it with contiguous loads
+#define TRANSFORM_DENSE_DIVISOR 16
+
+namespace Jazz {
+
+	static void toComponents(const Mat4& m, F32* out) {
+		for (U32 column = 0; column < 4; ++column) {
+			for (U32 row = 0; row < 3; ++row) {
+				out[column * 3 + row] = m.M[column * 4 + row];
+			}
+		}
+	}
+
+	static Mat4 fromComponents(const std::vector<F32>* components, U32 index) {
+		Mat4 m;
+		for (U32 column = 0; column < 4; ++column) {
+			for (U32 row = 0; row < 3; ++row) {
+				m.M[column * 4 + row] = components[column * 3 + row][index];
+			}
+			m.M[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+		}
+		return m;
+	}
+
+	TransformHierarchy::TransformHierarchy() {
+		_count = 0;
+	}
+
+	U32 TransformHierarchy::Create(const Mat4& local, U32 parent) {
+		U32 node;
+		if (!_freeNodes.empty()) {
+			node = _freeNodes.back();
+			_freeNodes.pop_back();
+		} else {
+			node = (U32)_nodes.size();
+			_nodes.push_back({});
+		}
+
+		TransformNode& transformNode = _nodes[node];
+		transformNode.Parent = U32_MAX;
+		transformNode.FirstChild = U32_MAX;
+		transformNode.NextSibling = U32_MAX;
+		transformNode.PreviousSibling = U32_MAX;
+		attach(node, parent);
+
+		F32 components[TRANSFORM_COMPONENTS];
+		toComponents(local, components);
+		appendSlot(node, parent == U32_MAX ? 0 : _nodes[parent].Depth + 1, components);
+		_count++;
+		return node;
+	}
+
+	void TransformHierarchy::Destroy(U32 node) {
+		// Top down, so children are still linked when a removal moves their parent's slot
+		std::vector<U32> subtree;
+		collectSubtree(node, subtree);
+		detach(node);
+
+		for (U32 removed : subtree) {
+			removeSlot(removed);
+			_nodes[removed].Depth = U32_MAX;
+			_freeNodes.push_back(removed);
+		}
+		_count -= (U32)subtree.size();
+	}
+
+	const bool TransformHierarchy::SetParent(U32 node, U32 parent) {
+		for (U32 ancestor = parent; ancestor != U32_MAX; ancestor = _nodes[ancestor].Parent) {
+			if (ancestor == node) {
+				Logger::Error("Unable to parent transform %d under its own descendant %d", node, parent);
+				return false;
+			}
+		}
+
+		if (_nodes[node].Parent == parent) {
+			return true;
+		}
+
+		U32 oldDepth = _nodes[node].Depth;
+		U32 newDepth = parent == U32_MAX ? 0 : _nodes[parent].Depth + 1;
+		detach(node);
+		attach(node, parent);
+
+		if (oldDepth == newDepth) {
+			_levels[newDepth].Parent[_nodes[node].Index] = parent == U32_MAX ? U32_MAX : _nodes[parent].Index;
+			queue(node);
+			return true;
+		}
+
+		// The whole subtree changes depth, parents move first so their children can find their new slots
+		std::vector<U32> subtree;
+		collectSubtree(node, subtree);
+		for (U32 moved : subtree) {
+			const TransformNode& movedNode = _nodes[moved];
+			const TransformLevel& level = _levels[movedNode.Depth];
+			F32 local[TRANSFORM_COMPONENTS];
+			for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+				local[c] = level.Local[c][movedNode.Index];
+			}
+
+			U32 depth = movedNode.Parent == U32_MAX ? 0 : _nodes[movedNode.Parent].Depth + 1;
+			removeSlot(moved);
+			appendSlot(moved, depth, local);
+		}
+		return true;
+	}
+
+	void TransformHierarchy::SetLocal(U32 node, const Mat4& local) {
+		const TransformNode& transformNode = _nodes[node];
+		TransformLevel& level = _levels[transformNode.Depth];
+		F32 components[TRANSFORM_COMPONENTS];
+		toComponents(local, components);
+		for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+			level.Local[c][transformNode.Index] = components[c];
+		}
+		queue(node);
+	}
+
+	Mat4 TransformHierarchy::GetLocal(U32 node) const {
+		const TransformNode& transformNode = _nodes[node];
+		return fromComponents(_levels[transformNode.Depth].Local, transformNode.Index);
+	}
+
+	Mat4 TransformHierarchy::GetWorld(U32 node) const {
+		const TransformNode& transformNode = _nodes[node];
+		return fromComponents(_levels[transformNode.Depth].World, transformNode.Index);
+	}
+
+	void TransformHierarchy::queue(U32 node) {
+		TransformNode& transformNode = _nodes[node];
+		if (!transformNode.Queued) {
+			transformNode.Queued = 1;
+			_levels[transformNode.Depth].DirtyNodes.push_back(node);
+		}
+	}
+
+	void TransformHierarchy::appendSlot(U32 node, U32 depth, const F32* local) {
+		while (_levels.size() <= depth) {
+			_levels.emplace_back();
+			_levels.back().AllDirty = false;
+		}
+
+		TransformLevel& level = _levels[depth];
+		TransformNode& transformNode = _nodes[node];
+		transformNode.Depth = depth;
+		transformNode.Index = (U32)level.Node.size();
+		transformNode.Queued = 0;
+
+		for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+			level.Local[c].push_back(local[c]);
+			level.World[c].push_back(local[c]);
+		}
+		level.Parent.push_back(transformNode.Parent == U32_MAX ? U32_MAX : _nodes[transformNode.Parent].Index);
+		level.Node.push_back(node);
+		queue(node);
+	}
+
+	void TransformHierarchy::removeSlot(U32 node) {
+		const TransformNode& transformNode = _nodes[node];
+		U32 depth = transformNode.Depth;
+		TransformLevel& level = _levels[depth];
+		U32 index = transformNode.Index;
+		U32 last = (U32)level.Node.size() - 1;
+
+		// The last node of the level fills the gap, and its children have to follow it
+		if (index != last) {
+			for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+				level.Local[c][index] = level.Local[c][last];
+				level.World[c][index] = level.World[c][last];
+			}
+			level.Parent[index] = level.Parent[last];
+
+			U32 moved = level.Node[last];
+			level.Node[index] = moved;
+			_nodes[moved].Index = index;
+
+			// Children still waiting to be moved by SetParent live elsewhere and find their parent once they are
+			for (U32 child = _nodes[moved].FirstChild; child != U32_MAX; child = _nodes[child].NextSibling) {
+				if (_nodes[child].Depth == depth + 1) {
+					_levels[depth + 1].Parent[_nodes[child].Index] = index;
+				}
+			}
+		}
+
+		for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+			level.Local[c].pop_back();
+			level.World[c].pop_back();
+		}
+		level.Parent.pop_back();
+		level.Node.pop_back();
+	}
+
+	void TransformHierarchy::attach(U32 node, U32 parent) {
+		TransformNode& transformNode = _nodes[node];
+		transformNode.Parent = parent;
+		transformNode.PreviousSibling = U32_MAX;
+		transformNode.NextSibling = U32_MAX;
+		if (parent == U32_MAX) {
+			return;
+		}
+
+		TransformNode& parentNode = _nodes[parent];
+		transformNode.NextSibling = parentNode.FirstChild;
+		if (parentNode.FirstChild != U32_MAX) {
+			_nodes[parentNode.FirstChild].PreviousSibling = node;
+		}
+		parentNode.FirstChild = node;
+	}
+
+	void TransformHierarchy::detach(U32 node) {
+		TransformNode& transformNode = _nodes[node];
+		if (transformNode.PreviousSibling != U32_MAX) {
+			_nodes[transformNode.PreviousSibling].NextSibling = transformNode.NextSibling;
+		} else if (transformNode.Parent != U32_MAX) {
+			_nodes[transformNode.Parent].FirstChild = transformNode.NextSibling;
+		}
+		if (transformNode.NextSibling != U32_MAX) {
+			_nodes[transformNode.NextSibling].PreviousSibling = transformNode.PreviousSibling;
+		}
+
+		transformNode.Parent = U32_MAX;
+		transformNode.PreviousSibling = U32_MAX;
+		transformNode.NextSibling = U32_MAX;
+	}
+
+	void TransformHierarchy::collectSubtree(U32 node, std::vector<U32>& outNodes) const {
+		outNodes.push_back(node);
+		for (size_t i = outNodes.size() - 1; i < outNodes.size(); ++i) {
+			for (U32 child = _nodes[outNodes[i]].FirstChild; child != U32_MAX; child = _nodes[child].NextSibling) {
+				outNodes.push_back(child);
+			}
+		}
+	}
+
+	// world = parentWorld * local on the top three rows, the bottom row of both is always 0 0 0 1
+	static void multiplyScalar(TransformLevel& level, const TransformLevel& parentLevel, const U32* slots, U32 start, U32 end) {
+		for (U32 i = start; i < end; ++i) {
+			U32 slot = slots ? slots[i] : i;
+			U32 parent = level.Parent[slot];
+
+			F32 local[TRANSFORM_COMPONENTS];
+			F32 parentWorld[TRANSFORM_COMPONENTS];
+			for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+				local[c] = level.Local[c][slot];
+				parentWorld[c] = parentLevel.World[c][parent];
+			}
+
+			for (U32 column = 0; column < 4; ++column) {
+				for (U32 row = 0; row < 3; ++row) {
+					F32 value = parentWorld[row] * local[column * 3] + parentWorld[3 + row] * local[column * 3 + 1] + parentWorld[6 + row] * local[column * 3 + 2];
+					level.World[column * 3 + row][slot] = column == 3 ? value + parentWorld[9 + row] : value;
+				}
+			}
+		}
+	}
+
+#ifdef ARCH_X64
+	// Eight nodes at a time. Parents are gathered, and so are changed nodes when only some of the level is updated.
+	TARGET_AVX2 static void multiplyAVX2(TransformLevel& level, const TransformLevel& parentLevel, const U32* slots, U32 start, U32 end) {
+		const F32* local[TRANSFORM_COMPONENTS];
+		const F32* parentWorld[TRANSFORM_COMPONENTS];
+		F32* world[TRANSFORM_COMPONENTS];
+		for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+			local[c] = level.Local[c].data();
+			parentWorld[c] = parentLevel.World[c].data();
+			world[c] = level.World[c].data();
+		}
+		const I32* parents = (const I32*)level.Parent.data();
+
+		U32 i = start;
+		for (; i + 8 <= end; i += 8) {
+			__m256i slot = _mm256_setzero_si256();
+			__m256i parent;
+			__m256 l[TRANSFORM_COMPONENTS];
+			if (slots) {
+				slot = _mm256_loadu_si256((const __m256i*)(slots + i));
+				parent = _mm256_i32gather_epi32(parents, slot, 4);
+				for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+					l[c] = _mm256_i32gather_ps(local[c], slot, 4);
+				}
+			} else {
+				parent = _mm256_loadu_si256((const __m256i*)(parents + i));
+				for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+					l[c] = _mm256_loadu_ps(local[c] + i);
+				}
+			}
+
+			__m256 p[TRANSFORM_COMPONENTS];
+			for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+				p[c] = _mm256_i32gather_ps(parentWorld[c], parent, 4);
+			}
+
+			__m256 w[TRANSFORM_COMPONENTS];
+			for (U32 column = 0; column < 4; ++column) {
+				for (U32 row = 0; row < 3; ++row) {
+					__m256 value = _mm256_mul_ps(p[row], l[column * 3]);
+					value = _mm256_fmadd_ps(p[3 + row], l[column * 3 + 1], value);
+					value = _mm256_fmadd_ps(p[6 + row], l[column * 3 + 2], value);
+					w[column * 3 + row] = column == 3 ? _mm256_add_ps(value, p[9 + row]) : value;
+				}
+			}
+
+			if (slots) {
+				// No scatter before AVX-512
+				alignas(32) U32 slotLanes[8];
+				alignas(32) F32 lanes[8];
+				_mm256_store_si256((__m256i*)slotLanes, slot);
+				for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+					_mm256_store_ps(lanes, w[c]);
+					for (U32 lane = 0; lane < 8; ++lane) {
+						world[c][slotLanes[lane]] = lanes[lane];
+					}
+				}
+			} else {
+				for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+					_mm256_storeu_ps(world[c] + i, w[c]);
+				}
+			}
+		}
+
+		multiplyScalar(level, parentLevel, slots, i, end);
+	}
+#endif
+
+	// slots lists the nodes to compute, or null for the whole level. Roots just copy their local matrix.
+	static void computeRange(TransformLevel& level, const TransformLevel* parentLevel, const U32* slots, U32 start, U32 end, SimdLevel simdLevel) {
+		if (!parentLevel) {
+			for (U32 i = start; i < end; ++i) {
+				U32 slot = slots ? slots[i] : i;
+				for (U32 c = 0; c < TRANSFORM_COMPONENTS; ++c) {
+					level.World[c][slot] = level.Local[c][slot];
+				}
+			}
+			return;
+		}
+
+#ifdef ARCH_X64
+		// The gathers need AVX2, AVX-512 shares its path
+		if (simdLevel >= SimdLevel::AVX2) {
+			multiplyAVX2(level, *parentLevel, slots, start, end);
+			return;
+		}
+#endif
+		multiplyScalar(level, *parentLevel, slots, start, end);
+	}
+
+	U32 TransformHierarchy::Update(SimdLevel simdLevel, bool parallel) {
+		U32 computed = 0;
+		for (U32 depth = 0; depth < _levels.size(); ++depth) {
+			TransformLevel& level = _levels[depth];
+			TransformLevel* parentLevel = depth > 0 ? &_levels[depth - 1] : nullptr;
+			U32 levelCount = (U32)level.Node.size();
+
+			// Skip entries for nodes destroyed or moved to another level since they were queued
+			_updateSlots.clear();
+			for (U32 node : level.DirtyNodes) {
+				TransformNode& transformNode = _nodes[node];
+				if (transformNode.Depth == depth) {
+					transformNode.Queued = 0;
+					_updateSlots.push_back(transformNode.Index);
+				}
+			}
+			level.DirtyNodes.clear();
+
+			if (!level.AllDirty) {
+				std::sort(_updateSlots.begin(), _updateSlots.end());
+				_updateSlots.erase(std::unique(_updateSlots.begin(), _updateSlots.end()), _updateSlots.end());
+				level.AllDirty = _updateSlots.size() == levelCount;
+			}
+
+			bool dense = level.AllDirty || _updateSlots.size() * TRANSFORM_DENSE_DIVISOR >= levelCount;
+			const U32* slots = dense ? nullptr : _updateSlots.data();
+			U32 count = dense ? levelCount : (U32)_updateSlots.size();
+			auto computeBatch = [&](U32 start, U32 end) {
+				computeRange(level, parentLevel, slots, start, end, simdLevel);
+			};
+			if (!parallel || count <= TRANSFORM_BATCH_SIZE) {
+				computeBatch(0, count);
+			} else {
+				JobSystem::ParallelFor(count, TRANSFORM_BATCH_SIZE, computeBatch);
+			}
+			computed += count;
+
+			// Children of changed nodes change too
+			if (depth + 1 < _levels.size()) {
+				if (level.AllDirty) {
+					_levels[depth + 1].AllDirty = true;
+				} else {
+					for (U32 slot : _updateSlots) {
+						for (U32 child = _nodes[level.Node[slot]].FirstChild; child != U32_MAX; child = _nodes[child].NextSibling) {
+							queue(child);
+						}
+					}
+				}
+			}
+			level.AllDirty = false;
+		}
+		return computed;
+	}
+
+	static Mat4 randomLocal(std::mt19937& random) {
+		std::uniform_real_distribution<F32> angle(-3.14159f, 3.14159f);
+		std::uniform_real_distribution<F32> offset(-2.0f, 2.0f);
+		F32 c = cosf(angle(random));
+		F32 s = sinf(angle(random));
+		Mat4 local = TMath::Translation({ offset(random), offset(random), offset(random) });
+		local.M[0] = c;
+		local.M[2] = -s;
+		local.M[8] = s;
+		local.M[10] = c;
+		return local;
+	}
+
+	const bool TransformHierarchy::RunBenchmark() {
+		const U32 nodeCount = 1000000;
+		const U32 branching = 4;
+		const U32 iterations = 10;
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::AVX2 };
+		SimdLevel supportedLevel = Simd::GetSupportedLevel();
+
+		Logger::Log("Transform hierarchy benchmark, %s supported, %d threads", Simd::GetLevelName(supportedLevel), JobSystem::GetThreadCount());
+		bool passed = true;
+
+		std::mt19937 random(1234);
+		TransformHierarchy hierarchy;
+		for (U32 i = 0; i < nodeCount; ++i) {
+			hierarchy.Create(randomLocal(random), i == 0 ? U32_MAX : (i - 1) / branching);
+		}
+		Mat4 rootLocal = hierarchy.GetLocal(0);
+		hierarchy.Update(SimdLevel::Scalar, false);
+		Logger::Log("%d nodes, %d levels", nodeCount, hierarchy.GetDepthCount());
+
+		std::vector<Mat4> baseline(nodeCount);
+		for (U32 i = 0; i < nodeCount; ++i) {
+			baseline[i] = hierarchy.GetWorld(i);
+		}
+
+		// Moving the root recomputes everything
+		U32 computed = 0;
+		F64 baselineTime = 0.0;
+		for (SimdLevel level : levels) {
+			if (level > supportedLevel) {
+				break;
+			}
+
+			for (U32 parallel = 0; parallel < 2; ++parallel) {
+				F64 time = Benchmark::Time(iterations, [&](U32) {
+					hierarchy.SetLocal(0, rootLocal);
+					computed = hierarchy.Update(level, parallel != 0);
+				});
+				baselineTime = baselineTime > 0.0 ? baselineTime : time;
+
+				F32 difference = 0.0f;
+				for (U32 i = 0; i < nodeCount; ++i) {
+					Mat4 world = hierarchy.GetWorld(i);
+					for (U32 e = 0; e < 16; ++e) {
+						difference = fmaxf(difference, fabsf(world.M[e] - baseline[i].M[e]));
+					}
+				}
+
+				char name[64];
+				snprintf(name, sizeof(name), "%s full%s", Simd::GetLevelName(level), parallel ? " parallel" : "");
+				Logger::Log("  %-24s %9.3f ms %7.2fx %8d nodes, max difference %g", name, time, baselineTime / time, computed, difference);
+				passed &= Benchmark::Check(computed == nodeCount && difference <= 1e-3f, "%s computed %d of %d nodes, max difference %g", name,
+					computed, nodeCount, difference);
+			}
+		}
+
+		// Scattered changes only pay for their own subtrees
+		const U32 changeCounts[] = { 10000, 1000, 0 };
+		std::uniform_int_distribution<U32> pick(0, nodeCount - 1);
+		for (U32 changeCount : changeCounts) {
+			std::vector<U32> changed(changeCount);
+			for (U32& node : changed) {
+				node = pick(random);
+			}
+
+			F64 time = Benchmark::Time(iterations, [&](U32) {
+				for (U32 node : changed) {
+					hierarchy.SetLocal(node, hierarchy.GetLocal(node));
+				}
+				computed = hierarchy.Update();
+			});
+
+			char name[64];
+			snprintf(name, sizeof(name), "%d changed", changeCount);
+			Logger::Log("  %-24s %9.3f ms %8d nodes", name, time, computed);
+			passed &= Benchmark::Check(changeCount > 0 || computed == 0, "%d nodes recomputed without any change", computed);
+		}
+		return passed;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include "Defines.h"
+#include "TMath.h"
+#include "Simd.h"
+
+// Affine matrices are stored as their top three rows, component (row, column) in array column * 3 + row
+#define TRANSFORM_COMPONENTS 12
+
+namespace Jazz {
+
+	struct TransformNode {
+		U32 Depth; // U32_MAX once destroyed
+		U32 Index; // Slot within its depth level
+		U32 Parent;
+		U32 FirstChild;
+		U32 NextSibling;
+		U32 PreviousSibling;
+		U32 Queued; // Listed in its level's dirty nodes
+	};
+
+	// Every node of one depth, structure of arrays so SIMD loads fetch one matrix component of 8 nodes
+	struct TransformLevel {
+		std::vector<F32> Local[TRANSFORM_COMPONENTS];
+		std::vector<F32> World[TRANSFORM_COMPONENTS];
+		std::vector<U32> Parent; // Slot in the level above
+		std::vector<U32> Node;
+		std::vector<U32> DirtyNodes;
+		bool AllDirty;
+	};
+
+	// Scene graph transforms grouped by depth, so parents are always finished before their children and each level can
+	// be computed in parallel. Nodes are stable handles; moving within the arrays on removal is hidden behind them.
+	// Only nodes whose local matrix changed, and their descendants, are recomputed by Update.
+	class TransformHierarchy {
+	public:
+		TransformHierarchy();
+
+		// Local matrices must be affine. parent is U32_MAX for a root.
+		U32 Create(const Mat4& local, U32 parent = U32_MAX);
+
+		// Destroys the node and every descendant
+		void Destroy(U32 node);
+
+		// Moves the node with its subtree under a new parent, keeping local matrices. Fails if that would form a cycle.
+		const bool SetParent(U32 node, U32 parent);
+
+		void SetLocal(U32 node, const Mat4& local);
+		Mat4 GetLocal(U32 node) const;
+
+		// As of the last Update
+		Mat4 GetWorld(U32 node) const;
+
+		U32 GetParent(U32 node) const { return _nodes[node].Parent; }
+		U32 GetCount() const { return _count; }
+		U32 GetDepthCount() const { return (U32)_levels.size(); }
+
+		// Recomputes the world matrices of every changed node and their descendants one depth at a time. Returns how
+		// many world matrices were computed.
+		U32 Update(SimdLevel level = Simd::GetSupportedLevel(), bool parallel = true);
+
+		// Full and partial updates of a million node hierarchy for every supported SIMD level, single threaded and parallel.
+		// Fails when a level disagrees with scalar code or an update without changes recomputes anything.
+		static const bool RunBenchmark();
+	private:
+		void queue(U32 node);
+		void appendSlot(U32 node, U32 depth, const F32* local);
+		void removeSlot(U32 node);
+		void attach(U32 node, U32 parent);
+		void detach(U32 node);
+		void collectSubtree(U32 node, std::vector<U32>& outNodes) const;
+	private:
+		std::vector<TransformNode> _nodes;
+		std::vector<U32> _freeNodes;
+		std::vector<TransformLevel> _levels;
+		std::vector<U32> _updateSlots;
+		U32 _count;
+	};
+}
\ No newline at end of file
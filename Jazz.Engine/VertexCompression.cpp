@@ -0,0 +1,380 @@
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <vector>
+
+#include "Defines.h"
+#include "Logger.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "TMath.h"
+#include "VertexCompression.h"
+
+#ifdef ARCH_X64
+#include <immintrin.h>
+#endif
+
+// Vertices per parallel batch, a multiple of every SIMD width
+#define VERTEX_COMPRESSION_BATCH_SIZE 16384
+
+namespace Jazz {
+
+	// Maps positions to 0..65535 across the bounds
+	struct PositionQuantization {
+		F32 Min[3];
+		F32 Scale[3];
+	};
+
+	static PositionQuantization makeQuantization(const MeshBounds& bounds) {
+		PositionQuantization quantization;
+		for (U32 axis = 0; axis < 3; ++axis) {
+			F32 extent = bounds.Max[axis] - bounds.Min[axis];
+			quantization.Min[axis] = bounds.Min[axis];
+			quantization.Scale[axis] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+		}
+		return quantization;
+	}
+
+	static U32 floatBits(F32 value) {
+		U32 bits;
+		memcpy(&bits, &value, sizeof(U32));
+		return bits;
+	}
+
+	static F32 bitsFloat(U32 bits) {
+		F32 value;
+		memcpy(&value, &bits, sizeof(F32));
+		return value;
+	}
+
+	// Round to nearest even, matching F16C
+	static U16 floatToHalf(F32 value) {
+		U32 bits = floatBits(value);
+		U32 sign = (bits >> 16) & 0x8000;
+		U32 magnitude = bits & 0x7fffffff;
+
+		if (magnitude > 0x7f800000) {
+			return (U16)(sign | 0x7e00 | ((magnitude >> 13) & 0x3ff));
+		}
+		if (magnitude >= 0x47800000) {
+			return (U16)(sign | 0x7c00);
+		}
+		if (magnitude < 0x33000000) {
+			return (U16)sign;
+		}
+
+		// Below the smallest normal half the implicit one becomes part of a denormal mantissa
+		if (magnitude < 0x38800000) {
+			U32 mantissa = (magnitude & 0x7fffff) | 0x800000;
+			U32 shift = 126 - (magnitude >> 23);
+			U32 half = mantissa >> shift;
+			U32 remainder = mantissa & ((1u << shift) - 1);
+			U32 halfway = 1u << (shift - 1);
+			half += (remainder > halfway || (remainder == halfway && (half & 1))) ? 1 : 0;
+			return (U16)(sign | half);
+		}
+
+		// Rebias the exponent, a carry out of the mantissa correctly rounds up to the next exponent or infinity
+		U32 half = (magnitude - 0x38000000) >> 13;
+		U32 remainder = magnitude & 0x1fff;
+		half += (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) ? 1 : 0;
+		return (U16)(sign | half);
+	}
+
+	static F32 halfToFloat(U16 half) {
+		U32 sign = (U32)(half & 0x8000) << 16;
+		U32 exponent = (half >> 10) & 0x1f;
+		U32 mantissa = half & 0x3ff;
+
+		if (exponent == 0) {
+			F32 value = (F32)mantissa * (1.0f / 16777216.0f);
+			return sign ? -value : value;
+		}
+		if (exponent == 31) {
+			return bitsFloat(sign | 0x7f800000 | (mantissa << 13));
+		}
+		return bitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+	}
+
+	static void encodeScalar(const MeshVertex* vertices, U32 start, U32 end, const PositionQuantization& quantization, CompressedVertex* out) {
+		for (U32 i = start; i < end; ++i) {
+			const MeshVertex& vertex = vertices[i];
+			CompressedVertex& compressed = out[i];
+
+			for (U32 axis = 0; axis < 3; ++axis) {
+				F32 q = (vertex.Position[axis] - quantization.Min[axis]) * quantization.Scale[axis];
+				q = q > 0.0f ? (q < 65535.0f ? q : 65535.0f) : 0.0f;
+				compressed.Position[axis] = (U16)nearbyintf(q);
+			}
+			compressed.Padding = 0;
+
+			// Project onto the octahedron, then fold the lower half over the upper one
+			F32 length = fabsf(vertex.Normal[0]) + fabsf(vertex.Normal[1]) + fabsf(vertex.Normal[2]);
+			F32 inverseLength = 1.0f / (length > 1e-20f ? length : 1e-20f);
+			F32 x = vertex.Normal[0] * inverseLength;
+			F32 y = vertex.Normal[1] * inverseLength;
+			if (vertex.Normal[2] < 0.0f) {
+				F32 foldedX = copysignf(1.0f - fabsf(y), x);
+				F32 foldedY = copysignf(1.0f - fabsf(x), y);
+				x = foldedX;
+				y = foldedY;
+			}
+			x = x > -1.0f ? (x < 1.0f ? x : 1.0f) : -1.0f;
+			y = y > -1.0f ? (y < 1.0f ? y : 1.0f) : -1.0f;
+			compressed.Normal[0] = (I16)nearbyintf(x * 32767.0f);
+			compressed.Normal[1] = (I16)nearbyintf(y * 32767.0f);
+
+			compressed.UV[0] = floatToHalf(vertex.UV[0]);
+			compressed.UV[1] = floatToHalf(vertex.UV[1]);
+		}
+	}
+
+#ifdef ARCH_X64
+	// Eight vertices at a time: each MeshVertex is exactly one register, so a transpose turns them into one register
+	// per component, and another packs the results back into vertices
+	TARGET_AVX2 static void encodeAVX2(const MeshVertex* vertices, U32 start, U32 end, const PositionQuantization& quantization, CompressedVertex* out) {
+		const __m256 minX = _mm256_set1_ps(quantization.Min[0]);
+		const __m256 minY = _mm256_set1_ps(quantization.Min[1]);
+		const __m256 minZ = _mm256_set1_ps(quantization.Min[2]);
+		const __m256 scaleX = _mm256_set1_ps(quantization.Scale[0]);
+		const __m256 scaleY = _mm256_set1_ps(quantization.Scale[1]);
+		const __m256 scaleZ = _mm256_set1_ps(quantization.Scale[2]);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 positionMax = _mm256_set1_ps(65535.0f);
+		const __m256 normalScale = _mm256_set1_ps(32767.0f);
+		const __m256 minLength = _mm256_set1_ps(1e-20f);
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		const __m256i lowHalf = _mm256_set1_epi32(0xffff);
+
+		U32 i = start;
+		for (; i + 8 <= end; i += 8) {
+			const F32* source = (const F32*)(vertices + i);
+			__m256 r0 = _mm256_loadu_ps(source + 0);
+			__m256 r1 = _mm256_loadu_ps(source + 8);
+			__m256 r2 = _mm256_loadu_ps(source + 16);
+			__m256 r3 = _mm256_loadu_ps(source + 24);
+			__m256 r4 = _mm256_loadu_ps(source + 32);
+			__m256 r5 = _mm256_loadu_ps(source + 40);
+			__m256 r6 = _mm256_loadu_ps(source + 48);
+			__m256 r7 = _mm256_loadu_ps(source + 56);
+
+			__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+			__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+			__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+			__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+			__m256 t4 = _mm256_unpacklo_ps(r4, r5);
+			__m256 t5 = _mm256_unpackhi_ps(r4, r5);
+			__m256 t6 = _mm256_unpacklo_ps(r6, r7);
+			__m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+			__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+			__m256 positionX = _mm256_permute2f128_ps(s0, s4, 0x20);
+			__m256 positionY = _mm256_permute2f128_ps(s1, s5, 0x20);
+			__m256 positionZ = _mm256_permute2f128_ps(s2, s6, 0x20);
+			__m256 normalX = _mm256_permute2f128_ps(s3, s7, 0x20);
+			__m256 normalY = _mm256_permute2f128_ps(s0, s4, 0x31);
+			__m256 normalZ = _mm256_permute2f128_ps(s1, s5, 0x31);
+			__m256 u = _mm256_permute2f128_ps(s2, s6, 0x31);
+			__m256 v = _mm256_permute2f128_ps(s3, s7, 0x31);
+
+			__m256i qx = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(positionX, minX), scaleX), zero), positionMax));
+			__m256i qy = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(positionY, minY), scaleY), zero), positionMax));
+			__m256i qz = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(positionZ, minZ), scaleZ), zero), positionMax));
+
+			__m256 length = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(signMask, normalX), _mm256_andnot_ps(signMask, normalY)), _mm256_andnot_ps(signMask, normalZ));
+			__m256 inverseLength = _mm256_div_ps(one, _mm256_max_ps(length, minLength));
+			__m256 x = _mm256_mul_ps(normalX, inverseLength);
+			__m256 y = _mm256_mul_ps(normalY, inverseLength);
+			__m256 foldedX = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, y)), _mm256_and_ps(signMask, x));
+			__m256 foldedY = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, x)), _mm256_and_ps(signMask, y));
+			__m256 lower = _mm256_cmp_ps(normalZ, zero, _CMP_LT_OQ);
+			x = _mm256_blendv_ps(x, foldedX, lower);
+			y = _mm256_blendv_ps(y, foldedY, lower);
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_sub_ps(zero, one)), one);
+			y = _mm256_min_ps(_mm256_max_ps(y, _mm256_sub_ps(zero, one)), one);
+			__m256i nx = _mm256_cvtps_epi32(_mm256_mul_ps(x, normalScale));
+			__m256i ny = _mm256_cvtps_epi32(_mm256_mul_ps(y, normalScale));
+
+			__m256i hu = _mm256_cvtepu16_epi32(_mm256_cvtps_ph(u, _MM_FROUND_TO_NEAREST_INT));
+			__m256i hv = _mm256_cvtepu16_epi32(_mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+
+			// Pairs of 16 bit fields per 32 bit word, four words per vertex
+			__m256i w0 = _mm256_or_si256(qx, _mm256_slli_epi32(qy, 16));
+			__m256i w1 = qz;
+			__m256i w2 = _mm256_or_si256(_mm256_and_si256(nx, lowHalf), _mm256_slli_epi32(ny, 16));
+			__m256i w3 = _mm256_or_si256(hu, _mm256_slli_epi32(hv, 16));
+
+			__m256i p0 = _mm256_unpacklo_epi32(w0, w1);
+			__m256i p1 = _mm256_unpackhi_epi32(w0, w1);
+			__m256i p2 = _mm256_unpacklo_epi32(w2, w3);
+			__m256i p3 = _mm256_unpackhi_epi32(w2, w3);
+			__m256i v04 = _mm256_unpacklo_epi64(p0, p2);
+			__m256i v15 = _mm256_unpackhi_epi64(p0, p2);
+			__m256i v26 = _mm256_unpacklo_epi64(p1, p3);
+			__m256i v37 = _mm256_unpackhi_epi64(p1, p3);
+
+			__m256i* destination = (__m256i*)(out + i);
+			_mm256_storeu_si256(destination + 0, _mm256_permute2x128_si256(v04, v15, 0x20));
+			_mm256_storeu_si256(destination + 1, _mm256_permute2x128_si256(v26, v37, 0x20));
+			_mm256_storeu_si256(destination + 2, _mm256_permute2x128_si256(v04, v15, 0x31));
+			_mm256_storeu_si256(destination + 3, _mm256_permute2x128_si256(v26, v37, 0x31));
+		}
+
+		encodeScalar(vertices, i, end, quantization, out);
+	}
+#endif
+
+	static void encodeRange(const MeshVertex* vertices, U32 start, U32 end, const PositionQuantization& quantization, CompressedVertex* out, SimdLevel level) {
+#ifdef ARCH_X64
+		if (level >= SimdLevel::AVX2) {
+			encodeAVX2(vertices, start, end, quantization, out);
+			return;
+		}
+#endif
+		encodeScalar(vertices, start, end, quantization, out);
+	}
+
+	void VertexCompression::Encode(const MeshVertex* vertices, U32 vertexCount, const MeshBounds& bounds, CompressedVertex* outVertices, SimdLevel level, bool parallel) {
+		PositionQuantization quantization = makeQuantization(bounds);
+		if (!parallel || vertexCount <= VERTEX_COMPRESSION_BATCH_SIZE) {
+			encodeRange(vertices, 0, vertexCount, quantization, outVertices, level);
+			return;
+		}
+
+		JobSystem::ParallelFor(vertexCount, VERTEX_COMPRESSION_BATCH_SIZE, [&](U32 start, U32 end) {
+			encodeRange(vertices, start, end, quantization, outVertices, level);
+		});
+	}
+
+	void VertexCompression::Decode(const CompressedVertex* vertices, U32 vertexCount, const MeshBounds& bounds, MeshVertex* outVertices) {
+		F32 step[3];
+		for (U32 axis = 0; axis < 3; ++axis) {
+			step[axis] = (bounds.Max[axis] - bounds.Min[axis]) / 65535.0f;
+		}
+
+		for (U32 i = 0; i < vertexCount; ++i) {
+			const CompressedVertex& compressed = vertices[i];
+			MeshVertex& vertex = outVertices[i];
+
+			for (U32 axis = 0; axis < 3; ++axis) {
+				vertex.Position[axis] = bounds.Min[axis] + (F32)compressed.Position[axis] * step[axis];
+			}
+
+			// Unfold the lower half of the octahedron
+			F32 x = (F32)compressed.Normal[0] / 32767.0f;
+			F32 y = (F32)compressed.Normal[1] / 32767.0f;
+			F32 z = 1.0f - fabsf(x) - fabsf(y);
+			if (z < 0.0f) {
+				F32 foldedX = copysignf(1.0f - fabsf(y), x);
+				F32 foldedY = copysignf(1.0f - fabsf(x), y);
+				x = foldedX;
+				y = foldedY;
+			}
+			F32 inverseLength = 1.0f / sqrtf(x * x + y * y + z * z);
+			vertex.Normal[0] = x * inverseLength;
+			vertex.Normal[1] = y * inverseLength;
+			vertex.Normal[2] = z * inverseLength;
+
+			vertex.UV[0] = halfToFloat(compressed.UV[0]);
+			vertex.UV[1] = halfToFloat(compressed.UV[1]);
+		}
+	}
+
+	const bool VertexCompression::CompressMeshFile(const char* inputPath, const char* outputPath) {
+		MeshFile meshFile;
+		if (!meshFile.Open(inputPath)) {
+			return false;
+		}
+
+		// The output may be the input, which is still mapped
+		const MeshFileHeader* header = meshFile.GetHeader();
+		std::vector<MeshVertex> vertices(header->VertexCount);
+		meshFile.ReadVertices(vertices.data());
+		const U32* indices = (const U32*)meshFile.GetIndexData();
+		std::vector<U32> indexCopy(indices, indices + header->IndexCount);
+		MeshLod lods[JAZZ_MESH_MAX_LODS];
+		U32 lodCount = header->LodCount;
+		memcpy(lods, header->Lods, sizeof(lods));
+		std::vector<SkinWeights> skinWeights;
+		if (meshFile.IsSkinned()) {
+			skinWeights.assign(meshFile.GetSkinWeights(), meshFile.GetSkinWeights() + header->VertexCount);
+		}
+		U32 jointCount = header->JointCount;
+		meshFile.Close();
+
+		Logger::Log("Vertex data: %d bytes -> %d bytes", (U32)(vertices.size() * sizeof(MeshVertex)), (U32)(vertices.size() * sizeof(CompressedVertex)));
+		return MeshFile::Write(outputPath, vertices.data(), (U32)vertices.size(), indexCopy.data(), (U32)indexCopy.size(), lods, lodCount, true,
+			skinWeights.empty() ? nullptr : skinWeights.data(), jointCount);
+	}
+
+	const bool VertexCompression::RunBenchmark() {
+		const U32 vertexCount = 1000000;
+		const U32 iterations = 20;
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::AVX2 };
+		SimdLevel supportedLevel = Simd::GetSupportedLevel();
+
+		Logger::Log("Vertex compression benchmark, %s supported, %d threads", Simd::GetLevelName(supportedLevel), JobSystem::GetThreadCount());
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<F32> position(-50.0f, 50.0f);
+		std::uniform_real_distribution<F32> direction(-1.0f, 1.0f);
+		std::uniform_real_distribution<F32> uv(0.0f, 1.0f);
+
+		std::vector<MeshVertex> vertices(vertexCount);
+		for (MeshVertex& vertex : vertices) {
+			Vec3 normal = TMath::Normalize({ direction(random), direction(random), direction(random) });
+			vertex = { { position(random), position(random), position(random) }, { normal.X, normal.Y, normal.Z }, { uv(random), uv(random) } };
+		}
+		MeshBounds bounds = MeshFile::ComputeBounds(vertices.data(), vertexCount);
+
+		Logger::Log("%d vertices, %d MB -> %d MB", vertexCount, (U32)(vertexCount * sizeof(MeshVertex) >> 20), (U32)(vertexCount * sizeof(CompressedVertex) >> 20));
+
+		std::vector<CompressedVertex> baseline(vertexCount);
+		F64 baselineTime = Benchmark::Time(iterations, [&](U32) { Encode(vertices.data(), vertexCount, bounds, baseline.data(), SimdLevel::Scalar, false); });
+		Logger::Log("  %-24s %9.3f ms", "Scalar (baseline)", baselineTime);
+
+		bool passed = true;
+		std::vector<CompressedVertex> compressed(vertexCount);
+		for (SimdLevel level : levels) {
+			if (level > supportedLevel) {
+				break;
+			}
+
+			for (U32 parallel = 0; parallel < 2; ++parallel) {
+				F64 time = Benchmark::Time(iterations, [&](U32) { Encode(vertices.data(), vertexCount, bounds, compressed.data(), level, parallel != 0); });
+				bool identical = memcmp(compressed.data(), baseline.data(), sizeof(CompressedVertex) * vertexCount) == 0;
+
+				char name[64];
+				snprintf(name, sizeof(name), "%s%s", Simd::GetLevelName(level), parallel ? " parallel" : "");
+				Logger::Log("  %-24s %9.3f ms %7.2fx", name, time, baselineTime / time);
+				passed &= Benchmark::Check(identical, "%s output differs from scalar encoding", name);
+			}
+		}
+
+		// Largest round trip errors
+		std::vector<MeshVertex> decoded(vertexCount);
+		Decode(baseline.data(), vertexCount, bounds, decoded.data());
+		F32 positionError = 0.0f;
+		F32 normalError = 0.0f;
+		F32 uvError = 0.0f;
+		for (U32 i = 0; i < vertexCount; ++i) {
+			for (U32 axis = 0; axis < 3; ++axis) {
+				positionError = fmaxf(positionError, fabsf(decoded[i].Position[axis] - vertices[i].Position[axis]));
+			}
+			F32 cosine = decoded[i].Normal[0] * vertices[i].Normal[0] + decoded[i].Normal[1] * vertices[i].Normal[1] + decoded[i].Normal[2] * vertices[i].Normal[2];
+			normalError = fmaxf(normalError, acosf(fminf(cosine, 1.0f)) * 57.2957795f);
+			uvError = fmaxf(uvError, fmaxf(fabsf(decoded[i].UV[0] - vertices[i].UV[0]), fabsf(decoded[i].UV[1] - vertices[i].UV[1])));
+		}
+		Logger::Log("Largest errors: position %f (bounds %f wide), normal %f degrees, UV %f", positionError, bounds.Max[0] - bounds.Min[0], normalError, uvError);
+		return passed;
+	}
+}
\ No newline at end of file
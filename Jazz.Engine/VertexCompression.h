@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Types.h"
+#include "Mesh.h"
+#include "Simd.h"
+
+namespace Jazz {
+
+	// Quantizes MeshVertex down to CompressedVertex, half its size. Positions become 16 bit fractions of the mesh
+	// bounds, normals octahedral 16 bit pairs and UVs half floats, all of which the vertex input unpacks for free.
+	class VertexCompression {
+	public:
+		// Every SIMD level produces the same bits
+		static void Encode(const MeshVertex* vertices, U32 vertexCount, const MeshBounds& bounds, CompressedVertex* outVertices,
+			SimdLevel level = Simd::GetSupportedLevel(), bool parallel = true);
+
+		static void Decode(const CompressedVertex* vertices, U32 vertexCount, const MeshBounds& bounds, MeshVertex* outVertices);
+
+		// Rewrites a mesh file with compressed vertices, keeping its indices and LODs
+		static const bool CompressMeshFile(const char* inputPath, const char* outputPath);
+
+		// Encoding throughput per SIMD level against the scalar path, and the error compression introduces. Fails when
+		// a level encodes anything differently.
+		static const bool RunBenchmark();
+	};
+}
\ No newline at end of file
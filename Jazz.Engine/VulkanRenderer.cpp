@@ -1,10 +1,15 @@
-#include <vector>
+#include <algorithm>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <string.h>
 
 #include "Platform.h"
 #include "Logger.h"
 #include "Defines.h"
 #include "TMath.h"
+#include "VertexCompression.h"
 #include "VulkanUtils.h"
 #include "VulkanRenderer.h"
 
@@ -115,8 +120,21 @@ namespace Jazz {
 		// Select physical device
 		_physicalDevice = selectPhysicalDevice();
 
+		vkGetPhysicalDeviceProperties(_physicalDevice, &_physicalDeviceProperties);
 		vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_physicalDeviceMemory);
 
+		// On UMA devices mesh data can be copied straight from the mapped file into device memory
+		_unifiedMemory = false;
+		if (_physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || _physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+			for (U32 i = 0; i < _physicalDeviceMemory.memoryTypeCount; ++i) {
+				VkMemoryPropertyFlags flags = _physicalDeviceMemory.memoryTypes[i].propertyFlags;
+				if ((flags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) == (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+					_unifiedMemory = true;
+					break;
+				}
+			}
+		}
+
 		// Create logical device
 		createLogicalDevice(requiredValidationLayers);
 
@@ -126,36 +144,189 @@ namespace Jazz {
 		createSwapchain();
 		createSwapchainImagesAndViews();
 
+		createCommandPool();
+
+		// Scene buffers shared by every draw
+		createGeometryBuffers();
+		createSceneBuffers();
+		createDescriptors();
+		createShadowResources();
+		createLightingResources();
+
 		createRenderPass();
+		createDepthPyramid();
 		createGraphicsPipeline();
+		createCullPipeline();
+		createSpriteResources();
+		createParticleResources();
+		createSkinningResources();
+#ifdef JAZZ_DEBUG_DRAW
+		createDebugDrawResources();
+#endif
 		createFramebuffers();
 
-		createCommandPool();
 		createCommandBuffers();
-		createSemaphores();
+		createQueryPools();
+		createSyncObjects();
+
+		// Default camera until the application provides one
+		_view = TMath::LookAt({ 0.0f, 2.0f, 5.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f });
+		_projection = TMath::Perspective(1.0f, (F32)_swapchainExtent.width / (F32)_swapchainExtent.height, 0.1f, 1000.0f);
 	}
 
 	VulkanRenderer::~VulkanRenderer() {
+#ifdef JAZZ_DEBUG_DRAW
+		DebugDraw::BeginFrame(nullptr);
+		vkDestroyPipeline(_device, _debugPipelines[0], nullptr);
+		vkDestroyPipeline(_device, _debugPipelines[1], nullptr);
+		vkDestroyPipelineLayout(_device, _debugPipelineLayout, nullptr);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT + 1; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_debugVertexBuffers[i]);
+		}
+#endif
+		vkDestroyPipeline(_device, _skinningPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _skinningPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _skinningSetLayout, nullptr);
+		VulkanUtils::destroyBuffer(_device, &_skinWeightBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_jointBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_skinBuffers[i]);
+		}
+
+		vkDestroyPipeline(_device, _particleDrawPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _particleDrawPipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _particleEmitPipeline, nullptr);
+		vkDestroyPipeline(_device, _particleArgsPipeline, nullptr);
+		vkDestroyPipeline(_device, _particleSimulatePipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _particleSimulatePipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _particleSetLayout, nullptr);
+		VulkanUtils::destroyBuffer(_device, &_particleBuffer);
+		VulkanUtils::destroyBuffer(_device, &_particleDeadListBuffer);
+		VulkanUtils::destroyBuffer(_device, &_particleAliveListBuffer);
+		VulkanUtils::destroyBuffer(_device, &_particleCounterBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_particleEmitterBuffers[i]);
+		}
+
+		vkDestroyPipeline(_device, _spritePipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _spritePipelineLayout, nullptr);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_textAtlasStagingBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_spriteInstanceBuffers[i]);
+		}
+		for (VulkanTexture& texture : _textures) {
+			vkDestroyImageView(_device, texture.View, nullptr);
+			vkFreeMemory(_device, texture.Memory, nullptr);
+			vkDestroyImage(_device, texture.Image, nullptr);
+		}
+		vkDestroyDescriptorPool(_device, _textureDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _textureSetLayout, nullptr);
+		vkDestroySampler(_device, _textureSampler, nullptr);
+
+		vkDestroyPipeline(_device, _lightBinPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _lightBinPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _lightingSetLayout, nullptr);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_lightBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_lightingParamsBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_lightClusterBuffers[i]);
+		}
+
+		vkDestroyPipeline(_device, _shadowPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _shadowPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _shadowSetLayout, nullptr);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_shadowInstanceBuffers[i]);
+		}
+		vkDestroyFramebuffer(_device, _shadowAtlasFramebuffer, nullptr);
+		vkDestroyFramebuffer(_device, _shadowCacheFramebuffer, nullptr);
+		vkDestroyRenderPass(_device, _shadowRenderPass, nullptr);
+		vkDestroyRenderPass(_device, _shadowCacheRenderPass, nullptr);
+		vkDestroySampler(_device, _shadowSampler, nullptr);
+		vkDestroyImageView(_device, _shadowAtlas.View, nullptr);
+		vkFreeMemory(_device, _shadowAtlas.Memory, nullptr);
+		vkDestroyImage(_device, _shadowAtlas.Image, nullptr);
+		vkDestroyImageView(_device, _shadowCache.View, nullptr);
+		vkFreeMemory(_device, _shadowCache.Memory, nullptr);
+		vkDestroyImage(_device, _shadowCache.Image, nullptr);
+
+		vkDestroyPipeline(_device, _depthPyramidPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _depthPyramidPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _depthPyramidSetLayout, nullptr);
+		vkDestroyPipeline(_device, _clusterCullPipeline, nullptr);
+		vkDestroyPipeline(_device, _compactPipeline, nullptr);
+		vkDestroyPipeline(_device, _cullPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _cullPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _cullSetLayout, nullptr);
+		vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _sceneSetLayout, nullptr);
+
+		vkDestroySampler(_device, _depthPyramid.sampler, nullptr);
+		for (U32 mip = 0; mip < _depthPyramid.mipCount; ++mip) {
+			vkDestroyImageView(_device, _depthPyramid.mipViews[mip], nullptr);
+		}
+		vkDestroyImageView(_device, _depthPyramid.view, nullptr);
+		vkFreeMemory(_device, _depthPyramid.memory, nullptr);
+		vkDestroyImage(_device, _depthPyramid.image, nullptr);
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_cullStatsBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_cullParamsBuffers[i]);
+		}
+		VulkanUtils::destroyBuffer(_device, &_visibilityBuffer);
+		VulkanUtils::destroyBuffer(_device, &_clusterIndexBuffer);
+		VulkanUtils::destroyBuffer(_device, &_clusterVisibilityBuffer);
+		VulkanUtils::destroyBuffer(_device, &_clusterBuffer);
+		VulkanUtils::destroyBuffer(_device, &_meshletBuffer);
+		VulkanUtils::destroyBuffer(_device, &_drawCountBuffer);
+		VulkanUtils::destroyBuffer(_device, &_drawCommandBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_drawInstanceStagingBuffers[i]);
+			VulkanUtils::destroyBuffer(_device, &_batchCommandStagingBuffers[i]);
+		}
+		VulkanUtils::destroyBuffer(_device, &_drawInstanceBuffer);
+		VulkanUtils::destroyBuffer(_device, &_materialBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::destroyBuffer(_device, &_instanceStagingBuffers[i]);
+		}
+		VulkanUtils::destroyBuffer(_device, &_instanceBuffer);
+		VulkanUtils::destroyBuffer(_device, &_meshDrawBuffer);
+		VulkanUtils::destroyBuffer(_device, &_indexBuffer);
+		VulkanUtils::destroyBuffer(_device, &_positionBuffer);
+		VulkanUtils::destroyBuffer(_device, &_vertexBuffer);
+
+		vkDestroyQueryPool(_device, _occlusionQueryPool, nullptr);
+		if (_pipelineStatisticsSupported) {
+			vkDestroyQueryPool(_device, _statisticsQueryPool, nullptr);
+		}
+
 		vkDestroyCommandPool(_device, _commandPool, nullptr);
 
 		for (auto framebuffer : _swapchainFramebuffers) {
 			vkDestroyFramebuffer(_device, framebuffer, nullptr);
 		}
 
+		vkDestroyPipeline(_device, _equalPipeline, nullptr);
+		vkDestroyPipeline(_device, _depthPrepassPipeline, nullptr);
 		vkDestroyPipeline(_device, _pipeline, nullptr);
 		vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+		vkDestroyRenderPass(_device, _loadRenderPass, nullptr);
 		vkDestroyRenderPass(_device, _renderPass, nullptr);
 
 		for (auto imageView : _swapchainImageViews) {
 			vkDestroyImageView(_device, imageView, nullptr);
 		}
 
+		vkDestroyImageView(_device, _depthStencil.sampleView, nullptr);
 		vkDestroyImageView(_device, _depthStencil.view, nullptr);
 		vkFreeMemory(_device, _depthStencil.memory, nullptr);
 		vkDestroyImage(_device, _depthStencil.image, nullptr);
 
-		vkDestroySemaphore(_device, _renderFinishedSemaphore, nullptr);
-		vkDestroySemaphore(_device, _imageAvailableSemaphore, nullptr);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			vkDestroyFence(_device, _inFlightFences[i], nullptr);
+			vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
+			vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
+		}
 
 		vkDestroySwapchainKHR(_device, _swapchain, nullptr);
 		vkDestroyDevice(_device, nullptr);
@@ -201,6 +372,19 @@ namespace Jazz {
 		VkPhysicalDeviceFeatures features;
 		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
 
+		VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		VkPhysicalDeviceFeatures2 features2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features2.pNext = &features12;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		// GPU-driven rendering needs the compute pass to emit any number of indirect draws
+		bool supportsIndirectDraws = properties.apiVersion >= VK_API_VERSION_1_2 && features12.drawIndirectCount &&
+			features.multiDrawIndirect && features.drawIndirectFirstInstance;
+
+		// Bindless textures: one sparsely filled array indexed per sprite, added to while frames using it are in flight
+		bool supportsBindlessTextures = features12.shaderSampledImageArrayNonUniformIndexing && features12.descriptorBindingPartiallyBound &&
+			features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending;
+
 		bool supportsRequiredQueueFamilies = (graphicsQueueIndex != -1) && (presentationQueueIndex != -1);
 
 		// Device extension support - Supported/Available extensions
@@ -234,7 +418,7 @@ namespace Jazz {
 		}
 
 		// NOTE: Could also look for discrete GPU. We could score and rank them based on features and capabilities
-		return supportsRequiredQueueFamilies && swapChainMeetsRequirements && features.samplerAnisotropy;
+		return supportsRequiredQueueFamilies && swapChainMeetsRequirements && features.samplerAnisotropy && supportsIndirectDraws && supportsBindlessTextures;
 	}
 
 	void VulkanRenderer::detectQueueFamilyIndices(VkPhysicalDevice physicalDevice, I32* graphicsQueueIndex, I32* presentationQueueIndex) {
@@ -311,13 +495,35 @@ namespace Jazz {
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE; // Request anistrophy
+		deviceFeatures.multiDrawIndirect = VK_TRUE;
+		deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+
+		// Optional, only for the depth pre-pass stats
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+		deviceFeatures.occlusionQueryPrecise = supportedFeatures.occlusionQueryPrecise;
+		_pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+		_preciseOcclusionSupported = supportedFeatures.occlusionQueryPrecise == VK_TRUE;
+
+		// Optional, debug lines stay one pixel wide without it
+		deviceFeatures.wideLines = supportedFeatures.wideLines;
+		_wideLinesSupported = supportedFeatures.wideLines == VK_TRUE;
+		_debugLineWidth = 1.0f;
+
+		VkPhysicalDeviceVulkan12Features deviceFeatures12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		deviceFeatures12.drawIndirectCount = VK_TRUE;
+		deviceFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		deviceFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+		deviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		deviceFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 	
 		VkDeviceCreateInfo deviceCreateInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
 		deviceCreateInfo.queueCreateInfoCount = (U32)indices.size();
 		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 		deviceCreateInfo.enabledExtensionCount = 1;
-		deviceCreateInfo.pNext = nullptr;
+		deviceCreateInfo.pNext = &deviceFeatures12;
 		const char* requiredExtensions[1] = {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
@@ -340,24 +546,8 @@ namespace Jazz {
 	}
 
 	void VulkanRenderer::createShader(const char* name) {
-		
-		// Vertex shader
-		U64 vertShaderSize;
-		char* vertexShaderSource = readShaderFile(name, "vert", &vertShaderSize);
-		VkShaderModuleCreateInfo vertexShaderCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		vertexShaderCreateInfo.codeSize = vertShaderSize;
-		vertexShaderCreateInfo.pCode = (U32*)vertexShaderSource;
-		VkShaderModule vertexShaderModule;
-		VK_CHECK(vkCreateShaderModule(_device, &vertexShaderCreateInfo, nullptr, &vertexShaderModule));
-
-		// Fragment shader
-		U64 fragShaderSize;
-		char* fragShaderSource = readShaderFile(name, "frag", &fragShaderSize);
-		VkShaderModuleCreateInfo fragShaderCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		fragShaderCreateInfo.codeSize = fragShaderSize;
-		fragShaderCreateInfo.pCode = (U32*)fragShaderSource;
-		VkShaderModule fragmentShaderModule;
-		VK_CHECK(vkCreateShaderModule(_device, &fragShaderCreateInfo, nullptr, &fragmentShaderModule));
+		VkShaderModule vertexShaderModule = VulkanUtils::loadShaderModule(_device, name, "vert");
+		VkShaderModule fragmentShaderModule = VulkanUtils::loadShaderModule(_device, name, "frag");
 
 		// Vertex shader stage
 		VkPipelineShaderStageCreateInfo vertShaderStageInfo = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
@@ -374,31 +564,6 @@ namespace Jazz {
 		_shaderStageCount = 2;
 		_shaderStages.push_back(vertShaderStageInfo);
 		_shaderStages.push_back(fragShaderStageInfo);
-
-		delete vertexShaderSource;
-		delete fragShaderSource;
-	}
-
-	char* VulkanRenderer::readShaderFile(const char* filename, const char* shaderType, U64* fileSize) {
-		char buffer[256];
-		I32 length = snprintf(buffer, 256, "shaders/%s.%s.spv", filename, shaderType);
-		if (length < 0) {
-			Logger::Fatal("Shader filename is too long.");
-		}
-		buffer[length] = '\0';
-
-		std::ifstream file(buffer, std::ios::ate | std::ios::binary);
-		if (!file.is_open()) {
-			Logger::Fatal("Shader unable to open file.");
-		}
-
-		*fileSize = (U64)file.tellg();
-		char* fileBuffer = (char*)malloc(*fileSize);
-		file.seekg(0);
-		file.read(fileBuffer, *fileSize);
-		file.close();
-
-		return fileBuffer;
 	}
 
 	void VulkanRenderer::createSwapchain() {
@@ -514,7 +679,8 @@ namespace Jazz {
 
 	void VulkanRenderer::createRenderPass() {
 
-		// Color attachment
+		// Color attachment. The scene is drawn in two passes around the occlusion culling pass: the first
+		// clears and keeps the attachments, the second loads them and presents.
 		VkAttachmentDescription colorAttachment = {};
 		colorAttachment.format = _swapchainImageFormat.format;
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -523,7 +689,7 @@ namespace Jazz {
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		// Color attachment reference
 		VkAttachmentReference colorAttachmentReference = {};
@@ -532,7 +698,7 @@ namespace Jazz {
 
 		// Depth attachment
 
-		// Find depth format
+		// Find depth format, it is also sampled to build the depth pyramid
 		const U64 candidateCount = 3;
 		VkFormat candidates[candidateCount] = {
 			VK_FORMAT_D32_SFLOAT,
@@ -540,14 +706,14 @@ namespace Jazz {
 			VK_FORMAT_D24_UNORM_S8_UINT
 		};
 		
-		U32 flags = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		U32 flags = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
 		VkFormat depthFormat;
 		bool depthFormatFound = false;
 		for (U64 i = 0; i < candidateCount; ++i) {
 			VkFormatProperties properties;
 			vkGetPhysicalDeviceFormatProperties(_physicalDevice, candidates[i], &properties);
 
-			if ((properties.linearTilingFeatures && flags) == flags) {
+			if ((properties.linearTilingFeatures & flags) == flags) {
 				depthFormat = candidates[i];
 				depthFormatFound = true;
 				break;
@@ -562,16 +728,16 @@ namespace Jazz {
 			Logger::Fatal("Unable to find a supported depth format");
 		}
 
-		// Depth attachment
+		// Depth attachment, left readable by the depth pyramid pass
 		VkAttachmentDescription depthAttachment = {};
 		depthAttachment.format = depthFormat;
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 		// Depth attachment reference
 		VkAttachmentReference depthAttachmentReference = {};
@@ -588,14 +754,24 @@ namespace Jazz {
 		subpass.pColorAttachments = &colorAttachmentReference;
 		subpass.pDepthStencilAttachment = &depthAttachmentReference;
 
-		// Render pass dependencies
-		VkSubpassDependency dependency = {};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		// Render pass dependencies, the depth attachment is read by compute between the two passes
+		const U32 dependencyCount = 2;
+		VkSubpassDependency dependencies[dependencyCount] = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 		const U32 attachmentCount = 2;
 		VkAttachmentDescription attachments[attachmentCount] = {
@@ -609,9 +785,19 @@ namespace Jazz {
 		renderPassCreateInfo.pAttachments = attachments;
 		renderPassCreateInfo.subpassCount = 1;
 		renderPassCreateInfo.pSubpasses = &subpass;
-		renderPassCreateInfo.dependencyCount = 1;
-		renderPassCreateInfo.pDependencies = &dependency;
+		renderPassCreateInfo.dependencyCount = dependencyCount;
+		renderPassCreateInfo.pDependencies = dependencies;
 		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, nullptr, &_renderPass));
+
+		// Second pass, compatible with the first so they share framebuffers and pipelines
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, nullptr, &_loadRenderPass));
 	}
 
 	void VulkanRenderer::createDepthStencil(VkFormat depthFormat) {
@@ -627,7 +813,7 @@ namespace Jazz {
 		imageInfo.arrayLayers = 1;
 		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
 		VK_CHECK(vkCreateImage(_device, &imageInfo, nullptr, &_depthStencil.image));
 	
@@ -659,6 +845,10 @@ namespace Jazz {
 		}
 
 		VK_CHECK(vkCreateImageView(_device, &imageView, nullptr, &_depthStencil.view));
+
+		// Sampled views may only have one aspect
+		imageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		VK_CHECK(vkCreateImageView(_device, &imageView, nullptr, &_depthStencil.sampleView));
 	}
 
 	void VulkanRenderer::createGraphicsPipeline() {
@@ -691,7 +881,7 @@ namespace Jazz {
 		rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
 		rasterizerCreateInfo.lineWidth = 1.0f;
 		rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizerCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // Meshes wind CCW, the projection flips Y
 		rasterizerCreateInfo.depthBiasEnable = VK_FALSE;
 		rasterizerCreateInfo.depthBiasConstantFactor = 0.0f;
 		rasterizerCreateInfo.depthBiasClamp = 0.0f;
@@ -739,21 +929,42 @@ namespace Jazz {
 		dynamicStateCreateInfo.dynamicStateCount = 2;
 		dynamicStateCreateInfo.pDynamicStates = dynamicStates;
 
+		// Vertex input, matches CompressedVertex. Positions are unorm within the mesh bounds and get rescaled in the shader.
+		VkVertexInputBindingDescription vertexBinding = {};
+		vertexBinding.binding = 0;
+		vertexBinding.stride = sizeof(CompressedVertex);
+		vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		const U32 vertexAttributeCount = 3;
+		VkVertexInputAttributeDescription vertexAttributes[vertexAttributeCount] = {
+			{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompressedVertex, Position) },
+			{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompressedVertex, Normal) },
+			{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompressedVertex, UV) }
+		};
+
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &vertexBinding;
+		vertexInputInfo.vertexAttributeDescriptionCount = vertexAttributeCount;
+		vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes;
 
 		// Input assembly
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
 		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-		// Pipeline layout
+		// Pipeline layout, the camera goes in push constants, the scene and this frame's lighting in descriptor sets
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(Mat4);
+
+		VkDescriptorSetLayout setLayouts[2] = { _sceneSetLayout, _lightingSetLayout };
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
-		pipelineLayoutCreateInfo.setLayoutCount = 0;
-		pipelineLayoutCreateInfo.pSetLayouts = nullptr;
-		pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-		pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+		pipelineLayoutCreateInfo.setLayoutCount = 2;
+		pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout));
 
 		// Pipeline create
@@ -777,6 +988,43 @@ namespace Jazz {
 
 		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_pipeline));
 
+		// Depth pre-pass: the position stream alone, no fragment shader and no color writes. Both vertex shaders
+		// declare gl_Position invariant so the EQUAL test below sees bit identical depths.
+		VkPipelineShaderStageCreateInfo depthShaderStage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+		depthShaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		depthShaderStage.module = VulkanUtils::loadShaderModule(_device, "depth", "vert");
+		depthShaderStage.pName = "main";
+
+		VkVertexInputBindingDescription positionBinding = {};
+		positionBinding.binding = 0;
+		positionBinding.stride = sizeof(GpuPositionVertex);
+		positionBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		VkVertexInputAttributeDescription positionAttribute = { 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(GpuPositionVertex, Position) };
+
+		VkPipelineVertexInputStateCreateInfo positionInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		positionInputInfo.vertexBindingDescriptionCount = 1;
+		positionInputInfo.pVertexBindingDescriptions = &positionBinding;
+		positionInputInfo.vertexAttributeDescriptionCount = 1;
+		positionInputInfo.pVertexAttributeDescriptions = &positionAttribute;
+
+		pipelineCreateInfo.stageCount = 1;
+		pipelineCreateInfo.pStages = &depthShaderStage;
+		pipelineCreateInfo.pVertexInputState = &positionInputInfo;
+		colorBlendAttachmentState.colorWriteMask = 0;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_depthPrepassPipeline));
+		vkDestroyShaderModule(_device, depthShaderStage.module, nullptr);
+
+		// Shading after the pre-pass only runs for the surface that won each pixel
+		pipelineCreateInfo.stageCount = _shaderStageCount;
+		pipelineCreateInfo.pStages = _shaderStages.data();
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		depthStencil.depthWriteEnable = VK_FALSE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_equalPipeline));
+		_depthPrepass = false;
+
 		Logger::Log("Graphics pipeline created!");
 
 		for (auto shader : _shaderStages) {
@@ -812,13 +1060,13 @@ namespace Jazz {
 
 		VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
 		poolInfo.queueFamilyIndex = presentationQueueIndex;
-		poolInfo.flags = 0;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 		VK_CHECK(vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool));
 	}
 
 	void VulkanRenderer::createCommandBuffers() {
-		_commandBuffers.resize(_swapchainFramebuffers.size());
+		_commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
 		VkCommandBufferAllocateInfo commandBufferInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
 		commandBufferInfo.commandPool = _commandPool;
@@ -826,63 +1074,682 @@ namespace Jazz {
 		commandBufferInfo.commandBufferCount = (U32)_commandBuffers.size();
 
 		VK_CHECK(vkAllocateCommandBuffers(_device, &commandBufferInfo, _commandBuffers.data()));
+	}
 
-		for (U64 i = 0; i < _commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-			beginInfo.flags = 0;
-			beginInfo.pInheritanceInfo = nullptr;
+	void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, U32 imageIndex) {
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = nullptr;
+
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+		resetBindState();
+
+		// The previous frame may still be reading the scene buffers rewritten below, and its visibility
+		// flags are read by this frame's culling
+		VkMemoryBarrier previousFrameBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		previousFrameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		previousFrameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previousFrameBarrier, 0, nullptr, 0, nullptr);
+
+		U32 instanceCount = (U32)_instances.size();
+		if (_instancesDirty && instanceCount > 0) {
+			VulkanBuffer& staging = _instanceStagingBuffers[_currentFrame];
+			VkBufferCopy copy = {};
+			copy.size = sizeof(GpuInstance) * instanceCount;
+			memcpy(staging.Mapped, _instances.data(), copy.size);
+			vkCmdCopyBuffer(commandBuffer, staging.Handle, _instanceBuffer.Handle, 1, &copy);
+		}
+		_instancesDirty = false;
+		uploadClusters(commandBuffer);
+		uploadTextAtlas(commandBuffer);
+
+		vkCmdFillBuffer(commandBuffer, _drawCountBuffer.Handle, 0, sizeof(U32) * 8, 0);
 
-			VK_CHECK(vkBeginCommandBuffer(_commandBuffers[i], &beginInfo));
+		// Two queries of each kind per frame, one per render pass
+		vkCmdResetQueryPool(commandBuffer, _occlusionQueryPool, _currentFrame * 2, 2);
+		if (_pipelineStatisticsSupported) {
+			vkCmdResetQueryPool(commandBuffer, _statisticsQueryPool, _currentFrame * 2, 2);
+		}
+		_depthPrepassQueryMasks[_currentFrame] = 0;
+		_depthPrepassQueriesEnabled[_currentFrame] = _depthPrepass;
+		_depthPrepassQueriesPending[_currentFrame] = true;
+
+		Mat4 viewProjection = TMath::Multiply(_projection, _view);
+		Frustum frustum = TMath::ExtractFrustum(viewProjection);
+		bool gpuCulling = _gpuCulling && instanceCount > 0;
+		bool occlusionCulling = gpuCulling && _occlusionCulling;
+
+		if (!_gpuCulling) {
+			_visibleInstances.resize(instanceCount);
+			_cullingStats.InstanceCount = instanceCount;
+			_cullingStats.DrawCount = 0;
+			_cullingStats.VisibleCount = Culling::CullSpheres(frustum, _instanceBounds, _visibleInstances.data());
+			_cullingStats.OccludedCount = 0;
+			_cullingStats.ClusterCount = 0;
+			_cullingStats.VisibleClusterCount = 0;
+			if (_occlusionCulling && !_occluderMeshes.empty()) {
+				U32 visibleCount = cullOccludedInstances(_cullingStats.VisibleCount);
+				_cullingStats.OccludedCount = _cullingStats.VisibleCount - visibleCount;
+				_cullingStats.VisibleCount = visibleCount;
+			}
+			uploadVisibleInstances(commandBuffer, _cullingStats.VisibleCount);
+		} else if (gpuCulling) {
+			uploadBatchCommands(commandBuffer);
+		}
 
+		VkMemoryBarrier uploadBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		uploadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+		recordSkinning(commandBuffer);
+		recordParticleSimulation(commandBuffer);
+		recordShadows(commandBuffer);
+		recordLightBinning(commandBuffer);
+
+		if (gpuCulling) {
+			GpuCullParams cullParams = {};
+			cullParams.View = _view;
+			cullParams.CameraFrustum = frustum;
+			cullParams.P00 = _projection.M[0];
+			cullParams.P11 = -_projection.M[5]; // Undo the Vulkan Y flip, the sphere projection works Y up
+			cullParams.DepthScale = _projection.M[14];
+			cullParams.DepthOffset = _projection.M[10];
+			cullParams.ZNear = _projection.M[14] / _projection.M[10];
+			cullParams.PyramidWidth = (F32)_depthPyramid.width;
+			cullParams.PyramidHeight = (F32)_depthPyramid.height;
+			cullParams.InstanceCount = instanceCount;
+			cullParams.OcclusionEnabled = occlusionCulling ? 1 : 0;
+			cullParams.LodErrorScale = lodErrorScale();
+			cullParams.LodHysteresis = LOD_HYSTERESIS;
+			cullParams.ClusterCount = (U32)_clusters.size();
+
+			// Inverse of the view's rotation applied to its translation
+			const F32* view = _view.M;
+			cullParams.CameraPosition = {
+				-(view[0] * view[12] + view[1] * view[13] + view[2] * view[14]),
+				-(view[4] * view[12] + view[5] * view[13] + view[6] * view[14]),
+				-(view[8] * view[12] + view[9] * view[13] + view[10] * view[14]),
+				1.0f
+			};
+			memcpy(_cullParamsBuffers[_currentFrame].Mapped, &cullParams, sizeof(GpuCullParams));
+
+			// Without occlusion culling the late phase alone does plain frustum culling
+			if (occlusionCulling) {
+				recordCullDispatch(commandBuffer, GPU_CULL_PHASE_EARLY, instanceCount);
+			}
+		}
 
-			VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			renderPassInfo.renderPass = _renderPass;
-			renderPassInfo.framebuffer = _swapchainFramebuffers[i];
-			renderPassInfo.renderArea.offset = { 0,0 };
-			renderPassInfo.renderArea.extent = _swapchainExtent;
+		VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		renderPassInfo.renderPass = _renderPass;
+		renderPassInfo.framebuffer = _swapchainFramebuffers[imageIndex];
+		renderPassInfo.renderArea.offset = { 0,0 };
+		renderPassInfo.renderArea.extent = _swapchainExtent;
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearValues;
+
+		// Early pass: last frame's visible set on the GPU path, everything on the CPU path
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		if (instanceCount > 0 && (!_gpuCulling || occlusionCulling)) {
+			recordScenePass(commandBuffer, GPU_CULL_PHASE_EARLY, viewProjection);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (gpuCulling) {
+			if (occlusionCulling) {
+				recordDepthPyramid(commandBuffer);
+			}
+			recordCullDispatch(commandBuffer, GPU_CULL_PHASE_LATE, instanceCount);
+
+			// Keep a copy of the visible and draw counts for the CPU, they are read once this frame's fence signals
+			VkBufferCopy statsCopy = {};
+			statsCopy.size = sizeof(U32) * 8;
+			vkCmdCopyBuffer(commandBuffer, _drawCountBuffer.Handle, _cullStatsBuffers[_currentFrame].Handle, 1, &statsCopy);
+			_cullStatsInstanceCounts[_currentFrame] = instanceCount;
+			_cullStatsClusterCounts[_currentFrame] = (U32)_clusters.size();
+			_cullStatsPending[_currentFrame] = true;
+
+			VkMemoryBarrier statsBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			statsBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			statsBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+				0, 1, &statsBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// Late pass: whatever the early pass missed
+		renderPassInfo.renderPass = _loadRenderPass;
+		renderPassInfo.clearValueCount = 0;
+		renderPassInfo.pClearValues = nullptr;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		if (gpuCulling) {
+			recordScenePass(commandBuffer, GPU_CULL_PHASE_LATE, viewProjection);
+		}
+
+		recordParticles(commandBuffer, viewProjection);
+
+#ifdef JAZZ_DEBUG_DRAW
+		recordDebugDraw(commandBuffer, viewProjection);
+#endif
+
+		// 2D on top of the finished scene
+		recordSprites(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+		VK_CHECK(vkEndCommandBuffer(commandBuffer));
+	}
+
+	// The draws of one render pass, behind a depth pre-pass when enabled. Queries count the samples passing the
+	// pre-pass and the fragment shader invocations of shading.
+	void VulkanRenderer::recordScenePass(VkCommandBuffer commandBuffer, GpuCullPhase phase, const Mat4& viewProjection) {
+		U32 query = _currentFrame * 2 + phase;
+		vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4), &viewProjection);
+
+		if (_depthPrepass) {
+			vkCmdBeginQuery(commandBuffer, _occlusionQueryPool, query, _preciseOcclusionSupported ? VK_QUERY_CONTROL_PRECISE_BIT : 0);
+			recordSceneDraws(commandBuffer, VULKAN_SCENE_PASS_DEPTH, phase);
+			vkCmdEndQuery(commandBuffer, _occlusionQueryPool, query);
+		}
+
+		if (_pipelineStatisticsSupported) {
+			vkCmdBeginQuery(commandBuffer, _statisticsQueryPool, query, 0);
+		}
+		recordSceneDraws(commandBuffer, VULKAN_SCENE_PASS_COLOR, phase);
+		if (_pipelineStatisticsSupported) {
+			vkCmdEndQuery(commandBuffer, _statisticsQueryPool, query);
+		}
+		_depthPrepassQueryMasks[_currentFrame] |= 1 << phase;
+	}
+
+	void VulkanRenderer::recordSceneDraws(VkCommandBuffer commandBuffer, VulkanScenePass pass, GpuCullPhase phase) {
+		U32 commandCount = (U32)_commandBatches.size();
+		U32 clusterDrawCount = (U32)_clusterDraws.size();
+
+		if (_gpuCulling) {
+			// Early and late draws each have their own half of the packed batch and cluster draws, only the GPU knows
+			// how many of them are not empty. The draw count comes back with the culling stats.
+			VkDeviceSize commandOffset = sizeof(VkDrawIndexedIndirectCommand) *
+				(COMPACT_DRAW_COMMAND_OFFSET + (phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_DRAW_COMMANDS));
+			VkDeviceSize clusterOffset = sizeof(VkDrawIndexedIndirectCommand) *
+				(COMPACT_DRAW_COMMAND_OFFSET + MAX_DRAW_COMMANDS * 2 + (phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_CLUSTER_DRAWS));
+			bindSceneState(commandBuffer, pass, scenePipeline(pass), _indexBuffer.Handle);
+			vkCmdDrawIndexedIndirectCount(commandBuffer, _drawCommandBuffer.Handle, commandOffset, _drawCountBuffer.Handle,
+				sizeof(U32) * (4 + phase), commandCount, sizeof(VkDrawIndexedIndirectCommand));
+
+			if (clusterDrawCount > 0) {
+				bindSceneState(commandBuffer, pass, scenePipeline(pass), _clusterIndexBuffer.Handle);
+				vkCmdDrawIndexedIndirectCount(commandBuffer, _drawCommandBuffer.Handle, clusterOffset, _drawCountBuffer.Handle,
+					sizeof(U32) * (6 + phase), clusterDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+			}
+		} else {
+			// Sorted by pass and pipeline, each draw only binds what differs from the one before
+			const U64* keys = _renderQueue.GetKeys();
+			const U32* payloads = _renderQueue.GetPayloads();
+			for (U32 i = 0; i < _renderQueue.GetCount(); ++i) {
+				if (RenderQueue::GetKeyPass(keys[i]) != (U32)pass) {
+					continue;
+				}
+				U32 command = payloads[i];
+				const VulkanDrawBatch& batch = _batches[_commandBatches[command]];
+				const VulkanMesh& mesh = _meshes[batch.MeshIndex];
+				const MeshLod& lod = mesh.Lods[command - batch.FirstCommand];
+				bindSceneState(commandBuffer, pass, (VulkanScenePipeline)RenderQueue::GetKeyPipeline(keys[i]), _indexBuffer.Handle);
+				vkCmdDrawIndexed(commandBuffer, lod.IndexCount, _commandVisibleCounts[command], mesh.FirstIndex + lod.FirstIndex, (I32)mesh.VertexOffset,
+					_commandFirstInstances[command]);
+				_cullingStats.DrawCount++;
+			}
+		}
+	}
+
+	void VulkanRenderer::uploadBatchCommands(VkCommandBuffer commandBuffer) {
+		U32 commandCount = (U32)_commandBatches.size();
+		U32 clusterDrawCount = (U32)_clusterDraws.size();
+		if (commandCount == 0) {
+			return;
+		}
+
+		// Early commands first, then the late ones which list their instances in the second half of the draw instance buffer
+		VulkanBuffer& staging = _batchCommandStagingBuffers[_currentFrame];
+		if (_batchCommandsDirty[_currentFrame]) {
+			VkDrawIndexedIndirectCommand* commands = (VkDrawIndexedIndirectCommand*)staging.Mapped;
+			for (const VulkanDrawBatch& batch : _batches) {
+				const VulkanMesh& mesh = _meshes[batch.MeshIndex];
+				for (U32 lod = 0; lod < batch.LodCount; ++lod) {
+					VkDrawIndexedIndirectCommand& command = commands[batch.FirstCommand + lod];
+					command.indexCount = mesh.Lods[lod].IndexCount;
+					command.instanceCount = 0;
+					command.firstIndex = mesh.FirstIndex + mesh.Lods[lod].FirstIndex;
+					command.vertexOffset = (I32)mesh.VertexOffset;
+					command.firstInstance = batch.FirstInstance + lod * batch.InstanceCount;
+					commands[commandCount + batch.FirstCommand + lod] = command;
+					commands[commandCount + batch.FirstCommand + lod].firstInstance += MAX_DRAW_INSTANCES;
+				}
+			}
+
+			// Cluster draws draw a single instance, the culling pass writes their index counts instead
+			VkDrawIndexedIndirectCommand* clusterCommands = commands + commandCount * 2;
+			for (U32 i = 0; i < clusterDrawCount; ++i) {
+				const VulkanClusterDraw& draw = _clusterDraws[i];
+				VkDrawIndexedIndirectCommand& command = clusterCommands[i];
+				command.indexCount = 0;
+				command.instanceCount = 1;
+				command.firstIndex = draw.FirstIndex;
+				command.vertexOffset = (I32)_meshes[_instances[draw.InstanceIndex].MeshIndex].VertexOffset;
+				command.firstInstance = MAX_DRAW_INSTANCES * 2 + i;
+				clusterCommands[clusterDrawCount + i] = command;
+				clusterCommands[clusterDrawCount + i].firstIndex += MAX_CLUSTER_INDICES;
+			}
+			_batchCommandsDirty[_currentFrame] = false;
+		}
+
+		// Instance and index counts start from zero every frame, culling adds the visible instances and clusters
+		VkBufferCopy copies[4] = {};
+		U32 copyCount = 2;
+		copies[0].size = sizeof(VkDrawIndexedIndirectCommand) * commandCount;
+		copies[1].srcOffset = copies[0].size;
+		copies[1].dstOffset = sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_COMMANDS;
+		copies[1].size = copies[0].size;
+		if (clusterDrawCount > 0) {
+			copies[2].srcOffset = copies[0].size * 2;
+			copies[2].dstOffset = sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_COMMANDS * 2;
+			copies[2].size = sizeof(VkDrawIndexedIndirectCommand) * clusterDrawCount;
+			copies[3].srcOffset = copies[2].srcOffset + copies[2].size;
+			copies[3].dstOffset = copies[2].dstOffset + sizeof(VkDrawIndexedIndirectCommand) * MAX_CLUSTER_DRAWS;
+			copies[3].size = copies[2].size;
+			copyCount = 4;
+		}
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _drawCommandBuffer.Handle, copyCount, copies);
+	}
+
+	// Clusters are only ever appended, new ones go up in pieces small enough to be inlined in the command buffer
+	void VulkanRenderer::uploadClusters(VkCommandBuffer commandBuffer) {
+		const U32 clustersPerUpdate = 65536 / sizeof(GpuCluster);
+		while (_clustersUploaded < (U32)_clusters.size()) {
+			U32 count = (U32)_clusters.size() - _clustersUploaded;
+			count = count < clustersPerUpdate ? count : clustersPerUpdate;
+			vkCmdUpdateBuffer(commandBuffer, _clusterBuffer.Handle, sizeof(GpuCluster) * _clustersUploaded, sizeof(GpuCluster) * count,
+				&_clusters[_clustersUploaded]);
+			_clustersUploaded += count;
+		}
+	}
+
+	// Coarsest LOD within the error threshold. Switching to a coarser LOD than the current one takes getting
+	// LOD_HYSTERESIS below the threshold, switching to a finer one happens as soon as the current one is over it.
+	static U32 selectLod(const VulkanMesh& mesh, F32 errorScale, U32 currentLod) {
+		U32 lod = 0;
+		U32 coarserLod = 0;
+		for (U32 i = 1; i < mesh.LodCount; ++i) {
+			F32 error = mesh.Lods[i].Error * errorScale;
+			lod = error <= 1.0f ? i : lod;
+			coarserLod = error <= 1.0f - LOD_HYSTERESIS ? i : coarserLod;
+		}
+
+		if (lod > currentLod) {
+			return coarserLod > currentLod ? coarserLod : currentLod;
+		}
+		return lod;
+	}
+
+	F32 VulkanRenderer::lodErrorScale() const {
+		return -_projection.M[5] * (F32)_swapchainExtent.height * 0.5f / _lodErrorThreshold;
+	}
+
+	void VulkanRenderer::uploadVisibleInstances(VkCommandBuffer commandBuffer, U32 visibleCount) {
+		U32 commandCount = (U32)_commandBatches.size();
+		_commandVisibleCounts.assign(commandCount, 0);
+		_commandDepths.assign(commandCount, 1.0f);
+		_renderQueue.Clear();
+		if (visibleCount == 0) {
+			return;
+		}
+
+		// Pick a LOD for every visible instance and count the instances each draw command gets
+		const F32* x = _instanceBounds.GetCenterX();
+		const F32* y = _instanceBounds.GetCenterY();
+		const F32* z = _instanceBounds.GetCenterZ();
+		const F32* radius = _instanceBounds.GetRadius();
+		F32 zNear = _projection.M[14] / _projection.M[10];
+		F32 errorScale = lodErrorScale();
+		_visibleCommands.resize(visibleCount);
+		for (U32 i = 0; i < visibleCount; ++i) {
+			U32 instanceIndex = _visibleInstances[i];
+			const GpuInstance& instance = _instances[instanceIndex];
+
+			// Distance to the closest point of the bounding sphere
+			F32 distance = -(_view.M[2] * x[instanceIndex] + _view.M[6] * y[instanceIndex] + _view.M[10] * z[instanceIndex] + _view.M[14]) - radius[instanceIndex];
+			distance = distance > zNear ? distance : zNear;
+
+			U32 lod = selectLod(_meshes[instance.MeshIndex], TMath::MaxScale(instance.Transform) * errorScale / distance, _instanceLods[instanceIndex]);
+			_instanceLods[instanceIndex] = (U8)lod;
+
+			U32 command = instance.FirstCommand + lod;
+			_visibleCommands[i] = command;
+			_commandVisibleCounts[command]++;
+
+			F32 depth = _projection.M[14] / distance - _projection.M[10];
+			_commandDepths[command] = depth < _commandDepths[command] ? depth : _commandDepths[command];
+		}
+
+		// Pack each command's instances in the ranges its draw reads through gl_InstanceIndex
+		_commandFirstInstances.resize(commandCount);
+		U32 offset = 0;
+		for (U32 i = 0; i < commandCount; ++i) {
+			_commandFirstInstances[i] = offset;
+			offset += _commandVisibleCounts[i];
+		}
+
+		U32* drawInstances = (U32*)_drawInstanceStagingBuffers[_currentFrame].Mapped;
+		for (U32 i = 0; i < visibleCount; ++i) {
+			drawInstances[_commandFirstInstances[_visibleCommands[i]]++] = _visibleInstances[i];
+		}
+		for (U32 i = 0; i < commandCount; ++i) {
+			_commandFirstInstances[i] -= _commandVisibleCounts[i];
+		}
+
+		// Every draw goes into each pass it is recorded in, front to back. Materials come from the scene set and meshes
+		// from the shared geometry buffers, so neither changes a bind and they stay out of the key.
+		for (U32 i = 0; i < commandCount; ++i) {
+			if (_commandVisibleCounts[i] > 0) {
+				if (_depthPrepass) {
+					_renderQueue.Push(RenderQueue::MakeKey(VULKAN_SCENE_PASS_DEPTH, scenePipeline(VULKAN_SCENE_PASS_DEPTH), _commandDepths[i]), i);
+				}
+				_renderQueue.Push(RenderQueue::MakeKey(VULKAN_SCENE_PASS_COLOR, scenePipeline(VULKAN_SCENE_PASS_COLOR), _commandDepths[i]), i);
+			}
+		}
+		_renderQueue.Sort();
 
-			VkClearValue clearValues[2];
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
-			renderPassInfo.clearValueCount = 2;
-			renderPassInfo.pClearValues = clearValues;
+		VkBufferCopy copy = {};
+		copy.size = sizeof(U32) * visibleCount;
+		vkCmdCopyBuffer(commandBuffer, _drawInstanceStagingBuffers[_currentFrame].Handle, _drawInstanceBuffer.Handle, 1, &copy);
+	}
+
+	void VulkanRenderer::resetBindState() {
+		_boundState = {};
+		_bindStats = {};
+	}
+
+	void VulkanRenderer::bindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipeline pipeline) {
+		_bindStats.Requested++;
+		if (_boundState.pipelines[bindPoint] == pipeline) {
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+		_boundState.pipelines[bindPoint] = pipeline;
+		_bindStats.Issued++;
+	}
+
+	void VulkanRenderer::bindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, U32 setCount, const VkDescriptorSet* sets) {
+		_bindStats.Requested++;
+
+		// Sets bound through another layout are treated as disturbed
+		bool bound = _boundState.layouts[bindPoint] == layout;
+		for (U32 i = 0; i < setCount && bound; ++i) {
+			bound = _boundState.sets[bindPoint][i] == sets[i];
+		}
+		if (bound) {
+			return;
+		}
+
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, 0, setCount, sets, 0, nullptr);
+		memset(_boundState.sets[bindPoint], 0, sizeof(_boundState.sets[bindPoint]));
+		memcpy(_boundState.sets[bindPoint], sets, sizeof(VkDescriptorSet) * setCount);
+		_boundState.layouts[bindPoint] = layout;
+		_bindStats.Issued++;
+	}
+
+	void VulkanRenderer::bindGeometryBuffers(VkCommandBuffer commandBuffer, VkBuffer vertexBuffer, VkBuffer indexBuffer) {
+		VkDeviceSize vertexOffset = 0;
+		_bindStats.Requested += 2;
+		if (_boundState.vertexBuffer != vertexBuffer) {
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+			_boundState.vertexBuffer = vertexBuffer;
+			_bindStats.Issued++;
+		}
+		if (_boundState.indexBuffer != indexBuffer) {
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			_boundState.indexBuffer = indexBuffer;
+			_bindStats.Issued++;
+		}
+	}
+
+	VulkanScenePipeline VulkanRenderer::scenePipeline(VulkanScenePass pass) const {
+		if (pass == VULKAN_SCENE_PASS_DEPTH) {
+			return VULKAN_SCENE_PIPELINE_DEPTH_PREPASS;
+		}
+		return _depthPrepass ? VULKAN_SCENE_PIPELINE_EQUAL : VULKAN_SCENE_PIPELINE_OPAQUE;
+	}
+
+	// Everything a scene draw needs. Materials are read from the scene set, so every mesh and material shares this state.
+	// Cluster draws read the indices culling gathered instead of the shared index buffer.
+	void VulkanRenderer::bindSceneState(VkCommandBuffer commandBuffer, VulkanScenePass pass, VulkanScenePipeline pipeline, VkBuffer indexBuffer) {
+		if (pipeline == VULKAN_SCENE_PIPELINE_DEPTH_PREPASS) {
+			bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _depthPrepassPipeline);
+		} else {
+			bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline == VULKAN_SCENE_PIPELINE_EQUAL ? _equalPipeline : _pipeline);
+		}
+		VkDescriptorSet sets[2] = { _sceneSet, _lightingSets[_currentFrame] };
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 2, sets);
+		bindGeometryBuffers(commandBuffer, pass == VULKAN_SCENE_PASS_DEPTH ? _positionBuffer.Handle : _vertexBuffer.Handle, indexBuffer);
+	}
+
+	void VulkanRenderer::recordCullDispatch(VkCommandBuffer commandBuffer, GpuCullPhase phase, U32 instanceCount) {
+		GpuCullPushConstants pushConstants = {};
+		pushConstants.Phase = phase;
+		pushConstants.CommandOffset = phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_DRAW_COMMANDS;
+
+		VkDescriptorSet sets[2] = { _sceneSet, _cullSets[_currentFrame] };
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 2, sets);
+		vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (instanceCount + 63) / 64, 1, 1);
+
+		// Clusters of the instances that survived at LOD 0, one workgroup each. The late phase reads the instance
+		// visibility the pass above just wrote.
+		U32 clusterCount = (U32)_clusters.size();
+		if (clusterCount > 0) {
+			VkMemoryBarrier visibilityBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			visibilityBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &visibilityBarrier, 0, nullptr, 0, nullptr);
+
+			pushConstants.CommandOffset = MAX_DRAW_COMMANDS * 2 + (phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_CLUSTER_DRAWS);
+			bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterCullPipeline);
+			vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullPushConstants), &pushConstants);
+
+			// Workgroup counts are only guaranteed up to 65535 per dimension
+			const U32 maxGroups = 65535;
+			vkCmdDispatch(commandBuffer, clusterCount < maxGroups ? clusterCount : maxGroups, (clusterCount + maxGroups - 1) / maxGroups, 1);
+		}
+
+		// Pack the non-empty batch and cluster draws of this phase once every survivor has been counted
+		VkMemoryBarrier countBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		countBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &countBarrier, 0, nullptr, 0, nullptr);
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _compactPipeline);
+
+		U32 commandCount = (U32)_commandBatches.size();
+		pushConstants.CommandOffset = phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_DRAW_COMMANDS;
+		pushConstants.CommandCount = commandCount;
+		pushConstants.CompactOffset = COMPACT_DRAW_COMMAND_OFFSET + pushConstants.CommandOffset;
+		pushConstants.CountIndex = 4 + phase;
+		vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (commandCount + 63) / 64, 1, 1);
+
+		U32 clusterDrawCount = (U32)_clusterDraws.size();
+		if (clusterDrawCount > 0) {
+			pushConstants.CommandOffset = MAX_DRAW_COMMANDS * 2 + (phase == GPU_CULL_PHASE_EARLY ? 0 : MAX_CLUSTER_DRAWS);
+			pushConstants.CommandCount = clusterDrawCount;
+			pushConstants.CompactOffset = COMPACT_DRAW_COMMAND_OFFSET + pushConstants.CommandOffset;
+			pushConstants.CountIndex = 6 + phase;
+			vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullPushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (clusterDrawCount + 63) / 64, 1, 1);
+		}
+
+		VkMemoryBarrier drawCommandBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		drawCommandBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		drawCommandBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &drawCommandBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VulkanRenderer::recordDepthPyramid(VkCommandBuffer commandBuffer) {
+
+		// Previous frame's late culling may still be sampling the pyramid
+		VkMemoryBarrier pyramidBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &pyramidBarrier, 0, nullptr, 0, nullptr);
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthPyramidPipeline);
 
-			vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+		// Each mip is the max of its footprint in the level above, the first one reads the depth attachment
+		U32 sourceWidth = _swapchainExtent.width;
+		U32 sourceHeight = _swapchainExtent.height;
+		for (U32 mip = 0; mip < _depthPyramid.mipCount; ++mip) {
+			GpuDepthPyramidPushConstants pushConstants = {};
+			pushConstants.SourceWidth = sourceWidth;
+			pushConstants.SourceHeight = sourceHeight;
+			pushConstants.DestinationWidth = _depthPyramid.width >> mip > 1 ? _depthPyramid.width >> mip : 1;
+			pushConstants.DestinationHeight = _depthPyramid.height >> mip > 1 ? _depthPyramid.height >> mip : 1;
 
-			vkCmdDraw(_commandBuffers[i], 3, 1, 0, 0);
+			bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthPyramidPipelineLayout, 1, &_depthPyramid.mipSets[mip]);
+			vkCmdPushConstants(commandBuffer, _depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuDepthPyramidPushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (pushConstants.DestinationWidth + 15) / 16, (pushConstants.DestinationHeight + 15) / 16, 1);
 
-			vkCmdEndRenderPass(_commandBuffers[i]);
-			VK_CHECK(vkEndCommandBuffer(_commandBuffers[i]));
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &pyramidBarrier, 0, nullptr, 0, nullptr);
+
+			sourceWidth = pushConstants.DestinationWidth;
+			sourceHeight = pushConstants.DestinationHeight;
+		}
+	}
+
+	void VulkanRenderer::createQueryPools() {
+		VkQueryPoolCreateInfo queryPoolInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+		queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+		VK_CHECK(vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &_occlusionQueryPool));
+
+		if (_pipelineStatisticsSupported) {
+			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+			VK_CHECK(vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &_statisticsQueryPool));
+		} else {
+			_statisticsQueryPool = VK_NULL_HANDLE;
+		}
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			_depthPrepassQueriesPending[i] = false;
+			_depthPrepassQueriesEnabled[i] = false;
+			_depthPrepassQueryMasks[i] = 0;
+		}
+		_depthPrepassStats = {};
+	}
+
+	// Called once the frame's fence has signaled, so the queries it recorded are available
+	void VulkanRenderer::readDepthPrepassStats() {
+		if (!_depthPrepassQueriesPending[_currentFrame]) {
+			return;
+		}
+
+		VulkanDepthPrepassStats stats = {};
+		stats.Enabled = _depthPrepassQueriesEnabled[_currentFrame];
+		for (U32 pass = 0; pass < 2; ++pass) {
+			if ((_depthPrepassQueryMasks[_currentFrame] & (1 << pass)) == 0) {
+				continue;
+			}
+
+			U32 query = _currentFrame * 2 + pass;
+			U64 value = 0;
+			if (stats.Enabled && vkGetQueryPoolResults(_device, _occlusionQueryPool, query, 1, sizeof(U64), &value, sizeof(U64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				stats.DepthPassedSamples += value;
+			}
+			if (_pipelineStatisticsSupported && vkGetQueryPoolResults(_device, _statisticsQueryPool, query, 1, sizeof(U64), &value, sizeof(U64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				stats.FragmentInvocations += value;
+			}
+		}
+
+		// Without the pre-pass every sample passing the depth test would have been shaded
+		if (stats.Enabled && _pipelineStatisticsSupported && stats.DepthPassedSamples > stats.FragmentInvocations) {
+			stats.SavedInvocations = stats.DepthPassedSamples - stats.FragmentInvocations;
 		}
+		_depthPrepassStats = stats;
+		_depthPrepassQueriesPending[_currentFrame] = false;
 	}
 
-	void VulkanRenderer::createSemaphores() {
+	void VulkanRenderer::createSyncObjects() {
 		VkSemaphoreCreateInfo semaphoreInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 
-		VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphore));
-		VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphore));
+		// Fences start signaled so the first wait on each frame returns immediately
+		VkFenceCreateInfo fenceInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]));
+			VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]));
+			VK_CHECK(vkCreateFence(_device, &fenceInfo, nullptr, &_inFlightFences[i]));
+		}
+
+		_currentFrame = 0;
 	}
 
 	void VulkanRenderer::drawFrame() {
+		VK_CHECK(vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, U64_MAX));
+
+		// The last submission of this frame slot has finished, its culling results are ready
+		if (_cullStatsPending[_currentFrame]) {
+			_cullingStats.InstanceCount = _cullStatsInstanceCounts[_currentFrame];
+			const U32* drawCounts = (const U32*)_cullStatsBuffers[_currentFrame].Mapped;
+			_cullingStats.VisibleCount = drawCounts[0] + drawCounts[1];
+			_cullingStats.OccludedCount = 0;
+			_cullingStats.ClusterCount = _cullStatsClusterCounts[_currentFrame];
+			_cullingStats.VisibleClusterCount = drawCounts[2] + drawCounts[3];
+
+			// Each non-empty draw is recorded again for the pre-pass
+			_cullingStats.DrawCount = (drawCounts[4] + drawCounts[5] + drawCounts[6] + drawCounts[7]) *
+				(_depthPrepassQueriesEnabled[_currentFrame] ? 2 : 1);
+			_cullStatsPending[_currentFrame] = false;
+		}
+		readDepthPrepassStats();
+
 		U32 imageIndex;
-		vkAcquireNextImageKHR(_device, _swapchain, U64_MAX, _imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		vkAcquireNextImageKHR(_device, _swapchain, U64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+		VK_CHECK(vkResetFences(_device, 1, &_inFlightFences[_currentFrame]));
+
+		VkCommandBuffer commandBuffer = _commandBuffers[_currentFrame];
+		VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+		recordCommandBuffer(commandBuffer, imageIndex);
 	
 		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 
-		VkSemaphore waitSemaphores[] = { _imageAvailableSemaphore };
+		VkSemaphore waitSemaphores[] = { _imageAvailableSemaphores[_currentFrame] };
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+		submitInfo.pCommandBuffers = &commandBuffer;
 
-		VkSemaphore signalSemaphores[] = { _renderFinishedSemaphore };
+		VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
 		submitInfo.signalSemaphoreCount = 1; 
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
-		VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]));
 
 		VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
 		presentInfo.waitSemaphoreCount = 1;
@@ -895,9 +1762,2547 @@ namespace Jazz {
 		presentInfo.pResults = nullptr;
 
 		vkQueuePresentKHR(_presentationQueue, &presentInfo);
+
+		_currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 	}
 
 	void VulkanRenderer::deviceWaitIdle() {
 		vkDeviceWaitIdle(_device);
 	}
+
+	void VulkanRenderer::createGeometryBuffers() {
+
+		// On UMA the shared buffers stay mapped and meshes are copied in from the file mapping directly
+		VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (_unifiedMemory) {
+			memoryFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		}
+
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, (VkDeviceSize)MAX_GEOMETRY_VERTICES * sizeof(CompressedVertex),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryFlags, &_vertexBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, (VkDeviceSize)MAX_GEOMETRY_VERTICES * sizeof(GpuPositionVertex),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryFlags, &_positionBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, (VkDeviceSize)MAX_GEOMETRY_INDICES * sizeof(U32),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryFlags, &_indexBuffer);
+
+		_geometryVertexCount = 0;
+		_geometryIndexCount = 0;
+	}
+
+	void VulkanRenderer::createSceneBuffers() {
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuMeshDraw) * MAX_MESHES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_meshDrawBuffer);
+
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuInstance) * MAX_INSTANCES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_instanceBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuInstance) * MAX_INSTANCES,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_instanceStagingBuffers[i]);
+		}
+		_instancesDirty = false;
+		_gpuCulling = true;
+		_lodErrorThreshold = 1.0f;
+
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuMaterial) * MAX_MATERIALS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_materialBuffer);
+
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(VkDrawIndexedIndirectCommand) * COMPACT_DRAW_COMMAND_OFFSET * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_drawCommandBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * (MAX_DRAW_INSTANCES * 2 + MAX_CLUSTER_DRAWS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_drawInstanceBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(VkDrawIndexedIndirectCommand) * (MAX_DRAW_COMMANDS + MAX_CLUSTER_DRAWS) * 2,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_batchCommandStagingBuffers[i]);
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_INSTANCES,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_drawInstanceStagingBuffers[i]);
+			_batchCommandsDirty[i] = false;
+		}
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * 8,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_drawCountBuffer);
+
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuMeshlet) * MAX_MESHLETS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_meshletBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuCluster) * MAX_CLUSTERS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_clusterBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_CLUSTER_INDICES * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_clusterIndexBuffer);
+		_meshletCount = 0;
+		_clustersUploaded = 0;
+		_clusterIndexCount = 0;
+
+		// Nothing was visible before the first frame, so everything goes through the late phase
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_INSTANCES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_visibilityBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_CLUSTERS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_clusterVisibilityBuffer);
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdFillBuffer(commandBuffer, _visibilityBuffer.Handle, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, _clusterVisibilityBuffer.Handle, 0, VK_WHOLE_SIZE, 0);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+		_occlusionCulling = true;
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_cullParamsBuffers[i]);
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * 8, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_cullStatsBuffers[i]);
+			_cullStatsInstanceCounts[i] = 0;
+			_cullStatsClusterCounts[i] = 0;
+			_cullStatsPending[i] = false;
+		}
+		_cullingStats = {};
+		_bindStats = {};
+
+		createMaterial({ 1.0f, 1.0f, 1.0f, 1.0f });
+	}
+
+	void VulkanRenderer::createDescriptors() {
+
+		// Scene set: instances, mesh draws, draw commands, draw counts, visibility, draw instances, materials, then what
+		// cluster culling reads and writes: geometry indices, meshlets, clusters, cluster visibility, cluster indices
+		const U32 bindingCount = 12;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		for (U32 i = 0; i < bindingCount; ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+		bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+		bindings[5].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+		bindings[6].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_sceneSetLayout));
+
+		// One pool for every set the renderer allocates
+		const U32 poolSizeCount = 4;
+		VkDescriptorPoolSize poolSizes[poolSizeCount] = {
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 64 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 32 }
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.maxSets = 64;
+		poolInfo.poolSizeCount = poolSizeCount;
+		poolInfo.pPoolSizes = poolSizes;
+		VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool));
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &_sceneSetLayout;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, &_sceneSet));
+
+		VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+			{ _instanceBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _meshDrawBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _drawCommandBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _drawCountBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _visibilityBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _drawInstanceBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _materialBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _indexBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _meshletBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _clusterBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _clusterVisibilityBuffer.Handle, 0, VK_WHOLE_SIZE },
+			{ _clusterIndexBuffer.Handle, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet writes[bindingCount] = {};
+		for (U32 i = 0; i < bindingCount; ++i) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = _sceneSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+	}
+
+	void VulkanRenderer::createCullPipeline() {
+
+		// Per frame set: culling parameters and the depth pyramid
+		const U32 bindingCount = 2;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_cullSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			setLayouts[i] = _cullSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _cullSets));
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VkDescriptorBufferInfo paramsInfo = { _cullParamsBuffers[i].Handle, 0, VK_WHOLE_SIZE };
+			VkDescriptorImageInfo pyramidInfo = { _depthPyramid.sampler, _depthPyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+
+			VkWriteDescriptorSet writes[bindingCount] = {};
+			for (U32 j = 0; j < bindingCount; ++j) {
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = _cullSets[i];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = bindings[j].descriptorType;
+			}
+			writes[0].pBufferInfo = &paramsInfo;
+			writes[1].pImageInfo = &pyramidInfo;
+			vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(GpuCullPushConstants);
+
+		VkDescriptorSetLayout pipelineSetLayouts[2] = { _sceneSetLayout, _cullSetLayout };
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 2;
+		pipelineLayoutCreateInfo.pSetLayouts = pipelineSetLayouts;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_cullPipelineLayout));
+
+		_cullPipeline = createComputePipeline("cull", _cullPipelineLayout);
+		_clusterCullPipeline = createComputePipeline("cluster", _cullPipelineLayout);
+		_compactPipeline = createComputePipeline("compact", _cullPipelineLayout);
+	}
+
+	VkPipeline VulkanRenderer::createComputePipeline(const char* shaderName, VkPipelineLayout layout) {
+		VkComputePipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineCreateInfo.stage.module = VulkanUtils::loadShaderModule(_device, shaderName, "comp");
+		pipelineCreateInfo.stage.pName = "main";
+		pipelineCreateInfo.layout = layout;
+
+		VkPipeline pipeline;
+		VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+		vkDestroyShaderModule(_device, pipelineCreateInfo.stage.module, nullptr);
+		return pipeline;
+	}
+
+	void VulkanRenderer::createDepthPyramid() {
+
+		// Largest power of two that fits in the swapchain, so every level halves exactly
+		_depthPyramid.width = 1;
+		while (_depthPyramid.width * 2 <= _swapchainExtent.width) {
+			_depthPyramid.width *= 2;
+		}
+		_depthPyramid.height = 1;
+		while (_depthPyramid.height * 2 <= _swapchainExtent.height) {
+			_depthPyramid.height *= 2;
+		}
+		_depthPyramid.mipCount = 1;
+		while ((_depthPyramid.width | _depthPyramid.height) >> _depthPyramid.mipCount) {
+			++_depthPyramid.mipCount;
+		}
+		if (_depthPyramid.mipCount > MAX_DEPTH_PYRAMID_MIPS) {
+			Logger::Fatal("Depth pyramid needs %d mips, at most %d are supported", _depthPyramid.mipCount, MAX_DEPTH_PYRAMID_MIPS);
+		}
+
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.extent.width = _depthPyramid.width;
+		imageInfo.extent.height = _depthPyramid.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = _depthPyramid.mipCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK(vkCreateImage(_device, &imageInfo, nullptr, &_depthPyramid.image));
+
+		VkMemoryRequirements memoryReqs{};
+		vkGetImageMemoryRequirements(_device, _depthPyramid.image, &memoryReqs);
+
+		VkMemoryAllocateInfo memoryAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memoryAlloc.allocationSize = memoryReqs.size;
+		memoryAlloc.memoryTypeIndex = VulkanUtils::getMemoryType(memoryReqs.memoryTypeBits, _physicalDeviceMemory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK(vkAllocateMemory(_device, &memoryAlloc, nullptr, &_depthPyramid.memory));
+		VK_CHECK(vkBindImageMemory(_device, _depthPyramid.image, _depthPyramid.memory, 0));
+
+		VkImageViewCreateInfo imageView = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageView.image = _depthPyramid.image;
+		imageView.format = VK_FORMAT_R32_SFLOAT;
+		imageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageView.subresourceRange.baseMipLevel = 0;
+		imageView.subresourceRange.levelCount = _depthPyramid.mipCount;
+		imageView.subresourceRange.baseArrayLayer = 0;
+		imageView.subresourceRange.layerCount = 1;
+		VK_CHECK(vkCreateImageView(_device, &imageView, nullptr, &_depthPyramid.view));
+
+		imageView.subresourceRange.levelCount = 1;
+		for (U32 mip = 0; mip < _depthPyramid.mipCount; ++mip) {
+			imageView.subresourceRange.baseMipLevel = mip;
+			VK_CHECK(vkCreateImageView(_device, &imageView, nullptr, &_depthPyramid.mipViews[mip]));
+		}
+
+		// The pyramid stays in the general layout, it is written as a storage image and sampled
+		VkImageMemoryBarrier layoutBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		layoutBarrier.srcAccessMask = 0;
+		layoutBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		layoutBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.image = _depthPyramid.image;
+		layoutBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, _depthPyramid.mipCount, 0, 1 };
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+
+		// Point sampling, the culling pass takes the max of the texels itself
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = (F32)_depthPyramid.mipCount;
+		VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &_depthPyramid.sampler));
+
+		// Downsample pipeline
+		const U32 bindingCount = 2;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_depthPyramidSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_DEPTH_PYRAMID_MIPS];
+		for (U32 mip = 0; mip < _depthPyramid.mipCount; ++mip) {
+			setLayouts[mip] = _depthPyramidSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = _depthPyramid.mipCount;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _depthPyramid.mipSets));
+
+		for (U32 mip = 0; mip < _depthPyramid.mipCount; ++mip) {
+			VkDescriptorImageInfo sourceInfo = {};
+			sourceInfo.sampler = _depthPyramid.sampler;
+			if (mip == 0) {
+				sourceInfo.imageView = _depthStencil.sampleView;
+				sourceInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			} else {
+				sourceInfo.imageView = _depthPyramid.mipViews[mip - 1];
+				sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+			VkDescriptorImageInfo destinationInfo = { VK_NULL_HANDLE, _depthPyramid.mipViews[mip], VK_IMAGE_LAYOUT_GENERAL };
+
+			VkWriteDescriptorSet writes[bindingCount] = {};
+			for (U32 j = 0; j < bindingCount; ++j) {
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = _depthPyramid.mipSets[mip];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = bindings[j].descriptorType;
+			}
+			writes[0].pImageInfo = &sourceInfo;
+			writes[1].pImageInfo = &destinationInfo;
+			vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(GpuDepthPyramidPushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &_depthPyramidSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_depthPyramidPipelineLayout));
+
+		_depthPyramidPipeline = createComputePipeline("hiz", _depthPyramidPipelineLayout);
+	}
+
+	void VulkanRenderer::createSpriteResources() {
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = 0.0f;
+		VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &_textureSampler));
+
+		// The whole array is one binding. Slots past the last texture are never sampled, and new textures are written
+		// while frames sampling the older ones are still in flight.
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = MAX_TEXTURES;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+		bindingFlagsInfo.bindingCount = 1;
+		bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_textureSetLayout));
+
+		// Update after bind sets need a pool created for them
+		VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES };
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_textureDescriptorPool));
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _textureDescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &_textureSetLayout;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, &_textureSet));
+
+		U32 white = 0xFFFFFFFF;
+		createTexture(1, 1, &white);
+
+		_textAtlasTexture = createTexture(TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, _text.GetAtlasPixels(), VK_FORMAT_R8_UNORM);
+		_text.SetAtlasTexture(_textAtlasTexture);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, TEXT_ATLAS_SIZE * TEXT_ATLAS_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_textAtlasStagingBuffers[i]);
+		}
+
+		// Written front to back by SpriteBatcher::Build(), so plain host visible memory is fine even when write combined
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(SpriteInstance) * MAX_SPRITES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_spriteInstanceBuffers[i]);
+		}
+
+		VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = VulkanUtils::loadShaderModule(_device, "sprite", "vert");
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = VulkanUtils::loadShaderModule(_device, "sprite", "frag");
+		shaderStages[1].pName = "main";
+
+		// One SpriteInstance per instance, no per vertex input
+		VkVertexInputBindingDescription instanceBinding = {};
+		instanceBinding.binding = 0;
+		instanceBinding.stride = sizeof(SpriteInstance);
+		instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		const U32 attributeCount = 6;
+		VkVertexInputAttributeDescription attributes[attributeCount] = {
+			{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SpriteInstance, X) },
+			{ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SpriteInstance, Width) },
+			{ 2, 0, VK_FORMAT_R32_SFLOAT, offsetof(SpriteInstance, Rotation) },
+			{ 3, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(SpriteInstance, UV) },
+			{ 4, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(SpriteInstance, Color) },
+			{ 5, 0, VK_FORMAT_R32_UINT, offsetof(SpriteInstance, Texture) }
+		};
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &instanceBinding;
+		vertexInputInfo.vertexAttributeDescriptionCount = attributeCount;
+		vertexInputInfo.pVertexAttributeDescriptions = attributes;
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+		VkViewport viewport = { 0.0f, 0.0f, (F32)_swapchainExtent.width, (F32)_swapchainExtent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, _swapchainExtent };
+		VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewportState.viewportCount = 1;
+		viewportState.pViewports = &viewport;
+		viewportState.scissorCount = 1;
+		viewportState.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.cullMode = VK_CULL_MODE_NONE; // Mirrored sprites flip their winding
+		rasterizer.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisampling = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Layers and depth order replace the depth test
+		VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencil.depthTestEnable = VK_FALSE;
+		depthStencil.depthWriteEnable = VK_FALSE;
+
+		// Straight alpha
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		blendAttachment.blendEnable = VK_TRUE;
+		blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		VkPipelineColorBlendStateCreateInfo colorBlend = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+		colorBlend.attachmentCount = 1;
+		colorBlend.pAttachments = &blendAttachment;
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(GpuSpritePushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &_textureSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_spritePipelineLayout));
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stageCount = 2;
+		pipelineCreateInfo.pStages = shaderStages;
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pRasterizationState = &rasterizer;
+		pipelineCreateInfo.pMultisampleState = &multisampling;
+		pipelineCreateInfo.pDepthStencilState = &depthStencil;
+		pipelineCreateInfo.pColorBlendState = &colorBlend;
+		pipelineCreateInfo.layout = _spritePipelineLayout;
+		pipelineCreateInfo.renderPass = _renderPass; // Compatible with the late pass it draws in
+		pipelineCreateInfo.subpass = 0;
+		pipelineCreateInfo.basePipelineIndex = -1;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_spritePipeline));
+
+		vkDestroyShaderModule(_device, shaderStages[0].module, nullptr);
+		vkDestroyShaderModule(_device, shaderStages[1].module, nullptr);
+	}
+
+	// The frame's sprites, sorted into this frame's ring buffer and drawn with one instanced draw
+	void VulkanRenderer::recordSprites(VkCommandBuffer commandBuffer) {
+		VulkanBuffer& instances = _spriteInstanceBuffers[_currentFrame];
+		U32 spriteCount = _sprites.Build((SpriteInstance*)instances.Mapped, MAX_SPRITES);
+		_sprites.Clear();
+		_text.EndFrame();
+		if (spriteCount == 0) {
+			return;
+		}
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _spritePipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _spritePipelineLayout, 1, &_textureSet);
+
+		// No index buffer, the strip comes from gl_VertexIndex
+		VkDeviceSize offset = 0;
+		_bindStats.Requested++;
+		if (_boundState.vertexBuffer != instances.Handle) {
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instances.Handle, &offset);
+			_boundState.vertexBuffer = instances.Handle;
+			_bindStats.Issued++;
+		}
+
+		GpuSpritePushConstants pushConstants = {};
+		pushConstants.PixelToClip[0] = 2.0f / (F32)_swapchainExtent.width;
+		pushConstants.PixelToClip[1] = 2.0f / (F32)_swapchainExtent.height;
+		vkCmdPushConstants(commandBuffer, _spritePipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GpuSpritePushConstants), &pushConstants);
+
+		vkCmdDraw(commandBuffer, 4, spriteCount, 0, 0);
+	}
+
+#ifdef JAZZ_DEBUG_DRAW
+	void VulkanRenderer::createDebugDrawResources() {
+		// DebugDraw writes vertices in whatever order threads reserve them, host visible is as good as it gets
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT + 1; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(DebugVertex) * DEBUG_DRAW_MAX_VERTICES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_debugVertexBuffers[i]);
+		}
+		_debugBufferIndex = 0;
+		DebugDraw::BeginFrame((DebugVertex*)_debugVertexBuffers[0].Mapped);
+
+		VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = VulkanUtils::loadShaderModule(_device, "debug", "vert");
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = VulkanUtils::loadShaderModule(_device, "debug", "frag");
+		shaderStages[1].pName = "main";
+
+		VkVertexInputBindingDescription vertexBinding = {};
+		vertexBinding.binding = 0;
+		vertexBinding.stride = sizeof(DebugVertex);
+		vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		const U32 attributeCount = 2;
+		VkVertexInputAttributeDescription attributes[attributeCount] = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(DebugVertex, Position) },
+			{ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(DebugVertex, Color) }
+		};
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &vertexBinding;
+		vertexInputInfo.vertexAttributeDescriptionCount = attributeCount;
+		vertexInputInfo.pVertexAttributeDescriptions = attributes;
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+
+		VkViewport viewport = { 0.0f, 0.0f, (F32)_swapchainExtent.width, (F32)_swapchainExtent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, _swapchainExtent };
+		VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewportState.viewportCount = 1;
+		viewportState.pViewports = &viewport;
+		viewportState.scissorCount = 1;
+		viewportState.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.lineWidth = 1.0f;
+
+		// The one piece of state set per draw
+		VkDynamicState dynamicState = VK_DYNAMIC_STATE_LINE_WIDTH;
+		VkPipelineDynamicStateCreateInfo dynamicStateInfo = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+		dynamicStateInfo.dynamicStateCount = 1;
+		dynamicStateInfo.pDynamicStates = &dynamicState;
+
+		VkPipelineMultisampleStateCreateInfo multisampling = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Tested against the finished scene but never written, so lines don't hide each other
+		VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencil.depthTestEnable = VK_TRUE;
+		depthStencil.depthWriteEnable = VK_FALSE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		// Straight alpha, the zeroed vertices of dropped shapes come out invisible
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		blendAttachment.blendEnable = VK_TRUE;
+		blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		VkPipelineColorBlendStateCreateInfo colorBlend = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+		colorBlend.attachmentCount = 1;
+		colorBlend.pAttachments = &blendAttachment;
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(Mat4);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_debugPipelineLayout));
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stageCount = 2;
+		pipelineCreateInfo.pStages = shaderStages;
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pRasterizationState = &rasterizer;
+		pipelineCreateInfo.pMultisampleState = &multisampling;
+		pipelineCreateInfo.pDepthStencilState = &depthStencil;
+		pipelineCreateInfo.pColorBlendState = &colorBlend;
+		pipelineCreateInfo.pDynamicState = &dynamicStateInfo;
+		pipelineCreateInfo.layout = _debugPipelineLayout;
+		pipelineCreateInfo.renderPass = _renderPass; // Compatible with the late pass it draws in
+		pipelineCreateInfo.subpass = 0;
+		pipelineCreateInfo.basePipelineIndex = -1;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_debugPipelines[0]));
+
+		// Overlay, drawn over everything
+		depthStencil.depthTestEnable = VK_FALSE;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_debugPipelines[1]));
+
+		vkDestroyShaderModule(_device, shaderStages[0].module, nullptr);
+		vkDestroyShaderModule(_device, shaderStages[1].module, nullptr);
+	}
+
+	// Two draws out of the buffer DebugDraw filled since the last frame, then hands it the next one. That buffer was
+	// last read MAX_FRAMES_IN_FLIGHT frames ago, which drawFrame() has just waited for.
+	void VulkanRenderer::recordDebugDraw(VkCommandBuffer commandBuffer, const Mat4& viewProjection) {
+		U32 counts[2];
+		DebugDraw::EndFrame(&counts[0], &counts[1]);
+		VulkanBuffer& vertices = _debugVertexBuffers[_debugBufferIndex];
+		_debugBufferIndex = (_debugBufferIndex + 1) % (MAX_FRAMES_IN_FLIGHT + 1);
+		DebugDraw::BeginFrame((DebugVertex*)_debugVertexBuffers[_debugBufferIndex].Mapped);
+		if (counts[0] == 0 && counts[1] == 0) {
+			return;
+		}
+
+		VkDeviceSize offset = 0;
+		_bindStats.Requested++;
+		if (_boundState.vertexBuffer != vertices.Handle) {
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.Handle, &offset);
+			_boundState.vertexBuffer = vertices.Handle;
+			_bindStats.Issued++;
+		}
+
+		for (U32 i = 0; i < 2; ++i) {
+			if (counts[i] == 0) {
+				continue;
+			}
+			bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _debugPipelines[i]);
+			vkCmdPushConstants(commandBuffer, _debugPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4), &viewProjection);
+			vkCmdSetLineWidth(commandBuffer, _debugLineWidth);
+			vkCmdDraw(commandBuffer, counts[i], 1, i * (DEBUG_DRAW_MAX_VERTICES / 2), 0);
+		}
+	}
+#endif
+
+	// Glyphs rasterized since the last frame. Frames still in flight may sample the cells being overwritten, the barrier
+	// orders the copy after them.
+	void VulkanRenderer::uploadTextAtlas(VkCommandBuffer commandBuffer) {
+		U32 firstRow;
+		U32 rowCount;
+		if (!_text.TakeDirtyRows(&firstRow, &rowCount)) {
+			return;
+		}
+
+		VulkanBuffer& staging = _textAtlasStagingBuffers[_currentFrame];
+		memcpy(staging.Mapped, _text.GetAtlasPixels() + firstRow * TEXT_ATLAS_SIZE, (size_t)rowCount * TEXT_ATLAS_SIZE);
+
+		VkImageMemoryBarrier layoutBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		layoutBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		layoutBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.image = _textures[_textAtlasTexture].Image;
+		layoutBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+
+		VkBufferImageCopy copy = {};
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageOffset = { 0, (I32)firstRow, 0 };
+		copy.imageExtent = { TEXT_ATLAS_SIZE, rowCount, 1 };
+		vkCmdCopyBufferToImage(commandBuffer, staging.Handle, layoutBarrier.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		layoutBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+	}
+
+	void VulkanRenderer::createSkinningResources() {
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(SkinWeights) * MAX_SKIN_WEIGHTS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_skinWeightBuffer);
+		_skinWeightCount = 0;
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(Mat4) * MAX_SKIN_JOINTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_jointBuffers[i]);
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuSkin) * MAX_SKINS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_skinBuffers[i]);
+		}
+
+		// Shared vertices and positions, skin weights, then this frame's joints and skins
+		const U32 bindingCount = 5;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		for (U32 i = 0; i < bindingCount; ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_skinningSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			setLayouts[i] = _skinningSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _skinningSets));
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+				{ _vertexBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _positionBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _skinWeightBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _jointBuffers[i].Handle, 0, VK_WHOLE_SIZE },
+				{ _skinBuffers[i].Handle, 0, VK_WHOLE_SIZE }
+			};
+
+			VkWriteDescriptorSet writes[bindingCount] = {};
+			for (U32 j = 0; j < bindingCount; ++j) {
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = _skinningSets[i];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[j].pBufferInfo = &bufferInfos[j];
+			}
+			vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(GpuSkinningPushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &_skinningSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_skinningPipelineLayout));
+
+		_skinningPipeline = createComputePipeline("skin", _skinningPipelineLayout);
+	}
+
+	// One dispatch poses every skin whose joints changed, 64 vertices per workgroup. Skins that are not posed keep
+	// last frame's vertices, so idle characters cost nothing.
+	void VulkanRenderer::recordSkinning(VkCommandBuffer commandBuffer) {
+		Mat4* joints = (Mat4*)_jointBuffers[_currentFrame].Mapped;
+		GpuSkin* gpuSkins = (GpuSkin*)_skinBuffers[_currentFrame].Mapped;
+		U32 skinCount = 0;
+		U32 groupCount = 0;
+		for (VulkanSkin& skin : _skins) {
+			if (!skin.Dirty) {
+				continue;
+			}
+
+			// Workgroup counts are only guaranteed up to 65535, the rest waits for the next frame
+			const VulkanMesh& source = _meshes[skin.SourceMesh];
+			const VulkanMesh& posed = _meshes[_instances[skin.InstanceIndex].MeshIndex];
+			U32 skinGroupCount = (source.VertexCount + 63) / 64;
+			if (groupCount + skinGroupCount > 65535) {
+				break;
+			}
+			memcpy(joints + skin.FirstJoint, &_skinJoints[skin.FirstJoint], sizeof(Mat4) * source.JointCount);
+
+			GpuSkin& gpuSkin = gpuSkins[skinCount++];
+			gpuSkin = {};
+			gpuSkin.SourceVertexOffset = source.VertexOffset;
+			gpuSkin.OutputVertexOffset = posed.VertexOffset;
+			gpuSkin.VertexCount = source.VertexCount;
+			gpuSkin.FirstWeight = source.FirstSkinWeight;
+			gpuSkin.FirstJoint = skin.FirstJoint;
+			gpuSkin.FirstGroup = groupCount;
+			gpuSkin.SourceOffset = { source.Bounds.Min[0], source.Bounds.Min[1], source.Bounds.Min[2], 0.0f };
+			gpuSkin.SourceScale = { source.Bounds.Max[0] - source.Bounds.Min[0], source.Bounds.Max[1] - source.Bounds.Min[1], source.Bounds.Max[2] - source.Bounds.Min[2], 0.0f };
+			gpuSkin.OutputOffset = { posed.Bounds.Min[0], posed.Bounds.Min[1], posed.Bounds.Min[2], 0.0f };
+			F32 extent = posed.Bounds.Max[0] - posed.Bounds.Min[0];
+			F32 inverseExtent = extent > 0.0f ? 1.0f / extent : 0.0f;
+			gpuSkin.OutputInverseScale = { inverseExtent, inverseExtent, inverseExtent, 0.0f };
+
+			groupCount += skinGroupCount;
+			skin.Dirty = false;
+		}
+		if (skinCount == 0) {
+			return;
+		}
+
+		// The previous frame may still be drawing the vertices about to be rewritten
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		GpuSkinningPushConstants pushConstants = {};
+		pushConstants.SkinCount = skinCount;
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _skinningPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _skinningPipelineLayout, 1, &_skinningSets[_currentFrame]);
+		vkCmdPushConstants(commandBuffer, _skinningPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuSkinningPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+		VkMemoryBarrier vertexBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		vertexBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		vertexBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0, 1, &vertexBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Depth image for the shadow atlas or cache, D32 float which every device can render, sample and copy
+	static void createShadowImage(VkDevice device, VkPhysicalDeviceMemoryProperties& memoryProperties, U32 width, U32 height, VkImageUsageFlags usage,
+		VulkanTexture* outImage) {
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_D32_SFLOAT;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | usage;
+		VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &outImage->Image));
+
+		VkMemoryRequirements memoryReqs{};
+		vkGetImageMemoryRequirements(device, outImage->Image, &memoryReqs);
+
+		VkMemoryAllocateInfo memoryAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memoryAlloc.allocationSize = memoryReqs.size;
+		memoryAlloc.memoryTypeIndex = VulkanUtils::getMemoryType(memoryReqs.memoryTypeBits, memoryProperties, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK(vkAllocateMemory(device, &memoryAlloc, nullptr, &outImage->Memory));
+		VK_CHECK(vkBindImageMemory(device, outImage->Image, outImage->Memory, 0));
+
+		VkImageViewCreateInfo imageView = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageView.image = outImage->Image;
+		imageView.format = VK_FORMAT_D32_SFLOAT;
+		imageView.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		VK_CHECK(vkCreateImageView(device, &imageView, nullptr, &outImage->View));
+
+		outImage->Width = width;
+		outImage->Height = height;
+	}
+
+	void VulkanRenderer::createShadowResources() {
+		const U32 atlasRows = (SHADOW_CASCADES + SHADOW_ATLAS_COLUMNS - 1) / SHADOW_ATLAS_COLUMNS;
+		createShadowImage(_device, _physicalDeviceMemory, SHADOW_CASCADE_SIZE * SHADOW_ATLAS_COLUMNS, SHADOW_CASCADE_SIZE * atlasRows,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, &_shadowAtlas);
+		createShadowImage(_device, _physicalDeviceMemory, SHADOW_CACHE_SIZE * SHADOW_ATLAS_COLUMNS, SHADOW_CACHE_SIZE * atlasRows,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &_shadowCache);
+
+		// The cache rests as a copy source, the atlas as a sampled image cleared to the far plane until the sun shines
+		VkImageMemoryBarrier layoutBarriers[2] = {};
+		for (U32 i = 0; i < 2; ++i) {
+			layoutBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			layoutBarriers[i].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			layoutBarriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			layoutBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			layoutBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			layoutBarriers[i].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		}
+		layoutBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		layoutBarriers[0].image = _shadowCache.Image;
+		layoutBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarriers[1].image = _shadowAtlas.Image;
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, layoutBarriers);
+		VkClearDepthStencilValue clearValue = { 1.0f, 0 };
+		vkCmdClearDepthStencilImage(commandBuffer, _shadowAtlas.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearValue, 1, &layoutBarriers[1].subresourceRange);
+		layoutBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		layoutBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &layoutBarriers[1]);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+
+		// Hardware filtered depth comparison, outside the atlas counts as lit
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		samplerInfo.compareEnable = VK_TRUE;
+		samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		samplerInfo.maxLod = 0.0f;
+		VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &_shadowSampler));
+
+		// Cache pass: clears and draws the static casters of one cache tile, which the render area keeps the other
+		// tiles out of. Dynamic pass: draws over the tiles copied into the atlas, then hands it to shading.
+		VkAttachmentDescription depthAttachment = {};
+		depthAttachment.format = VK_FORMAT_D32_SFLOAT;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+		const U32 dependencyCount = 2;
+		VkSubpassDependency dependencies[dependencyCount] = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassCreateInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		renderPassCreateInfo.attachmentCount = 1;
+		renderPassCreateInfo.pAttachments = &depthAttachment;
+		renderPassCreateInfo.subpassCount = 1;
+		renderPassCreateInfo.pSubpasses = &subpass;
+		renderPassCreateInfo.dependencyCount = dependencyCount;
+		renderPassCreateInfo.pDependencies = dependencies;
+		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, nullptr, &_shadowCacheRenderPass));
+
+		// Compatible with the cache pass, so both share the pipeline
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, nullptr, &_shadowRenderPass));
+
+		VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+		framebufferInfo.renderPass = _shadowCacheRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &_shadowCache.View;
+		framebufferInfo.width = _shadowCache.Width;
+		framebufferInfo.height = _shadowCache.Height;
+		framebufferInfo.layers = 1;
+		VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_shadowCacheFramebuffer));
+
+		framebufferInfo.renderPass = _shadowRenderPass;
+		framebufferInfo.pAttachments = &_shadowAtlas.View;
+		framebufferInfo.width = _shadowAtlas.Width;
+		framebufferInfo.height = _shadowAtlas.Height;
+		VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_shadowAtlasFramebuffer));
+
+		// Per frame set: the casters each shadow draw lists from gl_InstanceIndex on
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_SHADOW_CASTERS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_shadowInstanceBuffers[i]);
+		}
+
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_shadowSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			setLayouts[i] = _shadowSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _shadowSets));
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VkDescriptorBufferInfo bufferInfo = { _shadowInstanceBuffers[i].Handle, 0, VK_WHOLE_SIZE };
+			VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			write.dstSet = _shadowSets[i];
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &bufferInfo;
+			vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(Mat4);
+
+		VkDescriptorSetLayout pipelineSetLayouts[2] = { _sceneSetLayout, _shadowSetLayout };
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 2;
+		pipelineLayoutCreateInfo.pSetLayouts = pipelineSetLayouts;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_shadowPipelineLayout));
+
+		// Depth only from the position stream like the depth pre-pass, no fragment shader
+		VkPipelineShaderStageCreateInfo shaderStage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+		shaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStage.module = VulkanUtils::loadShaderModule(_device, "shadow", "vert");
+		shaderStage.pName = "main";
+
+		VkVertexInputBindingDescription positionBinding = {};
+		positionBinding.binding = 0;
+		positionBinding.stride = sizeof(GpuPositionVertex);
+		positionBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		VkVertexInputAttributeDescription positionAttribute = { 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(GpuPositionVertex, Position) };
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &positionBinding;
+		vertexInputInfo.vertexAttributeDescriptionCount = 1;
+		vertexInputInfo.pVertexAttributeDescriptions = &positionAttribute;
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		// Each cascade tile sets its own
+		VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStates;
+
+		// Both faces cast, the bias keeps lit surfaces from shadowing themselves
+		VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.depthBiasEnable = VK_TRUE;
+		rasterizer.depthBiasConstantFactor = 1.0f;
+		rasterizer.depthBiasSlopeFactor = 1.5f;
+
+		VkPipelineMultisampleStateCreateInfo multisampling = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencil.depthTestEnable = VK_TRUE;
+		depthStencil.depthWriteEnable = VK_TRUE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stageCount = 1;
+		pipelineCreateInfo.pStages = &shaderStage;
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pRasterizationState = &rasterizer;
+		pipelineCreateInfo.pMultisampleState = &multisampling;
+		pipelineCreateInfo.pDepthStencilState = &depthStencil;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.layout = _shadowPipelineLayout;
+		pipelineCreateInfo.renderPass = _shadowCacheRenderPass;
+		pipelineCreateInfo.subpass = 0;
+		pipelineCreateInfo.basePipelineIndex = -1;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_shadowPipeline));
+		vkDestroyShaderModule(_device, shaderStage.module, nullptr);
+
+		_sunDirection = { 0.0f, -1.0f, 0.0f };
+		_sunColor = { 0.0f, 0.0f, 0.0f };
+		_shadowDistance = 100.0f;
+		_shadowView = TMath::Identity();
+		_shadowStats = {};
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			_shadowCascades[i] = {};
+		}
+	}
+
+	void VulkanRenderer::setSunLight(const Vec3& direction, const Vec3& color) {
+		Vec3 unitDirection = TMath::Normalize(direction);
+		if (unitDirection.X != _sunDirection.X || unitDirection.Y != _sunDirection.Y || unitDirection.Z != _sunDirection.Z) {
+			for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+				_shadowCascades[i].CacheValid = false;
+			}
+		}
+		_sunDirection = unitDirection;
+		_sunColor = color;
+	}
+
+	void VulkanRenderer::setInstanceDynamic(U32 instanceIndex, bool dynamic) {
+
+		// Caches holding the instance lose it, caches it joins gain it
+		_instanceDynamic[instanceIndex] = 0;
+		invalidateShadowCaches(instanceIndex);
+		_instanceDynamic[instanceIndex] = dynamic || _instanceSkins[instanceIndex] != U32_MAX ? 1 : 0;
+	}
+
+	// A static caster changed, the caches its bounding sphere falls in get redrawn
+	void VulkanRenderer::invalidateShadowCaches(U32 instanceIndex) {
+		if (_instanceDynamic[instanceIndex]) {
+			return;
+		}
+
+		Vec3 center = { _instanceBounds.GetCenterX()[instanceIndex], _instanceBounds.GetCenterY()[instanceIndex], _instanceBounds.GetCenterZ()[instanceIndex] };
+		F32 radius = _instanceBounds.GetRadius()[instanceIndex];
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			VulkanShadowCascade& cascade = _shadowCascades[i];
+			bool inside = cascade.CacheValid;
+			for (U32 plane = 0; plane < 6 && inside; ++plane) {
+				const Vec4& p = cascade.CacheFrustum.Planes[plane];
+				inside = p.X * center.X + p.Y * center.Y + p.Z * center.Z + p.W >= -radius;
+			}
+			if (inside) {
+				cascade.CacheValid = false;
+			}
+		}
+	}
+
+	// Each cascade is an orthographic view around the bounding sphere of its slice of the view frustum. The sphere
+	// does not change size as the camera turns and its center snaps to whole texels, so static shadow edges stay put.
+	// A cache stays valid while the cascade stays within its border, in texels across and in depth along the sun.
+	void VulkanRenderer::updateShadowCascades() {
+		const F32* view = _view.M;
+		Vec3 cameraPosition = {
+			-(view[0] * view[12] + view[1] * view[13] + view[2] * view[14]),
+			-(view[4] * view[12] + view[5] * view[13] + view[6] * view[14]),
+			-(view[8] * view[12] + view[9] * view[13] + view[10] * view[14])
+		};
+		Vec3 forward = { -view[2], -view[6], -view[10] };
+
+		F32 zNear = _projection.M[14] / _projection.M[10];
+		F32 zFar = _projection.M[14] / (_projection.M[10] + 1.0f);
+		F32 shadowFar = _shadowDistance < zFar ? _shadowDistance : zFar;
+
+		// Squared distance of a frustum corner from the axis at unit depth
+		F32 tanX = 1.0f / _projection.M[0];
+		F32 tanY = 1.0f / _projection.M[5];
+		F32 cornerSquared = tanX * tanX + tanY * tanY;
+
+		Vec3 up = fabsf(_sunDirection.Y) > 0.99f ? Vec3{ 1.0f, 0.0f, 0.0f } : Vec3{ 0.0f, 1.0f, 0.0f };
+		_shadowView = TMath::LookAt({ 0.0f, 0.0f, 0.0f }, _sunDirection, up);
+		Vec3 lightRight = { _shadowView.M[0], _shadowView.M[4], _shadowView.M[8] };
+		Vec3 lightUp = { _shadowView.M[1], _shadowView.M[5], _shadowView.M[9] };
+
+		F32 nearDepth = zNear;
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			VulkanShadowCascade& cascade = _shadowCascades[i];
+			F32 fraction = (F32)(i + 1) / SHADOW_CASCADES;
+			F32 farDepth = SHADOW_SPLIT_BLEND * zNear * powf(shadowFar / zNear, fraction) + (1.0f - SHADOW_SPLIT_BLEND) * (zNear + (shadowFar - zNear) * fraction);
+
+			// Center on the axis equally far from the near and far corners, unless that lies past the far plane
+			F32 centerDepth = 0.5f * (nearDepth + farDepth) * (1.0f + cornerSquared);
+			centerDepth = centerDepth < farDepth ? centerDepth : farDepth;
+			F32 nearRadius = sqrtf((centerDepth - nearDepth) * (centerDepth - nearDepth) + nearDepth * nearDepth * cornerSquared);
+			F32 farRadius = sqrtf((farDepth - centerDepth) * (farDepth - centerDepth) + farDepth * farDepth * cornerSquared);
+			F32 radius = nearRadius > farRadius ? nearRadius : farRadius;
+			radius = ceilf(radius * 16.0f) / 16.0f;
+
+			Vec3 center = TMath::Add(cameraPosition, TMath::Scale(forward, centerDepth));
+			F32 texelSize = radius * 2.0f / SHADOW_CASCADE_SIZE;
+			cascade.SplitDepth = farDepth;
+			cascade.Radius = radius;
+			cascade.TexelSize = texelSize;
+			cascade.TexelX = (I32)floorf(TMath::Dot(center, lightRight) / texelSize);
+			cascade.TexelY = (I32)floorf(TMath::Dot(center, lightUp) / texelSize);
+			F32 depth = TMath::Dot(center, _sunDirection);
+
+			I32 shiftX = cascade.TexelX - cascade.CacheTexelX;
+			I32 shiftY = cascade.TexelY - cascade.CacheTexelY;
+			F32 border = SHADOW_CACHE_BORDER * texelSize;
+			if (!cascade.CacheValid || cascade.CacheRadius != radius || shiftX < -SHADOW_CACHE_BORDER || shiftX > SHADOW_CACHE_BORDER ||
+				shiftY < -SHADOW_CACHE_BORDER || shiftY > SHADOW_CACHE_BORDER || fabsf(depth - cascade.CacheDepth) > border) {
+				cascade.CacheTexelX = cascade.TexelX;
+				cascade.CacheTexelY = cascade.TexelY;
+				cascade.CacheDepth = depth;
+				cascade.CacheRadius = radius;
+				cascade.CacheValid = false;
+			}
+
+			F32 depthNear = cascade.CacheDepth - radius - border - SHADOW_CASTER_REACH;
+			F32 depthFar = cascade.CacheDepth + radius + border;
+			F32 halfSize = SHADOW_CASCADE_SIZE * 0.5f;
+			F32 cacheHalfSize = SHADOW_CACHE_SIZE * 0.5f;
+			Mat4 projection = TMath::Orthographic((cascade.TexelX - halfSize) * texelSize, (cascade.TexelX + halfSize) * texelSize,
+				(cascade.TexelY - halfSize) * texelSize, (cascade.TexelY + halfSize) * texelSize, depthNear, depthFar);
+			Mat4 cacheProjection = TMath::Orthographic((cascade.CacheTexelX - cacheHalfSize) * texelSize, (cascade.CacheTexelX + cacheHalfSize) * texelSize,
+				(cascade.CacheTexelY - cacheHalfSize) * texelSize, (cascade.CacheTexelY + cacheHalfSize) * texelSize, depthNear, depthFar);
+			cascade.ViewProjection = TMath::Multiply(projection, _shadowView);
+			cascade.CacheViewProjection = TMath::Multiply(cacheProjection, _shadowView);
+			cascade.CacheFrustum = TMath::ExtractFrustum(cascade.CacheViewProjection);
+
+			nearDepth = farDepth;
+		}
+	}
+
+	// Casters of one kind within a cascade or cache, grouped like the scene into one instanced draw per mesh, material
+	// and LOD. LODs are picked by their error in shadow texels. Returns the number of casters drawn.
+	U32 VulkanRenderer::recordShadowCasters(VkCommandBuffer commandBuffer, const Mat4& viewProjection, F32 texelSize, bool dynamic) {
+		_shadowCasters.resize(_instances.size());
+		_shadowCasterCommands.resize(_instances.size());
+		U32 candidateCount = _instanceTree.QueryFrustum(TMath::ExtractFrustum(viewProjection), _shadowCasters.data());
+
+		// Casters past the capacity of this frame's instance list are dropped
+		U32 commandCount = (U32)_commandBatches.size();
+		U32 capacity = MAX_SHADOW_CASTERS - _shadowInstanceCount;
+		F32 errorScale = 1.0f / (texelSize * _lodErrorThreshold);
+		_shadowCommandCounts.assign(commandCount, 0);
+		U32 casterCount = 0;
+		for (U32 i = 0; i < candidateCount && casterCount < capacity; ++i) {
+			U32 instanceIndex = _shadowCasters[i];
+			if ((_instanceDynamic[instanceIndex] != 0) != dynamic) {
+				continue;
+			}
+
+			const GpuInstance& instance = _instances[instanceIndex];
+			U32 command = instance.FirstCommand + selectLod(_meshes[instance.MeshIndex], TMath::MaxScale(instance.Transform) * errorScale, 0);
+			_shadowCasters[casterCount] = instanceIndex;
+			_shadowCasterCommands[casterCount] = command;
+			_shadowCommandCounts[command]++;
+			casterCount++;
+		}
+		if (casterCount == 0) {
+			return 0;
+		}
+
+		_shadowCommandFirstInstances.resize(commandCount);
+		U32 offset = _shadowInstanceCount;
+		for (U32 i = 0; i < commandCount; ++i) {
+			_shadowCommandFirstInstances[i] = offset;
+			offset += _shadowCommandCounts[i];
+		}
+		U32* shadowInstances = (U32*)_shadowInstanceBuffers[_currentFrame].Mapped;
+		for (U32 i = 0; i < casterCount; ++i) {
+			shadowInstances[_shadowCommandFirstInstances[_shadowCasterCommands[i]]++] = _shadowCasters[i];
+		}
+
+		VkDescriptorSet sets[2] = { _sceneSet, _shadowSets[_currentFrame] };
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowPipelineLayout, 2, sets);
+		bindGeometryBuffers(commandBuffer, _positionBuffer.Handle, _indexBuffer.Handle);
+		vkCmdPushConstants(commandBuffer, _shadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4), &viewProjection);
+		for (U32 i = 0; i < commandCount; ++i) {
+			if (_shadowCommandCounts[i] == 0) {
+				continue;
+			}
+			const VulkanDrawBatch& batch = _batches[_commandBatches[i]];
+			const VulkanMesh& mesh = _meshes[batch.MeshIndex];
+			const MeshLod& lod = mesh.Lods[i - batch.FirstCommand];
+			vkCmdDrawIndexed(commandBuffer, lod.IndexCount, _shadowCommandCounts[i], mesh.FirstIndex + lod.FirstIndex, (I32)mesh.VertexOffset,
+				_shadowCommandFirstInstances[i] - _shadowCommandCounts[i]);
+		}
+
+		_shadowInstanceCount += casterCount;
+		return casterCount;
+	}
+
+	// Redraws the caches that went stale, copies every cascade out of its cache into the atlas and draws the dynamic
+	// casters over it. A still camera in a static scene only pays for the copies.
+	void VulkanRenderer::recordShadows(VkCommandBuffer commandBuffer) {
+		_shadowStats = {};
+		_shadowInstanceCount = 0;
+		if (_sunColor.X <= 0.0f && _sunColor.Y <= 0.0f && _sunColor.Z <= 0.0f) {
+			return;
+		}
+		updateShadowCascades();
+
+		VkClearValue clearValue = {};
+		clearValue.depthStencil = { 1.0f, 0 };
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			VulkanShadowCascade& cascade = _shadowCascades[i];
+			if (cascade.CacheValid) {
+				_shadowStats.CachedCascades++;
+				continue;
+			}
+
+			VkRect2D tile = { { (I32)((i % SHADOW_ATLAS_COLUMNS) * SHADOW_CACHE_SIZE), (I32)((i / SHADOW_ATLAS_COLUMNS) * SHADOW_CACHE_SIZE) },
+				{ SHADOW_CACHE_SIZE, SHADOW_CACHE_SIZE } };
+			VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+			renderPassInfo.renderPass = _shadowCacheRenderPass;
+			renderPassInfo.framebuffer = _shadowCacheFramebuffer;
+			renderPassInfo.renderArea = tile;
+			renderPassInfo.clearValueCount = 1;
+			renderPassInfo.pClearValues = &clearValue;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			VkViewport viewport = { (F32)tile.offset.x, (F32)tile.offset.y, (F32)SHADOW_CACHE_SIZE, (F32)SHADOW_CACHE_SIZE, 0.0f, 1.0f };
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+			_shadowStats.StaticCasterCount += recordShadowCasters(commandBuffer, cascade.CacheViewProjection, cascade.TexelSize, false);
+			vkCmdEndRenderPass(commandBuffer);
+			cascade.CacheValid = true;
+		}
+
+		// The previous frame may still be sampling the atlas
+		VkImageMemoryBarrier atlasBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		atlasBarrier.srcAccessMask = 0;
+		atlasBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		atlasBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		atlasBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		atlasBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		atlasBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		atlasBarrier.image = _shadowAtlas.Image;
+		atlasBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &atlasBarrier);
+
+		// Cache rows run top down from the top of the light space window, so a cascade higher up is fewer rows in
+		VkImageCopy copies[SHADOW_CASCADES] = {};
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			const VulkanShadowCascade& cascade = _shadowCascades[i];
+			VkImageCopy& copy = copies[i];
+			copy.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+			copy.srcOffset.x = (I32)((i % SHADOW_ATLAS_COLUMNS) * SHADOW_CACHE_SIZE) + SHADOW_CACHE_BORDER + cascade.TexelX - cascade.CacheTexelX;
+			copy.srcOffset.y = (I32)((i / SHADOW_ATLAS_COLUMNS) * SHADOW_CACHE_SIZE) + SHADOW_CACHE_BORDER - (cascade.TexelY - cascade.CacheTexelY);
+			copy.dstSubresource = copy.srcSubresource;
+			copy.dstOffset.x = (I32)((i % SHADOW_ATLAS_COLUMNS) * SHADOW_CASCADE_SIZE);
+			copy.dstOffset.y = (I32)((i / SHADOW_ATLAS_COLUMNS) * SHADOW_CASCADE_SIZE);
+			copy.extent = { SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE, 1 };
+		}
+		vkCmdCopyImage(commandBuffer, _shadowCache.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _shadowAtlas.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			SHADOW_CASCADES, copies);
+
+		VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		renderPassInfo.renderPass = _shadowRenderPass;
+		renderPassInfo.framebuffer = _shadowAtlasFramebuffer;
+		renderPassInfo.renderArea = { { 0, 0 }, { _shadowAtlas.Width, _shadowAtlas.Height } };
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			const VulkanShadowCascade& cascade = _shadowCascades[i];
+			VkRect2D tile = { { (I32)((i % SHADOW_ATLAS_COLUMNS) * SHADOW_CASCADE_SIZE), (I32)((i / SHADOW_ATLAS_COLUMNS) * SHADOW_CASCADE_SIZE) },
+				{ SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE } };
+			VkViewport viewport = { (F32)tile.offset.x, (F32)tile.offset.y, (F32)SHADOW_CASCADE_SIZE, (F32)SHADOW_CASCADE_SIZE, 0.0f, 1.0f };
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+			_shadowStats.DynamicCasterCount += recordShadowCasters(commandBuffer, cascade.ViewProjection, cascade.TexelSize, true);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Bounding sphere of a spot's cone and end cap. Narrow cones fit in the sphere through the apex and the cap rim,
+	// wide ones in the sphere around the cap rim.
+	static GpuLight packLight(const Light& light) {
+		GpuLight gpuLight = {};
+		gpuLight.PositionRange = { light.Position.X, light.Position.Y, light.Position.Z, light.Range };
+		gpuLight.ColorCosInner = { light.Color.X, light.Color.Y, light.Color.Z, -1.0f };
+		gpuLight.DirectionCosOuter = { 0.0f, 0.0f, 0.0f, -2.0f };
+		gpuLight.BoundingSphere = gpuLight.PositionRange;
+		if (light.Type != LIGHT_TYPE_SPOT) {
+			return gpuLight;
+		}
+
+		Vec3 direction = TMath::Normalize(light.Direction);
+		F32 cosOuter = cosf(light.OuterAngle);
+		F32 cosInner = cosf(light.InnerAngle);
+		gpuLight.ColorCosInner.W = cosInner > cosOuter + 0.001f ? cosInner : cosOuter + 0.001f;
+		gpuLight.DirectionCosOuter = { direction.X, direction.Y, direction.Z, cosOuter };
+
+		F32 centerDistance;
+		F32 radius;
+		if (cosOuter > 0.7071068f) {
+			radius = light.Range / (2.0f * cosOuter);
+			centerDistance = radius;
+		} else {
+			radius = light.Range * sinf(light.OuterAngle);
+			centerDistance = light.Range * cosOuter;
+		}
+		Vec3 center = TMath::Add(light.Position, TMath::Scale(direction, centerDistance));
+		gpuLight.BoundingSphere = { center.X, center.Y, center.Z, radius };
+		return gpuLight;
+	}
+
+	void VulkanRenderer::createLightingResources() {
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuLight) * MAX_LIGHTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_lightBuffers[i]);
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuLightingParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_lightingParamsBuffers[i]);
+
+			// Light count of every cluster, then every cluster's light list
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * LIGHT_CLUSTER_COUNT * (1 + LIGHT_CLUSTER_MAX_LIGHTS),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_lightClusterBuffers[i]);
+			_lightsDirty[i] = false;
+		}
+		_ambientLight = { 0.1f, 0.1f, 0.1f };
+
+		// Per frame set: lighting parameters, lights, the cluster lists binning writes and shading reads, then the
+		// shadow atlas
+		const U32 bindingCount = 4;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		for (U32 i = 0; i < bindingCount; ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_lightingSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			setLayouts[i] = _lightingSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _lightingSets));
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VkDescriptorBufferInfo bufferInfos[bindingCount - 1] = {
+				{ _lightingParamsBuffers[i].Handle, 0, VK_WHOLE_SIZE },
+				{ _lightBuffers[i].Handle, 0, VK_WHOLE_SIZE },
+				{ _lightClusterBuffers[i].Handle, 0, VK_WHOLE_SIZE }
+			};
+			VkDescriptorImageInfo shadowAtlasInfo = { _shadowSampler, _shadowAtlas.View, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+			VkWriteDescriptorSet writes[bindingCount] = {};
+			for (U32 j = 0; j < bindingCount; ++j) {
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = _lightingSets[i];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = bindings[j].descriptorType;
+			}
+			for (U32 j = 0; j < bindingCount - 1; ++j) {
+				writes[j].pBufferInfo = &bufferInfos[j];
+			}
+			writes[3].pImageInfo = &shadowAtlasInfo;
+			vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+		}
+
+		// Binning uses the scene pipeline layout's set numbers, so both share the lighting declarations
+		VkDescriptorSetLayout pipelineSetLayouts[2] = { _sceneSetLayout, _lightingSetLayout };
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 2;
+		pipelineLayoutCreateInfo.pSetLayouts = pipelineSetLayouts;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_lightBinPipelineLayout));
+
+		_lightBinPipeline = createComputePipeline("light_bin", _lightBinPipelineLayout);
+	}
+
+	U32 VulkanRenderer::addLight(const Light& light) {
+		if (_lights.size() >= MAX_LIGHTS) {
+			Logger::Error("Unable to add a light, the light table is full");
+			return U32_MAX;
+		}
+		_lights.push_back(packLight(light));
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			_lightsDirty[i] = true;
+		}
+		return (U32)_lights.size() - 1;
+	}
+
+	void VulkanRenderer::setLight(U32 lightIndex, const Light& light) {
+		_lights[lightIndex] = packLight(light);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			_lightsDirty[i] = true;
+		}
+	}
+
+	// One workgroup per cluster tests every light's bounding sphere against the cluster's view space box. The cluster
+	// lists are rebuilt every frame since they follow the camera, the lights only go up when they changed.
+	void VulkanRenderer::recordLightBinning(VkCommandBuffer commandBuffer) {
+		U32 lightCount = (U32)_lights.size();
+		if (_lightsDirty[_currentFrame] && lightCount > 0) {
+			memcpy(_lightBuffers[_currentFrame].Mapped, _lights.data(), sizeof(GpuLight) * lightCount);
+		}
+		_lightsDirty[_currentFrame] = false;
+
+		// Slices split depth exponentially, so clusters stay roughly cubic from near to far
+		GpuLightingParams params = {};
+		params.View = _view;
+		params.Ambient = { _ambientLight.X, _ambientLight.Y, _ambientLight.Z, 0.0f };
+		params.P00 = _projection.M[0];
+		params.P11 = _projection.M[5];
+		params.DepthScale = _projection.M[14];
+		params.DepthOffset = _projection.M[10];
+		params.ZNear = _projection.M[14] / _projection.M[10];
+		params.ZFar = _projection.M[14] / (_projection.M[10] + 1.0f);
+		params.SliceScale = LIGHT_CLUSTERS_Z / logf(params.ZFar / params.ZNear);
+		params.SliceBias = -logf(params.ZNear) * params.SliceScale;
+		params.ScreenWidth = (F32)_swapchainExtent.width;
+		params.ScreenHeight = (F32)_swapchainExtent.height;
+		params.LightCount = lightCount;
+
+		// Shadow matrices go on from the cascade's clip space to its tile of the atlas
+		bool sunShines = _sunColor.X > 0.0f || _sunColor.Y > 0.0f || _sunColor.Z > 0.0f;
+		params.SunDirection = { -_sunDirection.X, -_sunDirection.Y, -_sunDirection.Z, sunShines ? 1.0f : 0.0f };
+		params.SunColor = { _sunColor.X, _sunColor.Y, _sunColor.Z, 0.0f };
+		F32 tileWidth = (F32)SHADOW_CASCADE_SIZE / _shadowAtlas.Width;
+		F32 tileHeight = (F32)SHADOW_CASCADE_SIZE / _shadowAtlas.Height;
+		for (U32 i = 0; i < SHADOW_CASCADES; ++i) {
+			const VulkanShadowCascade& cascade = _shadowCascades[i];
+			Mat4 toTile = TMath::Identity();
+			toTile.M[0] = 0.5f * tileWidth;
+			toTile.M[5] = 0.5f * tileHeight;
+			toTile.M[12] = (0.5f + i % SHADOW_ATLAS_COLUMNS) * tileWidth;
+			toTile.M[13] = (0.5f + i / SHADOW_ATLAS_COLUMNS) * tileHeight;
+			params.ShadowMatrices[i] = TMath::Multiply(toTile, cascade.ViewProjection);
+			(&params.CascadeSplits.X)[i] = cascade.SplitDepth;
+			(&params.CascadeTexelSizes.X)[i] = cascade.TexelSize;
+		}
+		memcpy(_lightingParamsBuffers[_currentFrame].Mapped, &params, sizeof(GpuLightingParams));
+
+		VkDescriptorSet sets[2] = { _sceneSet, _lightingSets[_currentFrame] };
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _lightBinPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _lightBinPipelineLayout, 2, sets);
+		vkCmdDispatch(commandBuffer, LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z);
+
+		VkMemoryBarrier clusterBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		clusterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		clusterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 1, &clusterBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VulkanRenderer::createParticleResources() {
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuParticle) * MAX_PARTICLES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_particleBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_PARTICLES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_particleDeadListBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(U32) * MAX_PARTICLES * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_particleAliveListBuffer);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuParticleCounters),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_particleCounterBuffer);
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, sizeof(GpuParticleEmitter) * MAX_PARTICLE_EMITTERS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_particleEmitterBuffers[i]);
+		}
+
+		// Every slot starts out dead, both alive lists empty
+		VulkanBuffer staging = {};
+		VkDeviceSize deadListSize = sizeof(U32) * MAX_PARTICLES;
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, deadListSize + sizeof(GpuParticleCounters), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging);
+		U32* deadList = (U32*)staging.Mapped;
+		for (U32 i = 0; i < MAX_PARTICLES; ++i) {
+			deadList[i] = i;
+		}
+		GpuParticleCounters* counters = (GpuParticleCounters*)((U8*)staging.Mapped + deadListSize);
+		*counters = {};
+		counters->DeadCount = MAX_PARTICLES;
+		counters->Draws[0].vertexCount = 4;
+		counters->Draws[1].vertexCount = 4;
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		VkBufferCopy deadListCopy = { 0, 0, deadListSize };
+		VkBufferCopy counterCopy = { deadListSize, 0, sizeof(GpuParticleCounters) };
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _particleDeadListBuffer.Handle, 1, &deadListCopy);
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _particleCounterBuffer.Handle, 1, &counterCopy);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+		VulkanUtils::destroyBuffer(_device, &staging);
+
+		_particleGravity = { 0.0f, -9.81f, 0.0f };
+		_particleDrag = 0.0f;
+		_particleTimeStep = 0.0f;
+		_particleList = 0;
+		_particleSeed = 0;
+
+		// Particles, dead list, alive lists, counters and this frame's emitters. Drawing reads the particles off the
+		// alive list.
+		const U32 bindingCount = 5;
+		VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+		for (U32 i = 0; i < bindingCount; ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+		bindings[2].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_particleSetLayout));
+
+		VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			setLayouts[i] = _particleSetLayout;
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = _descriptorPool;
+		allocateInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocateInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocateInfo, _particleSets));
+
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+				{ _particleBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _particleDeadListBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _particleAliveListBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _particleCounterBuffer.Handle, 0, VK_WHOLE_SIZE },
+				{ _particleEmitterBuffers[i].Handle, 0, VK_WHOLE_SIZE }
+			};
+
+			VkWriteDescriptorSet writes[bindingCount] = {};
+			for (U32 j = 0; j < bindingCount; ++j) {
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = _particleSets[i];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[j].pBufferInfo = &bufferInfos[j];
+			}
+			vkUpdateDescriptorSets(_device, bindingCount, writes, 0, nullptr);
+		}
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(GpuParticleSimulatePushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &_particleSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_particleSimulatePipelineLayout));
+
+		_particleEmitPipeline = createComputePipeline("particle_emit", _particleSimulatePipelineLayout);
+		_particleArgsPipeline = createComputePipeline("particle_args", _particleSimulatePipelineLayout);
+		_particleSimulatePipeline = createComputePipeline("particle_simulate", _particleSimulatePipelineLayout);
+
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.size = sizeof(GpuParticleDrawPushConstants);
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutCreateInfo, nullptr, &_particleDrawPipelineLayout));
+
+		VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = VulkanUtils::loadShaderModule(_device, "particle", "vert");
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = VulkanUtils::loadShaderModule(_device, "particle", "frag");
+		shaderStages[1].pName = "main";
+
+		// Particles are read from storage buffers, no vertex input
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+		VkViewport viewport = { 0.0f, 0.0f, (F32)_swapchainExtent.width, (F32)_swapchainExtent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, _swapchainExtent };
+		VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewportState.viewportCount = 1;
+		viewportState.pViewports = &viewport;
+		viewportState.scissorCount = 1;
+		viewportState.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisampling = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Hidden by the scene, but never hiding each other
+		VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencil.depthTestEnable = VK_TRUE;
+		depthStencil.depthWriteEnable = VK_FALSE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		// Additive, so the order particles land in does not matter
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		blendAttachment.blendEnable = VK_TRUE;
+		blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		VkPipelineColorBlendStateCreateInfo colorBlend = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+		colorBlend.attachmentCount = 1;
+		colorBlend.pAttachments = &blendAttachment;
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stageCount = 2;
+		pipelineCreateInfo.pStages = shaderStages;
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pRasterizationState = &rasterizer;
+		pipelineCreateInfo.pMultisampleState = &multisampling;
+		pipelineCreateInfo.pDepthStencilState = &depthStencil;
+		pipelineCreateInfo.pColorBlendState = &colorBlend;
+		pipelineCreateInfo.layout = _particleDrawPipelineLayout;
+		pipelineCreateInfo.renderPass = _renderPass; // Compatible with the late pass it draws in
+		pipelineCreateInfo.subpass = 0;
+		pipelineCreateInfo.basePipelineIndex = -1;
+		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_particleDrawPipeline));
+
+		vkDestroyShaderModule(_device, shaderStages[0].module, nullptr);
+		vkDestroyShaderModule(_device, shaderStages[1].module, nullptr);
+	}
+
+	U32 VulkanRenderer::addParticleEmitter(const ParticleEmitter& emitter) {
+		if (_particleEmitters.size() >= MAX_PARTICLE_EMITTERS) {
+			Logger::Error("Unable to add a particle emitter, the emitter table is full");
+			return U32_MAX;
+		}
+		_particleEmitters.push_back(emitter);
+		_particleEmitCredits.push_back(0.0f);
+		_particleBursts.push_back(0);
+		return (U32)_particleEmitters.size() - 1;
+	}
+
+	// Emission, then simulation sized by an indirect dispatch from the alive count the GPU holds. The CPU only writes
+	// the table of emitters spawning this frame.
+	void VulkanRenderer::recordParticleSimulation(VkCommandBuffer commandBuffer) {
+		if (_particleEmitters.empty()) {
+			return;
+		}
+
+		GpuParticleEmitter* gpuEmitters = (GpuParticleEmitter*)_particleEmitterBuffers[_currentFrame].Mapped;
+		U32 emitterCount = 0;
+		U32 emitCount = 0;
+		for (U32 i = 0; i < (U32)_particleEmitters.size(); ++i) {
+			const ParticleEmitter& emitter = _particleEmitters[i];
+			_particleEmitCredits[i] += emitter.Rate * _particleTimeStep;
+			U32 count = (U32)_particleEmitCredits[i];
+			_particleEmitCredits[i] -= (F32)count;
+			count += _particleBursts[i];
+			_particleBursts[i] = 0;
+
+			// Nothing spawns beyond the pool size anyway
+			count = count < MAX_PARTICLES - emitCount ? count : MAX_PARTICLES - emitCount;
+			if (count == 0) {
+				continue;
+			}
+
+			GpuParticleEmitter& gpuEmitter = gpuEmitters[emitterCount++];
+			gpuEmitter.PositionRadius = { emitter.Position.X, emitter.Position.Y, emitter.Position.Z, emitter.Radius };
+			gpuEmitter.VelocitySpread = { emitter.Velocity.X, emitter.Velocity.Y, emitter.Velocity.Z, emitter.Spread };
+			gpuEmitter.Color = emitter.Color;
+			gpuEmitter.Size = emitter.Size;
+			gpuEmitter.Lifetime = emitter.Lifetime;
+			gpuEmitter.FirstParticle = emitCount;
+			emitCount += count;
+		}
+
+		GpuParticleSimulatePushConstants pushConstants = {};
+		pushConstants.Gravity = _particleGravity;
+		pushConstants.DeltaTime = _particleTimeStep;
+		pushConstants.Drag = _particleDrag;
+		pushConstants.EmitterCount = emitterCount;
+		pushConstants.EmitCount = emitCount;
+		pushConstants.Seed = _particleSeed++ * 0x9e3779b9;
+		pushConstants.CurrentList = _particleList;
+		_particleTimeStep = 0.0f;
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _particleEmitPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _particleSimulatePipelineLayout, 1, &_particleSets[_currentFrame]);
+		vkCmdPushConstants(commandBuffer, _particleSimulatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuParticleSimulatePushConstants), &pushConstants);
+		if (emitCount > 0) {
+			vkCmdDispatch(commandBuffer, (emitCount + 63) / 64, 1, 1);
+		}
+
+		VkMemoryBarrier computeBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		computeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		computeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &computeBarrier, 0, nullptr, 0, nullptr);
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _particleArgsPipeline);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+		VkMemoryBarrier argsBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		argsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		argsBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &argsBarrier, 0, nullptr, 0, nullptr);
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _particleSimulatePipeline);
+		vkCmdDispatchIndirect(commandBuffer, _particleCounterBuffer.Handle, offsetof(GpuParticleCounters, SimulateDispatch));
+
+		VkMemoryBarrier drawBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+
+		// The survivors are in the other list now
+		_particleList = 1 - _particleList;
+	}
+
+	// One indirect draw of camera facing quads, its instance count is the length of the alive list
+	void VulkanRenderer::recordParticles(VkCommandBuffer commandBuffer, const Mat4& viewProjection) {
+		if (_particleEmitters.empty()) {
+			return;
+		}
+
+		GpuParticleDrawPushConstants pushConstants = {};
+		pushConstants.ViewProjection = viewProjection;
+		const F32* view = _view.M;
+		pushConstants.CameraRight = { view[0], view[4], view[8], 0.0f };
+		pushConstants.CameraUp = { view[1], view[5], view[9], 0.0f };
+		pushConstants.List = _particleList;
+
+		bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _particleDrawPipeline);
+		bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _particleDrawPipelineLayout, 1, &_particleSets[_currentFrame]);
+		vkCmdPushConstants(commandBuffer, _particleDrawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GpuParticleDrawPushConstants), &pushConstants);
+		vkCmdDrawIndirect(commandBuffer, _particleCounterBuffer.Handle, offsetof(GpuParticleCounters, Draws) + sizeof(VkDrawIndirectCommand) * _particleList, 1, 0);
+	}
+
+	U32 VulkanRenderer::loadMesh(const char* path) {
+		if (_meshes.size() >= MAX_MESHES) {
+			Logger::Error("Unable to load mesh %s, the mesh table is full", path);
+			return U32_MAX;
+		}
+
+		MeshFile meshFile;
+		if (!meshFile.Open(path)) {
+			return U32_MAX;
+		}
+
+		const MeshFileHeader* header = meshFile.GetHeader();
+		if (header->VertexCount == 0 || header->IndexCount == 0) {
+			Logger::Error("Mesh %s is empty", path);
+			return U32_MAX;
+		}
+
+		if (header->LodCount == 0 || header->LodCount > JAZZ_MESH_MAX_LODS) {
+			Logger::Error("Mesh %s has an invalid LOD count of %d", path, header->LodCount);
+			return U32_MAX;
+		}
+
+		if (_geometryVertexCount + header->VertexCount > MAX_GEOMETRY_VERTICES || _geometryIndexCount + header->IndexCount > MAX_GEOMETRY_INDICES) {
+			Logger::Error("Unable to load mesh %s, the shared geometry buffers are full", path);
+			return U32_MAX;
+		}
+
+		if (meshFile.IsSkinned() && _skinWeightCount + header->VertexCount > MAX_SKIN_WEIGHTS) {
+			Logger::Error("Unable to load mesh %s, the skin weight buffer is full", path);
+			return U32_MAX;
+		}
+
+		VulkanMesh mesh = {};
+		mesh.VertexOffset = _geometryVertexCount;
+		mesh.VertexCount = header->VertexCount;
+		mesh.FirstIndex = _geometryIndexCount;
+		mesh.IndexCount = header->IndexCount;
+		mesh.Bounds = header->Bounds;
+		mesh.LodCount = header->LodCount;
+		memcpy(mesh.Lods, header->Lods, sizeof(mesh.Lods));
+
+		// Skinned meshes are only ever drawn through posed copies, their rest pose feeds skinning
+		if (meshFile.IsSkinned()) {
+			mesh.FirstSkinWeight = _skinWeightCount;
+			mesh.JointCount = header->JointCount;
+			_skinWeightCount += mesh.VertexCount;
+		}
+
+		// Large meshes get their most detailed LOD split into meshlets, its triangles are reordered to match
+		std::vector<U32> meshletIndices;
+		std::vector<Meshlet> meshlets;
+		if (mesh.JointCount == 0 && mesh.Lods[0].IndexCount / 3 >= MESHLET_MIN_TRIANGLES) {
+			std::vector<MeshVertex> vertices(mesh.VertexCount);
+			meshFile.ReadVertices(vertices.data());
+			meshletIndices.resize(mesh.Lods[0].IndexCount);
+			MeshletBuilder::Build(vertices.data(), mesh.VertexCount, (const U32*)meshFile.GetIndexData() + mesh.Lods[0].FirstIndex,
+				mesh.Lods[0].IndexCount, meshletIndices.data(), meshlets);
+			if (_meshletCount + meshlets.size() <= MAX_MESHLETS) {
+				mesh.FirstMeshlet = _meshletCount;
+				mesh.MeshletCount = (U32)meshlets.size();
+				_meshletCount += mesh.MeshletCount;
+			} else {
+				Logger::Error("The meshlet buffer is full, mesh %s will only be culled as a whole", path);
+			}
+		}
+
+		_geometryVertexCount += mesh.VertexCount;
+		_geometryIndexCount += mesh.IndexCount;
+		_meshes.push_back(mesh);
+
+		uploadMeshData(meshFile, &_meshes.back());
+		if (mesh.MeshletCount > 0) {
+			uploadMeshlets(mesh, meshletIndices, meshlets);
+		}
+		if (mesh.JointCount > 0) {
+			uploadSkinWeights(meshFile, mesh);
+		}
+
+		return (U32)_meshes.size() - 1;
+	}
+
+	const bool VulkanRenderer::loadStaticBatches(const char* manifestPath) {
+		std::ifstream manifest(manifestPath);
+		if (!manifest.is_open()) {
+			Logger::Error("Unable to open static batch list %s", manifestPath);
+			return false;
+		}
+
+		// Batches are already in world space
+		std::string meshPath;
+		U32 materialIndex;
+		while (manifest >> meshPath >> materialIndex) {
+			U32 meshIndex = loadMesh(meshPath.c_str());
+			if (meshIndex == U32_MAX || addInstance(meshIndex, TMath::Identity(), materialIndex) == U32_MAX) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const bool VulkanRenderer::loadOccluderMesh(U32 meshIndex, const char* path) {
+		if (meshIndex >= _meshes.size()) {
+			Logger::Error("Unable to load occluder %s, mesh %d does not exist", path, meshIndex);
+			return false;
+		}
+
+		MeshFile meshFile;
+		if (!meshFile.Open(path)) {
+			return false;
+		}
+
+		// Only the most detailed LOD, occluders are drawn at a fixed low resolution anyway
+		const MeshFileHeader* header = meshFile.GetHeader();
+		std::vector<MeshVertex> vertices(header->VertexCount);
+		meshFile.ReadVertices(vertices.data());
+		const U32* indices = (const U32*)meshFile.GetIndexData() + header->Lods[0].FirstIndex;
+		if (_occluderMeshes.size() <= meshIndex) {
+			_occluderMeshes.resize(meshIndex + 1);
+		}
+
+		VulkanOccluderMesh& occluder = _occluderMeshes[meshIndex];
+		occluder.Positions.resize((size_t)header->VertexCount * 3);
+		for (U32 i = 0; i < header->VertexCount; ++i) {
+			memcpy(&occluder.Positions[(size_t)i * 3], vertices[i].Position, sizeof(F32) * 3);
+		}
+		occluder.Indices.assign(indices, indices + header->Lods[0].IndexCount);
+		return true;
+	}
+
+	U32 VulkanRenderer::cullOccludedInstances(U32 visibleCount) {
+		// Visible occluders, largest on screen first
+		_occluderCandidates.clear();
+		for (U32 i = 0; i < visibleCount; ++i) {
+			U32 meshIndex = _instances[_visibleInstances[i]].MeshIndex;
+			if (meshIndex < _occluderMeshes.size() && !_occluderMeshes[meshIndex].Indices.empty()) {
+				_occluderCandidates.push_back(_visibleInstances[i]);
+			}
+		}
+
+		const F32* x = _instanceBounds.GetCenterX();
+		const F32* y = _instanceBounds.GetCenterY();
+		const F32* z = _instanceBounds.GetCenterZ();
+		const F32* radius = _instanceBounds.GetRadius();
+		auto screenSize = [&](U32 instanceIndex) {
+			Vec3 center = TMath::TransformPoint(_view, { x[instanceIndex], y[instanceIndex], z[instanceIndex] });
+			return radius[instanceIndex] / (TMath::Length(center) + 1e-3f);
+		};
+
+		U32 occluderCount = (U32)_occluderCandidates.size() < MAX_OCCLUDERS ? (U32)_occluderCandidates.size() : MAX_OCCLUDERS;
+		std::partial_sort(_occluderCandidates.begin(), _occluderCandidates.begin() + occluderCount, _occluderCandidates.end(),
+			[&](U32 a, U32 b) { return screenSize(a) > screenSize(b); });
+
+		_occlusionBuffer.Begin(_view, _projection);
+		for (U32 i = 0; i < occluderCount; ++i) {
+			const GpuInstance& instance = _instances[_occluderCandidates[i]];
+			const VulkanOccluderMesh& occluder = _occluderMeshes[instance.MeshIndex];
+			_occlusionBuffer.AddOccluder(occluder.Positions.data(), occluder.Indices.data(), (U32)occluder.Indices.size(), instance.Transform);
+		}
+		_occlusionBuffer.Rasterize();
+
+		return _occlusionBuffer.CullSpheres(_instanceBounds, _visibleInstances.data(), visibleCount);
+	}
+
+	// The depth pre-pass stream is the position half of every vertex
+	static void extractPositions(const CompressedVertex* vertices, U32 vertexCount, GpuPositionVertex* outPositions) {
+		for (U32 i = 0; i < vertexCount; ++i) {
+			memcpy(&outPositions[i], &vertices[i], sizeof(GpuPositionVertex));
+		}
+	}
+
+	void VulkanRenderer::uploadMeshData(const MeshFile& meshFile, VulkanMesh* mesh) {
+		const MeshFileHeader* header = meshFile.GetHeader();
+		VkDeviceSize vertexSize = (VkDeviceSize)header->VertexCount * sizeof(CompressedVertex);
+		VkDeviceSize positionSize = (VkDeviceSize)header->VertexCount * sizeof(GpuPositionVertex);
+		VkDeviceSize indexSize = header->IndexDataSize;
+		VkDeviceSize vertexDestination = (VkDeviceSize)mesh->VertexOffset * sizeof(CompressedVertex);
+		VkDeviceSize positionDestination = (VkDeviceSize)mesh->VertexOffset * sizeof(GpuPositionVertex);
+		VkDeviceSize indexDestination = (VkDeviceSize)mesh->FirstIndex * sizeof(U32);
+		bool compressed = meshFile.HasCompressedVertices();
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		VulkanBuffer staging = {};
+
+		if (_unifiedMemory) {
+			// The mapped file pages go straight into memory the GPU reads from, float vertices are compressed on the way
+			if (compressed) {
+				memcpy((U8*)_vertexBuffer.Mapped + vertexDestination, meshFile.GetVertexData(), vertexSize);
+			} else {
+				VertexCompression::Encode((const MeshVertex*)meshFile.GetVertexData(), header->VertexCount, header->Bounds,
+					(CompressedVertex*)((U8*)_vertexBuffer.Mapped + vertexDestination));
+			}
+			extractPositions((const CompressedVertex*)((U8*)_vertexBuffer.Mapped + vertexDestination), header->VertexCount,
+				(GpuPositionVertex*)((U8*)_positionBuffer.Mapped + positionDestination));
+			memcpy((U8*)_indexBuffer.Mapped + indexDestination, meshFile.GetIndexData(), indexSize);
+		} else {
+			// One staging buffer holds both blobs. Compressed files keep the offsets they have in the file, so a single
+			// memcpy of the mapped range feeds both copies. The position stream goes after them.
+			VkDeviceSize stagingSize;
+			VkDeviceSize indexSource;
+			if (compressed) {
+				stagingSize = header->IndexDataOffset + indexSize - header->VertexDataOffset;
+				indexSource = header->IndexDataOffset - header->VertexDataOffset;
+			} else {
+				stagingSize = vertexSize + indexSize;
+				indexSource = vertexSize;
+			}
+			VkDeviceSize positionSource = stagingSize;
+			stagingSize += positionSize;
+			VulkanUtils::createBuffer(_device, _physicalDeviceMemory, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging);
+			if (compressed) {
+				memcpy(staging.Mapped, meshFile.GetVertexData(), positionSource);
+			} else {
+				VertexCompression::Encode((const MeshVertex*)meshFile.GetVertexData(), header->VertexCount, header->Bounds, (CompressedVertex*)staging.Mapped);
+				memcpy((U8*)staging.Mapped + indexSource, meshFile.GetIndexData(), indexSize);
+			}
+			extractPositions((const CompressedVertex*)staging.Mapped, header->VertexCount, (GpuPositionVertex*)((U8*)staging.Mapped + positionSource));
+
+			VkBufferCopy vertexCopy = {};
+			vertexCopy.srcOffset = 0;
+			vertexCopy.dstOffset = vertexDestination;
+			vertexCopy.size = vertexSize;
+			vkCmdCopyBuffer(commandBuffer, staging.Handle, _vertexBuffer.Handle, 1, &vertexCopy);
+
+			VkBufferCopy positionCopy = {};
+			positionCopy.srcOffset = positionSource;
+			positionCopy.dstOffset = positionDestination;
+			positionCopy.size = positionSize;
+			vkCmdCopyBuffer(commandBuffer, staging.Handle, _positionBuffer.Handle, 1, &positionCopy);
+
+			VkBufferCopy indexCopy = {};
+			indexCopy.srcOffset = indexSource;
+			indexCopy.dstOffset = indexDestination;
+			indexCopy.size = indexSize;
+			vkCmdCopyBuffer(commandBuffer, staging.Handle, _indexBuffer.Handle, 1, &indexCopy);
+		}
+
+		uploadMeshDraw(commandBuffer, (U32)(mesh - _meshes.data()));
+
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+
+		if (staging.Handle) {
+			VulkanUtils::destroyBuffer(_device, &staging);
+		}
+	}
+
+	// Registers the mesh with the culling pass
+	void VulkanRenderer::uploadMeshDraw(VkCommandBuffer commandBuffer, U32 meshIndex) {
+		const VulkanMesh* mesh = &_meshes[meshIndex];
+		GpuMeshDraw meshDraw = {};
+		meshDraw.LodCount = mesh->LodCount;
+		meshDraw.MeshletCount = mesh->MeshletCount;
+		meshDraw.FirstMeshlet = mesh->FirstMeshlet;
+		meshDraw.BoundingSphere = { mesh->Bounds.Center[0], mesh->Bounds.Center[1], mesh->Bounds.Center[2], mesh->Bounds.Radius };
+		meshDraw.PositionOffset = { mesh->Bounds.Min[0], mesh->Bounds.Min[1], mesh->Bounds.Min[2], 0.0f };
+		meshDraw.PositionScale = { mesh->Bounds.Max[0] - mesh->Bounds.Min[0], mesh->Bounds.Max[1] - mesh->Bounds.Min[1], mesh->Bounds.Max[2] - mesh->Bounds.Min[2], 0.0f };
+		for (U32 lod = 0; lod < mesh->LodCount; ++lod) {
+			meshDraw.LodErrors[lod] = mesh->Lods[lod].Error;
+		}
+		vkCmdUpdateBuffer(commandBuffer, _meshDrawBuffer.Handle, sizeof(GpuMeshDraw) * meshIndex, sizeof(GpuMeshDraw), &meshDraw);
+	}
+
+	void VulkanRenderer::uploadMeshlets(const VulkanMesh& mesh, const std::vector<U32>& indices, const std::vector<Meshlet>& meshlets) {
+		VkDeviceSize indexSize = sizeof(U32) * indices.size();
+		VkDeviceSize meshletSize = sizeof(GpuMeshlet) * meshlets.size();
+		U32 firstIndex = mesh.FirstIndex + mesh.Lods[0].FirstIndex;
+
+		VulkanBuffer staging = {};
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, indexSize + meshletSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging);
+		memcpy(staging.Mapped, indices.data(), indexSize);
+
+		GpuMeshlet* gpuMeshlets = (GpuMeshlet*)((U8*)staging.Mapped + indexSize);
+		for (U32 i = 0; i < (U32)meshlets.size(); ++i) {
+			const Meshlet& meshlet = meshlets[i];
+			GpuMeshlet& gpuMeshlet = gpuMeshlets[i];
+			gpuMeshlet = {};
+			gpuMeshlet.BoundingSphere = { meshlet.Center[0], meshlet.Center[1], meshlet.Center[2], meshlet.Radius };
+			gpuMeshlet.Cone = { meshlet.ConeAxis[0], meshlet.ConeAxis[1], meshlet.ConeAxis[2], meshlet.ConeCutoff };
+			gpuMeshlet.FirstIndex = firstIndex + meshlet.FirstIndex;
+			gpuMeshlet.IndexCount = meshlet.IndexCount;
+		}
+
+		// The reordered triangles replace the file's LOD 0, which draws the same either way
+		VkBufferCopy copies[2] = {};
+		copies[0].dstOffset = (VkDeviceSize)firstIndex * sizeof(U32);
+		copies[0].size = indexSize;
+		copies[1].srcOffset = indexSize;
+		copies[1].dstOffset = sizeof(GpuMeshlet) * mesh.FirstMeshlet;
+		copies[1].size = meshletSize;
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _indexBuffer.Handle, 1, &copies[0]);
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _meshletBuffer.Handle, 1, &copies[1]);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+
+		VulkanUtils::destroyBuffer(_device, &staging);
+	}
+
+	void VulkanRenderer::uploadSkinWeights(const MeshFile& meshFile, const VulkanMesh& mesh) {
+		VkDeviceSize size = sizeof(SkinWeights) * mesh.VertexCount;
+		VulkanBuffer staging = {};
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging);
+		memcpy(staging.Mapped, meshFile.GetSkinWeights(), size);
+
+		VkBufferCopy copy = { 0, sizeof(SkinWeights) * mesh.FirstSkinWeight, size };
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdCopyBuffer(commandBuffer, staging.Handle, _skinWeightBuffer.Handle, 1, &copy);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+
+		VulkanUtils::destroyBuffer(_device, &staging);
+	}
+
+	// A copy of a skinned mesh for one instance to be posed into. It shares the source's indices and LODs, but has
+	// vertices of its own and bounds wide enough for any pose. Returns the mesh index, or U32_MAX.
+	U32 VulkanRenderer::createPosedMesh(U32 sourceMeshIndex) {
+		if (_meshes.size() >= MAX_MESHES) {
+			Logger::Error("Unable to pose a skinned mesh, the mesh table is full");
+			return U32_MAX;
+		}
+
+		VulkanMesh posed = _meshes[sourceMeshIndex];
+		if (_geometryVertexCount + posed.VertexCount > MAX_GEOMETRY_VERTICES) {
+			Logger::Error("Unable to pose a skinned mesh, the shared geometry buffers are full");
+			return U32_MAX;
+		}
+
+		// Meshlet bounds and cones only hold for the rest pose
+		posed.VertexOffset = _geometryVertexCount;
+		posed.FirstMeshlet = 0;
+		posed.MeshletCount = 0;
+		F32 reach = posed.Bounds.Radius * SKINNED_BOUNDS_SCALE;
+		for (U32 axis = 0; axis < 3; ++axis) {
+			posed.Bounds.Min[axis] = posed.Bounds.Center[axis] - reach;
+			posed.Bounds.Max[axis] = posed.Bounds.Center[axis] + reach;
+		}
+		posed.Bounds.Radius = reach;
+
+		_geometryVertexCount += posed.VertexCount;
+		_meshes.push_back(posed);
+
+		U32 meshIndex = (U32)_meshes.size() - 1;
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		uploadMeshDraw(commandBuffer, meshIndex);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+		return meshIndex;
+	}
+
+	U32 VulkanRenderer::createMaterial(const Vec4& baseColor) {
+		if (_materials.size() >= MAX_MATERIALS) {
+			Logger::Error("Unable to create material, the material table is full");
+			return U32_MAX;
+		}
+
+		GpuMaterial material = {};
+		material.BaseColor = baseColor;
+		_materials.push_back(material);
+
+		U32 materialIndex = (U32)_materials.size() - 1;
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdUpdateBuffer(commandBuffer, _materialBuffer.Handle, sizeof(GpuMaterial) * materialIndex, sizeof(GpuMaterial), &material);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+		return materialIndex;
+	}
+
+	U32 VulkanRenderer::createTexture(U32 width, U32 height, const void* pixels, VkFormat format) {
+		if (_textures.size() >= MAX_TEXTURES) {
+			Logger::Error("Unable to create texture, the texture set is full");
+			return U32_MAX;
+		}
+
+		VulkanTexture texture = {};
+		texture.Width = width;
+		texture.Height = height;
+
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK(vkCreateImage(_device, &imageInfo, nullptr, &texture.Image));
+
+		VkMemoryRequirements memoryReqs{};
+		vkGetImageMemoryRequirements(_device, texture.Image, &memoryReqs);
+
+		VkMemoryAllocateInfo memoryAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memoryAlloc.allocationSize = memoryReqs.size;
+		memoryAlloc.memoryTypeIndex = VulkanUtils::getMemoryType(memoryReqs.memoryTypeBits, _physicalDeviceMemory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK(vkAllocateMemory(_device, &memoryAlloc, nullptr, &texture.Memory));
+		VK_CHECK(vkBindImageMemory(_device, texture.Image, texture.Memory, 0));
+
+		VkImageViewCreateInfo imageView = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageView.image = texture.Image;
+		imageView.format = format;
+		imageView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (format == VK_FORMAT_R8_UNORM) {
+			imageView.components = { VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R };
+		}
+		VK_CHECK(vkCreateImageView(_device, &imageView, nullptr, &texture.View));
+
+		VulkanBuffer staging = {};
+		VkDeviceSize size = (VkDeviceSize)width * height * (format == VK_FORMAT_R8_UNORM ? 1 : 4);
+		VulkanUtils::createBuffer(_device, _physicalDeviceMemory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging);
+		memcpy(staging.Mapped, pixels, size);
+
+		VkImageMemoryBarrier layoutBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		layoutBarrier.srcAccessMask = 0;
+		layoutBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.image = texture.Image;
+		layoutBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(_device, _commandPool);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+
+		VkBufferImageCopy copy = {};
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageExtent = { width, height, 1 };
+		vkCmdCopyBufferToImage(commandBuffer, staging.Handle, texture.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		layoutBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+		VulkanUtils::endSingleTimeCommands(_device, _commandPool, _graphicsQueue, commandBuffer);
+		VulkanUtils::destroyBuffer(_device, &staging);
+
+		// No frame in flight samples this slot yet, so it may be written while they run
+		U32 textureIndex = (U32)_textures.size();
+		_textures.push_back(texture);
+
+		VkDescriptorImageInfo imageDescriptor = { _textureSampler, texture.View, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = _textureSet;
+		write.dstBinding = 0;
+		write.dstArrayElement = textureIndex;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageDescriptor;
+		vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+		return textureIndex;
+	}
+
+	U32 VulkanRenderer::addInstance(U32 meshIndex, const Mat4& transform, U32 materialIndex) {
+		if (_instances.size() >= MAX_INSTANCES) {
+			Logger::Error("Unable to add instance, the scene is full");
+			return U32_MAX;
+		}
+
+		// Skinned instances draw a posed copy of the mesh of their own
+		U32 skinIndex = U32_MAX;
+		if (_meshes[meshIndex].JointCount > 0) {
+			U32 jointCount = _meshes[meshIndex].JointCount;
+			if (_skins.size() >= MAX_SKINS || _skinJoints.size() + jointCount > MAX_SKIN_JOINTS) {
+				Logger::Error("Unable to add instance, the skinning buffers are full");
+				return U32_MAX;
+			}
+			if (_commandBatches.size() + _meshes[meshIndex].LodCount > MAX_DRAW_COMMANDS) {
+				Logger::Error("Unable to add instance, there are too many mesh and material combinations");
+				return U32_MAX;
+			}
+
+			U32 posedMesh = createPosedMesh(meshIndex);
+			if (posedMesh == U32_MAX) {
+				return U32_MAX;
+			}
+
+			// Bind pose until the first joints come in
+			skinIndex = (U32)_skins.size();
+			_skins.push_back({ (U32)_instances.size(), meshIndex, (U32)_skinJoints.size(), true });
+			_skinJoints.insert(_skinJoints.end(), jointCount, TMath::Identity());
+			meshIndex = posedMesh;
+		}
+
+		const VulkanMesh& mesh = _meshes[meshIndex];
+		if (mesh.MeshletCount > 0 && (_clusterDraws.size() >= MAX_CLUSTER_DRAWS || _clusters.size() + mesh.MeshletCount > MAX_CLUSTERS ||
+			_clusterIndexCount + mesh.Lods[0].IndexCount > MAX_CLUSTER_INDICES)) {
+			Logger::Error("Unable to add instance, the cluster buffers are full");
+			return U32_MAX;
+		}
+
+		// Instances of the same mesh and material share a batch
+		U64 batchKey = ((U64)meshIndex << 32) | materialIndex;
+		auto batch = _batchLookup.find(batchKey);
+		if (batch == _batchLookup.end()) {
+			U32 lodCount = mesh.LodCount;
+			if (_commandBatches.size() + lodCount > MAX_DRAW_COMMANDS) {
+				Logger::Error("Unable to add instance, there are too many mesh and material combinations");
+				return U32_MAX;
+			}
+
+			U32 firstInstance = 0;
+			if (!_batches.empty()) {
+				firstInstance = _batches.back().FirstInstance + _batches.back().InstanceCount * _batches.back().LodCount;
+			}
+			batch = _batchLookup.emplace(batchKey, (U32)_batches.size()).first;
+			_batches.push_back({ meshIndex, materialIndex, 0, firstInstance, lodCount, (U32)_commandBatches.size() });
+			_commandBatches.insert(_commandBatches.end(), lodCount, batch->second);
+		}
+
+		// Draw instance ranges follow each other in batch order
+		U32 batchIndex = batch->second;
+		_batches[batchIndex].InstanceCount++;
+		for (U32 i = batchIndex + 1; i < _batches.size(); ++i) {
+			_batches[i].FirstInstance += _batches[batchIndex].LodCount;
+		}
+		for (U32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+			_batchCommandsDirty[i] = true;
+		}
+
+		GpuInstance instance = {};
+		instance.Transform = transform;
+		instance.MeshIndex = meshIndex;
+		instance.MaterialIndex = materialIndex;
+		instance.BatchIndex = batchIndex;
+		instance.FirstCommand = _batches[batchIndex].FirstCommand;
+		_instances.push_back(instance);
+		_instanceSkins.push_back(skinIndex);
+		_instanceLods.push_back(0);
+		_instanceDynamic.push_back(skinIndex != U32_MAX ? 1 : 0);
+		_instancesDirty = true;
+
+		// Every meshlet of the mesh becomes a cluster of this instance
+		if (mesh.MeshletCount > 0) {
+			U32 drawIndex = (U32)_clusterDraws.size();
+			_clusterDraws.push_back({ (U32)_instances.size() - 1, _clusterIndexCount });
+			_clusterIndexCount += mesh.Lods[0].IndexCount;
+			for (U32 i = 0; i < mesh.MeshletCount; ++i) {
+				_clusters.push_back({ (U32)_instances.size() - 1, mesh.FirstMeshlet + i, drawIndex });
+			}
+		}
+
+		U32 instanceIndex = _instanceBounds.Add({ 0.0f, 0.0f, 0.0f }, 0.0f);
+		updateInstanceBounds(instanceIndex);
+		invalidateShadowCaches(instanceIndex);
+		return instanceIndex;
+	}
+
+	void VulkanRenderer::setInstanceTransform(U32 instanceIndex, const Mat4& transform) {
+		// Static casters leave a hole in the caches they were in and show up in the ones they move to
+		invalidateShadowCaches(instanceIndex);
+		_instances[instanceIndex].Transform = transform;
+		_instancesDirty = true;
+		updateInstanceBounds(instanceIndex);
+		invalidateShadowCaches(instanceIndex);
+	}
+
+	void VulkanRenderer::setInstanceJoints(U32 instanceIndex, const Mat4* jointMatrices) {
+		U32 skinIndex = _instanceSkins[instanceIndex];
+		if (skinIndex == U32_MAX) {
+			Logger::Error("Instance %d is not skinned", instanceIndex);
+			return;
+		}
+
+		VulkanSkin& skin = _skins[skinIndex];
+		memcpy(&_skinJoints[skin.FirstJoint], jointMatrices, sizeof(Mat4) * _meshes[skin.SourceMesh].JointCount);
+		skin.Dirty = true;
+	}
+
+	void VulkanRenderer::updateInstanceBounds(U32 instanceIndex) {
+		const GpuInstance& instance = _instances[instanceIndex];
+		const MeshBounds& bounds = _meshes[instance.MeshIndex].Bounds;
+
+		Vec3 center = TMath::TransformPoint(instance.Transform, { bounds.Center[0], bounds.Center[1], bounds.Center[2] });
+		F32 radius = bounds.Radius * TMath::MaxScale(instance.Transform);
+		_instanceBounds.Set(instanceIndex, center, radius);
+
+		Aabb box = { TMath::Subtract(center, { radius, radius, radius }), TMath::Add(center, { radius, radius, radius }) };
+		if (instanceIndex < _instanceProxies.size()) {
+			_instanceTree.MoveProxy(_instanceProxies[instanceIndex], box);
+		} else {
+			_instanceProxies.push_back(_instanceTree.CreateProxy(box, instanceIndex));
+		}
+	}
+
+	U32 VulkanRenderer::pickInstance(const Vec3& origin, const Vec3& direction, F32 maxDistance, F32* outDistance) const {
+		Vec3 unitDirection = TMath::Normalize(direction);
+		const F32* x = _instanceBounds.GetCenterX();
+		const F32* y = _instanceBounds.GetCenterY();
+		const F32* z = _instanceBounds.GetCenterZ();
+		const F32* radius = _instanceBounds.GetRadius();
+
+		// Exact ray against sphere for the candidates the tree finds
+		return _instanceTree.RayCast(origin, unitDirection, maxDistance, outDistance, [&](U32 instanceIndex) {
+			Vec3 toCenter = TMath::Subtract({ x[instanceIndex], y[instanceIndex], z[instanceIndex] }, origin);
+			F32 along = TMath::Dot(toCenter, unitDirection);
+			F32 squaredDistance = TMath::Dot(toCenter, toCenter) - along * along;
+			F32 squaredRadius = radius[instanceIndex] * radius[instanceIndex];
+			if (squaredDistance > squaredRadius) {
+				return -1.0f;
+			}
+			F32 entry = along - sqrtf(squaredRadius - squaredDistance);
+			return entry >= 0.0f ? entry : (along + sqrtf(squaredRadius - squaredDistance) >= 0.0f ? 0.0f : -1.0f);
+		});
+	}
+
+	void VulkanRenderer::setCamera(const Mat4& view, const Mat4& projection) {
+		_view = view;
+		_projection = projection;
+	}
 }
\ No newline at end of file
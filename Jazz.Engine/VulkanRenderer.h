@@ -1,10 +1,100 @@
 #pragma once
 
 #include "Types.h"
+#include "TMath.h"
+#include "Mesh.h"
+#include "MeshletBuilder.h"
+#include "Culling.h"
+#include "DynamicAabbTree.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "SpriteBatcher.h"
+#include "TextRenderer.h"
+#include "DebugDraw.h"
+#include "VulkanUtils.h"
 
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan.h>
 
+#define MAX_FRAMES_IN_FLIGHT 2
+
+// Capacities of the shared GPU-driven scene buffers
+#define MAX_GEOMETRY_VERTICES (1 << 21)
+#define MAX_GEOMETRY_INDICES (1 << 23)
+#define MAX_MESHES 4096
+#define MAX_INSTANCES (1 << 18)
+#define MAX_MATERIALS 1024
+#define MAX_DRAW_COMMANDS 16384
+
+// Every batch reserves a draw instance range per LOD, as any of them may end up drawing all its instances
+#define MAX_DRAW_INSTANCES (MAX_INSTANCES * JAZZ_MESH_MAX_LODS)
+
+// Share of the LOD error threshold an instance must get below before it switches to a coarser LOD, so
+// instances hovering around a switching distance don't pop back and forth
+#define LOD_HYSTERESIS 0.25f
+
+// Large meshes are also split into meshlets, each culled on its own for every instance. A cluster is one meshlet of
+// one instance. Each instance of a meshlet mesh gets a draw gathering the triangles of its surviving clusters, with
+// room for all of its most detailed LOD in the cluster index buffer of each culling phase.
+#define MESHLET_MIN_TRIANGLES 2048
+#define MAX_MESHLETS (1 << 16)
+#define MAX_CLUSTERS (1 << 20)
+#define MAX_CLUSTER_DRAWS 4096
+#define MAX_CLUSTER_INDICES (1 << 22)
+
+// Batch and cluster draws of both culling phases, their non-empty draws are packed the same way right after them
+#define COMPACT_DRAW_COMMAND_OFFSET ((MAX_DRAW_COMMANDS + MAX_CLUSTER_DRAWS) * 2)
+
+// Enough mips for a 32k depth pyramid
+#define MAX_DEPTH_PYRAMID_MIPS 16
+
+// Closest occluders rasterized by CPU occlusion culling each frame
+#define MAX_OCCLUDERS 64
+
+// Bindless texture array, sprites name their texture by its index in it
+#define MAX_TEXTURES 4096
+
+// Sprite instances each frame in flight has room for in its upload ring
+#define MAX_SPRITES (1 << 17)
+
+// Particle pool simulated on the GPU, and the emitters feeding it
+#define MAX_PARTICLES (1 << 20)
+#define MAX_PARTICLE_EMITTERS 1024
+
+// Skinned instances, the skin weights of all skinned meshes and the joints of all skinned instances
+#define MAX_SKINS 4096
+#define MAX_SKIN_WEIGHTS (1 << 20)
+#define MAX_SKIN_JOINTS (1 << 16)
+
+// Posed vertices are quantized within the rest pose bounding sphere grown by this much, and clamped to it
+#define SKINNED_BOUNDS_SCALE 2.0f
+
+// Lights, and the view space clusters they are binned into each frame: screen tiles by exponential depth slices.
+// Lights past the per cluster limit are dropped from that cluster.
+#define MAX_LIGHTS 4096
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+#define LIGHT_CLUSTER_MAX_LIGHTS 128
+
+// Sun shadow cascades, laid out in an atlas SHADOW_ATLAS_COLUMNS tiles wide. Static casters are cached per cascade in
+// tiles SHADOW_CACHE_BORDER texels larger on every side, which the cascade can move within before the cache is redrawn.
+#define SHADOW_CASCADES 4
+#define SHADOW_CASCADE_SIZE 1024
+#define SHADOW_ATLAS_COLUMNS 2
+#define SHADOW_CACHE_BORDER 64
+#define SHADOW_CACHE_SIZE (SHADOW_CASCADE_SIZE + SHADOW_CACHE_BORDER * 2)
+
+// Blend of logarithmic (1) and uniform (0) cascade splits, and how far towards the sun casters outside a cascade
+// still shadow it
+#define SHADOW_SPLIT_BLEND 0.75f
+#define SHADOW_CASTER_REACH 100.0f
+
+// Caster instances the shadow draws of a frame can list, across all cascades
+#define MAX_SHADOW_CASTERS (MAX_INSTANCES * 2)
+
 namespace Jazz {
 
 	struct VulkanSwapchainSupportDetails {
@@ -13,6 +103,339 @@ namespace Jazz {
 		std::vector<VkPresentModeKHR> PresentationModes;
 	};
 
+	// A mesh living in the shared vertex/index buffers
+	struct VulkanMesh {
+		U32 VertexOffset; // In vertices
+		U32 VertexCount;
+		U32 FirstIndex; // In indices
+		U32 IndexCount;
+		MeshBounds Bounds;
+		U32 LodCount;
+		MeshLod Lods[JAZZ_MESH_MAX_LODS];
+		U32 FirstMeshlet;
+		U32 MeshletCount; // Zero for meshes only culled as a whole
+		U32 FirstSkinWeight;
+		U32 JointCount; // Zero for meshes that are not skinned
+	};
+
+	// A skinned instance draws a copy of its mesh of its own, which the skinning pass poses whenever the joints change
+	struct VulkanSkin {
+		U32 InstanceIndex;
+		U32 SourceMesh;
+		U32 FirstJoint;
+		bool Dirty;
+	};
+
+	// The following mirror the std430 layouts declared in the shaders
+	struct GpuInstance {
+		Mat4 Transform;
+		U32 MeshIndex;
+		U32 MaterialIndex;
+		U32 BatchIndex;
+		U32 FirstCommand; // The batch's draw command for LOD 0, the other LODs follow
+	};
+
+	struct GpuMaterial {
+		Vec4 BaseColor;
+	};
+
+	struct GpuMeshDraw {
+		U32 LodCount;
+		U32 MeshletCount; // LOD 0 of meshes with meshlets is drawn cluster by cluster
+		U32 FirstMeshlet;
+		U32 Padding;
+		Vec4 BoundingSphere; // Object space center and radius
+		F32 LodErrors[JAZZ_MESH_MAX_LODS];
+		Vec4 PositionOffset; // position = offset + unorm * scale
+		Vec4 PositionScale;
+	};
+
+	// Position only stream for the depth pre-pass, the first half of each CompressedVertex
+	struct GpuPositionVertex {
+		U16 Position[3];
+		U16 Padding;
+	};
+
+	struct GpuMeshlet {
+		Vec4 BoundingSphere; // Object space center and radius
+		Vec4 Cone; // Object space axis and cutoff
+		U32 FirstIndex; // In the shared index buffer
+		U32 IndexCount;
+		U32 Padding[2];
+	};
+
+	struct GpuCluster {
+		U32 InstanceIndex;
+		U32 MeshletIndex;
+		U32 DrawIndex; // Cluster draw of the instance
+	};
+
+	// std140, one per frame in flight
+	struct GpuCullParams {
+		Mat4 View;
+		Frustum CameraFrustum;
+		F32 P00; // Projection terms used to project bounding spheres to the screen
+		F32 P11;
+		F32 DepthScale; // Depth of a view space distance d is DepthScale / d - DepthOffset
+		F32 DepthOffset;
+		F32 ZNear;
+		F32 PyramidWidth;
+		F32 PyramidHeight;
+		U32 InstanceCount;
+		U32 OcclusionEnabled;
+		F32 LodErrorScale; // Object space error over view distance to error over the threshold in pixels
+		F32 LodHysteresis;
+		U32 ClusterCount;
+		Vec4 CameraPosition; // World space, for normal cone culling
+	};
+
+	// Occlusion culling runs in two phases: the early phase draws what was visible last frame, the late
+	// phase tests everything against a depth pyramid built from the early draws and draws what was missed
+	enum GpuCullPhase {
+		GPU_CULL_PHASE_EARLY = 0,
+		GPU_CULL_PHASE_LATE = 1
+	};
+
+	struct GpuCullPushConstants {
+		U32 Phase;
+		U32 CommandOffset; // First draw command written by this phase, batch or cluster draws depending on the pass
+		U32 CommandCount; // Compaction only, draws to pack from CommandOffset on
+		U32 CompactOffset; // Compaction only, where the non-empty draws go
+		U32 CountIndex; // Compaction only, draw count receiving them
+	};
+
+	struct GpuDepthPyramidPushConstants {
+		U32 SourceWidth;
+		U32 SourceHeight;
+		U32 DestinationWidth;
+		U32 DestinationHeight;
+	};
+
+	struct VulkanCullingStats {
+		U32 InstanceCount;
+		U32 VisibleCount;
+		U32 OccludedCount; // Frustum visible instances rejected by CPU occlusion culling
+		U32 DrawCount; // Draw calls recorded for the scene
+		U32 ClusterCount; // GPU culling only, clusters of visible and invisible instances alike
+		U32 VisibleClusterCount;
+	};
+
+	// Fragment shading of the last frame whose queries have come back
+	struct VulkanDepthPrepassStats {
+		bool Enabled;
+		U64 FragmentInvocations; // Color pass fragment shader runs, zero without pipeline statistics queries
+		U64 DepthPassedSamples; // Samples passing the pre-pass depth test, what the color pass shades without it
+		U64 SavedInvocations;
+	};
+
+	// Scene draws either shade or only lay down depth with the position stream ahead of shading. In recording order,
+	// which is also the order of the pass field of render queue keys.
+	enum VulkanScenePass {
+		VULKAN_SCENE_PASS_DEPTH = 0,
+		VULKAN_SCENE_PASS_COLOR = 1
+	};
+
+	// Graphics pipelines scene draws bind, the pipeline field of render queue keys
+	enum VulkanScenePipeline {
+		VULKAN_SCENE_PIPELINE_DEPTH_PREPASS = 0,
+		VULKAN_SCENE_PIPELINE_OPAQUE = 1,
+		VULKAN_SCENE_PIPELINE_EQUAL = 2 // Shading behind the pre-pass, only where depth matches it exactly
+	};
+
+	// RGBA8, sampled through the bindless texture set
+	struct VulkanTexture {
+		VkImage Image;
+		VkDeviceMemory Memory;
+		VkImageView View;
+		U32 Width;
+		U32 Height;
+	};
+
+	// Skins posed this frame, each covering the workgroups from FirstGroup to the next one's
+	struct GpuSkin {
+		U32 SourceVertexOffset;
+		U32 OutputVertexOffset;
+		U32 VertexCount;
+		U32 FirstWeight;
+		U32 FirstJoint;
+		U32 FirstGroup;
+		U32 Padding[2];
+		Vec4 SourceOffset;
+		Vec4 SourceScale;
+		Vec4 OutputOffset;
+		Vec4 OutputInverseScale;
+	};
+
+	struct GpuSkinningPushConstants {
+		U32 SkinCount;
+	};
+
+	struct GpuSpritePushConstants {
+		F32 PixelToClip[2];
+	};
+
+	// Particles spawn within Radius of Position, moving at Velocity plus up to Spread in any direction
+	struct ParticleEmitter {
+		Vec3 Position;
+		F32 Radius;
+		Vec3 Velocity;
+		F32 Spread;
+		U32 Color; // RGBA8 with R in the lowest byte
+		F32 Size;
+		F32 Lifetime; // Seconds
+		F32 Rate; // Particles per second
+	};
+
+	struct GpuParticle {
+		Vec4 PositionAge;
+		Vec4 VelocityLifetime;
+		U32 Color;
+		F32 Size;
+		U32 Padding[2];
+	};
+
+	// An emitter spawning this frame, its particles run up to the next one's FirstParticle
+	struct GpuParticleEmitter {
+		Vec4 PositionRadius;
+		Vec4 VelocitySpread;
+		U32 Color;
+		F32 Size;
+		F32 Lifetime;
+		U32 FirstParticle;
+	};
+
+	// Simulation dispatch size, free slot count, then the draw of each alive list, whose instance count is its length
+	struct GpuParticleCounters {
+		U32 SimulateDispatch[3];
+		I32 DeadCount;
+		VkDrawIndirectCommand Draws[2];
+	};
+
+	struct GpuParticleSimulatePushConstants {
+		Vec3 Gravity;
+		F32 DeltaTime;
+		F32 Drag;
+		U32 EmitterCount;
+		U32 EmitCount;
+		U32 Seed;
+		U32 CurrentList;
+	};
+
+	struct GpuParticleDrawPushConstants {
+		Mat4 ViewProjection;
+		Vec4 CameraRight;
+		Vec4 CameraUp;
+		U32 List;
+	};
+
+	enum LightType {
+		LIGHT_TYPE_POINT = 0,
+		LIGHT_TYPE_SPOT = 1
+	};
+
+	// Light fades out to nothing at Range. Spot lights shine along Direction, at full strength within InnerAngle of
+	// it and none past OuterAngle, both half angles in radians below pi / 2.
+	struct Light {
+		LightType Type;
+		Vec3 Position;
+		F32 Range;
+		Vec3 Color; // Linear, intensity included
+		Vec3 Direction;
+		F32 InnerAngle;
+		F32 OuterAngle;
+	};
+
+	// Spot cosines of a point light never cut anything off. The bounding sphere is in world space, around the cone
+	// for spot lights.
+	struct GpuLight {
+		Vec4 PositionRange;
+		Vec4 ColorCosInner;
+		Vec4 DirectionCosOuter;
+		Vec4 BoundingSphere;
+	};
+
+	// View depth of a depth buffer value is DepthScale / (depth + DepthOffset), its cluster slice log(depth) *
+	// SliceScale + SliceBias
+	struct GpuLightingParams {
+		Mat4 View;
+		Vec4 Ambient;
+		F32 P00;
+		F32 P11;
+		F32 DepthScale;
+		F32 DepthOffset;
+		F32 ZNear;
+		F32 ZFar;
+		F32 SliceScale;
+		F32 SliceBias;
+		F32 ScreenWidth;
+		F32 ScreenHeight;
+		U32 LightCount;
+		U32 Padding;
+		Vec4 SunDirection; // Towards the sun, W is 1 when the sun shines
+		Vec4 SunColor;
+		Vec4 CascadeSplits; // View depth each cascade reaches
+		Vec4 CascadeTexelSizes; // World size of a shadow texel
+		Mat4 ShadowMatrices[SHADOW_CASCADES]; // World to atlas UV and depth
+	};
+
+	// A cascade and the cache of static casters it is cut from. Both use the cache's depth range in light space,
+	// which makes the cascade the cache shifted by whole texels.
+	struct VulkanShadowCascade {
+		Mat4 ViewProjection;
+		Mat4 CacheViewProjection;
+		Frustum CacheFrustum;
+		F32 SplitDepth;
+		F32 Radius;
+		F32 TexelSize;
+		I32 TexelX; // Light space position of the cascade center in texels
+		I32 TexelY;
+		I32 CacheTexelX;
+		I32 CacheTexelY;
+		F32 CacheDepth; // Light space depth of the cascade center when the cache was drawn
+		F32 CacheRadius;
+		bool CacheValid;
+	};
+
+	static_assert(SHADOW_CASCADES <= 4, "Cascade splits and texel sizes are packed in a Vec4");
+
+	// Shadow work of the last recorded frame
+	struct VulkanShadowStats {
+		U32 CachedCascades; // Cascades whose static casters came from the cache
+		U32 StaticCasterCount; // Static casters drawn into caches that had to be redrawn
+		U32 DynamicCasterCount; // Dynamic casters drawn over the caches, every cascade every frame
+	};
+
+	// vkCmdBind* calls of the last recorded frame
+	struct VulkanBindStats {
+		U32 Requested; // What recording asked for, one full set of binds per draw
+		U32 Issued; // What reached the command buffer once rebinds of bound state were skipped
+	};
+
+	// Every instance sharing a mesh and material, drawn by one instanced draw per LOD. On the GPU culling path
+	// the visible instances of LOD n are listed from FirstInstance + n * InstanceCount on in the draw instance
+	// buffer, which gl_InstanceIndex indexes.
+	struct VulkanDrawBatch {
+		U32 MeshIndex;
+		U32 MaterialIndex;
+		U32 InstanceCount;
+		U32 FirstInstance;
+		U32 LodCount;
+		U32 FirstCommand;
+	};
+
+	// An instance of a meshlet mesh. Its surviving clusters' indices are packed from FirstIndex on in the cluster index
+	// buffer of each phase.
+	struct VulkanClusterDraw {
+		U32 InstanceIndex;
+		U32 FirstIndex;
+	};
+
+	// CPU copy of a mesh that may stand in for itself when rasterizing occluders, usually a simplified version
+	struct VulkanOccluderMesh {
+		std::vector<F32> Positions;
+		std::vector<U32> Indices;
+	};
+
 	class Platform;
 
 	class VulkanRenderer {
@@ -21,6 +444,102 @@ namespace Jazz {
 		~VulkanRenderer();
 		void drawFrame();
 		void deviceWaitIdle();
+
+		// Returns the mesh index, or U32_MAX if the file could not be loaded
+		U32 loadMesh(const char* path);
+
+		// Instances of the mesh occlude others on the CPU culling path, using the geometry of the given file
+		const bool loadOccluderMesh(U32 meshIndex, const char* path);
+
+		// Loads the merged static geometry StaticBatcher::BuildSceneFiles() wrote, each batch as a mesh with one instance
+		// at the origin. Returns false if the list or any of its meshes could not be loaded.
+		const bool loadStaticBatches(const char* manifestPath);
+
+		// Returns the material index, or U32_MAX if the material table is full. Material 0 is plain white.
+		U32 createMaterial(const Vec4& baseColor);
+
+		// Returns the instance index, or U32_MAX if the scene is full
+		U32 addInstance(U32 meshIndex, const Mat4& transform, U32 materialIndex = 0);
+		void setInstanceTransform(U32 instanceIndex, const Mat4& transform);
+
+		// Instances of skinned meshes get a posed copy of the geometry that the depth pre-pass, shadow and main passes
+		// all draw. Takes one skinning matrix per joint of the mesh, in object space with the inverse bind pose applied.
+		// The instance is posed once with the next frame.
+		void setInstanceJoints(U32 instanceIndex, const Mat4* jointMatrices);
+
+		// Closest instance whose bounding sphere the ray hits within maxDistance, or U32_MAX
+		U32 pickInstance(const Vec3& origin, const Vec3& direction, F32 maxDistance, F32* outDistance = nullptr) const;
+
+		void setCamera(const Mat4& view, const Mat4& projection);
+
+		// GPU culling writes the draws in a compute pass, CPU culling records one draw per visible instance
+		void setGpuCulling(bool enabled) { _gpuCulling = enabled; }
+
+		// Hi-Z occlusion culling on the GPU culling path, a software occlusion buffer on the CPU path
+		void setOcclusionCulling(bool enabled) { _occlusionCulling = enabled; }
+
+		// Largest projected simplification error in pixels a LOD may have to be picked
+		void setLodErrorThreshold(F32 pixels) { _lodErrorThreshold = pixels; }
+
+		// Visible instance counts. GPU culling results are read back without stalling, so they lag a frame or two behind
+		const VulkanCullingStats& getCullingStats() const { return _cullingStats; }
+
+		const VulkanBindStats& getBindStats() const { return _bindStats; }
+
+		// Lays down depth with positions only before shading, which then tests EQUAL without writing so every pixel is
+		// shaded once. Pays off for scenes with overdraw and costly fragments.
+		void setDepthPrepass(bool enabled) { _depthPrepass = enabled; }
+
+		// Lags a frame or two behind like the GPU culling stats
+		const VulkanDepthPrepassStats& getDepthPrepassStats() const { return _depthPrepassStats; }
+
+		// RGBA8 pixels, rows tightly packed. Returns the bindless texture index, or U32_MAX if the texture set is full.
+		// Texture 0 is plain white. R8 textures are single channel coverage, sampled as white with that alpha.
+		U32 createTexture(U32 width, U32 height, const void* pixels, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+
+		// Sprites drawn over the scene this frame, cleared once the frame is recorded
+		SpriteBatcher& getSprites() { return _sprites; }
+
+		// Text goes out with the sprites, on the top layer unless told otherwise. Returns the width of the widest line.
+		F32 drawText(const char* text, F32 x, F32 y, U32 pixelSize = 16, U32 color = 0xFFFFFFFF, U32 layer = SPRITE_MAX_LAYERS - 1) {
+			return _text.Draw(_sprites, text, x, y, pixelSize, color, layer);
+		}
+		TextRenderer& getText() { return _text; }
+
+		// GPU particles. Emission, integration and recycling of dead particles all run in compute passes, the CPU only
+		// hands over how many particles each emitter spawns. Particles blend additively, so they need no sorting.
+		// Returns the emitter index, or U32_MAX if the emitter table is full.
+		U32 addParticleEmitter(const ParticleEmitter& emitter);
+		void setParticleEmitter(U32 emitterIndex, const ParticleEmitter& emitter) { _particleEmitters[emitterIndex] = emitter; }
+
+		// A burst on top of the emitter's rate, spawned with the next frame
+		void emitParticles(U32 emitterIndex, U32 count) { _particleBursts[emitterIndex] += count; }
+		void setParticleForces(const Vec3& gravity, F32 drag) { _particleGravity = gravity; _particleDrag = drag; }
+
+		// Time the next drawFrame() advances the particles by
+		void updateParticles(F32 deltaTime) { _particleTimeStep += deltaTime; }
+
+		// Clustered forward lighting. A compute pass bins the lights into view space clusters every frame and shading
+		// only loops over the lights of its pixel's cluster. Returns the light index, or U32_MAX if the light table is full.
+		U32 addLight(const Light& light);
+		void setLight(U32 lightIndex, const Light& light);
+		void setAmbientLight(const Vec3& color) { _ambientLight = color; }
+
+		// Cascaded shadows from a directional sun, Direction being the way its light travels. Black turns it off.
+		void setSunLight(const Vec3& direction, const Vec3& color);
+
+		// Shadows reach this far from the camera, split among SHADOW_CASCADES cascades
+		void setShadowDistance(F32 distance) { _shadowDistance = distance; }
+
+		// Static instances are drawn into per cascade caches, redrawn only when a cascade moves past its cache border
+		// or a static instance within it changes. Dynamic ones are drawn over the caches every frame. Instances start
+		// out static, skinned ones are always dynamic.
+		void setInstanceDynamic(U32 instanceIndex, bool dynamic);
+
+		const VulkanShadowStats& getShadowStats() const { return _shadowStats; }
+
+		// Width of DebugDraw lines in pixels, 1 when the device has no wide lines
+		void setDebugLineWidth(F32 width) { _debugLineWidth = _wideLinesSupported ? width : 1.0f; }
 	private:
 		VkPhysicalDevice selectPhysicalDevice();
 		const bool physicalDeviceMeetsRequirements(VkPhysicalDevice physicalDevice);
@@ -28,16 +547,64 @@ namespace Jazz {
 		VulkanSwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice physicalDevice);
 		void createLogicalDevice(std::vector<const char*>& requireValidationLayers);
 		void createShader(const char* name);
-		char* readShaderFile(const char* filename, const char* shaderType, U64* fileSize);
 		void createSwapchain();
 		void createSwapchainImagesAndViews();
 		void createRenderPass();
 		void createDepthStencil(VkFormat depthFormat);
+		void createDepthPyramid();
 		void createGraphicsPipeline();
 		void createFramebuffers();
 		void createCommandPool();
 		void createCommandBuffers();
-		void createSemaphores();
+		void createSyncObjects();
+		void createGeometryBuffers();
+		void createSceneBuffers();
+		void createDescriptors();
+		void createCullPipeline();
+		VkPipeline createComputePipeline(const char* shaderName, VkPipelineLayout layout);
+		void recordCommandBuffer(VkCommandBuffer commandBuffer, U32 imageIndex);
+		void recordCullDispatch(VkCommandBuffer commandBuffer, GpuCullPhase phase, U32 instanceCount);
+		void recordDepthPyramid(VkCommandBuffer commandBuffer);
+		void uploadMeshData(const MeshFile& meshFile, VulkanMesh* mesh);
+		void uploadMeshlets(const VulkanMesh& mesh, const std::vector<U32>& indices, const std::vector<Meshlet>& meshlets);
+		void uploadMeshDraw(VkCommandBuffer commandBuffer, U32 meshIndex);
+		void uploadSkinWeights(const MeshFile& meshFile, const VulkanMesh& mesh);
+		U32 createPosedMesh(U32 sourceMeshIndex);
+		void createSkinningResources();
+		void recordSkinning(VkCommandBuffer commandBuffer);
+		void uploadClusters(VkCommandBuffer commandBuffer);
+		void updateInstanceBounds(U32 instanceIndex);
+		void uploadBatchCommands(VkCommandBuffer commandBuffer);
+		void uploadVisibleInstances(VkCommandBuffer commandBuffer, U32 visibleCount);
+		F32 lodErrorScale() const;
+		void resetBindState();
+		void bindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+		void bindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, U32 setCount, const VkDescriptorSet* sets);
+		void bindGeometryBuffers(VkCommandBuffer commandBuffer, VkBuffer vertexBuffer, VkBuffer indexBuffer);
+		VulkanScenePipeline scenePipeline(VulkanScenePass pass) const;
+		void bindSceneState(VkCommandBuffer commandBuffer, VulkanScenePass pass, VulkanScenePipeline pipeline, VkBuffer indexBuffer);
+		void recordSceneDraws(VkCommandBuffer commandBuffer, VulkanScenePass pass, GpuCullPhase phase);
+		void recordScenePass(VkCommandBuffer commandBuffer, GpuCullPhase phase, const Mat4& viewProjection);
+		void createQueryPools();
+		void createSpriteResources();
+		void recordSprites(VkCommandBuffer commandBuffer);
+		void uploadTextAtlas(VkCommandBuffer commandBuffer);
+		void createShadowResources();
+		void updateShadowCascades();
+		void invalidateShadowCaches(U32 instanceIndex);
+		U32 recordShadowCasters(VkCommandBuffer commandBuffer, const Mat4& viewProjection, F32 texelSize, bool dynamic);
+		void recordShadows(VkCommandBuffer commandBuffer);
+		void createLightingResources();
+		void recordLightBinning(VkCommandBuffer commandBuffer);
+		void createParticleResources();
+		void recordParticleSimulation(VkCommandBuffer commandBuffer);
+		void recordParticles(VkCommandBuffer commandBuffer, const Mat4& viewProjection);
+#ifdef JAZZ_DEBUG_DRAW
+		void createDebugDrawResources();
+		void recordDebugDraw(VkCommandBuffer commandBuffer, const Mat4& viewProjection);
+#endif
+		void readDepthPrepassStats();
+		U32 cullOccludedInstances(U32 visibleCount);
 	private:
 		Platform* _platform;
 
@@ -46,7 +613,9 @@ namespace Jazz {
 		VkDebugUtilsMessengerEXT _debugMessenger;
 
 		VkPhysicalDevice _physicalDevice;
+		VkPhysicalDeviceProperties _physicalDeviceProperties;
 		VkPhysicalDeviceMemoryProperties _physicalDeviceMemory;
+		bool _unifiedMemory; // Device local memory is also host visible (integrated GPUs)
 		VkDevice _device; // Logical device
 		I32 _graphicsFamilyQueueIndex;
 		I32 _presentationFamilyQueueIndex;
@@ -70,15 +639,265 @@ namespace Jazz {
 			VkImage image;
 			VkDeviceMemory memory;
 			VkImageView view;
+			VkImageView sampleView; // Depth aspect only
 		} _depthStencil;
 
-		VkRenderPass _renderPass;
+		// Hi-Z: max depth of the early pass, power of two sized and halved down to 1x1
+		struct {
+			VkImage image;
+			VkDeviceMemory memory;
+			VkImageView view; // Every mip, sampled by the culling pass
+			VkImageView mipViews[MAX_DEPTH_PYRAMID_MIPS];
+			VkDescriptorSet mipSets[MAX_DEPTH_PYRAMID_MIPS]; // Reads the previous mip, writes this one
+			VkSampler sampler;
+			U32 width;
+			U32 height;
+			U32 mipCount;
+		} _depthPyramid;
+
+		VkRenderPass _renderPass; // Clears, used by the early draws
+		VkRenderPass _loadRenderPass; // Loads and presents, used by the late draws
 		VkPipelineLayout _pipelineLayout;
 		VkPipeline _pipeline;
+
+		// Depth pre-pass, the shading pipeline that follows it tests EQUAL. Both share the scene pipeline layout.
+		bool _depthPrepass;
+		VkPipeline _depthPrepassPipeline;
+		VkPipeline _equalPipeline;
+
+		// Per frame in flight and render pass: samples passing the pre-pass and fragment shader invocations of shading
+		bool _pipelineStatisticsSupported;
+		bool _preciseOcclusionSupported;
+		VkQueryPool _occlusionQueryPool;
+		VkQueryPool _statisticsQueryPool;
+		bool _depthPrepassQueriesPending[MAX_FRAMES_IN_FLIGHT];
+		bool _depthPrepassQueriesEnabled[MAX_FRAMES_IN_FLIGHT];
+		U32 _depthPrepassQueryMasks[MAX_FRAMES_IN_FLIGHT]; // Which of the two render passes recorded queries
+		VulkanDepthPrepassStats _depthPrepassStats;
 		VkCommandPool _commandPool;
-		std::vector<VkCommandBuffer> _commandBuffers;
+		std::vector<VkCommandBuffer> _commandBuffers; // One per frame in flight, re-recorded every frame
+
+		U32 _currentFrame;
+		VkSemaphore _imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
+		VkSemaphore _renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
+		VkFence _inFlightFences[MAX_FRAMES_IN_FLIGHT];
+
+		// Shared geometry, every mesh is a range of these
+		VulkanBuffer _vertexBuffer;
+		VulkanBuffer _positionBuffer; // GpuPositionVertex at the same offsets, for the depth pre-pass
+		VulkanBuffer _indexBuffer;
+		U32 _geometryVertexCount;
+		U32 _geometryIndexCount;
+
+		std::vector<VulkanMesh> _meshes;
+		VulkanBuffer _meshDrawBuffer;
+
+		std::vector<GpuMaterial> _materials;
+		VulkanBuffer _materialBuffer;
+
+		std::vector<GpuInstance> _instances;
+		std::vector<U32> _instanceSkins; // U32_MAX for instances that are not skinned
+		bool _instancesDirty;
+		VulkanBuffer _instanceBuffer;
+		VulkanBuffer _instanceStagingBuffers[MAX_FRAMES_IN_FLIGHT];
+
+		// World space instance bounds for the CPU culling path
+		bool _gpuCulling;
+		BoundingSphereSoA _instanceBounds;
+		std::vector<U32> _visibleInstances;
+
+		// Spatial index over the instance bounds for picking and the small shadow cascade frustums, one proxy per
+		// instance. Camera culling stays a SIMD scan of the exact spheres, faster while much of the scene is visible.
+		DynamicAabbTree _instanceTree;
+		std::vector<U32> _instanceProxies;
+
+		// Software occlusion culling for the CPU path, indexed by mesh
+		std::vector<VulkanOccluderMesh> _occluderMeshes;
+		std::vector<U32> _occluderCandidates;
+		OcclusionBuffer _occlusionBuffer;
+
+		// Batches are keyed by mesh index in the high half and material index in the low half
+		std::vector<VulkanDrawBatch> _batches;
+		std::unordered_map<U64, U32> _batchLookup;
+		std::vector<U32> _commandBatches; // Batch of each draw command
+		bool _batchCommandsDirty[MAX_FRAMES_IN_FLIGHT];
+		VulkanBuffer _batchCommandStagingBuffers[MAX_FRAMES_IN_FLIGHT];
+
+		// LOD selection, the LOD each instance used last frame is where hysteresis starts from
+		F32 _lodErrorThreshold;
+		std::vector<U8> _instanceLods; // CPU culling path only, the GPU path keeps them with the visibility flags
+		std::vector<U8> _instanceDynamic; // Shadow casters drawn every frame rather than cached
+
+		// CPU culling path draws, per draw command. Visible instances are packed without gaps each frame.
+		std::vector<U32> _visibleCommands; // Draw command of each visible instance
+		std::vector<U32> _commandVisibleCounts;
+		std::vector<U32> _commandFirstInstances;
+		std::vector<F32> _commandDepths; // Nearest visible instance of each draw command
+		RenderQueue _renderQueue; // Payloads are draw command indices, keys hold the scene pass and pipeline of the draw
+
+		// One draw command per batch and LOD, reset from the staging copy every frame. The culling compute pass
+		// counts the visible instances into them and lists them in the draw instance buffer. Early and late draws
+		// each get MAX_DRAW_COMMANDS commands and MAX_DRAW_INSTANCES draw instances. The counts hold the visible
+		// instances of each phase, then the visible clusters. A compaction pass then packs the non-empty draws after
+		// all of those, in the same order, and counts them in the second half of the counts for the indirect draws.
+		VulkanBuffer _drawCommandBuffer;
+		VulkanBuffer _drawCountBuffer;
+		VulkanBuffer _drawInstanceBuffer;
+		VulkanBuffer _drawInstanceStagingBuffers[MAX_FRAMES_IN_FLIGHT]; // Written on the CPU culling path
+
+		// Meshlet culling. Cluster draws follow the batch draws in the draw command buffer, early ones then late ones,
+		// and list their instance after the batch draw instances.
+		VulkanBuffer _meshletBuffer;
+		U32 _meshletCount;
+		std::vector<GpuCluster> _clusters;
+		U32 _clustersUploaded;
+		VulkanBuffer _clusterBuffer;
+		VulkanBuffer _clusterVisibilityBuffer; // Whether each cluster passed the late phase last frame
+		std::vector<VulkanClusterDraw> _clusterDraws;
+		U32 _clusterIndexCount; // Per phase
+		VulkanBuffer _clusterIndexBuffer; // Early phase indices, then late phase indices
+
+		// Per instance, whether it passed the late phase last frame in bit 0 and the LOD it picked above it
+		bool _occlusionCulling;
+		VulkanBuffer _visibilityBuffer;
+		VulkanBuffer _cullParamsBuffers[MAX_FRAMES_IN_FLIGHT];
+
+		// Per frame copies of the draw count, read on the CPU once that frame's fence has signaled
+		VulkanBuffer _cullStatsBuffers[MAX_FRAMES_IN_FLIGHT];
+		U32 _cullStatsInstanceCounts[MAX_FRAMES_IN_FLIGHT];
+		U32 _cullStatsClusterCounts[MAX_FRAMES_IN_FLIGHT];
+		bool _cullStatsPending[MAX_FRAMES_IN_FLIGHT];
+		VulkanCullingStats _cullingStats;
+
+		VkDescriptorPool _descriptorPool;
+		VkDescriptorSetLayout _sceneSetLayout;
+		VkDescriptorSet _sceneSet;
+
+		VkDescriptorSetLayout _cullSetLayout;
+		VkDescriptorSet _cullSets[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _cullPipelineLayout;
+		VkPipeline _cullPipeline;
+		VkPipeline _clusterCullPipeline; // Same layout as the instance culling pipeline
+		VkPipeline _compactPipeline; // Same layout as the instance culling pipeline
+
+		VkDescriptorSetLayout _depthPyramidSetLayout;
+		VkPipelineLayout _depthPyramidPipelineLayout;
+		VkPipeline _depthPyramidPipeline;
+
+		// State bound in the command buffer being recorded, indexed by bind point (graphics, compute)
+		struct {
+			VkPipeline pipelines[2];
+			VkPipelineLayout layouts[2];
+			VkDescriptorSet sets[2][4];
+			VkBuffer vertexBuffer;
+			VkBuffer indexBuffer;
+		} _boundState;
+		VulkanBindStats _bindStats;
+
+		// Bindless textures, allocated from their own update after bind pool
+		std::vector<VulkanTexture> _textures;
+		VkSampler _textureSampler;
+		VkDescriptorPool _textureDescriptorPool;
+		VkDescriptorSetLayout _textureSetLayout;
+		VkDescriptorSet _textureSet;
+
+		// Sprites go out as one instanced draw at the end of the frame, from a per frame upload ring
+		SpriteBatcher _sprites;
+		VulkanBuffer _spriteInstanceBuffers[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _spritePipelineLayout;
+		VkPipeline _spritePipeline;
+
+		// Glyph atlas rows written since the last frame are copied through this frame's staging buffer
+		TextRenderer _text;
+		U32 _textAtlasTexture;
+		VulkanBuffer _textAtlasStagingBuffers[MAX_FRAMES_IN_FLIGHT];
+
+		// Skinning. Joints of dirty skins go up through this frame's joint buffer, one dispatch poses them all.
+		VulkanBuffer _skinWeightBuffer;
+		U32 _skinWeightCount;
+		std::vector<VulkanSkin> _skins;
+		std::vector<Mat4> _skinJoints;
+		VulkanBuffer _jointBuffers[MAX_FRAMES_IN_FLIGHT];
+		VulkanBuffer _skinBuffers[MAX_FRAMES_IN_FLIGHT];
+		VkDescriptorSetLayout _skinningSetLayout;
+		VkDescriptorSet _skinningSets[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _skinningPipelineLayout;
+		VkPipeline _skinningPipeline;
+
+		// Lighting. Lights go up through this frame's light buffer when they changed, binning rebuilds this frame's
+		// cluster lists from scratch.
+		std::vector<GpuLight> _lights;
+		bool _lightsDirty[MAX_FRAMES_IN_FLIGHT];
+		Vec3 _ambientLight;
+		VulkanBuffer _lightBuffers[MAX_FRAMES_IN_FLIGHT];
+		VulkanBuffer _lightingParamsBuffers[MAX_FRAMES_IN_FLIGHT];
+		VulkanBuffer _lightClusterBuffers[MAX_FRAMES_IN_FLIGHT];
+		VkDescriptorSetLayout _lightingSetLayout;
+		VkDescriptorSet _lightingSets[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _lightBinPipelineLayout;
+		VkPipeline _lightBinPipeline;
+
+		// Sun shadows. Caches are redrawn a tile at a time, then every frame copies them into the atlas and draws the
+		// dynamic casters over them. Both images are single, barriers order them against the previous frame.
+		Vec3 _sunDirection;
+		Vec3 _sunColor;
+		F32 _shadowDistance;
+		Mat4 _shadowView;
+		VulkanShadowCascade _shadowCascades[SHADOW_CASCADES];
+		VulkanShadowStats _shadowStats;
+		std::vector<U32> _shadowCasters;
+		std::vector<U32> _shadowCasterCommands;
+		std::vector<U32> _shadowCommandCounts;
+		std::vector<U32> _shadowCommandFirstInstances;
+		U32 _shadowInstanceCount; // Listed in this frame's shadow instance buffer so far
+		VulkanTexture _shadowAtlas;
+		VulkanTexture _shadowCache;
+		VkRenderPass _shadowCacheRenderPass;
+		VkRenderPass _shadowRenderPass;
+		VkFramebuffer _shadowCacheFramebuffer;
+		VkFramebuffer _shadowAtlasFramebuffer;
+		VkSampler _shadowSampler;
+		VulkanBuffer _shadowInstanceBuffers[MAX_FRAMES_IN_FLIGHT];
+		VkDescriptorSetLayout _shadowSetLayout;
+		VkDescriptorSet _shadowSets[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _shadowPipelineLayout;
+		VkPipeline _shadowPipeline;
+
+		// Particle state lives on the GPU. Simulation compacts the survivors of one alive list into the other, which
+		// then gets drawn and is simulated next frame.
+		VulkanBuffer _particleBuffer;
+		VulkanBuffer _particleDeadListBuffer;
+		VulkanBuffer _particleAliveListBuffer;
+		VulkanBuffer _particleCounterBuffer;
+		VulkanBuffer _particleEmitterBuffers[MAX_FRAMES_IN_FLIGHT];
+		VkDescriptorSetLayout _particleSetLayout;
+		VkDescriptorSet _particleSets[MAX_FRAMES_IN_FLIGHT];
+		VkPipelineLayout _particleSimulatePipelineLayout;
+		VkPipeline _particleEmitPipeline;
+		VkPipeline _particleArgsPipeline;
+		VkPipeline _particleSimulatePipeline;
+		VkPipelineLayout _particleDrawPipelineLayout;
+		VkPipeline _particleDrawPipeline;
+		std::vector<ParticleEmitter> _particleEmitters;
+		std::vector<F32> _particleEmitCredits; // Fractional particles carried over to the next frame
+		std::vector<U32> _particleBursts;
+		Vec3 _particleGravity;
+		F32 _particleDrag;
+		F32 _particleTimeStep;
+		U32 _particleList; // Alive list simulation reads next
+		U32 _particleSeed;
+
+		bool _wideLinesSupported;
+		F32 _debugLineWidth;
+#ifdef JAZZ_DEBUG_DRAW
+		// DebugDraw writes the next frame's lines while the frames in flight read theirs, hence the spare buffer
+		VulkanBuffer _debugVertexBuffers[MAX_FRAMES_IN_FLIGHT + 1];
+		U32 _debugBufferIndex;
+		VkPipelineLayout _debugPipelineLayout;
+		VkPipeline _debugPipelines[2]; // Depth tested, overlay
+#endif
 
-		VkSemaphore _imageAvailableSemaphore;
-		VkSemaphore _renderFinishedSemaphore;
+		Mat4 _view;
+		Mat4 _projection;
 	};
 }
\ No newline at end of file
@@ -1,3 +1,6 @@
+#include <fstream>
+#include <vector>
+
 #include "VulkanUtils.h"
 
 namespace Jazz {
@@ -24,4 +27,92 @@ namespace Jazz {
 			return 0;
 		}
 	}
+
+	void VulkanUtils::createBuffer(VkDevice device, VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VulkanBuffer* outBuffer) {
+		*outBuffer = {};
+		outBuffer->Size = size;
+
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VK_CHECK(vkCreateBuffer(device, &bufferInfo, nullptr, &outBuffer->Handle));
+
+		VkMemoryRequirements memoryReqs;
+		vkGetBufferMemoryRequirements(device, outBuffer->Handle, &memoryReqs);
+
+		VkMemoryAllocateInfo memoryAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memoryAlloc.allocationSize = memoryReqs.size;
+		memoryAlloc.memoryTypeIndex = getMemoryType(memoryReqs.memoryTypeBits, memoryProperties, properties);
+		VK_CHECK(vkAllocateMemory(device, &memoryAlloc, nullptr, &outBuffer->Memory));
+		VK_CHECK(vkBindBufferMemory(device, outBuffer->Handle, outBuffer->Memory, 0));
+
+		if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			VK_CHECK(vkMapMemory(device, outBuffer->Memory, 0, VK_WHOLE_SIZE, 0, &outBuffer->Mapped));
+		}
+	}
+
+	void VulkanUtils::destroyBuffer(VkDevice device, VulkanBuffer* buffer) {
+		if (buffer->Mapped) {
+			vkUnmapMemory(device, buffer->Memory);
+		}
+		vkDestroyBuffer(device, buffer->Handle, nullptr);
+		vkFreeMemory(device, buffer->Memory, nullptr);
+		*buffer = {};
+	}
+
+	VkShaderModule VulkanUtils::loadShaderModule(VkDevice device, const char* name, const char* shaderType) {
+		char buffer[256];
+		I32 length = snprintf(buffer, 256, "shaders/%s.%s.spv", name, shaderType);
+		if (length < 0 || length >= 256) {
+			Logger::Fatal("Shader filename is too long.");
+		}
+
+		std::ifstream file(buffer, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			Logger::Fatal("Shader unable to open file: %s", buffer);
+		}
+
+		// SPIR-V is a stream of words, keep the storage U32 aligned
+		U64 fileSize = (U64)file.tellg();
+		std::vector<U32> code((fileSize + 3) / 4);
+		file.seekg(0);
+		file.read((char*)code.data(), fileSize);
+		file.close();
+
+		VkShaderModuleCreateInfo createInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+		createInfo.codeSize = fileSize;
+		createInfo.pCode = code.data();
+		VkShaderModule module;
+		VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &module));
+		return module;
+	}
+
+	VkCommandBuffer VulkanUtils::beginSingleTimeCommands(VkDevice device, VkCommandPool commandPool) {
+		VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocateInfo.commandPool = commandPool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+		return commandBuffer;
+	}
+
+	void VulkanUtils::endSingleTimeCommands(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer) {
+		VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK(vkQueueWaitIdle(queue));
+
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	}
 }
\ No newline at end of file
@@ -11,8 +11,24 @@
 
 namespace Jazz {
 
+	struct VulkanBuffer {
+		VkBuffer Handle;
+		VkDeviceMemory Memory;
+		VkDeviceSize Size;
+		void* Mapped; // Persistently mapped when created host visible
+	};
+
 	class VulkanUtils {
 	public:
 		static U32 getMemoryType(U32 typeBits, VkPhysicalDeviceMemoryProperties &memoryProperties, VkMemoryPropertyFlags properties, VkBool32* memTypeFound = nullptr);
+
+		static void createBuffer(VkDevice device, VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VulkanBuffer* outBuffer);
+		static void destroyBuffer(VkDevice device, VulkanBuffer* buffer);
+
+		// Loads shaders/<name>.<shaderType>.spv
+		static VkShaderModule loadShaderModule(VkDevice device, const char* name, const char* shaderType);
+
+		static VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPool);
+		static void endSingleTimeCommands(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer);
 	};
 }
\ No newline at end of file
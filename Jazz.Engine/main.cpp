@@ -2,8 +2,67 @@
 #include "Defines.h"
 #include "Engine.h"
 #include "Logger.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
+#include "EntityWorld.h"
+#include "DynamicAabbTree.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "VertexCompression.h"
+#include "StaticBatcher.h"
+#include "SpriteBatcher.h"
+#include "TextRenderer.h"
+#include "Animation.h"
+
+#include <string.h>
+
+struct BenchmarkCommand {
+	const char* Argument;
+	const bool (*Run)();
+};
+
+static const BenchmarkCommand benchmarkCommands[] = {
+	{ "--benchmark-culling", Jazz::Culling::RunBenchmark },
+	{ "--benchmark-occlusion", Jazz::OcclusionBuffer::RunBenchmark },
+	{ "--benchmark-render-queue", Jazz::RenderQueue::RunBenchmark },
+	{ "--benchmark-transforms", Jazz::TransformHierarchy::RunBenchmark },
+	{ "--benchmark-entities", Jazz::EntityWorld::RunBenchmark },
+	{ "--benchmark-bvh", Jazz::DynamicAabbTree::RunBenchmark },
+	{ "--benchmark-sprites", Jazz::SpriteBatcher::RunBenchmark },
+	{ "--benchmark-text", Jazz::TextRenderer::RunBenchmark },
+	{ "--benchmark-vertex-compression", Jazz::VertexCompression::RunBenchmark },
+	{ "--benchmark-animation", Jazz::Animation::RunBenchmark },
+};
 
 int main(int argc, const char** argv) {
+	for (const BenchmarkCommand& command : benchmarkCommands) {
+		if (argc > 1 && strcmp(argv[1], command.Argument) == 0) {
+			Jazz::JobSystem::Initialize();
+			const bool passed = command.Run();
+			Jazz::JobSystem::Shutdown();
+			return passed ? 0 : 1;
+		}
+	}
+
+	if (argc > 3 && strcmp(argv[1], "--generate-mesh-lods") == 0) {
+		return Jazz::MeshSimplifier::BuildLodFile(argv[2], argv[3]) ? 0 : 1;
+	}
+
+	if (argc > 3 && strcmp(argv[1], "--optimize-mesh") == 0) {
+		return Jazz::MeshOptimizer::OptimizeMeshFile(argv[2], argv[3]) ? 0 : 1;
+	}
+
+	if (argc > 3 && strcmp(argv[1], "--compress-mesh") == 0) {
+		return Jazz::VertexCompression::CompressMeshFile(argv[2], argv[3]) ? 0 : 1;
+	}
+
+	if (argc > 3 && strcmp(argv[1], "--batch-static") == 0) {
+		return Jazz::StaticBatcher::BuildSceneFiles(argv[2], argv[3]) ? 0 : 1;
+	}
+
 	Jazz::Engine* engine = new Jazz::Engine("Jazz Graphics Engine");
 	engine->Run();
 	delete engine;
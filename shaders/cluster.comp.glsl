@@ -0,0 +1,110 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// One workgroup per cluster: the first invocation culls it, then the whole group copies out its triangles
+layout(local_size_x = 64) in;
+
+#include "culling.glsl"
+
+struct Meshlet {
+    vec4 boundingSphere;
+    vec4 cone; // Axis and cutoff
+    uint firstIndex;
+    uint indexCount;
+    uint padding[2];
+};
+
+struct Cluster {
+    uint instanceIndex;
+    uint meshletIndex;
+    uint drawIndex;
+};
+
+layout(std430, set = 0, binding = 7) readonly buffer Indices {
+    uint indices[];
+};
+
+layout(std430, set = 0, binding = 8) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+
+layout(std430, set = 0, binding = 9) readonly buffer Clusters {
+    Cluster clusters[];
+};
+
+// Whether each cluster passed the late phase last frame
+layout(std430, set = 0, binding = 10) buffer ClusterVisibility {
+    uint clusterVisibility[];
+};
+
+// Triangles of the surviving clusters, packed from each cluster draw's firstIndex on
+layout(std430, set = 0, binding = 11) writeonly buffer ClusterIndices {
+    uint clusterIndices[];
+};
+
+shared bool clusterDrawn;
+shared uint clusterSourceIndex;
+shared uint clusterDestinationIndex;
+shared uint clusterIndexCount;
+
+// Every triangle of the cluster faces away from the camera
+bool isConeBackfacing(vec3 center, float radius, vec3 axis, float cutoff) {
+    vec3 toCenter = center - params.cameraPosition.xyz;
+    return cutoff < 1.0 && dot(toCenter, axis) >= cutoff * length(toCenter) + radius;
+}
+
+void main() {
+    uint clusterIndex = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (clusterIndex >= params.clusterCount) {
+        return;
+    }
+
+    if (gl_LocalInvocationIndex == 0) {
+        Cluster cluster = clusters[clusterIndex];
+        Instance instance = instances[cluster.instanceIndex];
+        Meshlet meshlet = meshlets[cluster.meshletIndex];
+        bool visibleLastFrame = clusterVisibility[clusterIndex] != 0;
+
+        // Bounds in world space, the cone assumes uniform scale
+        vec3 center = (instance.transform * vec4(meshlet.boundingSphere.xyz, 1.0)).xyz;
+        float radius = meshlet.boundingSphere.w * maxScale(instance.transform);
+        vec3 axis = normalize(mat3(instance.transform) * meshlet.cone.xyz);
+
+        bool drawn;
+        if (pc.phase == PHASE_EARLY) {
+            // Clusters visible last frame, when their instance was visible at LOD 0
+            drawn = visibleLastFrame && isSphereVisible(center, radius) && !isConeBackfacing(center, radius, axis, meshlet.cone.w);
+        } else {
+            // The instance pass just found the instance visible at LOD 0
+            bool visible = visibility[cluster.instanceIndex] == 1 && isSphereVisible(center, radius) &&
+                !isConeBackfacing(center, radius, axis, meshlet.cone.w);
+            if (visible && params.occlusionEnabled != 0) {
+                visible = !isSphereOccluded(center, radius);
+            }
+            clusterVisibility[clusterIndex] = visible ? 1 : 0;
+
+            // Already drawn by the early phase
+            drawn = visible && !(params.occlusionEnabled != 0 && visibleLastFrame);
+        }
+
+        if (drawn) {
+            atomicAdd(drawCounts[2 + pc.phase], 1);
+            uint command = pc.commandOffset + cluster.drawIndex;
+            clusterDestinationIndex = drawCommands[command].firstIndex + atomicAdd(drawCommands[command].indexCount, meshlet.indexCount);
+            drawInstances[drawCommands[command].firstInstance] = cluster.instanceIndex;
+        }
+        clusterDrawn = drawn;
+        clusterSourceIndex = meshlet.firstIndex;
+        clusterIndexCount = meshlet.indexCount;
+    }
+
+    barrier();
+    if (!clusterDrawn) {
+        return;
+    }
+
+    for (uint i = gl_LocalInvocationIndex; i < clusterIndexCount; i += gl_WorkGroupSize.x) {
+        clusterIndices[clusterDestinationIndex + i] = indices[clusterSourceIndex + i];
+    }
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Packs the draws the culling passes left non-empty so the draw count comes from the GPU
+layout(local_size_x = 64) in;
+
+#include "culling.glsl"
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= pc.commandCount) {
+        return;
+    }
+
+    // Batch draws are empty without visible instances, cluster draws without surviving triangles
+    DrawCommand command = drawCommands[pc.commandOffset + index];
+    if (command.instanceCount == 0 || command.indexCount == 0) {
+        return;
+    }
+
+    uint slot = atomicAdd(drawCounts[pc.countIndex], 1);
+    drawCommands[pc.compactOffset + slot] = command;
+}
@@ -0,0 +1,95 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(local_size_x = 64) in;
+
+#include "culling.glsl"
+
+#define MAX_LODS 8
+
+struct MeshDraw {
+    uint lodCount;
+    uint meshletCount;
+    uint firstMeshlet;
+    uint padding;
+    vec4 boundingSphere;
+    float lodErrors[MAX_LODS];
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer MeshDraws {
+    MeshDraw meshDraws[];
+};
+
+// Coarsest LOD within the error threshold, only switching to a coarser one than last frame's once well below it
+uint selectLod(MeshDraw mesh, float errorScale, uint currentLod) {
+    uint lod = 0;
+    uint coarserLod = 0;
+    for (uint i = 1; i < mesh.lodCount; ++i) {
+        float error = mesh.lodErrors[i] * errorScale;
+        lod = error <= 1.0 ? i : lod;
+        coarserLod = error <= 1.0 - params.lodHysteresis ? i : coarserLod;
+    }
+    return lod > currentLod ? max(coarserLod, currentLod) : lod;
+}
+
+void main() {
+    uint instanceIndex = gl_GlobalInvocationID.x;
+    if (instanceIndex >= params.instanceCount) {
+        return;
+    }
+
+    // The early phase only considers what the late phase found visible last frame
+    uint state = visibility[instanceIndex];
+    bool visibleLastFrame = (state & 1) != 0;
+    if (pc.phase == PHASE_EARLY && !visibleLastFrame) {
+        return;
+    }
+
+    Instance instance = instances[instanceIndex];
+    MeshDraw mesh = meshDraws[instance.meshIndex];
+    uint lod = min(state >> 1, mesh.lodCount - 1);
+
+    // Move the mesh bounding sphere into world space
+    vec3 center = (instance.transform * vec4(mesh.boundingSphere.xyz, 1.0)).xyz;
+    float scale = maxScale(instance.transform);
+    float radius = mesh.boundingSphere.w * scale;
+
+    bool visible = isSphereVisible(center, radius);
+
+    if (pc.phase == PHASE_LATE) {
+        if (visible && params.occlusionEnabled != 0) {
+            visible = !isSphereOccluded(center, radius);
+        }
+
+        // The early phase draws with the LOD picked here last frame
+        if (visible) {
+            float distance = max(-(params.view * vec4(center, 1.0)).z - radius, params.znear);
+            lod = selectLod(mesh, scale * params.lodErrorScale / distance, lod);
+        }
+        visibility[instanceIndex] = (visible ? 1 : 0) | (lod << 1);
+
+        // Already drawn by the early phase
+        if (params.occlusionEnabled != 0 && visibleLastFrame) {
+            return;
+        }
+    }
+
+    if (!visible) {
+        return;
+    }
+
+    atomicAdd(drawCounts[pc.phase], 1);
+
+    // The cluster pass draws what survives of the most detailed LOD of meshlet meshes
+    if (lod == 0 && mesh.meshletCount > 0) {
+        return;
+    }
+
+    // Append the survivor to its batch's instanced draw
+    uint command = pc.commandOffset + instance.firstCommand + lod;
+    uint slot = atomicAdd(drawCommands[command].instanceCount, 1);
+    drawInstances[drawCommands[command].firstInstance + slot] = instanceIndex;
+}
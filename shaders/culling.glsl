@@ -0,0 +1,136 @@
+// Declarations shared by the instance and cluster culling passes
+
+#define PHASE_EARLY 0
+#define PHASE_LATE 1
+
+struct Instance {
+    mat4 transform;
+    uint meshIndex;
+    uint materialIndex;
+    uint batchIndex;
+    uint firstCommand;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+// One per batch and LOD, instance counts start at zero. Cluster draws follow, their index counts start at zero.
+layout(std430, set = 0, binding = 2) buffer DrawCommands {
+    DrawCommand drawCommands[];
+};
+
+// Early and late visible instance counts, then early and late visible cluster counts. The compaction pass
+// counts the non-empty batch draws of each phase, then the non-empty cluster draws, into the second half.
+layout(std430, set = 0, binding = 3) buffer DrawCounts {
+    uint drawCounts[8];
+};
+
+// Whether each instance passed the late phase last frame in bit 0, the LOD it picked above it
+layout(std430, set = 0, binding = 4) buffer Visibility {
+    uint visibility[];
+};
+
+// Visible instances of each batch, from its draw command's firstInstance on. Cluster draws list their one instance.
+layout(std430, set = 0, binding = 5) writeonly buffer DrawInstances {
+    uint drawInstances[];
+};
+
+layout(std140, set = 1, binding = 0) uniform CullParams {
+    mat4 view;
+    vec4 frustumPlanes[6];
+    float P00;
+    float P11;
+    float depthScale;
+    float depthOffset;
+    float znear;
+    float pyramidWidth;
+    float pyramidHeight;
+    uint instanceCount;
+    uint occlusionEnabled;
+    float lodErrorScale;
+    float lodHysteresis;
+    uint clusterCount;
+    vec4 cameraPosition;
+} params;
+
+layout(set = 1, binding = 1) uniform sampler2D depthPyramid;
+
+layout(push_constant) uniform Phase {
+    uint phase;
+    uint commandOffset;
+    uint commandCount;
+    uint compactOffset;
+    uint countIndex;
+} pc;
+
+// Largest axis scale of an affine transform, used to scale bounding sphere radii
+float maxScale(mat4 transform) {
+    vec3 scale2 = vec3(dot(transform[0].xyz, transform[0].xyz), dot(transform[1].xyz, transform[1].xyz), dot(transform[2].xyz, transform[2].xyz));
+    return sqrt(max(scale2.x, max(scale2.y, scale2.z)));
+}
+
+bool isSphereVisible(vec3 center, float radius) {
+    for (int i = 0; i < 6; ++i) {
+        if (dot(params.frustumPlanes[i].xyz, center) + params.frustumPlanes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+// The center is in view space looking down +Z. Returns the screen space bounds as UVs (min x, min y, max x, max y).
+bool projectSphere(vec3 c, float r, out vec4 aabb) {
+    if (c.z < r + params.znear) {
+        return false;
+    }
+
+    vec2 cx = -c.xz;
+    vec2 vx = vec2(sqrt(dot(cx, cx) - r * r), r);
+    vec2 minx = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+    vec2 maxx = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+    vec2 cy = -c.yz;
+    vec2 vy = vec2(sqrt(dot(cy, cy) - r * r), r);
+    vec2 miny = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+    vec2 maxy = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+    aabb = vec4(minx.x / minx.y * params.P00, miny.x / miny.y * params.P11, maxx.x / maxx.y * params.P00, maxy.x / maxy.y * params.P11);
+    aabb = aabb.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5); // Clip space to UV, Y points down
+    return true;
+}
+
+bool isSphereOccluded(vec3 center, float radius) {
+    vec3 c = (params.view * vec4(center, 1.0)).xyz;
+    c.z = -c.z;
+
+    // Spheres touching the near plane can't be projected, keep them
+    vec4 aabb;
+    if (!projectSphere(c, radius, aabb)) {
+        return false;
+    }
+
+    // Pick the level where the bounds cover at most 2x2 texels and take the farthest of them
+    float width = (aabb.z - aabb.x) * params.pyramidWidth;
+    float height = (aabb.w - aabb.y) * params.pyramidHeight;
+    float level = max(ceil(log2(max(width, height))), 0.0);
+
+    float depth = textureLod(depthPyramid, aabb.xy, level).x;
+    depth = max(depth, textureLod(depthPyramid, aabb.zy, level).x);
+    depth = max(depth, textureLod(depthPyramid, aabb.xw, level).x);
+    depth = max(depth, textureLod(depthPyramid, aabb.zw, level).x);
+
+    // Depth of the point of the sphere closest to the camera
+    float sphereDepth = params.depthScale / (c.z - radius) - params.depthOffset;
+    return sphereDepth > depth;
+}
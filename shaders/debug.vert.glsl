@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// DebugDraw lines, already in world space
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+} camera;
+
+// DebugVertex
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    gl_Position = camera.viewProjection * vec4(inPosition, 1.0);
+    outColor = inColor;
+}
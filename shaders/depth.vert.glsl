@@ -0,0 +1,54 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass: positions only, transformed exactly as main.vert does
+
+struct Instance {
+    mat4 transform;
+    uint meshIndex;
+    uint materialIndex;
+    uint batchIndex;
+    uint firstCommand;
+};
+
+#define MAX_LODS 8
+
+struct MeshDraw {
+    uint lodCount;
+    uint meshletCount;
+    uint firstMeshlet;
+    uint padding;
+    vec4 boundingSphere;
+    float lodErrors[MAX_LODS];
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer MeshDraws {
+    MeshDraw meshDraws[];
+};
+
+layout(std430, set = 0, binding = 5) readonly buffer DrawInstances {
+    uint drawInstances[];
+};
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+} camera;
+
+// GpuPositionVertex: position as unorm within the mesh bounds
+layout(location = 0) in vec4 inPosition;
+
+invariant gl_Position;
+
+void main() {
+    Instance instance = instances[drawInstances[gl_InstanceIndex]];
+    MeshDraw mesh = meshDraws[instance.meshIndex];
+    vec3 position = mesh.positionOffset.xyz + inPosition.xyz * mesh.positionScale.xyz;
+
+    gl_Position = camera.viewProjection * instance.transform * vec4(position, 1.0);
+}
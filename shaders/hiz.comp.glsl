@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform Params {
+    uvec2 sourceSize;
+    uvec2 destinationSize;
+} params;
+
+void main() {
+    uvec2 position = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(position, params.destinationSize))) {
+        return;
+    }
+
+    // Footprint of this texel in the source. The first level is not an exact halving of the depth
+    // attachment, so the footprint can be up to 3x3 texels there.
+    uvec2 begin = (position * params.sourceSize) / params.destinationSize;
+    uvec2 end = ((position + 1) * params.sourceSize + params.destinationSize - 1) / params.destinationSize;
+    end = min(max(end, begin + 1), params.sourceSize);
+
+    // Keep the farthest depth so the pyramid never claims more occlusion than there is
+    float depth = 0.0;
+    for (uint y = begin.y; y < end.y; ++y) {
+        for (uint x = begin.x; x < end.x; ++x) {
+            depth = max(depth, texelFetch(source, ivec2(x, y), 0).x);
+        }
+    }
+
+    imageStore(destination, ivec2(position), vec4(depth));
+}
@@ -0,0 +1,62 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(local_size_x = 64) in;
+
+// One workgroup per cluster lists the lights whose bounding spheres touch the cluster's view space box. Depth is
+// positive into the screen here, tiles run top to bottom like framebuffer rows.
+
+#define LIGHT_CLUSTERS_WRITE
+#include "lights.glsl"
+
+shared uint clusterLightCount;
+
+float sliceDepth(uint slice) {
+    return lighting.zNear * pow(lighting.zFar / lighting.zNear, float(slice) / float(LIGHT_CLUSTERS_Z));
+}
+
+void main() {
+    uvec3 cluster = gl_WorkGroupID;
+    uint clusterIndex = lightClusterIndex(cluster);
+    if (gl_LocalInvocationIndex == 0) {
+        clusterLightCount = 0;
+    }
+
+    // The box around the slice of the tile's frustum, which is widest at whichever end is further from the axis
+    vec2 tileCount = vec2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y);
+    vec2 ndcToView = 1.0 / vec2(lighting.p00, lighting.p11);
+    vec2 tileMin = (vec2(cluster.xy) / tileCount * 2.0 - 1.0) * ndcToView;
+    vec2 tileMax = (vec2(cluster.xy + 1) / tileCount * 2.0 - 1.0) * ndcToView;
+    float nearDepth = sliceDepth(cluster.z);
+    float farDepth = sliceDepth(cluster.z + 1);
+    vec2 nearMin = tileMin * nearDepth;
+    vec2 nearMax = tileMax * nearDepth;
+    vec2 farMin = tileMin * farDepth;
+    vec2 farMax = tileMax * farDepth;
+    vec3 boxMin = vec3(min(min(nearMin, nearMax), min(farMin, farMax)), nearDepth);
+    vec3 boxMax = vec3(max(max(nearMin, nearMax), max(farMin, farMax)), farDepth);
+
+    barrier();
+
+    for (uint i = gl_LocalInvocationIndex; i < lighting.lightCount; i += gl_WorkGroupSize.x) {
+        vec4 sphere = lights[i].boundingSphere;
+        vec3 center = (lighting.view * vec4(sphere.xyz, 1.0)).xyz;
+        center.z = -center.z;
+
+        // Zero range lights are off, the strict test drops them
+        vec3 offset = center - clamp(center, boxMin, boxMax);
+        if (dot(offset, offset) < sphere.w * sphere.w) {
+            uint slot = atomicAdd(clusterLightCount, 1u);
+            if (slot < LIGHT_CLUSTER_MAX_LIGHTS) {
+                lightClusterLists[clusterIndex * LIGHT_CLUSTER_MAX_LIGHTS + slot] = i;
+            }
+        }
+    }
+
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0) {
+        lightClusterCounts[clusterIndex] = min(clusterLightCount, uint(LIGHT_CLUSTER_MAX_LIGHTS));
+    }
+}
@@ -0,0 +1,63 @@
+// Declarations shared by light binning and clustered shading
+
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+#define LIGHT_CLUSTER_MAX_LIGHTS 128
+
+#define SHADOW_CASCADES 4
+#define SHADOW_ATLAS_COLUMNS 2
+
+struct Light {
+    vec4 positionRange;
+    vec4 colorCosInner; // Spot cosines of point lights never cut anything off
+    vec4 directionCosOuter;
+    vec4 boundingSphere; // World space, around the cone for spot lights
+};
+
+// View depth of a depth buffer value is depthScale / (depth + depthOffset), its slice log(depth) * sliceScale + sliceBias
+layout(std140, set = 1, binding = 0) uniform Lighting {
+    mat4 view;
+    vec4 ambient;
+    float p00;
+    float p11;
+    float depthScale;
+    float depthOffset;
+    float zNear;
+    float zFar;
+    float sliceScale;
+    float sliceBias;
+    float screenWidth;
+    float screenHeight;
+    uint lightCount;
+    uint padding;
+    vec4 sunDirection; // Towards the sun, w is 1 when the sun shines
+    vec4 sunColor;
+    vec4 cascadeSplits; // View depth each cascade reaches
+    vec4 cascadeTexelSizes; // World size of a shadow texel
+    mat4 shadowMatrices[SHADOW_CASCADES]; // World to atlas UV and depth
+} lighting;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights {
+    Light lights[];
+};
+
+// Light count of every cluster, then LIGHT_CLUSTER_MAX_LIGHTS light indices per cluster
+#ifdef LIGHT_CLUSTERS_WRITE
+layout(std430, set = 1, binding = 2) writeonly buffer LightClusters {
+#else
+layout(std430, set = 1, binding = 2) readonly buffer LightClusters {
+#endif
+    uint lightClusterCounts[LIGHT_CLUSTER_COUNT];
+    uint lightClusterLists[];
+};
+
+// Shading only, binning leaves the shadows alone
+#ifndef LIGHT_CLUSTERS_WRITE
+layout(set = 1, binding = 3) uniform sampler2DShadow shadowAtlas;
+#endif
+
+uint lightClusterIndex(uvec3 cluster) {
+    return cluster.x + LIGHT_CLUSTERS_X * (cluster.y + LIGHT_CLUSTERS_Y * cluster.z);
+}
@@ -1,10 +1,84 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "lights.glsl"
 
 layout(location = 0) out vec4 outColor;
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragPosition;
+layout(location = 2) in vec3 fragNormal;
+
+// Sun visibility from the first cascade reaching this far, 1 past the last one
+float sunShadow(vec3 position, vec3 normal, float viewDepth) {
+    uint cascade = 0;
+    while (cascade < SHADOW_CASCADES && viewDepth > lighting.cascadeSplits[cascade]) {
+        ++cascade;
+    }
+    if (cascade == SHADOW_CASCADES) {
+        return 1.0;
+    }
+
+    // Pushed off the surface by a texel or so, so it does not shadow itself
+    vec3 offsetPosition = position + normal * (lighting.cascadeTexelSizes[cascade] * 1.5);
+    vec4 shadowPosition = lighting.shadowMatrices[cascade] * vec4(offsetPosition, 1.0);
+
+    // Four filtered taps, kept within the cascade's tile of the atlas
+    vec2 atlasSize = vec2(textureSize(shadowAtlas, 0));
+    vec2 tileSize = vec2(atlasSize.x / SHADOW_ATLAS_COLUMNS, atlasSize.y / ((SHADOW_CASCADES + SHADOW_ATLAS_COLUMNS - 1) / SHADOW_ATLAS_COLUMNS));
+    vec2 tileMin = vec2(cascade % SHADOW_ATLAS_COLUMNS, cascade / SHADOW_ATLAS_COLUMNS) * tileSize / atlasSize;
+    vec2 tileMax = tileMin + (tileSize - 1.0) / atlasSize;
+    tileMin += 1.0 / atlasSize;
+    float visibility = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        vec2 offset = (vec2(i & 1, i >> 1) - 0.5) / atlasSize;
+        vec2 uv = clamp(shadowPosition.xy + offset, tileMin, tileMax);
+        visibility += texture(shadowAtlas, vec3(uv, shadowPosition.z));
+    }
+    return visibility * 0.25;
+}
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 normal = normalize(fragNormal);
+
+    // The cluster of this pixel, from its tile and the view depth its depth buffer value maps back to
+    float viewDepth = lighting.depthScale / (gl_FragCoord.z + lighting.depthOffset);
+    vec2 tile = gl_FragCoord.xy / vec2(lighting.screenWidth, lighting.screenHeight) * vec2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y);
+    float slice = log(viewDepth) * lighting.sliceScale + lighting.sliceBias;
+    uvec3 cluster = uvec3(
+        min(uvec2(tile), uvec2(LIGHT_CLUSTERS_X - 1, LIGHT_CLUSTERS_Y - 1)),
+        uint(clamp(slice, 0.0, float(LIGHT_CLUSTERS_Z - 1))));
+    uint clusterIndex = lightClusterIndex(cluster);
+
+    // Ambient a little brighter from above
+    vec3 radiance = lighting.ambient.rgb * (0.75 + 0.25 * normal.y);
+
+    // The sun, shadowed by the cascades
+    if (lighting.sunDirection.w > 0.0) {
+        float sunLight = max(dot(normal, lighting.sunDirection.xyz), 0.0);
+        if (sunLight > 0.0) {
+            sunLight *= sunShadow(fragPosition, normal, viewDepth);
+        }
+        radiance += lighting.sunColor.rgb * sunLight;
+    }
+
+    uint firstLight = clusterIndex * LIGHT_CLUSTER_MAX_LIGHTS;
+    uint lightCount = lightClusterCounts[clusterIndex];
+    for (uint i = 0; i < lightCount; ++i) {
+        Light light = lights[lightClusterLists[firstLight + i]];
+        vec3 toLight = light.positionRange.xyz - fragPosition;
+        float distanceSquared = dot(toLight, toLight);
+        vec3 direction = toLight * inversesqrt(max(distanceSquared, 1e-8));
+
+        // Inverse square falloff windowed to reach zero at the light's range
+        float rangeFraction = distanceSquared / (light.positionRange.w * light.positionRange.w);
+        float window = clamp(1.0 - rangeFraction * rangeFraction, 0.0, 1.0);
+        float attenuation = window * window / (distanceSquared + 1.0);
+        float spot = smoothstep(light.directionCosOuter.w, light.colorCosInner.w, dot(-direction, light.directionCosOuter.xyz));
+
+        radiance += light.colorCosInner.rgb * (max(dot(normal, direction), 0.0) * attenuation * spot);
+    }
+
+    outColor = vec4(fragColor * radiance, 1.0);
 }
@@ -1,21 +1,83 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+struct Instance {
+    mat4 transform;
+    uint meshIndex;
+    uint materialIndex;
+    uint batchIndex;
+    uint firstCommand;
+};
+
+#define MAX_LODS 8
+
+struct MeshDraw {
+    uint lodCount;
+    uint meshletCount;
+    uint firstMeshlet;
+    uint padding;
+    vec4 boundingSphere;
+    float lodErrors[MAX_LODS];
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+struct Material {
+    vec4 baseColor;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer MeshDraws {
+    MeshDraw meshDraws[];
+};
+
+layout(std430, set = 0, binding = 5) readonly buffer DrawInstances {
+    uint drawInstances[];
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Materials {
+    Material materials[];
+};
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+} camera;
+
+// CompressedVertex: position as unorm within the mesh bounds, octahedral normal, half float UV
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosition;
+layout(location = 2) out vec3 fragNormal;
 
-vec2 positions[3] = vec2[] (
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// The depth pre-pass computes the same position, EQUAL testing needs identical depths
+invariant gl_Position;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    // Each batch draw lists its visible instances from firstInstance on
+    Instance instance = instances[drawInstances[gl_InstanceIndex]];
+    MeshDraw mesh = meshDraws[instance.meshIndex];
+    vec3 position = mesh.positionOffset.xyz + inPosition.xyz * mesh.positionScale.xyz;
+    vec3 normal = normalize(mat3(instance.transform) * decodeOctahedral(inNormal));
+
+    vec4 worldPosition = instance.transform * vec4(position, 1.0);
+
+    // Same expression as depth.vert so the invariant position matches the pre-pass exactly
+    gl_Position = camera.viewProjection * instance.transform * vec4(position, 1.0);
+    fragColor = materials[instance.materialIndex].baseColor.rgb;
+    fragPosition = worldPosition.xyz;
+    fragNormal = normal;
 }
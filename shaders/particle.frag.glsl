@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec2 inCorner;
+
+layout(location = 0) out vec4 outColor;
+
+// Round soft edged dot, added to what is behind it
+void main() {
+    float falloff = max(1.0 - dot(inCorner, inCorner), 0.0);
+    outColor = vec4(inColor.rgb, inColor.a * falloff);
+}
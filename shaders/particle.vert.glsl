@@ -0,0 +1,45 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// One instance per alive particle, the four strip vertices are the corners of a camera facing quad
+
+#define MAX_PARTICLES (1 << 20)
+
+struct Particle {
+    vec4 positionAge;
+    vec4 velocityLifetime;
+    uint color;
+    float size;
+    uint padding[2];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer AliveLists {
+    uint aliveLists[];
+};
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+    vec4 right; // World space
+    vec4 up;
+    uint list; // Alive list the simulation just wrote
+} camera;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outCorner;
+
+void main() {
+    Particle particle = particles[aliveLists[camera.list * MAX_PARTICLES + gl_InstanceIndex]];
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1) * 2.0 - 1.0;
+    vec3 offset = (camera.right.xyz * corner.x + camera.up.xyz * corner.y) * (particle.size * 0.5);
+
+    gl_Position = camera.viewProjection * vec4(particle.positionAge.xyz + offset, 1.0);
+
+    // Fades out over its lifetime
+    outColor = unpackUnorm4x8(particle.color);
+    outColor.a *= 1.0 - particle.positionAge.w / particle.velocityLifetime.w;
+    outCorner = corner;
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(local_size_x = 1) in;
+
+#include "particles.glsl"
+
+// Sizes the simulation dispatch to the alive list and empties the list it compacts into
+void main() {
+    uint aliveCount = draws[pc.currentList].instanceCount;
+    simulateDispatch[0] = (aliveCount + 63) / 64;
+    simulateDispatch[1] = 1;
+    simulateDispatch[2] = 1;
+    draws[1 - pc.currentList].instanceCount = 0;
+}
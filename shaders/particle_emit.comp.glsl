@@ -0,0 +1,68 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(local_size_x = 64) in;
+
+#include "particles.glsl"
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+// Uniformly distributed within the unit sphere
+vec3 randomInSphere(inout uint state) {
+    float z = random(state) * 2.0 - 1.0;
+    float angle = random(state) * 6.28318531;
+    float r = sqrt(1.0 - z * z);
+    return vec3(r * cos(angle), r * sin(angle), z) * pow(random(state), 1.0 / 3.0);
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= pc.emitCount) {
+        return;
+    }
+
+    // Last emitter starting at or before this particle
+    uint low = 0;
+    uint high = pc.emitterCount - 1;
+    while (low < high) {
+        uint middle = (low + high + 1) / 2;
+        if (emitters[middle].firstParticle <= index) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    Emitter emitter = emitters[low];
+
+    // Pop a free slot, handing the count back when there was none
+    int dead = atomicAdd(deadCount, -1) - 1;
+    if (dead < 0) {
+        atomicAdd(deadCount, 1);
+        return;
+    }
+    uint particleIndex = deadList[dead];
+
+    uint state = hash(index ^ pc.seed);
+    Particle particle;
+    particle.positionAge = vec4(emitter.positionRadius.xyz + randomInSphere(state) * emitter.positionRadius.w, 0.0);
+    particle.velocityLifetime = vec4(emitter.velocitySpread.xyz + randomInSphere(state) * emitter.velocitySpread.w, emitter.lifetime);
+    particle.color = emitter.color;
+    particle.size = emitter.size;
+    particles[particleIndex] = particle;
+
+    uint slot = atomicAdd(draws[pc.currentList].instanceCount, 1);
+    aliveLists[pc.currentList * MAX_PARTICLES + slot] = particleIndex;
+}
@@ -0,0 +1,36 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(local_size_x = 64) in;
+
+#include "particles.glsl"
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= draws[pc.currentList].instanceCount) {
+        return;
+    }
+
+    uint particleIndex = aliveLists[pc.currentList * MAX_PARTICLES + slot];
+    vec4 positionAge = particles[particleIndex].positionAge;
+    vec4 velocityLifetime = particles[particleIndex].velocityLifetime;
+
+    // Expired particles go back on the dead list
+    float age = positionAge.w + pc.deltaTime;
+    if (age >= velocityLifetime.w) {
+        int dead = atomicAdd(deadCount, 1);
+        deadList[dead] = particleIndex;
+        return;
+    }
+
+    // Semi-implicit Euler with linear drag
+    vec3 velocity = (velocityLifetime.xyz + pc.gravity * pc.deltaTime) * max(1.0 - pc.drag * pc.deltaTime, 0.0);
+    particles[particleIndex].positionAge = vec4(positionAge.xyz + velocity * pc.deltaTime, age);
+    particles[particleIndex].velocityLifetime.xyz = velocity;
+
+    // Survivors are compacted into the other list, which is also what gets drawn
+    uint nextList = 1 - pc.currentList;
+    uint aliveSlot = atomicAdd(draws[nextList].instanceCount, 1);
+    aliveLists[nextList * MAX_PARTICLES + aliveSlot] = particleIndex;
+}
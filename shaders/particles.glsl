@@ -0,0 +1,64 @@
+// Declarations shared by the particle simulation passes
+
+#define MAX_PARTICLES (1 << 20)
+
+struct Particle {
+    vec4 positionAge; // Seconds lived in w
+    vec4 velocityLifetime; // Seconds to live in w
+    uint color;
+    float size;
+    uint padding[2];
+};
+
+// Emitters spawning this frame, each owns the emitted particles from firstParticle to the next one's
+struct Emitter {
+    vec4 positionRadius;
+    vec4 velocitySpread;
+    uint color;
+    float size;
+    float lifetime;
+    uint firstParticle;
+};
+
+// Matches VkDrawIndirectCommand
+struct DrawCommand {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) buffer Particles {
+    Particle particles[];
+};
+
+// Stack of free particle slots
+layout(std430, set = 0, binding = 1) buffer DeadList {
+    uint deadList[];
+};
+
+// Two lists of MAX_PARTICLES back to back. Each frame the survivors of one are compacted into the other.
+layout(std430, set = 0, binding = 2) buffer AliveLists {
+    uint aliveLists[];
+};
+
+// The instance count of each list's draw is its length
+layout(std430, set = 0, binding = 3) buffer Counters {
+    uint simulateDispatch[3];
+    int deadCount;
+    DrawCommand draws[2];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer Emitters {
+    Emitter emitters[];
+};
+
+layout(push_constant) uniform Simulation {
+    vec3 gravity;
+    float deltaTime;
+    float drag;
+    uint emitterCount;
+    uint emitCount;
+    uint seed;
+    uint currentList; // Read by simulation, the other one is written
+} pc;
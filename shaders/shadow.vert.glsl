@@ -0,0 +1,53 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Shadow casters: positions only like the depth pre-pass, each draw listing its casters in the shadow set
+
+struct Instance {
+    mat4 transform;
+    uint meshIndex;
+    uint materialIndex;
+    uint batchIndex;
+    uint firstCommand;
+};
+
+#define MAX_LODS 8
+
+struct MeshDraw {
+    uint lodCount;
+    uint meshletCount;
+    uint firstMeshlet;
+    uint padding;
+    vec4 boundingSphere;
+    float lodErrors[MAX_LODS];
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer MeshDraws {
+    MeshDraw meshDraws[];
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer ShadowInstances {
+    uint shadowInstances[];
+};
+
+// The cascade, or the static caster cache it is cut from
+layout(push_constant) uniform Cascade {
+    mat4 viewProjection;
+} cascade;
+
+// GpuPositionVertex: position as unorm within the mesh bounds
+layout(location = 0) in vec4 inPosition;
+
+void main() {
+    Instance instance = instances[shadowInstances[gl_InstanceIndex]];
+    MeshDraw mesh = meshDraws[instance.meshIndex];
+    vec3 position = mesh.positionOffset.xyz + inPosition.xyz * mesh.positionScale.xyz;
+
+    gl_Position = cascade.viewProjection * instance.transform * vec4(position, 1.0);
+}
@@ -0,0 +1,110 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(local_size_x = 64) in;
+
+// Poses the rest vertices of each skin into the instance's own copy of the geometry, which every pass then draws
+// like any other mesh. One workgroup covers 64 vertices of one skin.
+
+struct Skin {
+    uint sourceVertexOffset;
+    uint outputVertexOffset;
+    uint vertexCount;
+    uint firstWeight;
+    uint firstJoint;
+    uint firstGroup;
+    uint padding[2];
+    vec4 sourceOffset; // Rest position = offset + unorm * scale
+    vec4 sourceScale;
+    vec4 outputOffset; // Posed unorm = (position - offset) * inverse scale
+    vec4 outputInverseScale;
+};
+
+// CompressedVertex as words: position XY, position Z and padding, normal, UV
+layout(std430, set = 0, binding = 0) buffer Vertices {
+    uvec4 vertices[];
+};
+
+// GpuPositionVertex, the first two words of each vertex
+layout(std430, set = 0, binding = 1) writeonly buffer Positions {
+    uvec2 positions[];
+};
+
+// SkinWeights: four joint bytes, four weight bytes
+layout(std430, set = 0, binding = 2) readonly buffer Weights {
+    uvec2 weights[];
+};
+
+// Object space skinning matrices, the inverse bind pose already applied
+layout(std430, set = 0, binding = 3) readonly buffer Joints {
+    mat4 joints[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer Skins {
+    Skin skins[];
+};
+
+layout(push_constant) uniform Params {
+    uint skinCount;
+} params;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// Same folding as VertexCompression::Encode
+vec2 encodeOctahedral(vec3 n) {
+    vec2 e = n.xy / max(abs(n.x) + abs(n.y) + abs(n.z), 1e-20);
+    if (n.z < 0.0) {
+        e = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return e;
+}
+
+void main() {
+    // Last skin starting at or before this workgroup, the same for the whole group
+    uint group = gl_WorkGroupID.x;
+    uint low = 0;
+    uint high = params.skinCount - 1;
+    while (low < high) {
+        uint middle = (low + high + 1) / 2;
+        if (skins[middle].firstGroup <= group) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    Skin skin = skins[low];
+
+    uint vertex = (group - skin.firstGroup) * 64 + gl_LocalInvocationID.x;
+    if (vertex >= skin.vertexCount) {
+        return;
+    }
+
+    uvec4 restVertex = vertices[skin.sourceVertexOffset + vertex];
+    vec3 position = skin.sourceOffset.xyz + vec3(unpackUnorm2x16(restVertex.x), unpackUnorm2x16(restVertex.y).x) * skin.sourceScale.xyz;
+    vec3 normal = decodeOctahedral(unpackSnorm2x16(restVertex.z));
+
+    // Linear blend of up to four joints
+    uvec2 weight = weights[skin.firstWeight + vertex];
+    vec4 w = unpackUnorm4x8(weight.y);
+    mat4 skinning = joints[skin.firstJoint + (weight.x & 0xff)] * w.x;
+    skinning += joints[skin.firstJoint + ((weight.x >> 8) & 0xff)] * w.y;
+    skinning += joints[skin.firstJoint + ((weight.x >> 16) & 0xff)] * w.z;
+    skinning += joints[skin.firstJoint + (weight.x >> 24)] * w.w;
+
+    position = (skinning * vec4(position, 1.0)).xyz;
+    normal = normalize(mat3(skinning) * normal);
+
+    // Posed positions are quantized within the grown bounds of the posed copy
+    vec3 q = clamp((position - skin.outputOffset.xyz) * skin.outputInverseScale.xyz, 0.0, 1.0);
+    uint xy = packUnorm2x16(q.xy);
+    uint z = packUnorm2x16(vec2(q.z, 0.0));
+    uint outputVertex = skin.outputVertexOffset + vertex;
+    vertices[outputVertex] = uvec4(xy, z, packSnorm2x16(encodeOctahedral(normal)), restVertex.w);
+    positions[outputVertex] = uvec2(xy, z);
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+// Bindless, every sprite of the draw names its own texture
+
+#define MAX_TEXTURES 4096
+
+layout(set = 0, binding = 0) uniform sampler2D textures[MAX_TEXTURES];
+
+layout(location = 0) in vec2 inUV;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) flat in uint inTexture;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(textures[nonuniformEXT(inTexture)], inUV) * inColor;
+}
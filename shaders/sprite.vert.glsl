@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// One instance per sprite, the four strip vertices are its corners
+
+layout(push_constant) uniform Screen {
+    vec2 pixelToClip; // 2 / extent
+} screen;
+
+// SpriteInstance
+layout(location = 0) in vec2 inCenter;
+layout(location = 1) in vec2 inSize;
+layout(location = 2) in float inRotation;
+layout(location = 3) in vec4 inUV;
+layout(location = 4) in vec4 inColor;
+layout(location = 5) in uint inTexture;
+
+layout(location = 0) out vec2 outUV;
+layout(location = 1) out vec4 outColor;
+layout(location = 2) flat out uint outTexture;
+
+void main() {
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    vec2 offset = (corner - 0.5) * inSize;
+
+    // Y points down the screen, so this turns clockwise
+    float c = cos(inRotation);
+    float s = sin(inRotation);
+    vec2 position = inCenter + vec2(c * offset.x - s * offset.y, s * offset.x + c * offset.y);
+
+    gl_Position = vec4(position * screen.pixelToClip - 1.0, 0.0, 1.0);
+    outUV = mix(inUV.xy, inUV.zw, corner);
+    outColor = inColor;
+    outTexture = inTexture;
+}
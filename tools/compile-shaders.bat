@@ -5,7 +5,41 @@ if not exist "build\shaders\" mkdir "build\shaders"
 echo "Compiling shaders..."
 echo "shaders/main.vert.glsl -> build/shaders/main.vert.spv"
 glslc.exe -fshader-stage=vert shaders/main.vert.glsl -o build/shaders/main.vert.spv
+echo "shaders/depth.vert.glsl -> build/shaders/depth.vert.spv"
+glslc.exe -fshader-stage=vert shaders/depth.vert.glsl -o build/shaders/depth.vert.spv
+echo "shaders/shadow.vert.glsl -> build/shaders/shadow.vert.spv"
+glslc.exe -fshader-stage=vert shaders/shadow.vert.glsl -o build/shaders/shadow.vert.spv
 echo "shaders/main.frag.glsl -> build/shaders/main.frag.spv"
 glslc.exe -fshader-stage=frag shaders/main.frag.glsl -o build/shaders/main.frag.spv
+echo "shaders/cull.comp.glsl -> build/shaders/cull.comp.spv"
+glslc.exe -fshader-stage=comp shaders/cull.comp.glsl -o build/shaders/cull.comp.spv
+echo "shaders/compact.comp.glsl -> build/shaders/compact.comp.spv"
+glslc.exe -fshader-stage=comp shaders/compact.comp.glsl -o build/shaders/compact.comp.spv
+echo "shaders/cluster.comp.glsl -> build/shaders/cluster.comp.spv"
+glslc.exe -fshader-stage=comp shaders/cluster.comp.glsl -o build/shaders/cluster.comp.spv
+echo "shaders/hiz.comp.glsl -> build/shaders/hiz.comp.spv"
+glslc.exe -fshader-stage=comp shaders/hiz.comp.glsl -o build/shaders/hiz.comp.spv
+echo "shaders/sprite.vert.glsl -> build/shaders/sprite.vert.spv"
+glslc.exe -fshader-stage=vert shaders/sprite.vert.glsl -o build/shaders/sprite.vert.spv
+echo "shaders/sprite.frag.glsl -> build/shaders/sprite.frag.spv"
+glslc.exe -fshader-stage=frag shaders/sprite.frag.glsl -o build/shaders/sprite.frag.spv
+echo "shaders/debug.vert.glsl -> build/shaders/debug.vert.spv"
+glslc.exe -fshader-stage=vert shaders/debug.vert.glsl -o build/shaders/debug.vert.spv
+echo "shaders/debug.frag.glsl -> build/shaders/debug.frag.spv"
+glslc.exe -fshader-stage=frag shaders/debug.frag.glsl -o build/shaders/debug.frag.spv
+echo "shaders/particle_emit.comp.glsl -> build/shaders/particle_emit.comp.spv"
+glslc.exe -fshader-stage=comp shaders/particle_emit.comp.glsl -o build/shaders/particle_emit.comp.spv
+echo "shaders/particle_args.comp.glsl -> build/shaders/particle_args.comp.spv"
+glslc.exe -fshader-stage=comp shaders/particle_args.comp.glsl -o build/shaders/particle_args.comp.spv
+echo "shaders/particle_simulate.comp.glsl -> build/shaders/particle_simulate.comp.spv"
+glslc.exe -fshader-stage=comp shaders/particle_simulate.comp.glsl -o build/shaders/particle_simulate.comp.spv
+echo "shaders/particle.vert.glsl -> build/shaders/particle.vert.spv"
+glslc.exe -fshader-stage=vert shaders/particle.vert.glsl -o build/shaders/particle.vert.spv
+echo "shaders/particle.frag.glsl -> build/shaders/particle.frag.spv"
+glslc.exe -fshader-stage=frag shaders/particle.frag.glsl -o build/shaders/particle.frag.spv
+echo "shaders/skin.comp.glsl -> build/shaders/skin.comp.spv"
+glslc.exe -fshader-stage=comp shaders/skin.comp.glsl -o build/shaders/skin.comp.spv
+echo "shaders/light_bin.comp.glsl -> build/shaders/light_bin.comp.spv"
+glslc.exe -fshader-stage=comp shaders/light_bin.comp.glsl -o build/shaders/light_bin.comp.spv
 
 echo "Done."
\ No newline at end of file